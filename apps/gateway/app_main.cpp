@@ -3,16 +3,15 @@ extern "C" {
 #include "bm_common_pub_sub.h"
 #include "bm_os.h"
 #include "config_cbor_map_service.h"
-#include "config_cbor_map_srv_reply_msg.h"
 #include "messages/config.h"
-#include "messages/neighbors.h"
 #include "pubsub.h"
-#include "sys_info_service.h"
-#include "sys_info_svc_reply_msg.h"
 }
+#include "app_runner.h"
 #include "cbor.h"
 #include "gateway_device.h"
 #include "gateway_ipc.h"
+#include "mote_cache.h"
+#include "mote_request.h"
 #include "runtime.h"
 #include <arpa/inet.h>
 #include <atomic>
@@ -21,6 +20,7 @@ extern "C" {
 #include <cstring>
 #include <errno.h>
 #include <filesystem>
+#include <inttypes.h>
 #include <string>
 #include <sys/socket.h>
 #include <time.h>
@@ -29,16 +29,26 @@ extern "C" {
 using namespace std::filesystem;
 
 #define SBC_COMMAND_KEY "sbc_command"
-#define SBC_COMMAND_KEY_LEN (sizeof(SBC_COMMAND_KEY) - 1)
 
 #define WIFI_ENABLED_KEY "wifi_enabled"
-#define WIFI_ENABLED_KEY_LEN (sizeof(WIFI_ENABLED_KEY) - 1)
 
 #define INIT_LOG_PATH "/var/run/bristlemouth_init_log.txt"
 #define BACKUP_INIT_LOG_PATH "/etc/bm_sbc/gateway/bristlemouth_init_log.txt.bak"
 #define INIT_LOG_TMP_PATH INIT_LOG_PATH ".tmp"
+#define MOTE_CACHE_PATH "/etc/bm_sbc/gateway/mote_cache.bin"
 #define CONFIG_MAP_REQUEST_TIMEOUT_S 2
 
+// Resend intervals: a service request's timeout plus padding, and a bcmp
+// config get's reply wait.
+#define SERVICE_REPLY_WAIT_MS (CONFIG_MAP_REQUEST_TIMEOUT_S * 1000 + 500)
+#define CONFIG_GET_REPLY_WAIT_MS 500
+
+// Shared deadline for the bring-up requests, counted from when the mote is
+// found: the longest single chain (5 config map attempts) still fits.
+#define BOOT_DEADLINE_MS (5 * SERVICE_REPLY_WAIT_MS)
+
+#define NEIGHBOR_WARN_MS 1000
+
 static struct sockaddr_in GPS_DEST = {
     .sin_family = AF_INET,
     .sin_port = htons(5000),
@@ -46,45 +56,16 @@ static struct sockaddr_in GPS_DEST = {
 
 static struct {
   int gps_udp_socket_fd = -1;
-  uint64_t mote_node_id = 0;
-  bool mote_neighbor_found = false;
-  std::atomic<bool> mote_app_name_received = false;
+  // Set by the bring-up task; handed to IPC from loop().
+  std::atomic<uint64_t> mote_node_id = 0;
   char mote_app_name[MAX_STR_LEN_BYTES + 1] = "borealis2";
   std::atomic<bool> sbc_command_received = false;
-  char sbc_command[MAX_STR_LEN_BYTES] = "";
-  std::atomic<bool> config_map_received = false;
-  std::atomic<bool> wifi_command_received = false;
+  char sbc_command[MAX_STR_LEN_BYTES + 1] = "";
   std::atomic<bool> system_time_synced = false;
   time_t last_rmc_time = 0;
   uint32_t wifi_enabled = 1;
 } CONTEXT;
 
-static void neighbor_cb(BcmpNeighbor *neighbor) {
-  bcmp_print_neighbor_info(neighbor);
-  if (neighbor->port == GATEWAY_UART_PORT) {
-    CONTEXT.mote_node_id = neighbor->node_id;
-    CONTEXT.mote_neighbor_found = true;
-  }
-}
-
-static void await_uart_neighbor(void) {
-  uint8_t num_neighbors = 0;
-  while (!CONTEXT.mote_neighbor_found) {
-    BcmpNeighbor *neighbor = bcmp_get_neighbors(&num_neighbors);
-    if (num_neighbors == 0) {
-      bm_log_warn("No neighbors, will delay and retry");
-      bm_delay(1000);
-    } else {
-      bm_log_info("Found %u neighbor(s)", num_neighbors);
-      bcmp_neighbor_foreach(neighbor_cb);
-      if (!CONTEXT.mote_neighbor_found) {
-        bm_log_warn("None of the neighbors are the mote, will delay and retry");
-        bm_delay(1000);
-      }
-    }
-  }
-}
-
 /**************** SBC command ****************/
 static char s_sbc_undo_command[MAX_STR_LEN_BYTES] = "";
 
@@ -117,79 +98,49 @@ static void register_sbc_undo(const char *cmd) {
   }
 }
 
-static void run_sbc_command(void) {
-  static bool sbc_command_ran = false;
-
-  if (CONTEXT.system_time_synced && !sbc_command_ran &&
-      CONTEXT.sbc_command_received) {
-    bm_log_info("Running sbc_command: %s", CONTEXT.sbc_command);
-    const int status = system(CONTEXT.sbc_command);
-    sbc_command_ran = true;
-    if (status == -1) {
-      bm_log_error("Failed to run sbc_command: %s", strerror(errno));
-    } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-      bm_log_error("sbc_command exited %d", WEXITSTATUS(status));
-    } else if (WIFSIGNALED(status)) {
-      bm_log_error("sbc_command killed by signal %d", WTERMSIG(status));
-    } else {
-      // Command ran successfully — register the undo for DFU pre-exec cleanup.
-      register_sbc_undo(CONTEXT.sbc_command);
-    }
-  }
-}
-
-static BmErr sbc_command_reply_cb(uint8_t *payload) {
-  BmErr err = BmENODATA;
-  if (payload) {
-    BmConfigValue *msg = reinterpret_cast<BmConfigValue *>(payload);
-    static char sbc_command[1024];
-    size_t sbc_command_len = sizeof(sbc_command);
-    memset(sbc_command, 0, sbc_command_len);
-    err = bcmp_config_decode_value(STR, msg->data, msg->data_length,
-                                   sbc_command, &sbc_command_len);
-    if (err == BmOK) {
-      if (sbc_command_len > 0) {
-        bm_log_info("Received sbc command: %.*s", (int)sbc_command_len,
-                    sbc_command);
-        CONTEXT.sbc_command_received = true;
-        memcpy(CONTEXT.sbc_command, sbc_command, sbc_command_len);
-        // Will run the sbc command if the time is synced
-        run_sbc_command();
-      }
-    } else {
-      bm_log_error("Failed to decode sbc command bcmp value, err=%d", err);
-    }
+// Log how a runner command ended.
+// @return true if it exited 0.
+static bool log_command_result(const ProcessResult *r) {
+  if (r->spawn_errno) {
+    bm_log_error("Failed to run %s: %s", r->name, strerror(r->spawn_errno));
+  } else if (r->timed_out) {
+    bm_log_error("%s timed out after %" PRIu64 " ms", r->name,
+                 r->run_us / 1000);
+  } else if (WIFSIGNALED(r->status)) {
+    bm_log_error("%s killed by signal %d", r->name, WTERMSIG(r->status));
+  } else if (WEXITSTATUS(r->status) != 0) {
+    bm_log_error("%s exited %d: %.*s", r->name, WEXITSTATUS(r->status),
+                 (int)r->output_len, r->output);
+  } else {
+    bm_log_debug("%s finished in %" PRIu64 " ms", r->name, r->run_us / 1000);
   }
-
-  return err;
+  return process_result_ok(r);
 }
 
-static void send_sbc_command_request(void) {
-  BmErr err = BmOK;
-  bool sent = bcmp_config_get(CONTEXT.mote_node_id, BM_CFG_PARTITION_SYSTEM,
-                              SBC_COMMAND_KEY_LEN, SBC_COMMAND_KEY, &err,
-                              sbc_command_reply_cb);
-  if (!sent) {
-    bm_log_warn("Failed to send bcmp config get for sbc_command, err=%d", err);
+static void on_sbc_command_done(const ProcessResult *r, void *arg) {
+  (void)arg;
+  if (log_command_result(r)) {
+    // Command ran successfully — register the undo for DFU pre-exec cleanup.
+    register_sbc_undo(CONTEXT.sbc_command);
   }
 }
 
-static void wait_for_config_reply(std::atomic<bool> *received) {
-  uint32_t total_awaited_ms = 0;
-  const uint32_t timeout_ms = 500;
-  while (!received->load() && total_awaited_ms < timeout_ms) {
-    const uint32_t delay_poll_ms = 20;
-    bm_delay(delay_poll_ms);
-    total_awaited_ms += delay_poll_ms;
-  }
-}
+static void run_sbc_command(void) {
+  // Called from both the bring-up task and the GPS callback.
+  static std::atomic<bool> sbc_command_ran = false;
 
-static void get_sbc_command(void) {
-  int8_t retries_remaining = 3;
-  while (!CONTEXT.sbc_command_received && retries_remaining > 0) {
-    send_sbc_command_request();
-    wait_for_config_reply(&CONTEXT.sbc_command_received);
-    retries_remaining--;
+  if (CONTEXT.system_time_synced && CONTEXT.sbc_command_received &&
+      !sbc_command_ran.exchange(true)) {
+    bm_log_info("Running sbc_command: %s", CONTEXT.sbc_command);
+    ProcessRunner *runner = bm_sbc_process_runner();
+    // Not captured: an sbc_command often starts background daemons, which
+    // would get SIGPIPE writing to the pipe after the shell exits.
+    if (!runner || !process_runner_shell_flags(
+                       runner, "sbc_command", CONTEXT.sbc_command, 0,
+                       PROCESS_RUNNER_NO_CAPTURE, on_sbc_command_done,
+                       NULL)) {
+      bm_log_error("Failed to run sbc_command: %s", strerror(errno));
+    }
   }
 }
 
@@ -276,7 +227,10 @@ static inline bool restore_backup(void) {
   return false;
 }
 
-static bool write_init_log_file(const uint8_t *cbor_data, size_t cbor_len) {
+// @p backup also refreshes the backup copy; not needed when the map came
+// from the mote cache, which the backup already matches.
+static bool write_init_log_file(const uint8_t *cbor_data, size_t cbor_len,
+                                bool backup) {
   CborParser parser;
   CborValue map;
   if (cbor_parser_init(cbor_data, cbor_len, 0, &parser, &map) != CborNoError ||
@@ -346,240 +300,66 @@ static bool write_init_log_file(const uint8_t *cbor_data, size_t cbor_len) {
     return false;
   }
 
-  save_init_backup();
+  if (backup) {
+    save_init_backup();
+  }
 
   bm_log_info("Wrote mote system configs to %s", INIT_LOG_PATH);
   return true;
 }
 
-static bool config_map_reply_cb(bool ack, uint32_t msg_id,
-                                size_t service_strlen, const char *service,
-                                size_t reply_len, uint8_t *reply_data) {
-  (void)msg_id;
-  (void)service_strlen;
-  (void)service;
+/**************** Wi-Fi ****************/
 
-  if (!ack || !reply_data) {
-    bm_log_warn("Config map request not acknowledged");
-    return false;
-  }
+// rfkill, NetworkManager and the driver, in that order; each command starts
+// when the one before it exits.
+typedef const char *const WifiStep[5];
 
-  ConfigCborMapReplyData reply = {0, 0, false, 0, NULL};
-  CborError err = config_cbor_map_reply_decode(&reply, reply_data, reply_len);
-  if (err != CborNoError) {
-    bm_log_error("Failed to decode config map reply, err=%d", err);
-    if (reply.cbor_data) {
-      bm_free(reply.cbor_data);
-    }
-    return false;
-  }
-
-  if (!reply.success || !reply.cbor_data || reply.cbor_encoded_map_len == 0) {
-    bm_log_warn("Config map reply unsuccessful or empty");
-    if (reply.cbor_data) {
-      bm_free(reply.cbor_data);
-    }
-    return false;
-  }
-
-  bool wrote = write_init_log_file(reply.cbor_data, reply.cbor_encoded_map_len);
-  bm_free(reply.cbor_data);
-
-  if (wrote) {
-    CONTEXT.config_map_received = true;
-  }
-  return wrote;
-}
-
-static void send_config_map_request(void) {
-  bool sent = config_cbor_map_service_request(
-      CONTEXT.mote_node_id, CONFIG_CBOR_MAP_PARTITION_ID_SYS,
-      config_map_reply_cb, CONFIG_MAP_REQUEST_TIMEOUT_S);
-  if (!sent) {
-    bm_log_warn("Failed to send config map request");
-  }
-}
-
-static void wait_for_config_map_reply(void) {
-  uint32_t total_awaited_ms = 0;
-  const uint32_t extra_padding_ms = 500;
-  const uint32_t timeout_ms =
-      CONFIG_MAP_REQUEST_TIMEOUT_S * 1000 + extra_padding_ms;
-  while (!CONTEXT.config_map_received && total_awaited_ms < timeout_ms) {
-    const uint32_t delay_poll_ms = 20;
-    bm_delay(delay_poll_ms);
-    total_awaited_ms += delay_poll_ms;
-  }
-}
+static const WifiStep WIFI_ENABLE_STEPS[] = {
+    {"rfkill", "unblock", "wifi", NULL},
+    {"systemctl", "enable", "--now", "NetworkManager", NULL},
+    {"modprobe", "brcmfmac", NULL},
+    {NULL},
+};
 
-static void get_mote_system_configs(void) {
-  int8_t retries_remaining = 5;
-  while (!CONTEXT.config_map_received && retries_remaining > 0) {
-    send_config_map_request();
-    wait_for_config_map_reply();
-    retries_remaining--;
-  }
-  if (!CONTEXT.config_map_received) {
-    bm_log_warn("Could not retrieve mote system configs; "
-                "copying backup at %s to %s",
-                BACKUP_INIT_LOG_PATH, INIT_LOG_PATH);
-    restore_backup();
-  }
-}
+static const WifiStep WIFI_DISABLE_STEPS[] = {
+    {"rfkill", "block", "wifi", NULL},
+    {"systemctl", "disable", "--now", "NetworkManager", NULL},
+    {"modprobe", "-r", "brcmfmac", NULL},
+    {"modprobe", "-r", "brcmutil", NULL},
+    {NULL},
+};
 
-/**************** mote app name ****************/
+#define WIFI_STEP_TIMEOUT_MS 30000
 
-static bool sys_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
-                              const char *service, size_t reply_len,
-                              uint8_t *reply_data) {
-  (void)msg_id;
-  (void)service_strlen;
-  (void)service;
+static void start_wifi_step(const WifiStep *step);
 
-  if (!ack || !reply_data) {
-    bm_log_warn("Sys info request not acknowledged");
-    return false;
-  }
-
-  SysInfoReplyData reply = {0, 0, 0, 0, NULL};
-  CborError err = sys_info_reply_decode(&reply, reply_data, reply_len);
-  if (err != CborNoError) {
-    bm_log_error("Failed to decode sys info reply, err=%d", err);
-    if (reply.app_name) {
-      bm_free(reply.app_name);
-    }
-    return false;
-  }
-
-  if (reply.app_name && reply.app_name_strlen > 0 &&
-      reply.app_name_strlen <= MAX_STR_LEN_BYTES) {
-    memcpy(CONTEXT.mote_app_name, reply.app_name, reply.app_name_strlen);
-    CONTEXT.mote_app_name[reply.app_name_strlen] = '\0';
-    CONTEXT.mote_app_name_received = true;
-    bm_log_info("Mote app name: %s", CONTEXT.mote_app_name);
-  } else {
-    bm_log_warn("Sys info reply missing or oversized app_name");
-  }
-
-  if (reply.app_name) {
-    bm_free(reply.app_name);
-  }
-  return CONTEXT.mote_app_name_received;
+static void on_wifi_step_done(const ProcessResult *r, void *arg) {
+  log_command_result(r);
+  start_wifi_step(static_cast<const WifiStep *>(arg) + 1);
 }
 
-static void send_sys_info_request(void) {
-  bool sent = sys_info_service_request(CONTEXT.mote_node_id, sys_info_reply_cb,
-                                       CONFIG_MAP_REQUEST_TIMEOUT_S);
-  if (!sent) {
-    bm_log_warn("Failed to send sys info request");
-  }
-}
-
-static void wait_for_sys_info_reply(void) {
-  uint32_t total_awaited_ms = 0;
-  const uint32_t extra_padding_ms = 500;
-  const uint32_t timeout_ms =
-      CONFIG_MAP_REQUEST_TIMEOUT_S * 1000 + extra_padding_ms;
-  while (!CONTEXT.mote_app_name_received && total_awaited_ms < timeout_ms) {
-    const uint32_t delay_poll_ms = 20;
-    bm_delay(delay_poll_ms);
-    total_awaited_ms += delay_poll_ms;
+static void start_wifi_step(const WifiStep *step) {
+  if (!(*step)[0]) {
+    return;
   }
-}
-
-static void get_mote_app_name(void) {
-  int8_t retries_remaining = 3;
-  while (!CONTEXT.mote_app_name_received && retries_remaining > 0) {
-    send_sys_info_request();
-    wait_for_sys_info_reply();
-    retries_remaining--;
+  std::string command = (*step)[0];
+  for (size_t i = 1; (*step)[i]; i++) {
+    command += std::string(" ") + (*step)[i];
   }
-  if (!CONTEXT.mote_app_name_received) {
-    bm_log_warn("Could not retrieve mote app name; defaulting to '%s'",
-                CONTEXT.mote_app_name);
+  bm_log_info("Invoking Wi-Fi command: %s", command.c_str());
+  ProcessRunner *runner = bm_sbc_process_runner();
+  if (!runner ||
+      !process_runner_spawn(runner, (*step)[0], *step, WIFI_STEP_TIMEOUT_MS,
+                            on_wifi_step_done,
+                            const_cast<void *>(
+                                static_cast<const void *>(step)))) {
+    bm_log_error("Failed to run %s", command.c_str());
   }
 }
 
-static BmErr wifi_enabled_reply_cb(uint8_t *payload) {
-  bm_log_debug("Ticks in " WIFI_ENABLED_KEY " reply cb: %u",
-               bm_get_tick_count());
-
-  BmErr err = BmENODATA;
-  if (payload) {
-    BmConfigValue *msg = reinterpret_cast<BmConfigValue *>(payload);
-    size_t wifi_enabled_len = sizeof(CONTEXT.wifi_enabled);
-    err = bcmp_config_decode_value(UINT32, msg->data, msg->data_length,
-                                   &CONTEXT.wifi_enabled, &wifi_enabled_len);
-    if (err == BmOK) {
-      if (wifi_enabled_len > 0) {
-        bm_log_info("Received " WIFI_ENABLED_KEY ": %u",
-                    (uint)CONTEXT.wifi_enabled);
-        CONTEXT.wifi_command_received = true;
-      }
-    } else {
-      bm_log_error("Failed to decode " WIFI_ENABLED_KEY
-                   " bcmp value, enabling Wi-Fi, err=%d",
-                   err);
-    }
-  }
-
-  return err;
-}
-
-static void send_wifi_enable_request(void) {
-  bm_log_debug("Ticks before bcmp config get: %u", bm_get_tick_count());
-  BmErr err = BmOK;
-  bool sent = bcmp_config_get(CONTEXT.mote_node_id, BM_CFG_PARTITION_SYSTEM,
-                              WIFI_ENABLED_KEY_LEN, WIFI_ENABLED_KEY, &err,
-                              wifi_enabled_reply_cb);
-  bm_log_debug("Ticks after bcmp config get: %u", bm_get_tick_count());
-  if (!sent) {
-    bm_log_warn(
-        "Failed to send bcmp config get for " WIFI_ENABLED_KEY ", err=%d", err);
-  }
-}
-
-static void get_wifi_enable(void) {
-  int8_t retries_remaining = 3;
-  while (!CONTEXT.wifi_command_received && retries_remaining > 0) {
-    send_wifi_enable_request();
-    wait_for_config_reply(&CONTEXT.wifi_command_received);
-    retries_remaining--;
-  }
-
-  std::string network_manager_service_action = "enable";
-  std::string wifi_enable_action = "unblock";
-  std::string wifi_driver_action = "";
-  std::string wifi_driver_dependency_command = "";
-
-  if (!CONTEXT.wifi_enabled) {
-    network_manager_service_action = "disable";
-    wifi_enable_action = "block";
-    wifi_driver_action = "-r ";
-    wifi_driver_dependency_command = " modprobe -r brcmutil";
-  }
-
-  // Configure Wi-Fi In Software
-  std::string wifi_command = "rfkill " + wifi_enable_action + " wifi";
-  bm_log_info("Invoking command for Wi-Fi radio: %s", wifi_command.c_str());
-  system(wifi_command.c_str());
-
-  // Configure NetworkManager.service
-  std::string systemctl_action =
-      "systemctl " + network_manager_service_action + " --now NetworkManager";
-  bm_log_info("Invoking systemctl command: %s", systemctl_action.c_str());
-  system(systemctl_action.c_str());
-
-  // Configure Wi-Fi Hardware
-  std::string wifi_driver_command =
-      "modprobe " + wifi_driver_action + "brcmfmac";
-  bm_log_info("Invoking driver command: %s", wifi_driver_command.c_str());
-  system(wifi_driver_command.c_str());
-  if (wifi_driver_dependency_command.length()) {
-    bm_log_info("Invoking driver dependency command: %s",
-                wifi_driver_dependency_command.c_str());
-    system(wifi_driver_dependency_command.c_str());
-  }
+static void apply_wifi_enable(void) {
+  start_wifi_step(CONTEXT.wifi_enabled ? WIFI_ENABLE_STEPS
+                                       : WIFI_DISABLE_STEPS);
 }
 
 #define MAX_NMEA_RMC_LEN 82
@@ -825,7 +605,276 @@ static void utc_callback(uint64_t node_id, const char *topic,
   }
 }
 
+/**************** Bring-up ****************/
+
+// Bring-up runs on its own task so IPC is served throughout.  It blocks on
+// completions signalled by neighbor discovery and the reply callbacks, so it
+// wakes as soon as each answer lands; the requests go out together and each
+// is resent on its own schedule until it is answered, runs out of attempts
+// or the shared deadline passes.
+//
+// With a mote cache for this node the init log is written from it as soon
+// as the mote is found, and the config map is fetched again only if
+// sys_info says the mote changed.
+static struct {
+  uint64_t start_ms = 0;
+  uint64_t ipc_ms = 0;
+  uint64_t mote_ms = 0;
+  uint64_t init_log_ms = 0;
+  const char *init_log_source = "none";
+  CompletionWaiter waiter;
+  MoteSysInfo sys_info;
+  MoteConfigMap config_map;
+  MoteConfigGet sbc_command;
+  MoteConfigGet wifi_enabled;
+  MoteCache cache;
+  bool cached = false;
+  bool map_claimed = false; ///< config_map holds its reply slot.
+  bool configs_done = false;
+  bool ipc_told = false; ///< loop() only.
+} s_boot;
+
+static void note_init_log(const char *source) {
+  s_boot.init_log_ms = completion_now_ms();
+  s_boot.init_log_source = source;
+}
+
+// Remember what the init log was written from, keyed by what sys_info said.
+static void store_mote_cache(const uint8_t *cbor, size_t cbor_len) {
+  MoteCache *c = &s_boot.cache;
+  c->node_id = s_boot.sys_info.node_id;
+  c->git_sha = s_boot.sys_info.git_sha;
+  c->sys_config_crc = s_boot.sys_info.sys_config_crc;
+  snprintf(c->app_name, sizeof(c->app_name), "%s", CONTEXT.mote_app_name);
+  if (cbor != c->cbor && !mote_cache_set_cbor(c, cbor, cbor_len)) {
+    return;
+  }
+  if (!mote_cache_store(MOTE_CACHE_PATH, c)) {
+    bm_log_warn("Failed to write mote cache %s", MOTE_CACHE_PATH);
+  }
+}
+
+// Cache miss: runs once both the app name and the config map requests have
+// settled, since the init log leads with the app name.
+static void finish_mote_system_configs(void) {
+  const MoteConfigMap *q = &s_boot.config_map;
+  if (q->cbor && write_init_log_file(q->cbor, q->cbor_len, true)) {
+    note_init_log("mote");
+    if (completion_done(&s_boot.sys_info.req.done, NULL)) {
+      store_mote_cache(q->cbor, q->cbor_len);
+    }
+    return;
+  }
+  bm_log_warn("Could not retrieve mote system configs; "
+              "copying backup at %s to %s",
+              BACKUP_INIT_LOG_PATH, INIT_LOG_PATH);
+  if (restore_backup()) {
+    note_init_log("backup");
+  }
+}
+
+// Cache hit, once sys_info has answered: fetch the map again only if the
+// mote changed, and rewrite the init log only if the map or name did.
+static void revalidate_mote_cache(void) {
+  const MoteSysInfo *info = &s_boot.sys_info;
+  if (mote_cache_matches(&s_boot.cache, info->git_sha, info->sys_config_crc,
+                         CONTEXT.mote_app_name)) {
+    bm_log_info("Mote unchanged since it was cached; init log kept");
+    return;
+  }
+  if (!s_boot.map_claimed) {
+    bm_log_warn("Mote changed since it was cached; keeping the cached init "
+                "log (config map request unavailable)");
+    return;
+  }
+  bm_log_info("Mote changed since it was cached; fetching config map");
+  CompletionRequest *const reqs[] = {&s_boot.config_map.req};
+  if (completion_request_run(reqs, 1, &s_boot.waiter,
+                             completion_now_ms() + BOOT_DEADLINE_MS, NULL,
+                             NULL) == 0) {
+    bm_log_warn("No config map reply; keeping the cached init log");
+    return;
+  }
+  const MoteConfigMap *q = &s_boot.config_map;
+  const MoteCache *c = &s_boot.cache;
+  bool changed = q->cbor_len != c->cbor_len ||
+                 memcmp(q->cbor, c->cbor, q->cbor_len) != 0 ||
+                 strcmp(c->app_name, CONTEXT.mote_app_name) != 0;
+  if (changed && !write_init_log_file(q->cbor, q->cbor_len, true)) {
+    return;
+  }
+  if (changed) {
+    note_init_log("mote");
+  } else {
+    bm_log_info("Mote config map unchanged; init log kept");
+  }
+  store_mote_cache(q->cbor, q->cbor_len);
+}
+
+static void on_boot_request_settled(CompletionRequest *req, bool ok,
+                                    void *arg) {
+  (void)arg;
+  if (!ok && req->attempts > 0) {
+    bm_log_warn("No %s reply after %u request(s)", req->name, req->attempts);
+  }
+
+  if (req == &s_boot.sys_info.req && ok) {
+    memcpy(CONTEXT.mote_app_name, s_boot.sys_info.app_name,
+           sizeof(CONTEXT.mote_app_name));
+    bm_log_info("Mote app name: %s", CONTEXT.mote_app_name);
+  } else if (req == &s_boot.sbc_command.req && ok) {
+    const MoteConfigGet *q = &s_boot.sbc_command;
+    if (q->value_len > 0 && q->value_len <= MAX_STR_LEN_BYTES) {
+      bm_log_info("Received sbc command: %.*s", (int)q->value_len,
+                  (const char *)q->value);
+      memcpy(CONTEXT.sbc_command, q->value, q->value_len);
+      CONTEXT.sbc_command[q->value_len] = '\0';
+      CONTEXT.sbc_command_received = true;
+      // Will run the sbc command if the time is synced
+      run_sbc_command();
+    }
+  } else if (req == &s_boot.wifi_enabled.req) {
+    const MoteConfigGet *q = &s_boot.wifi_enabled;
+    if (ok && q->value_len == sizeof(CONTEXT.wifi_enabled)) {
+      memcpy(&CONTEXT.wifi_enabled, q->value, sizeof(CONTEXT.wifi_enabled));
+      bm_log_info("Received " WIFI_ENABLED_KEY ": %u",
+                  (uint)CONTEXT.wifi_enabled);
+    }
+    // rfkill, systemctl and modprobe can take seconds; they run on the
+    // process runner, off the remaining requests' resend schedule.
+    apply_wifi_enable();
+  }
+
+  if (!s_boot.cached && !s_boot.configs_done &&
+      s_boot.sys_info.req.settled && s_boot.config_map.req.settled) {
+    s_boot.configs_done = true;
+    if (!completion_done(&s_boot.sys_info.req.done, NULL)) {
+      bm_log_warn("Could not retrieve mote app name; defaulting to '%s'",
+                  CONTEXT.mote_app_name);
+    }
+    finish_mote_system_configs();
+  }
+}
+
+static void log_boot_timeline(CompletionRequest *const *reqs, size_t n,
+                              uint64_t now) {
+  char line[256];
+  int len = snprintf(line, sizeof(line),
+                     "Boot timeline: ipc=+%ums mote=+%ums",
+                     (unsigned)(s_boot.ipc_ms - s_boot.start_ms),
+                     (unsigned)(s_boot.mote_ms - s_boot.start_ms));
+  for (size_t i = 0; i < n && len > 0 && (size_t)len < sizeof(line); i++) {
+    if (reqs[i]->attempts == 0) {
+      continue;
+    }
+    len += snprintf(line + len, sizeof(line) - len, " %s=+%ums(%s)",
+                    reqs[i]->name,
+                    (unsigned)(reqs[i]->settled_ms - s_boot.start_ms),
+                    completion_done(&reqs[i]->done, NULL) ? "ok" : "timeout");
+  }
+  bm_log_info("%s init_log=+%ums(%s) ready=+%ums", line,
+              (unsigned)(s_boot.init_log_ms - s_boot.start_ms),
+              s_boot.init_log_source, (unsigned)(now - s_boot.start_ms));
+}
+
+// A boot request that could not claim its reply slot settles as failed
+// without being sent.
+static void skip_boot_request(CompletionRequest *req) {
+  bm_log_error("Another %s request holds its reply slot; skipping it",
+               req->name);
+  req->settled = true;
+  req->settled_ms = completion_now_ms();
+  on_boot_request_settled(req, false, NULL);
+}
+
+static void bring_up_task(void *arg) {
+  (void)arg;
+  uint64_t mote = 0;
+  if (!gateway_device_has_uart()) {
+    bm_log_error("No UART link (--uart / uart-device); the mote cannot be "
+                 "brought up");
+    bm_task_delete(NULL);
+    return;
+  }
+  while (!gateway_device_wait_uart_neighbor(&mote, NEIGHBOR_WARN_MS)) {
+    bm_log_warn("Mote not yet seen on the UART port, still waiting");
+  }
+  s_boot.mote_ms = completion_now_ms();
+  bm_log_info("Mote %016" PRIx64 " found on the UART port", mote);
+  CONTEXT.mote_node_id = mote;
+
+  s_boot.cached = mote_cache_load(MOTE_CACHE_PATH, mote, &s_boot.cache);
+  if (s_boot.cached) {
+    snprintf(CONTEXT.mote_app_name, sizeof(CONTEXT.mote_app_name), "%s",
+             s_boot.cache.app_name);
+    s_boot.cached = write_init_log_file(s_boot.cache.cbor,
+                                        s_boot.cache.cbor_len, false);
+  }
+  if (s_boot.cached) {
+    note_init_log("cache");
+  }
+
+  const CompletionRetry service_retry = {3, SERVICE_REPLY_WAIT_MS};
+  const CompletionRetry config_map_retry = {5, SERVICE_REPLY_WAIT_MS};
+  const CompletionRetry config_get_retry = {3, CONFIG_GET_REPLY_WAIT_MS};
+  completion_waiter_init(&s_boot.waiter);
+  const bool claimed[] = {
+      mote_sys_info_init(&s_boot.sys_info, &s_boot.waiter, mote,
+                         CONFIG_MAP_REQUEST_TIMEOUT_S, service_retry),
+      mote_config_get_init(&s_boot.sbc_command, &s_boot.waiter, mote,
+                           BM_CFG_PARTITION_SYSTEM, SBC_COMMAND_KEY, STR,
+                           config_get_retry),
+      mote_config_get_init(&s_boot.wifi_enabled, &s_boot.waiter, mote,
+                           BM_CFG_PARTITION_SYSTEM, WIFI_ENABLED_KEY, UINT32,
+                           config_get_retry),
+      mote_config_map_init(&s_boot.config_map, &s_boot.waiter, mote,
+                           CONFIG_CBOR_MAP_PARTITION_ID_SYS,
+                           CONFIG_MAP_REQUEST_TIMEOUT_S, config_map_retry),
+  };
+  s_boot.map_claimed = claimed[3];
+
+  // The config map goes last so a cache hit can leave it out.
+  CompletionRequest *const all[] = {
+      &s_boot.sys_info.req,
+      &s_boot.sbc_command.req,
+      &s_boot.wifi_enabled.req,
+      &s_boot.config_map.req,
+  };
+  const size_t n = sizeof(all) / sizeof(all[0]);
+  CompletionRequest *reqs[n];
+  size_t nreqs = 0;
+  for (size_t i = 0; i < (s_boot.cached ? n - 1 : n); i++) {
+    if (claimed[i]) {
+      reqs[nreqs++] = all[i];
+    } else {
+      skip_boot_request(all[i]);
+    }
+  }
+  completion_request_run(reqs, nreqs, &s_boot.waiter,
+                         s_boot.mote_ms + BOOT_DEADLINE_MS,
+                         on_boot_request_settled, NULL);
+  if (s_boot.cached && completion_done(&s_boot.sys_info.req.done, NULL)) {
+    revalidate_mote_cache();
+  } else if (s_boot.cached) {
+    bm_log_warn("No sys info reply; keeping the cached init log");
+  }
+  log_boot_timeline(all, n, completion_now_ms());
+
+  mote_sys_info_release(&s_boot.sys_info);
+  mote_config_map_release(&s_boot.config_map);
+  mote_config_get_release(&s_boot.sbc_command);
+  mote_config_get_release(&s_boot.wifi_enabled);
+  mote_cache_free(&s_boot.cache);
+  bm_task_delete(NULL);
+}
+
 void setup(void) {
+  s_boot.start_ms = completion_now_ms();
+  // Clients may connect before the mote is found; sensor_data they send is
+  // held until then.
+  gateway_ipc_init(0);
+  s_boot.ipc_ms = completion_now_ms();
+
   CONTEXT.gps_udp_socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
   if (CONTEXT.gps_udp_socket_fd == -1) {
     bm_log_error("Failed to create GPS UDP socket: %s", strerror(errno));
@@ -833,12 +882,23 @@ void setup(void) {
   }
   bm_sub("gps-nmea/rmc", gprmc_callback);
   bm_sub("spotter/utc-time", utc_callback);
-  await_uart_neighbor();
-  get_mote_app_name();
-  get_mote_system_configs();
-  get_sbc_command();
-  get_wifi_enable();
-  gateway_ipc_init(CONTEXT.mote_node_id);
+
+  if (bm_task_create(bring_up_task, "Bring-up", 1024, NULL, 1, NULL) !=
+      BmOK) {
+    bm_log_error("Failed to start the bring-up task");
+    exit(EXIT_FAILURE);
+  }
 }
 
-void loop(void) { gateway_ipc_poll(); }
+void loop(void) {
+  gateway_ipc_poll();
+  // IPC state belongs to this thread, so the mote id found by the bring-up
+  // task is handed over here.
+  if (!s_boot.ipc_told) {
+    const uint64_t mote = CONTEXT.mote_node_id;
+    if (mote != 0) {
+      gateway_ipc_set_mote_node_id(mote);
+      s_boot.ipc_told = true;
+    }
+  }
+}
@@ -2,15 +2,31 @@
 //
 // Used by scripts/gateway_ipc_test.sh to exercise the Python client against a
 // real gateway_ipc.cpp binding without needing the full mote+UART setup.
+//
+// With BM_SBC_IPC_STUB_PUBSUB=1, sensor_data is counted and discarded instead
+// of going to bm_pub(), so scripts/gateway_ipc_bench.sh measures ingestion
+// alone.
 #include "bm_log.h"
 #include "gateway_ipc.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define MOTE_NODE_ID (0xDEADBEEFDEADBEEF)
 
+static BmErr stub_publish(const char *, const uint8_t *, uint16_t) {
+  return BmOK;
+}
+
 void setup(void) {
   if (gateway_ipc_init(MOTE_NODE_ID) != 0) {
     bm_log_fatal("ipc_test: gateway_ipc_init failed");
   }
+  const char *stub = getenv("BM_SBC_IPC_STUB_PUBSUB");
+  if (stub && strcmp(stub, "1") == 0) {
+    gateway_ipc_set_publish_fn(stub_publish);
+    bm_log_info("ipc_test: sensor_data goes to the stub pubsub sink");
+  }
 }
 
 void loop(void) { gateway_ipc_poll(); }
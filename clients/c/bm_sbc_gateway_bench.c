@@ -0,0 +1,229 @@
+// bm_sbc_gateway_bench — client-side IPC throughput benchmark.
+//
+// Sends sensor_data messages to a running gateway (normally bm_sbc_ipc_test)
+// as fast as the chosen transport allows and reports messages per second.
+//
+// Modes:
+//   send   one send() per message (blocking: paced by the gateway's queue)
+//   batch  sendmmsg() batches of --batch messages
+//   ack    req_id on every message, at most `credits` un-acked in flight
+//   shm    shared-memory ring, doorbell once per --batch records
+//
+// Usage: bm_sbc_gateway_bench [--socket PATH] [--mode MODE] [--count N]
+//                             [--batch N] [--payload BYTES]
+
+#define _GNU_SOURCE
+#include "bm_sbc_gateway_client.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char k_usage[] =
+    "Usage: bm_sbc_gateway_bench [options]\n"
+    "  --socket PATH    Gateway socket (default: $BM_SBC_GATEWAY_IPC or "
+    GATEWAY_CLIENT_DEFAULT_PATH ")\n"
+    "  --mode MODE      send | batch | ack | shm (default: batch)\n"
+    "  --count N        Messages to send (default: 100000)\n"
+    "  --batch N        Messages per sendmmsg / doorbell (default: 32)\n"
+    "  --payload BYTES  sensor_data payload size (default: 16)\n";
+
+#define ACK_TIMEOUT_MS 1000
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long run_send(GatewayClient *c, const uint8_t *payload, size_t plen,
+                     long count) {
+  uint8_t buf[GATEWAY_CLIENT_MAX_DGRAM];
+  size_t n = gateway_client_encode_sensor_data(buf, sizeof(buf), 0, "bench",
+                                               payload, plen);
+  for (long i = 0; i < count; i++) {
+    if (gateway_client_send(c, buf, n) != 0) {
+      fprintf(stderr, "send: %s\n", strerror(errno));
+      return i;
+    }
+  }
+  return count;
+}
+
+static long run_batch(GatewayClient *c, const uint8_t *payload, size_t plen,
+                      long count, size_t batch) {
+  static uint8_t bufs[GATEWAY_CLIENT_BATCH_MAX][GATEWAY_CLIENT_MAX_DGRAM];
+  GatewayClientMsg msgs[GATEWAY_CLIENT_BATCH_MAX];
+  for (size_t i = 0; i < batch; i++) {
+    msgs[i].buf = bufs[i];
+    msgs[i].len = gateway_client_encode_sensor_data(
+        bufs[i], sizeof(bufs[i]), 0, "bench", payload, plen);
+  }
+  long sent = 0;
+  while (sent < count) {
+    size_t want = (size_t)(count - sent) < batch ? (size_t)(count - sent)
+                                                 : batch;
+    int r = gateway_client_send_batch(c, msgs, want);
+    if (r < 0) {
+      fprintf(stderr, "sendmmsg: %s\n", strerror(errno));
+      break;
+    }
+    sent += r;
+  }
+  return sent;
+}
+
+static long run_ack(GatewayClient *c, const uint8_t *payload, size_t plen,
+                    long count, long *errors) {
+  uint8_t buf[GATEWAY_CLIENT_MAX_DGRAM];
+  long sent = 0, acked = 0;
+  // One message in flight until the first ack advertises a window.
+  uint32_t window = 1;
+  while (acked < count) {
+    while (sent < count && (uint32_t)(sent - acked) < window) {
+      size_t n = gateway_client_encode_sensor_data(
+          buf, sizeof(buf), gateway_client_next_req_id(c), "bench", payload,
+          plen);
+      if (gateway_client_send(c, buf, n) != 0) {
+        fprintf(stderr, "send: %s\n", strerror(errno));
+        return acked;
+      }
+      sent++;
+    }
+    GatewayClientAck ack;
+    if (gateway_client_recv_ack(c, &ack, ACK_TIMEOUT_MS) != 0) {
+      fprintf(stderr, "ack: %s (%ld un-acked)\n", strerror(errno),
+              sent - acked);
+      return acked;
+    }
+    acked++;
+    if (ack.status != 0) {
+      (*errors)++;
+    }
+    window = ack.credits ? ack.credits : 1;
+  }
+  return acked;
+}
+
+static long run_shm(GatewayClient *c, const uint8_t *payload, size_t plen,
+                    long count, size_t batch, long *full_spins) {
+  GatewayClientShm shm;
+  if (gateway_client_shm_open(c, &shm, "bench", 1u << 20, 1000) != 0) {
+    fprintf(stderr, "shm_open: %s\n", strerror(errno));
+    return 0;
+  }
+  long sent = 0;
+  while (sent < count) {
+    size_t queued = 0;
+    while (queued < batch && sent < count) {
+      if (gateway_client_shm_sensor_data(&shm, "bench", payload, plen) != 0) {
+        break;
+      }
+      queued++;
+      sent++;
+    }
+    gateway_client_shm_kick(&shm);
+    if (queued < batch && sent < count) {
+      (*full_spins)++;
+      sched_yield();
+    }
+  }
+  // Let the gateway drain before the ring is unregistered.
+  while (shm_ring_used(&shm.ring) > 0) {
+    gateway_client_shm_kick(&shm);
+    sched_yield();
+  }
+  gateway_client_shm_close(c, &shm);
+  return sent;
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  const char *mode = "batch";
+  long count = 100000;
+  long batch = 32;
+  long payload_len = 16;
+
+  static const struct option long_opts[] = {
+      {"socket", required_argument, NULL, 's'},
+      {"mode", required_argument, NULL, 'm'},
+      {"count", required_argument, NULL, 'n'},
+      {"batch", required_argument, NULL, 'b'},
+      {"payload", required_argument, NULL, 'p'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      path = optarg;
+      break;
+    case 'm':
+      mode = optarg;
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 10);
+      break;
+    case 'b':
+      batch = strtol(optarg, NULL, 10);
+      break;
+    case 'p':
+      payload_len = strtol(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "%s", k_usage);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (count <= 0 || batch <= 0 || batch > GATEWAY_CLIENT_BATCH_MAX ||
+      payload_len < 0 || payload_len > 3900) {
+    fprintf(stderr, "bench: invalid --count/--batch/--payload\n%s", k_usage);
+    return 1;
+  }
+
+  GatewayClient c;
+  if (gateway_client_open(&c, path) != 0) {
+    fprintf(stderr, "bench: connect failed: %s\n", strerror(errno));
+    return 1;
+  }
+
+  static uint8_t payload[4096];
+  memset(payload, 0xa5, sizeof(payload));
+  size_t plen = (size_t)payload_len;
+
+  long errors = 0, full_spins = 0, done = 0;
+  double t0 = now_s();
+  if (strcmp(mode, "send") == 0) {
+    done = run_send(&c, payload, plen, count);
+  } else if (strcmp(mode, "batch") == 0) {
+    done = run_batch(&c, payload, plen, count, (size_t)batch);
+  } else if (strcmp(mode, "ack") == 0) {
+    done = run_ack(&c, payload, plen, count, &errors);
+  } else if (strcmp(mode, "shm") == 0) {
+    done = run_shm(&c, payload, plen, count, (size_t)batch, &full_spins);
+  } else {
+    fprintf(stderr, "bench: unknown --mode %s\n%s", mode, k_usage);
+    gateway_client_close(&c);
+    return 1;
+  }
+  double elapsed = now_s() - t0;
+  gateway_client_close(&c);
+
+  printf("mode=%s payload=%zu batch=%ld sent=%ld elapsed=%.3fs "
+         "rate=%.0f msg/s",
+         mode, plen, batch, done, elapsed,
+         elapsed > 0 ? (double)done / elapsed : 0.0);
+  if (strcmp(mode, "ack") == 0) {
+    printf(" errors=%ld last_credits=%u", errors, c.credits);
+  }
+  if (strcmp(mode, "shm") == 0) {
+    printf(" ring_full=%ld", full_spins);
+  }
+  printf("\n");
+  return done == count ? 0 : 1;
+}
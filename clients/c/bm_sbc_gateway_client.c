@@ -0,0 +1,789 @@
+#define _GNU_SOURCE // memfd_create, sendmmsg
+#include "bm_sbc_gateway_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Shared-memory sensor_data record header: [topic_suffix_len (u16)].  Mirrors
+// GATEWAY_IPC_SHM_SENSOR_HDR_BYTES without pulling in the gateway's headers.
+#define SHM_SENSOR_HDR_BYTES 2
+
+// ---- Minimal CBOR writer ----------------------------------------------------
+//
+// Only what the v1 schema needs: definite-length maps, text and byte
+// strings, integers, float32 and booleans.  On overflow the writer keeps
+// counting but stops writing, and the encoder returns 0.
+
+typedef struct {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+} CborOut;
+
+enum {
+  MAJOR_UINT = 0,
+  MAJOR_NINT = 1,
+  MAJOR_BYTES = 2,
+  MAJOR_TEXT = 3,
+  MAJOR_ARRAY = 4,
+  MAJOR_MAP = 5,
+  MAJOR_SIMPLE = 7,
+};
+
+static void put_raw(CborOut *o, const void *p, size_t n) {
+  if (o->len + n <= o->cap) {
+    memcpy(o->buf + o->len, p, n);
+  }
+  o->len += n;
+}
+
+static void put_head(CborOut *o, uint8_t major, uint64_t v) {
+  uint8_t h[9];
+  size_t n;
+  if (v < 24) {
+    h[0] = (uint8_t)(major << 5 | v);
+    n = 1;
+  } else if (v <= UINT8_MAX) {
+    h[0] = (uint8_t)(major << 5 | 24);
+    h[1] = (uint8_t)v;
+    n = 2;
+  } else if (v <= UINT16_MAX) {
+    h[0] = (uint8_t)(major << 5 | 25);
+    h[1] = (uint8_t)(v >> 8);
+    h[2] = (uint8_t)v;
+    n = 3;
+  } else if (v <= UINT32_MAX) {
+    h[0] = (uint8_t)(major << 5 | 26);
+    for (int i = 0; i < 4; i++) {
+      h[1 + i] = (uint8_t)(v >> (24 - 8 * i));
+    }
+    n = 5;
+  } else {
+    h[0] = (uint8_t)(major << 5 | 27);
+    for (int i = 0; i < 8; i++) {
+      h[1 + i] = (uint8_t)(v >> (56 - 8 * i));
+    }
+    n = 9;
+  }
+  put_raw(o, h, n);
+}
+
+static void put_text(CborOut *o, const char *s) {
+  size_t n = strlen(s);
+  put_head(o, MAJOR_TEXT, n);
+  put_raw(o, s, n);
+}
+
+static void put_bytes(CborOut *o, const uint8_t *p, size_t n) {
+  put_head(o, MAJOR_BYTES, n);
+  if (n) {
+    put_raw(o, p, n);
+  }
+}
+
+static void put_int(CborOut *o, int64_t v) {
+  if (v >= 0) {
+    put_head(o, MAJOR_UINT, (uint64_t)v);
+  } else {
+    put_head(o, MAJOR_NINT, (uint64_t)(-1 - v));
+  }
+}
+
+static void put_bool(CborOut *o, bool v) {
+  uint8_t b = (uint8_t)(MAJOR_SIMPLE << 5 | (v ? 21 : 20));
+  put_raw(o, &b, 1);
+}
+
+static void put_float(CborOut *o, float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint8_t h[5] = {(uint8_t)(MAJOR_SIMPLE << 5 | 26), (uint8_t)(bits >> 24),
+                  (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+  put_raw(o, h, sizeof(h));
+}
+
+// Start a message map: "v", "type" and (if non-zero) "req_id", followed by
+// @p fields message-specific pairs.
+static void begin_msg(CborOut *o, uint8_t *buf, size_t cap, const char *type,
+                      uint64_t req_id, size_t fields) {
+  o->buf = buf;
+  o->cap = cap;
+  o->len = 0;
+  put_head(o, MAJOR_MAP, 2 + (req_id ? 1 : 0) + fields);
+  put_text(o, "v");
+  put_head(o, MAJOR_UINT, 1);
+  put_text(o, "type");
+  put_text(o, type);
+  if (req_id) {
+    put_text(o, "req_id");
+    put_head(o, MAJOR_UINT, req_id);
+  }
+}
+
+static size_t end_msg(const CborOut *o) {
+  return o->len <= o->cap ? o->len : 0;
+}
+
+size_t gateway_client_encode_replay_caught_up(uint8_t *buf, size_t cap,
+                                              uint64_t req_id) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "replay_caught_up", req_id, 0);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_spotter_log(uint8_t *buf, size_t cap,
+                                         uint64_t req_id, const char *data,
+                                         const char *file_name,
+                                         bool print_timestamp) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "spotter_log", req_id, file_name ? 3 : 2);
+  put_text(&o, "data");
+  put_text(&o, data);
+  if (file_name) {
+    put_text(&o, "file_name");
+    put_text(&o, file_name);
+  }
+  put_text(&o, "print_timestamp");
+  put_bool(&o, print_timestamp);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_spotter_tx(uint8_t *buf, size_t cap,
+                                        uint64_t req_id, const uint8_t *data,
+                                        size_t data_len,
+                                        bool iridium_fallback) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "spotter_tx", req_id, 2);
+  put_text(&o, "data");
+  put_bytes(&o, data, data_len);
+  put_text(&o, "iridium_fallback");
+  put_bool(&o, iridium_fallback);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_sensor_data(uint8_t *buf, size_t cap,
+                                         uint64_t req_id,
+                                         const char *topic_suffix,
+                                         const uint8_t *data,
+                                         size_t data_len) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "sensor_data", req_id, 2);
+  put_text(&o, "topic_suffix");
+  put_text(&o, topic_suffix);
+  put_text(&o, "data");
+  put_bytes(&o, data, data_len);
+  return end_msg(&o);
+}
+
+static void begin_config_set(CborOut *o, uint8_t *buf, size_t cap,
+                             uint64_t req_id, const char *key) {
+  begin_msg(o, buf, cap, "config_set", req_id, 2);
+  put_text(o, "config_key");
+  put_text(o, key);
+  put_text(o, "config_value");
+}
+
+size_t gateway_client_encode_config_set_str(uint8_t *buf, size_t cap,
+                                            uint64_t req_id, const char *key,
+                                            const char *value) {
+  CborOut o;
+  begin_config_set(&o, buf, cap, req_id, key);
+  put_text(&o, value);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_config_set_uint(uint8_t *buf, size_t cap,
+                                             uint64_t req_id, const char *key,
+                                             uint32_t value) {
+  CborOut o;
+  begin_config_set(&o, buf, cap, req_id, key);
+  put_head(&o, MAJOR_UINT, value);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_config_set_int(uint8_t *buf, size_t cap,
+                                            uint64_t req_id, const char *key,
+                                            int32_t value) {
+  CborOut o;
+  begin_config_set(&o, buf, cap, req_id, key);
+  put_int(&o, value);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_config_set_float(uint8_t *buf, size_t cap,
+                                              uint64_t req_id, const char *key,
+                                              float value) {
+  CborOut o;
+  begin_config_set(&o, buf, cap, req_id, key);
+  put_float(&o, value);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_config_set_batch(
+    uint8_t *buf, size_t cap, uint64_t req_id,
+    const GatewayClientConfigEntry *entries, size_t n) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "config_set_batch", req_id, 1);
+  put_text(&o, "entries");
+  put_head(&o, MAJOR_MAP, n);
+  for (size_t i = 0; i < n; i++) {
+    const GatewayClientConfigEntry *e = &entries[i];
+    put_text(&o, e->key);
+    switch (e->type) {
+    case GATEWAY_CLIENT_CONFIG_STR:
+      put_text(&o, e->value.str);
+      break;
+    case GATEWAY_CLIENT_CONFIG_UINT:
+      put_head(&o, MAJOR_UINT, e->value.u);
+      break;
+    case GATEWAY_CLIENT_CONFIG_INT:
+      put_int(&o, e->value.i);
+      break;
+    case GATEWAY_CLIENT_CONFIG_FLOAT:
+      put_float(&o, e->value.f);
+      break;
+    default:
+      return 0;
+    }
+  }
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_subscribe(uint8_t *buf, size_t cap,
+                                       uint64_t req_id, const char *topic,
+                                       const char *reply_path) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "subscribe", req_id, 2);
+  put_text(&o, "topic");
+  put_text(&o, topic);
+  put_text(&o, "reply_path");
+  put_text(&o, reply_path);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_unsubscribe(uint8_t *buf, size_t cap,
+                                         uint64_t req_id, const char *topic,
+                                         const char *reply_path) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "unsubscribe", req_id, topic ? 2 : 1);
+  if (topic) {
+    put_text(&o, "topic");
+    put_text(&o, topic);
+  }
+  put_text(&o, "reply_path");
+  put_text(&o, reply_path);
+  return end_msg(&o);
+}
+
+size_t gateway_client_encode_stats(uint8_t *buf, size_t cap, uint64_t req_id,
+                                   bool reset) {
+  CborOut o;
+  begin_msg(&o, buf, cap, "stats", req_id, reset ? 1 : 0);
+  if (reset) {
+    put_text(&o, "reset");
+    put_bool(&o, true);
+  }
+  return end_msg(&o);
+}
+
+// ---- Reply decoding ---------------------------------------------------------
+
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+} CborIn;
+
+// Read one item head; returns false on truncation or indefinite lengths.
+static bool get_head(CborIn *in, uint8_t *major, uint64_t *v) {
+  if (in->p >= in->end) {
+    return false;
+  }
+  uint8_t ib = *in->p++;
+  *major = ib >> 5;
+  uint8_t ai = ib & 0x1f;
+  if (ai < 24) {
+    *v = ai;
+    return true;
+  }
+  size_t n = ai == 24 ? 1 : ai == 25 ? 2 : ai == 26 ? 4 : ai == 27 ? 8 : 0;
+  if (n == 0 || (size_t)(in->end - in->p) < n) {
+    return false;
+  }
+  *v = 0;
+  for (size_t i = 0; i < n; i++) {
+    *v = *v << 8 | *in->p++;
+  }
+  return true;
+}
+
+int gateway_client_decode_ack(const uint8_t *buf, size_t len,
+                              GatewayClientAck *ack) {
+  CborIn in = {buf, buf + len};
+  uint8_t major;
+  uint64_t pairs;
+  if (!get_head(&in, &major, &pairs) || major != MAJOR_MAP) {
+    return -1;
+  }
+  bool is_ack = false, have_req_id = false;
+  GatewayClientAck out = {0, 0, 0};
+  for (uint64_t i = 0; i < pairs; i++) {
+    uint64_t klen;
+    if (!get_head(&in, &major, &klen) || major != MAJOR_TEXT ||
+        (uint64_t)(in.end - in.p) < klen) {
+      return -1;
+    }
+    const char *key = (const char *)in.p;
+    in.p += klen;
+
+    uint64_t v;
+    if (!get_head(&in, &major, &v)) {
+      return -1;
+    }
+    if (major == MAJOR_TEXT || major == MAJOR_BYTES) {
+      if ((uint64_t)(in.end - in.p) < v) {
+        return -1;
+      }
+      if (klen == 4 && memcmp(key, "type", 4) == 0) {
+        is_ack = major == MAJOR_TEXT && v == 3 && memcmp(in.p, "ack", 3) == 0;
+      }
+      in.p += v;
+      continue;
+    }
+    if (major != MAJOR_UINT && major != MAJOR_NINT) {
+      return -1;
+    }
+    int64_t iv = major == MAJOR_UINT ? (int64_t)v : -1 - (int64_t)v;
+    if (klen == 6 && memcmp(key, "req_id", 6) == 0 && major == MAJOR_UINT) {
+      out.req_id = v;
+      have_req_id = true;
+    } else if (klen == 6 && memcmp(key, "status", 6) == 0) {
+      out.status = (int32_t)iv;
+    } else if (klen == 7 && memcmp(key, "credits", 7) == 0 &&
+               major == MAJOR_UINT) {
+      out.credits = v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+    }
+  }
+  if (!is_ack || !have_req_id) {
+    return -1;
+  }
+  *ack = out;
+  return 0;
+}
+
+static bool key_is(const char *key, uint64_t klen, const char *want) {
+  return klen == strlen(want) && memcmp(key, want, klen) == 0;
+}
+
+int gateway_client_decode_stats(const uint8_t *buf, size_t len,
+                                GatewayClientStats *stats) {
+  static const struct {
+    const char *key;
+    size_t offset;
+  } k_counters[] = {
+      {"rx_datagrams", offsetof(GatewayClientStats, rx_datagrams)},
+      {"rx_batches", offsetof(GatewayClientStats, rx_batches)},
+      {"dispatch_errors", offsetof(GatewayClientStats, dispatch_errors)},
+      {"rate_limited", offsetof(GatewayClientStats, rate_limited)},
+      {"published", offsetof(GatewayClientStats, published)},
+      {"shm_records", offsetof(GatewayClientStats, shm_records)},
+      {"poll_cpu_ns", offsetof(GatewayClientStats, poll_cpu_ns)},
+      {"dispatch_ns_total", offsetof(GatewayClientStats, dispatch_ns_total)},
+  };
+  CborIn in = {buf, buf + len};
+  uint8_t major;
+  uint64_t pairs;
+  if (!get_head(&in, &major, &pairs) || major != MAJOR_MAP) {
+    return -1;
+  }
+  bool is_stats = false;
+  GatewayClientStats out;
+  memset(&out, 0, sizeof(out));
+  for (uint64_t i = 0; i < pairs; i++) {
+    uint64_t klen;
+    if (!get_head(&in, &major, &klen) || major != MAJOR_TEXT ||
+        (uint64_t)(in.end - in.p) < klen) {
+      return -1;
+    }
+    const char *key = (const char *)in.p;
+    in.p += klen;
+
+    uint64_t v;
+    if (!get_head(&in, &major, &v)) {
+      return -1;
+    }
+    if (major == MAJOR_TEXT || major == MAJOR_BYTES) {
+      if ((uint64_t)(in.end - in.p) < v) {
+        return -1;
+      }
+      if (key_is(key, klen, "type")) {
+        is_stats =
+            major == MAJOR_TEXT && v == 5 && memcmp(in.p, "stats", 5) == 0;
+      }
+      in.p += v;
+    } else if (major == MAJOR_ARRAY) {
+      if (!key_is(key, klen, "dispatch_ns_hist")) {
+        return -1;
+      }
+      for (uint64_t b = 0; b < v; b++) {
+        uint64_t count;
+        if (!get_head(&in, &major, &count) || major != MAJOR_UINT) {
+          return -1;
+        }
+        if (b < GATEWAY_CLIENT_LAT_BUCKETS) {
+          out.dispatch_ns_hist[b] = count;
+        }
+      }
+    } else if (major == MAJOR_UINT) {
+      for (size_t k = 0; k < sizeof(k_counters) / sizeof(k_counters[0]);
+           k++) {
+        if (key_is(key, klen, k_counters[k].key)) {
+          memcpy((uint8_t *)&out + k_counters[k].offset, &v, sizeof(v));
+          break;
+        }
+      }
+    } else if (major != MAJOR_NINT && major != MAJOR_SIMPLE) {
+      return -1;
+    }
+  }
+  if (!is_stats) {
+    return -1;
+  }
+  *stats = out;
+  return 0;
+}
+
+// ---- Connection -------------------------------------------------------------
+
+int gateway_client_open(GatewayClient *c, const char *path) {
+  c->fd = -1;
+  c->next_req_id = 1;
+  c->credits = 0;
+
+  if (!path) {
+    const char *env = getenv("BM_SBC_GATEWAY_IPC");
+    path = (env && env[0]) ? env : GATEWAY_CLIENT_DEFAULT_PATH;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  // Autobind: an address of just the family asks the kernel for a unique
+  // abstract name, which is where the gateway sends acks.
+  struct sockaddr_un self;
+  memset(&self, 0, sizeof(self));
+  self.sun_family = AF_UNIX;
+  if (bind(fd, (struct sockaddr *)&self, sizeof(sa_family_t)) < 0 ||
+      connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  c->fd = fd;
+  return 0;
+}
+
+void gateway_client_close(GatewayClient *c) {
+  if (c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+  }
+}
+
+uint64_t gateway_client_next_req_id(GatewayClient *c) {
+  if (c->next_req_id == 0) {
+    c->next_req_id = 1;
+  }
+  return c->next_req_id++;
+}
+
+int gateway_client_set_nonblocking(GatewayClient *c, bool nonblocking) {
+  int flags = fcntl(c->fd, F_GETFL, 0);
+  if (flags < 0) {
+    return -1;
+  }
+  flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  return fcntl(c->fd, F_SETFL, flags);
+}
+
+int gateway_client_send(GatewayClient *c, const uint8_t *buf, size_t len) {
+  for (;;) {
+    if (send(c->fd, buf, len, 0) >= 0) {
+      return 0;
+    }
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+int gateway_client_send_batch(GatewayClient *c, const GatewayClientMsg *msgs,
+                              size_t n) {
+  struct mmsghdr hdrs[GATEWAY_CLIENT_BATCH_MAX];
+  struct iovec iovs[GATEWAY_CLIENT_BATCH_MAX];
+  size_t sent = 0;
+  while (sent < n) {
+    size_t chunk = n - sent;
+    if (chunk > GATEWAY_CLIENT_BATCH_MAX) {
+      chunk = GATEWAY_CLIENT_BATCH_MAX;
+    }
+    memset(hdrs, 0, chunk * sizeof(hdrs[0]));
+    for (size_t i = 0; i < chunk; i++) {
+      iovs[i].iov_base = (void *)msgs[sent + i].buf;
+      iovs[i].iov_len = msgs[sent + i].len;
+      hdrs[i].msg_hdr.msg_iov = &iovs[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int r = sendmmsg(c->fd, hdrs, (unsigned int)chunk, 0);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return sent ? (int)sent : -1;
+    }
+    sent += (size_t)r;
+    if ((size_t)r < chunk) {
+      // Partial batch: the next datagram hit an error or a full queue.
+      break;
+    }
+  }
+  return (int)sent;
+}
+
+// Receive the next datagram within @p timeout_ms.  Returns its length, or -1
+// on timeout (errno ETIMEDOUT) or error.
+static ssize_t recv_timeout(GatewayClient *c, uint8_t *buf, size_t cap,
+                            int timeout_ms) {
+  for (;;) {
+    struct pollfd pfd = {c->fd, POLLIN, 0};
+    int pr = poll(&pfd, 1, timeout_ms);
+    if (pr < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (pr == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    ssize_t n = recv(c->fd, buf, cap, MSG_DONTWAIT);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    }
+    return n;
+  }
+}
+
+int gateway_client_recv_ack(GatewayClient *c, GatewayClientAck *ack,
+                            int timeout_ms) {
+  uint8_t buf[256];
+  for (;;) {
+    ssize_t n = recv_timeout(c, buf, sizeof(buf), timeout_ms);
+    if (n < 0) {
+      return -1;
+    }
+    if (gateway_client_decode_ack(buf, (size_t)n, ack) == 0) {
+      c->credits = ack->credits;
+      return 0;
+    }
+  }
+}
+
+int gateway_client_get_stats(GatewayClient *c, bool reset,
+                             GatewayClientStats *stats, int timeout_ms) {
+  uint8_t buf[1024];
+  size_t len = gateway_client_encode_stats(buf, sizeof(buf), 0, reset);
+  if (gateway_client_send(c, buf, len) != 0) {
+    return -1;
+  }
+  for (;;) {
+    ssize_t n = recv_timeout(c, buf, sizeof(buf), timeout_ms);
+    if (n < 0) {
+      return -1;
+    }
+    if (gateway_client_decode_stats(buf, (size_t)n, stats) == 0) {
+      return 0;
+    }
+  }
+}
+
+// ---- Shared-memory sensor_data ring ----------------------------------------
+
+static int send_shm_register(GatewayClient *c, uint64_t req_id,
+                             const char *name, int mem_fd, int doorbell_fd) {
+  uint8_t buf[128];
+  CborOut o;
+  begin_msg(&o, buf, sizeof(buf), "shm_register", req_id, 1);
+  put_text(&o, "name");
+  put_text(&o, name);
+  size_t len = end_msg(&o);
+  if (len == 0) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  int fds[2] = {mem_fd, doorbell_fd};
+  union {
+    struct cmsghdr align;
+    uint8_t bytes[CMSG_SPACE(sizeof(fds))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = {buf, len};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.bytes;
+  msg.msg_controllen = sizeof(control.bytes);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  return sendmsg(c->fd, &msg, 0) < 0 ? -1 : 0;
+}
+
+// Wait for the ack to @p req_id; a refusal sets errno to its status.
+static int wait_ack(GatewayClient *c, uint64_t req_id, int timeout_ms) {
+  GatewayClientAck ack;
+  do {
+    if (gateway_client_recv_ack(c, &ack, timeout_ms) != 0) {
+      return -1;
+    }
+  } while (ack.req_id != req_id);
+  if (ack.status != 0) {
+    errno = ack.status;
+    return -1;
+  }
+  return 0;
+}
+
+int gateway_client_shm_open(GatewayClient *c, GatewayClientShm *shm,
+                            const char *name, uint32_t capacity,
+                            int timeout_ms) {
+  memset(shm, 0, sizeof(*shm));
+  shm->doorbell_fd = -1;
+  if (capacity < SHM_RING_MIN_CAPACITY || capacity > SHM_RING_MAX_CAPACITY ||
+      (capacity & (capacity - 1)) != 0 || strlen(name) >= sizeof(shm->name)) {
+    errno = EINVAL;
+    return -1;
+  }
+  strcpy(shm->name, name);
+
+  size_t len = SHM_RING_REGION_BYTES((size_t)capacity);
+  int mem_fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (mem_fd < 0) {
+    return -1;
+  }
+  int saved;
+  uint64_t req_id;
+  GatewayClient *unregister = NULL;
+  if (ftruncate(mem_fd, (off_t)len) < 0 ||
+      fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+    goto fail;
+  }
+  shm->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  if (shm->map == MAP_FAILED) {
+    shm->map = NULL;
+    goto fail;
+  }
+  shm->map_len = len;
+  if (shm_ring_init(&shm->ring, shm->map, len) != 0) {
+    errno = EINVAL;
+    goto fail;
+  }
+  shm->doorbell_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  req_id = gateway_client_next_req_id(c);
+  if (shm->doorbell_fd < 0 ||
+      send_shm_register(c, req_id, name, mem_fd, shm->doorbell_fd) < 0) {
+    goto fail;
+  }
+  if (wait_ack(c, req_id, timeout_ms) < 0) {
+    // Without an answer the gateway may hold the ring after all.
+    if (errno == ETIMEDOUT) {
+      unregister = c;
+    }
+    goto fail;
+  }
+  // The gateway holds its own reference now; the mapping keeps ours alive.
+  close(mem_fd);
+  return 0;
+
+fail:
+  saved = errno;
+  close(mem_fd);
+  gateway_client_shm_close(unregister, shm);
+  errno = saved;
+  return -1;
+}
+
+int gateway_client_shm_sensor_data(GatewayClientShm *shm,
+                                   const char *topic_suffix,
+                                   const uint8_t *data, size_t data_len) {
+  size_t suffix_len = strlen(topic_suffix);
+  if (suffix_len > UINT16_MAX) {
+    return -1;
+  }
+  size_t len = SHM_SENSOR_HDR_BYTES + suffix_len + data_len;
+  uint8_t *dst = shm_ring_reserve(&shm->ring, len);
+  if (!dst) {
+    return -1;
+  }
+  uint16_t hdr = (uint16_t)suffix_len;
+  memcpy(dst, &hdr, sizeof(hdr));
+  memcpy(dst + SHM_SENSOR_HDR_BYTES, topic_suffix, suffix_len);
+  if (data_len) {
+    memcpy(dst + SHM_SENSOR_HDR_BYTES + suffix_len, data,
+           data_len);
+  }
+  shm_ring_commit(&shm->ring);
+  return 0;
+}
+
+void gateway_client_shm_kick(GatewayClientShm *shm) {
+  uint64_t one = 1;
+  // EAGAIN means the counter is saturated, i.e. a wakeup is already pending.
+  while (write(shm->doorbell_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+}
+
+void gateway_client_shm_close(GatewayClient *c, GatewayClientShm *shm) {
+  if (c && shm->name[0]) {
+    uint8_t buf[128];
+    CborOut o;
+    begin_msg(&o, buf, sizeof(buf), "shm_unregister", 0, 1);
+    put_text(&o, "name");
+    put_text(&o, shm->name);
+    size_t len = end_msg(&o);
+    if (len) {
+      gateway_client_send(c, buf, len);
+    }
+  }
+  if (shm->map) {
+    munmap(shm->map, shm->map_len);
+  }
+  if (shm->doorbell_fd >= 0) {
+    close(shm->doorbell_fd);
+  }
+  memset(shm, 0, sizeof(*shm));
+  shm->doorbell_fd = -1;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+/// @file bm_sbc_gateway_client.h
+/// @brief Native C/C++ client for the bm_sbc_gateway IPC socket.
+///
+/// Encoders write one v1 CBOR message (docs/gateway-ipc.md) into a
+/// caller-provided buffer and never allocate.  A GatewayClient keeps one
+/// connected SOCK_DGRAM socket, sends single messages or sendmmsg() batches,
+/// and can read back `ack` replies for messages sent with a req_id.
+/// GatewayClientShm wraps a shared-memory sensor_data ring.
+///
+/// Typical use:
+/// @code
+///   GatewayClient c;
+///   gateway_client_open(&c, NULL);
+///   uint8_t buf[GATEWAY_CLIENT_MAX_DGRAM];
+///   size_t n = gateway_client_encode_sensor_data(buf, sizeof(buf), 0,
+///                                                "temperature", data, len);
+///   gateway_client_send(&c, buf, n);
+///   gateway_client_close(&c);
+/// @endcode
+
+#include "shm_ring.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Default gateway socket path (same as GATEWAY_IPC_SOCKET_PATH).
+#define GATEWAY_CLIENT_DEFAULT_PATH "/run/bm_sbc/gateway_ipc.sock"
+
+/// Largest datagram the gateway accepts.
+#define GATEWAY_CLIENT_MAX_DGRAM 4096
+
+/// Messages handed to one sendmmsg() call by gateway_client_send_batch().
+#define GATEWAY_CLIENT_BATCH_MAX 64
+
+// ---- Encoders ---------------------------------------------------------------
+//
+// Each encoder returns the encoded length, or 0 if the message does not fit
+// in @p cap bytes.  @p req_id 0 omits the field (no ack requested).
+// Strings are NUL-terminated; optional strings may be NULL.
+
+size_t gateway_client_encode_replay_caught_up(uint8_t *buf, size_t cap,
+                                              uint64_t req_id);
+
+size_t gateway_client_encode_spotter_log(uint8_t *buf, size_t cap,
+                                         uint64_t req_id, const char *data,
+                                         const char *file_name,
+                                         bool print_timestamp);
+
+size_t gateway_client_encode_spotter_tx(uint8_t *buf, size_t cap,
+                                        uint64_t req_id, const uint8_t *data,
+                                        size_t data_len,
+                                        bool iridium_fallback);
+
+size_t gateway_client_encode_sensor_data(uint8_t *buf, size_t cap,
+                                         uint64_t req_id,
+                                         const char *topic_suffix,
+                                         const uint8_t *data, size_t data_len);
+
+size_t gateway_client_encode_config_set_str(uint8_t *buf, size_t cap,
+                                            uint64_t req_id, const char *key,
+                                            const char *value);
+
+size_t gateway_client_encode_config_set_uint(uint8_t *buf, size_t cap,
+                                             uint64_t req_id, const char *key,
+                                             uint32_t value);
+
+size_t gateway_client_encode_config_set_int(uint8_t *buf, size_t cap,
+                                            uint64_t req_id, const char *key,
+                                            int32_t value);
+
+size_t gateway_client_encode_config_set_float(uint8_t *buf, size_t cap,
+                                              uint64_t req_id, const char *key,
+                                              float value);
+
+typedef enum {
+  GATEWAY_CLIENT_CONFIG_STR,
+  GATEWAY_CLIENT_CONFIG_UINT,
+  GATEWAY_CLIENT_CONFIG_INT,
+  GATEWAY_CLIENT_CONFIG_FLOAT,
+} GatewayClientConfigType;
+
+/// One key/value for gateway_client_encode_config_set_batch().
+typedef struct {
+  const char *key;
+  GatewayClientConfigType type;
+  union {
+    const char *str;
+    uint32_t u;
+    int32_t i;
+    float f;
+  } value;
+} GatewayClientConfigEntry;
+
+/// Set @p n keys and persist them once.  The gateway checks every entry
+/// before applying any, so one bad entry leaves the partition untouched.
+size_t gateway_client_encode_config_set_batch(
+    uint8_t *buf, size_t cap, uint64_t req_id,
+    const GatewayClientConfigEntry *entries, size_t n);
+
+/// Send subscribe/unsubscribe from the socket bound at @p reply_path: the
+/// gateway pushes to the sender's own address and refuses a reply_path
+/// that is not it.
+size_t gateway_client_encode_subscribe(uint8_t *buf, size_t cap,
+                                       uint64_t req_id, const char *topic,
+                                       const char *reply_path);
+
+/// @p topic NULL drops every topic held by @p reply_path.
+size_t gateway_client_encode_unsubscribe(uint8_t *buf, size_t cap,
+                                         uint64_t req_id, const char *topic,
+                                         const char *reply_path);
+
+/// @p reset true zeroes the gateway's counters after the snapshot is taken.
+size_t gateway_client_encode_stats(uint8_t *buf, size_t cap, uint64_t req_id,
+                                   bool reset);
+
+// ---- Connection -------------------------------------------------------------
+
+typedef struct {
+  int fd;
+  uint64_t next_req_id;
+  /// Window from the most recent ack (0 until one arrives).
+  uint32_t credits;
+} GatewayClient;
+
+typedef struct {
+  const uint8_t *buf;
+  size_t len;
+} GatewayClientMsg;
+
+typedef struct {
+  uint64_t req_id;
+  int32_t status; ///< 0, or a BmErr code (errno numbering).
+  uint32_t credits;
+} GatewayClientAck;
+
+/// Buckets in GatewayClientStats::dispatch_ns_hist (GATEWAY_IPC_LAT_BUCKETS).
+#define GATEWAY_CLIENT_LAT_BUCKETS 32
+
+/// Gateway ingestion counters from a `stats` reply.  Bucket b of
+/// dispatch_ns_hist counts datagrams handled in [2^b, 2^(b+1)) ns.
+typedef struct {
+  uint64_t rx_datagrams;
+  uint64_t rx_batches;
+  uint64_t dispatch_errors;
+  uint64_t rate_limited;
+  uint64_t published;
+  uint64_t shm_records;
+  uint64_t poll_cpu_ns;
+  uint64_t dispatch_ns_total;
+  uint64_t dispatch_ns_hist[GATEWAY_CLIENT_LAT_BUCKETS];
+} GatewayClientStats;
+
+/// Connect to the gateway at @p path (NULL: $BM_SBC_GATEWAY_IPC, then the
+/// default path).  The socket is autobound to an abstract address so the
+/// gateway can send acks back.
+/// @return 0 on success, -1 on failure (errno set).
+int gateway_client_open(GatewayClient *c, const char *path);
+
+void gateway_client_close(GatewayClient *c);
+
+/// Allocate the next non-zero request id for an acked message.
+uint64_t gateway_client_next_req_id(GatewayClient *c);
+
+/// Send one encoded message.  Blocks while the gateway's queue is full
+/// unless @p c was opened non-blocking with gateway_client_set_nonblocking().
+/// @return 0 on success, -1 on failure (errno set).
+int gateway_client_send(GatewayClient *c, const uint8_t *buf, size_t len);
+
+/// Send @p n messages with as few sendmmsg() calls as possible.
+/// @return Number of messages sent (less than @p n only on error or, for a
+///         non-blocking client, when the queue fills), or -1 if none were.
+int gateway_client_send_batch(GatewayClient *c, const GatewayClientMsg *msgs,
+                              size_t n);
+
+/// Make sends fail with EAGAIN instead of blocking on a full queue.
+/// @return 0 on success, -1 on failure (errno set).
+int gateway_client_set_nonblocking(GatewayClient *c, bool nonblocking);
+
+/// Wait up to @p timeout_ms (-1: forever) for the next ack.  Other
+/// datagrams (e.g. pubsub pushes) are discarded.  Updates c->credits.
+/// @return 0 on success, -1 on timeout or error (errno set).
+int gateway_client_recv_ack(GatewayClient *c, GatewayClientAck *ack,
+                            int timeout_ms);
+
+/// Decode an `ack` datagram.  Exposed for callers running their own socket.
+/// @return 0 on success, -1 if @p buf is not a well-formed ack.
+int gateway_client_decode_ack(const uint8_t *buf, size_t len,
+                              GatewayClientAck *ack);
+
+/// Request the gateway's counters and wait up to @p timeout_ms for the
+/// reply.  Acks and pushes received meanwhile are discarded.
+/// @return 0 on success, -1 on timeout or error (errno set).
+int gateway_client_get_stats(GatewayClient *c, bool reset,
+                             GatewayClientStats *stats, int timeout_ms);
+
+/// Decode a `stats` reply.
+/// @return 0 on success, -1 if @p buf is not a well-formed stats reply.
+int gateway_client_decode_stats(const uint8_t *buf, size_t len,
+                                GatewayClientStats *stats);
+
+// ---- Shared-memory sensor_data ring ----------------------------------------
+
+typedef struct {
+  ShmRing ring;
+  void *map;
+  size_t map_len;
+  int doorbell_fd;
+  char name[32];
+} GatewayClientShm;
+
+/// Create a sealed memfd ring with a data area of @p capacity bytes (power of
+/// two, SHM_RING_MIN_CAPACITY..SHM_RING_MAX_CAPACITY) plus an eventfd
+/// doorbell, and register both with the gateway under @p name, waiting up
+/// to @p timeout_ms (-1: forever) for its ack.
+/// @return 0 on success, -1 on failure (errno set: the ack's status if the
+///         gateway refused, ETIMEDOUT if it did not answer).
+int gateway_client_shm_open(GatewayClient *c, GatewayClientShm *shm,
+                            const char *name, uint32_t capacity,
+                            int timeout_ms);
+
+/// Queue one sensor_data record.  Nothing is read by the gateway until the
+/// next gateway_client_shm_kick() (or its next poll).
+/// @return 0 on success, -1 if the ring is full or the record too large.
+int gateway_client_shm_sensor_data(GatewayClientShm *shm,
+                                   const char *topic_suffix,
+                                   const uint8_t *data, size_t data_len);
+
+/// Ring the doorbell; call once per batch of records.
+void gateway_client_shm_kick(GatewayClientShm *shm);
+
+/// Unregister the ring (when @p c is non-NULL) and release it.
+void gateway_client_shm_close(GatewayClient *c, GatewayClientShm *shm);
+
+#ifdef __cplusplus
+}
+#endif
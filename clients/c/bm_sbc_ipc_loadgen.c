@@ -0,0 +1,349 @@
+// bm_sbc_ipc_loadgen — paced load generator for the gateway IPC socket.
+//
+// Offers a fixed message rate and mix to a running gateway (normally
+// bm_sbc_ipc_test with BM_SBC_IPC_STUB_PUBSUB=1), then asks the gateway for
+// its `stats` and reports what was ingested, what the kernel refused and how
+// long dispatch took.  Unlike bm_sbc_gateway_bench, sends never block: a full
+// socket queue (EAGAIN) is counted as a drop and the schedule moves on, the
+// way a sensor producer with no buffer of its own would behave.
+//
+// Usage: bm_sbc_ipc_loadgen [--socket PATH] [--rate MSG_PER_S]
+//                           [--duration S | --count N] [--mix SPEC]
+//                           [--payload BYTES] [--batch N]
+
+#define _GNU_SOURCE
+#include "bm_sbc_gateway_client.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char k_usage[] =
+    "Usage: bm_sbc_ipc_loadgen [options]\n"
+    "  --socket PATH     Gateway socket (default: $BM_SBC_GATEWAY_IPC or "
+    GATEWAY_CLIENT_DEFAULT_PATH ")\n"
+    "  --rate N          Offered messages per second, 0 = unpaced "
+    "(default: 10000)\n"
+    "  --duration S      Seconds to run (default: 5)\n"
+    "  --count N         Stop after N messages instead of --duration\n"
+    "  --mix SPEC        Weighted types, e.g. sensor_data=90,spotter_log=10\n"
+    "                    (sensor_data, spotter_log, spotter_tx; default: "
+    "sensor_data=100)\n"
+    "  --payload BYTES   Payload size per message (default: 16)\n"
+    "  --batch N         Max messages per sendmmsg (default: 16)\n";
+
+#define TICK_NS 1000000L
+#define STATS_TIMEOUT_MS 1000
+#define DRAIN_SETTLE_MS 50
+#define DRAIN_MAX_ROUNDS 100
+
+enum { MIX_SENSOR_DATA, MIX_SPOTTER_LOG, MIX_SPOTTER_TX, MIX_TYPES };
+
+static const char *const k_mix_names[MIX_TYPES] = {"sensor_data",
+                                                   "spotter_log", "spotter_tx"};
+
+typedef struct {
+  long weight[MIX_TYPES];
+  long credit[MIX_TYPES];
+  long total;
+  uint8_t buf[MIX_TYPES][GATEWAY_CLIENT_MAX_DGRAM];
+  size_t len[MIX_TYPES];
+  long sent[MIX_TYPES];
+} Mix;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ns(long ns) {
+  struct timespec ts = {ns / 1000000000L, ns % 1000000000L};
+  nanosleep(&ts, NULL);
+}
+
+// Parse "type=weight,type=weight".  Returns 0 on success.
+static int parse_mix(Mix *mix, const char *spec) {
+  char tmp[256];
+  if (strlen(spec) >= sizeof(tmp)) {
+    return -1;
+  }
+  strcpy(tmp, spec);
+  memset(mix->weight, 0, sizeof(mix->weight));
+  mix->total = 0;
+  char *save = NULL;
+  for (char *tok = strtok_r(tmp, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    char *eq = strchr(tok, '=');
+    if (!eq) {
+      return -1;
+    }
+    *eq = '\0';
+    long w = strtol(eq + 1, NULL, 10);
+    int t = 0;
+    while (t < MIX_TYPES && strcmp(tok, k_mix_names[t]) != 0) {
+      t++;
+    }
+    if (t == MIX_TYPES || w < 0) {
+      return -1;
+    }
+    mix->weight[t] += w;
+    mix->total += w;
+  }
+  return mix->total > 0 ? 0 : -1;
+}
+
+static int encode_mix(Mix *mix, const uint8_t *payload, size_t plen) {
+  static char text[GATEWAY_CLIENT_MAX_DGRAM];
+  memset(text, 'x', plen);
+  text[plen] = '\0';
+  mix->len[MIX_SENSOR_DATA] = gateway_client_encode_sensor_data(
+      mix->buf[MIX_SENSOR_DATA], GATEWAY_CLIENT_MAX_DGRAM, 0, "loadgen",
+      payload, plen);
+  mix->len[MIX_SPOTTER_LOG] = gateway_client_encode_spotter_log(
+      mix->buf[MIX_SPOTTER_LOG], GATEWAY_CLIENT_MAX_DGRAM, 0, text,
+      "loadgen.log", false);
+  mix->len[MIX_SPOTTER_TX] = gateway_client_encode_spotter_tx(
+      mix->buf[MIX_SPOTTER_TX], GATEWAY_CLIENT_MAX_DGRAM, 0, payload, plen,
+      false);
+  for (int t = 0; t < MIX_TYPES; t++) {
+    if (mix->weight[t] > 0 && mix->len[t] == 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Smooth weighted round-robin: the same spec always yields the same evenly
+// interleaved sequence, so runs are repeatable.
+static int mix_next(Mix *mix) {
+  int best = 0;
+  for (int t = 0; t < MIX_TYPES; t++) {
+    mix->credit[t] += mix->weight[t];
+    if (mix->credit[t] > mix->credit[best]) {
+      best = t;
+    }
+  }
+  mix->credit[best] -= mix->total;
+  return best;
+}
+
+// Offer @p n messages without blocking.  Returns the number the kernel
+// refused (EAGAIN); hard errors end the run with -1.
+static long offer(GatewayClient *c, Mix *mix, long n, size_t batch) {
+  GatewayClientMsg msgs[GATEWAY_CLIENT_BATCH_MAX];
+  int types[GATEWAY_CLIENT_BATCH_MAX];
+  long dropped = 0;
+  while (n > 0) {
+    size_t want = (size_t)n < batch ? (size_t)n : batch;
+    for (size_t i = 0; i < want; i++) {
+      types[i] = mix_next(mix);
+      msgs[i].buf = mix->buf[types[i]];
+      msgs[i].len = mix->len[types[i]];
+    }
+    int r = gateway_client_send_batch(c, msgs, want);
+    if (r < 0 && errno != EAGAIN) {
+      fprintf(stderr, "loadgen: sendmmsg: %s\n", strerror(errno));
+      return -1;
+    }
+    size_t ok = r < 0 ? 0 : (size_t)r;
+    for (size_t i = 0; i < ok; i++) {
+      mix->sent[types[i]]++;
+    }
+    dropped += (long)(want - ok);
+    n -= (long)want;
+  }
+  return dropped;
+}
+
+// Upper bound in ns of the bucket holding the @p pct-th percentile.
+static uint64_t hist_percentile(const GatewayClientStats *st, double pct) {
+  uint64_t total = 0;
+  for (int b = 0; b < GATEWAY_CLIENT_LAT_BUCKETS; b++) {
+    total += st->dispatch_ns_hist[b];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)((double)total * pct / 100.0 + 0.5);
+  uint64_t seen = 0;
+  for (int b = 0; b < GATEWAY_CLIENT_LAT_BUCKETS; b++) {
+    seen += st->dispatch_ns_hist[b];
+    if (seen >= rank && seen > 0) {
+      return 1ull << (b + 1);
+    }
+  }
+  return 1ull << GATEWAY_CLIENT_LAT_BUCKETS;
+}
+
+// Wait until the gateway's rx counter stops moving, then return its stats.
+static int settle_stats(GatewayClient *c, GatewayClientStats *st) {
+  uint64_t last = UINT64_MAX;
+  for (int i = 0; i < DRAIN_MAX_ROUNDS; i++) {
+    if (gateway_client_get_stats(c, false, st, STATS_TIMEOUT_MS) != 0) {
+      return -1;
+    }
+    if (st->rx_datagrams == last) {
+      return 0;
+    }
+    last = st->rx_datagrams;
+    sleep_ns(DRAIN_SETTLE_MS * 1000000L);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  const char *mix_spec = "sensor_data=100";
+  long rate = 10000;
+  double duration = 5.0;
+  long count = 0;
+  long payload_len = 16;
+  long batch = 16;
+
+  static const struct option long_opts[] = {
+      {"socket", required_argument, NULL, 's'},
+      {"rate", required_argument, NULL, 'r'},
+      {"duration", required_argument, NULL, 'd'},
+      {"count", required_argument, NULL, 'n'},
+      {"mix", required_argument, NULL, 'm'},
+      {"payload", required_argument, NULL, 'p'},
+      {"batch", required_argument, NULL, 'b'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      path = optarg;
+      break;
+    case 'r':
+      rate = strtol(optarg, NULL, 10);
+      break;
+    case 'd':
+      duration = strtod(optarg, NULL);
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 10);
+      break;
+    case 'm':
+      mix_spec = optarg;
+      break;
+    case 'p':
+      payload_len = strtol(optarg, NULL, 10);
+      break;
+    case 'b':
+      batch = strtol(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "%s", k_usage);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  static Mix mix;
+  if (rate < 0 || duration <= 0 || count < 0 || payload_len < 0 ||
+      payload_len > 3900 || batch <= 0 || batch > GATEWAY_CLIENT_BATCH_MAX) {
+    fprintf(stderr, "loadgen: invalid option value\n%s", k_usage);
+    return 1;
+  }
+  if (parse_mix(&mix, mix_spec) != 0) {
+    fprintf(stderr, "loadgen: bad --mix '%s'\n%s", mix_spec, k_usage);
+    return 1;
+  }
+  static uint8_t payload[GATEWAY_CLIENT_MAX_DGRAM];
+  memset(payload, 0xa5, sizeof(payload));
+  size_t plen = (size_t)payload_len;
+  if (encode_mix(&mix, payload, plen) != 0) {
+    fprintf(stderr, "loadgen: --payload %zu does not fit a datagram\n", plen);
+    return 1;
+  }
+
+  GatewayClient c;
+  if (gateway_client_open(&c, path) != 0) {
+    fprintf(stderr, "loadgen: connect failed: %s\n", strerror(errno));
+    return 1;
+  }
+  GatewayClientStats st;
+  if (gateway_client_get_stats(&c, true, &st, STATS_TIMEOUT_MS) != 0) {
+    fprintf(stderr, "loadgen: no stats reply: %s\n", strerror(errno));
+    gateway_client_close(&c);
+    return 1;
+  }
+  gateway_client_set_nonblocking(&c, true);
+
+  long offered = 0, dropped = 0;
+  uint64_t t0 = now_ns();
+  uint64_t end = t0 + (uint64_t)(duration * 1e9);
+  for (;;) {
+    uint64_t now = now_ns();
+    if (count ? offered >= count : now >= end) {
+      break;
+    }
+    long due = rate ? (long)((double)(now - t0) * (double)rate / 1e9) + 1
+                    : offered + batch;
+    if (count && due > count) {
+      due = count;
+    }
+    if (due > offered) {
+      long r = offer(&c, &mix, due - offered, (size_t)batch);
+      if (r < 0) {
+        break;
+      }
+      dropped += r;
+      offered = due;
+    }
+    if (rate) {
+      sleep_ns(TICK_NS);
+    }
+  }
+  double elapsed = (double)(now_ns() - t0) / 1e9;
+
+  gateway_client_set_nonblocking(&c, false);
+  int stats_rc = settle_stats(&c, &st);
+  gateway_client_close(&c);
+  if (stats_rc != 0) {
+    fprintf(stderr, "loadgen: no stats reply: %s\n", strerror(errno));
+    return 1;
+  }
+
+  // The settle requests themselves are datagrams the gateway received.
+  uint64_t ingested = st.rx_datagrams;
+  long delivered = offered - dropped;
+  if (ingested > (uint64_t)delivered) {
+    ingested = (uint64_t)delivered;
+  }
+  printf("rate=%ld mix=%s payload=%zu batch=%ld elapsed=%.3fs\n", rate,
+         mix_spec, plen, batch, elapsed);
+  printf("  offered=%ld (%.0f msg/s) kernel_drops=%ld (%.2f%%)\n", offered,
+         elapsed > 0 ? (double)offered / elapsed : 0.0, dropped,
+         offered ? 100.0 * (double)dropped / (double)offered : 0.0);
+  printf("  sent:");
+  for (int t = 0; t < MIX_TYPES; t++) {
+    if (mix.weight[t] > 0) {
+      printf(" %s=%ld", k_mix_names[t], mix.sent[t]);
+    }
+  }
+  printf("\n");
+  printf("  ingested=%" PRIu64 " (%.0f msg/s) published=%" PRIu64
+         " dispatch_errors=%" PRIu64 " rate_limited=%" PRIu64
+         " avg_batch=%.1f\n",
+         ingested, elapsed > 0 ? (double)ingested / elapsed : 0.0,
+         st.published, st.dispatch_errors, st.rate_limited,
+         st.rx_batches ? (double)st.rx_datagrams / (double)st.rx_batches
+                       : 0.0);
+  printf("  cpu_per_msg=%.0fns dispatch_mean=%.0fns p50<=%" PRIu64
+         "ns p90<=%" PRIu64 "ns p99<=%" PRIu64 "ns\n",
+         st.rx_datagrams ? (double)st.poll_cpu_ns / (double)st.rx_datagrams
+                         : 0.0,
+         st.rx_datagrams
+             ? (double)st.dispatch_ns_total / (double)st.rx_datagrams
+             : 0.0,
+         hist_percentile(&st, 50), hist_percentile(&st, 90),
+         hist_percentile(&st, 99));
+  return 0;
+}
@@ -0,0 +1,276 @@
+// bm_sbc_replay — replay a capture into a running node.
+//
+// Reads a pcap or pcapng file written by --pcap and sends its frames to a
+// node's virtual port socket in the VPD wire format ([port][frame]), so
+// each one reaches the node's callbacks->receive() on the port it was
+// recorded on.  Frames go out at their recorded spacing, scaled by
+// --speed, or back to back with --speed 0, and the run ends with the rate
+// achieved.
+//
+// pcapng captures carry the port (interface n is port n + 1) and the
+// direction; by default only inbound frames are replayed, since outbound
+// ones were the node's own.  Classic pcap has neither, so every frame is
+// sent on --port (default 1).
+//
+// Usage: bm_sbc_replay --node-id HEX [--socket-dir DIR] | --socket PATH
+//                      [--speed X] [--loop N] [--port N] [--dir in|out|all]
+//                      FILE
+
+#define _GNU_SOURCE
+#include "replay_capture.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char k_usage[] =
+    "Usage: bm_sbc_replay [options] FILE\n"
+    "  --node-id HEX     Node to inject into; its socket is\n"
+    "                    <socket-dir>/bm_sbc_<node-id>.sock\n"
+    "  --socket-dir DIR  (default: /tmp)\n"
+    "  --socket PATH     Socket to send to, instead of --node-id\n"
+    "  --speed X         Timing scale: 1 = as recorded, 2 = twice as fast,\n"
+    "                    0 = as fast as the node takes them (default: 1)\n"
+    "  --loop N          Play the capture N times (default: 1)\n"
+    "  --port N          Port for classic pcap frames, 1-15 (default: 1)\n"
+    "  --dir DIR         pcapng frames to send: in, out or all "
+    "(default: in)\n";
+
+// Largest --speed and --loop accepted.
+#define MAX_SPEED 1e6
+#define MAX_LOOPS 1000000
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Parse a whole-string node id in hex, with an optional "0x".
+static bool parse_node_id(const char *s, uint64_t *out) {
+  char *end = NULL;
+  errno = 0;
+  const unsigned long long v = strtoull(s, &end, 16);
+  // strtoull() would take leading blanks and a minus sign.
+  if (!isxdigit((unsigned char)*s) || *end != '\0' || errno == ERANGE) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+// Parse a whole-string decimal in [min, max].  Returns -1 on failure.
+static long parse_long(const char *s, long min, long max) {
+  char *end = NULL;
+  errno = 0;
+  const long v = strtol(s, &end, 10);
+  if (!*s || *end != '\0' || errno == ERANGE || v < min || v > max) {
+    return -1;
+  }
+  return v;
+}
+
+// Parse a --speed scale in [0, MAX_SPEED].  Returns -1 on failure.
+static double parse_speed(const char *s) {
+  char *end = NULL;
+  errno = 0;
+  const double v = strtod(s, &end);
+  // The comparison is false for NaN, so NaN is rejected too.
+  if (!*s || *end != '\0' || errno == ERANGE || !(v >= 0 && v <= MAX_SPEED)) {
+    return -1;
+  }
+  return v;
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = NULL;
+  const char *socket_dir = "/tmp";
+  uint64_t node_id = 0;
+  bool node_id_set = false;
+  double speed = 1.0;
+  long loops = 1;
+  long port = 1;
+  int dirs = REPLAY_DIR_IN;
+
+  static const struct option long_opts[] = {
+      {"node-id", required_argument, NULL, 'n'},
+      {"socket-dir", required_argument, NULL, 'D'},
+      {"socket", required_argument, NULL, 's'},
+      {"speed", required_argument, NULL, 'x'},
+      {"loop", required_argument, NULL, 'l'},
+      {"port", required_argument, NULL, 'p'},
+      {"dir", required_argument, NULL, 'd'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (opt) {
+    case 'n':
+      if (!parse_node_id(optarg, &node_id)) {
+        fprintf(stderr, "replay: bad --node-id '%s'\n", optarg);
+        return 1;
+      }
+      node_id_set = true;
+      break;
+    case 'D':
+      socket_dir = optarg;
+      break;
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'x':
+      speed = parse_speed(optarg);
+      if (speed < 0) {
+        fprintf(stderr, "replay: bad --speed '%s' (0-%g)\n", optarg,
+                MAX_SPEED);
+        return 1;
+      }
+      break;
+    case 'l':
+      loops = parse_long(optarg, 1, MAX_LOOPS);
+      if (loops < 0) {
+        fprintf(stderr, "replay: bad --loop '%s' (1-%d)\n", optarg,
+                MAX_LOOPS);
+        return 1;
+      }
+      break;
+    case 'p':
+      port = parse_long(optarg, 1, REPLAY_MAX_PORT);
+      if (port < 0) {
+        fprintf(stderr, "replay: bad --port '%s' (1-%d)\n", optarg,
+                REPLAY_MAX_PORT);
+        return 1;
+      }
+      break;
+    case 'd':
+      dirs = strcmp(optarg, "in") == 0    ? REPLAY_DIR_IN
+             : strcmp(optarg, "out") == 0 ? REPLAY_DIR_OUT
+             : strcmp(optarg, "all") == 0 ? REPLAY_DIR_ALL
+                                          : -1;
+      break;
+    default:
+      fprintf(stderr, "%s", k_usage);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind != argc - 1 || (!socket_path && !node_id_set) || dirs < 0) {
+    fprintf(stderr, "replay: invalid arguments\n%s", k_usage);
+    return 1;
+  }
+  const char *file = argv[optind];
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  int n = socket_path
+              ? snprintf(addr.sun_path, sizeof(addr.sun_path), "%s",
+                         socket_path)
+              : snprintf(addr.sun_path, sizeof(addr.sun_path),
+                         "%s/bm_sbc_%016" PRIx64 ".sock", socket_dir,
+                         node_id);
+  if (n < 0 || (size_t)n >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "replay: socket path too long\n");
+    return 1;
+  }
+
+  const int fd = open(file, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < 24) {
+    fprintf(stderr, "replay: cannot read %s\n", file);
+    return 1;
+  }
+  const size_t len = (size_t)st.st_size;
+  const uint8_t *buf =
+      (const uint8_t *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED) {
+    fprintf(stderr, "replay: mmap %s: %s\n", file, strerror(errno));
+    return 1;
+  }
+
+  ReplayFrameList frames = {0};
+  const int rc = replay_capture_load(&frames, buf, len, (uint8_t)port, dirs);
+  if (rc == -EINVAL) {
+    fprintf(stderr, "replay: %s is not pcap or pcapng\n", file);
+    return 1;
+  }
+  if (rc != 0 || frames.count == 0) {
+    fprintf(stderr, "replay: no frames to send from %s\n", file);
+    return 1;
+  }
+
+  const int sfd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sfd < 0) {
+    fprintf(stderr, "replay: socket: %s\n", strerror(errno));
+    return 1;
+  }
+
+  // Blocking sends: at --speed 0 the node's receive queue paces the run,
+  // so the rate reported is the rate the node kept up with.
+  uint8_t dgram[1 + REPLAY_MAX_FRAME];
+  uint64_t sent = 0, bytes = 0, errors = 0, late_max = 0;
+  const uint64_t t0 = now_ns();
+  for (long loop = 0; loop < loops; loop++) {
+    const uint64_t loop_t0 = now_ns();
+    const uint64_t first_ts = frames.frames[0].ts_ns;
+    for (size_t i = 0; i < frames.count; i++) {
+      const ReplayFrame *f = &frames.frames[i];
+      if (speed > 0) {
+        const uint64_t rel =
+            f->ts_ns > first_ts ? f->ts_ns - first_ts : 0;
+        const uint64_t due = loop_t0 + (uint64_t)((double)rel / speed);
+        if (due > now_ns()) {
+          struct timespec ts = {(time_t)(due / 1000000000ull),
+                                (long)(due % 1000000000ull)};
+          clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        const uint64_t now = now_ns();
+        if (now > due && now - due > late_max) {
+          late_max = now - due;
+        }
+      }
+      dgram[0] = f->port;
+      memcpy(dgram + 1, f->data, f->len);
+      if (sendto(sfd, dgram, 1 + f->len, 0, (struct sockaddr *)&addr,
+                 sizeof(addr)) < 0) {
+        if (errno == ENOENT || errno == ECONNREFUSED) {
+          fprintf(stderr, "replay: %s: %s\n", addr.sun_path, strerror(errno));
+          return 1;
+        }
+        errors++;
+        continue;
+      }
+      sent++;
+      bytes += f->len;
+    }
+  }
+  const double elapsed = (double)(now_ns() - t0) / 1e9;
+  close(sfd);
+
+  printf("file=%s frames=%zu skipped=%zu speed=%g loops=%ld\n", file,
+         frames.count, frames.skipped, speed, loops);
+  printf("  sent=%" PRIu64 " errors=%" PRIu64 " elapsed=%.3fs\n", sent,
+         errors, elapsed);
+  printf("  rate=%.0f frames/s %.2f Mbit/s", elapsed > 0 ? sent / elapsed : 0,
+         elapsed > 0 ? (double)bytes * 8 / elapsed / 1e6 : 0.0);
+  if (speed > 0) {
+    printf(" max_late=%.3fms", (double)late_max / 1e6);
+  }
+  printf("\n");
+  replay_capture_free(&frames);
+  munmap((void *)buf, len);
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include "replay_capture.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pcap / pcapng, either byte order.
+#define PCAP_MAGIC_US 0xa1b2c3d4u
+#define PCAP_MAGIC_NS 0xa1b23c4du
+#define PCAP_HDR_LEN 24
+#define NG_SHB 0x0a0d0d0au
+#define NG_IDB 0x00000001u
+#define NG_EPB 0x00000006u
+#define NG_BYTE_ORDER_MAGIC 0x1a2b3c4du
+#define NG_OPT_IF_TSRESOL 9
+#define NG_OPT_EPB_FLAGS 2
+#define NG_MAX_IFACES 64
+
+static uint32_t rd32(const uint8_t *p, bool swap) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t rd16(const uint8_t *p, bool swap) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap ? __builtin_bswap16(v) : v;
+}
+
+static int add_frame(ReplayFrameList *l, uint64_t ts_ns, uint8_t port,
+                     const uint8_t *data, uint32_t len) {
+  if (port < 1 || port > REPLAY_MAX_PORT || len < REPLAY_MIN_FRAME ||
+      len > REPLAY_MAX_FRAME) {
+    l->skipped++;
+    return 0;
+  }
+  if (l->count == l->cap) {
+    size_t cap = l->cap ? l->cap * 2 : 1024;
+    ReplayFrame *f =
+        (ReplayFrame *)realloc(l->frames, cap * sizeof(ReplayFrame));
+    if (!f) {
+      return -ENOMEM;
+    }
+    l->frames = f;
+    l->cap = cap;
+  }
+  l->frames[l->count++] = (ReplayFrame){ts_ns, data, len, port};
+  return 0;
+}
+
+// Classic pcap: 24-byte global header, then 16-byte record headers.
+static int load_pcap(ReplayFrameList *l, const uint8_t *buf, size_t len,
+                     uint8_t port) {
+  const uint32_t magic = rd32(buf, false);
+  const bool swap = magic == __builtin_bswap32(PCAP_MAGIC_US) ||
+                    magic == __builtin_bswap32(PCAP_MAGIC_NS);
+  const bool ns = rd32(buf, swap) == PCAP_MAGIC_NS;
+  size_t off = PCAP_HDR_LEN;
+  while (off + 16 <= len) {
+    const uint64_t sec = rd32(buf + off, swap);
+    const uint64_t frac = rd32(buf + off + 4, swap);
+    const uint32_t incl = rd32(buf + off + 8, swap);
+    const uint32_t orig = rd32(buf + off + 12, swap);
+    if (incl > len - off - 16) {
+      break; // Cut short, e.g. copied while still being written.
+    }
+    // A truncated frame would not be the frame the node saw.
+    if (incl != orig) {
+      l->skipped++;
+    } else if (add_frame(l, sec * 1000000000ull + (ns ? frac : frac * 1000),
+                         port, buf + off + 16, incl) != 0) {
+      return -ENOMEM;
+    }
+    off += 16 + incl;
+  }
+  return 0;
+}
+
+// Nanoseconds per tick for an if_tsresol value.
+static uint64_t tsresol_ns(uint8_t r) {
+  if (r & 0x80) {
+    const int e = r & 0x7f;
+    return e < 30 ? 1000000000ull >> e : 1; // 2^-e s, floored at 1 ns.
+  }
+  uint64_t div = 1;
+  for (int i = 0; i < r && div < 1000000000ull; i++) {
+    div *= 10;
+  }
+  return 1000000000ull / div;
+}
+
+// pcapng: SHB, IDBs, EPBs.  Other block types are skipped.
+static int load_pcapng(ReplayFrameList *l, const uint8_t *buf, size_t len,
+                       int dirs) {
+  uint64_t tick_ns[NG_MAX_IFACES];
+  uint32_t ifaces = 0;
+  bool swap = false;
+  size_t off = 0;
+  while (off + 12 <= len) {
+    uint32_t type = rd32(buf + off, swap);
+    if (type == NG_SHB) {
+      // Each section sets its own byte order and interfaces.
+      swap = rd32(buf + off + 8, false) != NG_BYTE_ORDER_MAGIC;
+      ifaces = 0;
+    }
+    const uint32_t total = rd32(buf + off + 4, swap);
+    if (total < 12 || total % 4 || total > len - off) {
+      break;
+    }
+    const uint8_t *b = buf + off;
+    if (type == NG_IDB && ifaces < NG_MAX_IFACES) {
+      uint64_t tick = 1000; // Microseconds unless if_tsresol says.
+      for (size_t o = 16; o + 4 <= total - 4;) {
+        const uint16_t code = rd16(b + o, swap);
+        const uint16_t olen = rd16(b + o + 2, swap);
+        if (code == 0 || o + 4 + olen > total - 4) {
+          break;
+        }
+        if (code == NG_OPT_IF_TSRESOL && olen >= 1) {
+          tick = tsresol_ns(b[o + 4]);
+        }
+        o += 4 + ((olen + 3u) & ~3u);
+      }
+      tick_ns[ifaces++] = tick;
+    } else if (type == NG_EPB && total >= 32) {
+      const uint32_t iface = rd32(b + 8, swap);
+      const uint64_t ts = ((uint64_t)rd32(b + 12, swap) << 32) |
+                          rd32(b + 16, swap);
+      const uint32_t cap = rd32(b + 20, swap);
+      const uint32_t orig = rd32(b + 24, swap);
+      if (28 + (size_t)cap + 4 > total) {
+        break;
+      }
+      int dir = 0;
+      for (size_t o = 28 + ((cap + 3u) & ~3u); o + 4 <= total - 4;) {
+        const uint16_t code = rd16(b + o, swap);
+        const uint16_t olen = rd16(b + o + 2, swap);
+        if (code == 0 || o + 4 + olen > total - 4) {
+          break;
+        }
+        if (code == NG_OPT_EPB_FLAGS && olen == 4) {
+          dir = (int)(rd32(b + o + 4, swap) & 3u);
+        }
+        o += 4 + ((olen + 3u) & ~3u);
+      }
+      // Frames with no direction recorded are always sent.
+      if (iface >= ifaces || cap != orig || (dir != 0 && !(dir & dirs))) {
+        l->skipped++;
+      } else if (add_frame(l, ts * tick_ns[iface], (uint8_t)(iface + 1),
+                           b + 28, cap) != 0) {
+        return -ENOMEM;
+      }
+    }
+    off += total;
+  }
+  return 0;
+}
+
+int replay_capture_load(ReplayFrameList *l, const uint8_t *buf, size_t len,
+                        uint8_t port, int dirs) {
+  if (len < PCAP_HDR_LEN) {
+    return -EINVAL;
+  }
+  const uint32_t magic = rd32(buf, false);
+  if (magic == NG_SHB) {
+    return load_pcapng(l, buf, len, dirs);
+  }
+  if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+      magic == __builtin_bswap32(PCAP_MAGIC_US) ||
+      magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+    return load_pcap(l, buf, len, port);
+  }
+  return -EINVAL;
+}
+
+void replay_capture_free(ReplayFrameList *l) {
+  free(l->frames);
+  memset(l, 0, sizeof(*l));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/// @file replay_capture.h
+/// @brief Frames of a pcap or pcapng capture, for bm_sbc_replay.
+///
+/// The capture is parsed in place: each frame points into the caller's
+/// buffer, which must outlive the list.  pcapng captures carry the port
+/// (interface n is port n + 1) and the direction, and only frames in one of
+/// the requested directions are kept; classic pcap has neither, so every
+/// frame gets the caller's port.  Frames the virtual port device could not
+/// carry (bad port, runt or oversized, truncated by the capture) are
+/// counted in @c skipped.  A capture cut short, e.g. copied while still
+/// being written, yields the frames before the cut.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Same limits as the virtual port device's wire format.
+#define REPLAY_MAX_PORT 15
+#define REPLAY_MAX_FRAME 1514
+#define REPLAY_MIN_FRAME 14
+
+/// pcapng directions to keep; frames with none recorded are always kept.
+enum { REPLAY_DIR_IN = 1, REPLAY_DIR_OUT = 2, REPLAY_DIR_ALL = 3 };
+
+typedef struct {
+  uint64_t ts_ns;
+  const uint8_t *data;
+  uint32_t len;
+  uint8_t port;
+} ReplayFrame;
+
+typedef struct {
+  ReplayFrame *frames;
+  size_t count;
+  size_t cap;
+  size_t skipped; ///< Wrong direction, bad port or size.
+} ReplayFrameList;
+
+/// Append the frames of the capture in [@p buf, @p buf + @p len) to @p l,
+/// which starts zeroed.
+/// @param port  Port for classic pcap frames.
+/// @param dirs  REPLAY_DIR_* mask for pcapng frames.
+/// @return 0, -EINVAL if @p buf is not pcap or pcapng, or -ENOMEM.
+int replay_capture_load(ReplayFrameList *l, const uint8_t *buf, size_t len,
+                        uint8_t port, int dirs);
+
+/// Free the list's storage; the frames' data belongs to the caller.
+void replay_capture_free(ReplayFrameList *l);
+
+#ifdef __cplusplus
+}
+#endif
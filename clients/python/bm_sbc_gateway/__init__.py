@@ -20,13 +20,18 @@ Example::
     spotter_log("boot complete", file_name="system.log", print_timestamp=True)
     config_set("wifi_ssid", "mynet")
     replay_caught_up()
+
+    with Subscriber(["spotter/utc-time"]) as sub:
+        for msg in sub:
+            print(msg["topic"], msg["data"])
 """
 
 from __future__ import annotations
 
 import os
 import socket
-from typing import Any, Optional
+import tempfile
+from typing import Any, Iterable, Iterator, Optional
 
 import cbor2
 
@@ -34,7 +39,9 @@ __all__ = [
     "DEFAULT_SOCKET_PATH",
     "SCHEMA_VERSION",
     "Client",
+    "Subscriber",
     "config_set",
+    "config_set_batch",
     "replay_caught_up",
     "sensor_data",
     "spotter_log",
@@ -51,11 +58,31 @@ class Client:
     Prefer a single `Client` instance over the module-level helpers
     when sending many messages —
     it avoids re-opening the socket every call.
+
+    With `ack=True` every message carries a `req_id`,
+    and each call blocks until the gateway's `ack` arrives and returns it
+    as a dict with `status` (0 or a positive errno-style code)
+    and `credits`.
+    The latest advertised window is also kept in `credits`.
     """
 
-    def __init__(self, socket_path: str = DEFAULT_SOCKET_PATH) -> None:
+    def __init__(
+        self,
+        socket_path: str = DEFAULT_SOCKET_PATH,
+        ack: bool = False,
+        ack_timeout: float = 1.0,
+        sock: Optional[socket.socket] = None,
+    ) -> None:
         self._path = socket_path
-        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self._sock = sock or socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self._ack = ack
+        self._next_req_id = 1
+        self.credits: Optional[int] = None
+        if ack:
+            if not self._sock.getsockname():
+                # Autobind to an abstract address so the gateway can reply.
+                self._sock.bind("")
+            self._sock.settimeout(ack_timeout)
 
     def close(self) -> None:
         """Close the underlying socket."""
@@ -67,20 +94,72 @@ class Client:
     def __exit__(self, *exc_info: object) -> None:
         self.close()
 
-    def _send(self, message: dict[str, Any]) -> None:
+    def _send(self, message: dict[str, Any]) -> Optional[dict[str, Any]]:
         message["v"] = SCHEMA_VERSION
+        if not self._ack:
+            self._sock.sendto(cbor2.dumps(message), self._path)
+            return None
+        req_id = self._next_req_id
+        self._next_req_id += 1
+        message["req_id"] = req_id
         self._sock.sendto(cbor2.dumps(message), self._path)
-
-    def replay_caught_up(self) -> None:
+        while True:
+            reply = cbor2.loads(self._sock.recv(4096))
+            if reply.get("type") == "ack" and reply.get("req_id") == req_id:
+                self.credits = reply.get("credits")
+                return reply
+
+    def _query(self, message: dict[str, Any], reply_type: str) -> dict[str, Any]:
+        """Send a request and wait for the gateway's reply of `reply_type`."""
+        if not self._sock.getsockname():
+            self._sock.bind("")
+        if self._sock.gettimeout() is None:
+            self._sock.settimeout(1.0)
+        message["v"] = SCHEMA_VERSION
+        self._sock.sendto(cbor2.dumps(message), self._path)
+        while True:
+            reply = cbor2.loads(self._sock.recv(4096))
+            if reply.get("type") == reply_type:
+                return reply
+
+    def stats(self, reset: bool = False) -> dict[str, Any]:
+        """Return the gateway's ingestion counters (see `stats` in the docs)."""
+        msg: dict[str, Any] = {"type": "stats"}
+        if reset:
+            msg["reset"] = True
+        return self._query(msg, "stats")
+
+    def clients(self) -> list[dict[str, Any]]:
+        """Return per-client admission counters: `pid`, `uid`, `accepted`,
+        `dropped` and `limited` for each sender the gateway is tracking."""
+        return self._query({"type": "clients"}, "clients")["clients"]
+
+    def log_level(
+        self, level: Optional[str] = None, modules: Optional[str] = None
+    ) -> Optional[dict[str, Any]]:
+        """Change the gateway's log levels without a restart.
+
+        `level` is the global level name ("trace" ... "fatal").
+        `modules` is "module=level,...", e.g. "vpd=debug";
+        "module=default" returns a module to the global level.
+        """
+        msg: dict[str, Any] = {"type": "log_level"}
+        if level is not None:
+            msg["level"] = level
+        if modules is not None:
+            msg["modules"] = modules
+        return self._send(msg)
+
+    def replay_caught_up(self) -> Optional[dict[str, Any]]:
         """Signal that the upstream replay has caught up."""
-        self._send({"type": "replay_caught_up"})
+        return self._send({"type": "replay_caught_up"})
 
     def spotter_log(
         self,
         data: str,
         file_name: Optional[str] = None,
         print_timestamp: Optional[bool] = None,
-    ) -> None:
+    ) -> Optional[dict[str, Any]]:
         """Append a line to a Spotter log, either SD card file or console.
 
         `data` is bounded by the gateway at 1024 bytes.
@@ -91,13 +170,13 @@ class Client:
             msg["file_name"] = file_name
         if print_timestamp is not None:
             msg["print_timestamp"] = print_timestamp
-        self._send(msg)
+        return self._send(msg)
 
     def spotter_tx(
         self,
         data: bytes,
         iridium_fallback: Optional[bool] = None,
-    ) -> None:
+    ) -> Optional[dict[str, Any]]:
         """Transmit a payload over the Spotter cell/satellite link.
 
         `iridium_fallback=True` enables Iridium fallback on top of cellular;
@@ -106,16 +185,18 @@ class Client:
         msg: dict[str, Any] = {"type": "spotter_tx", "data": data}
         if iridium_fallback is not None:
             msg["iridium_fallback"] = iridium_fallback
-        self._send(msg)
+        return self._send(msg)
 
-    def config_set(self, config_key: str, config_value: Any) -> None:
+    def config_set(
+        self, config_key: str, config_value: Any
+    ) -> Optional[dict[str, Any]]:
         """Write a key-value pair into the local system config partition.
 
         The gateway infers the stored type from the CBOR wire type of `config_value`:
         text → STR, unsigned int → UINT32, negative int → INT32, float/double → FLOAT.
         Strings are capped at 48 bytes by the gateway.
         """
-        self._send(
+        return self._send(
             {
                 "type": "config_set",
                 "config_key": config_key,
@@ -123,7 +204,21 @@ class Client:
             }
         )
 
-    def sensor_data(self, topic_suffix: str, data: bytes) -> None:
+    def config_set_batch(
+        self, entries: dict[str, Any]
+    ) -> Optional[dict[str, Any]]:
+        """Write several key-value pairs and persist them with one save.
+
+        Types are inferred per value exactly as in `config_set`.
+        The gateway checks every entry before applying any,
+        so a single bad entry leaves the partition unchanged.
+        At most 32 entries, and the encoded message must fit one datagram.
+        """
+        return self._send({"type": "config_set_batch", "entries": dict(entries)})
+
+    def sensor_data(
+        self, topic_suffix: str, data: bytes
+    ) -> Optional[dict[str, Any]]:
         """Publish sensor data on the Bristlemouth pub-sub network.
 
         Published topic is `sensor/<node_id_hex16>/<topic_suffix>`.
@@ -135,7 +230,80 @@ class Client:
                 "topic_suffix must not begin with '/'; the gateway inserts "
                 "the separator between the node ID and the suffix"
             )
-        self._send({"type": "sensor_data", "topic_suffix": topic_suffix, "data": data})
+        return self._send(
+            {"type": "sensor_data", "topic_suffix": topic_suffix, "data": data}
+        )
+
+    def subscribe(self, topic: str) -> Optional[dict[str, Any]]:
+        """Ask the gateway to push messages published on `topic`.
+
+        Pushes arrive as `pubsub` datagrams on this client's own socket,
+        which must be bound to a filesystem path (pass it as `sock`);
+        see `Subscriber` for a ready-made receiver.
+        Topics match exactly — there are no wildcards.
+        """
+        return self._send({"type": "subscribe", "topic": topic})
+
+    def unsubscribe(self, topic: Optional[str] = None) -> Optional[dict[str, Any]]:
+        """Stop pushes for `topic`, or for every topic when omitted."""
+        msg: dict[str, Any] = {"type": "unsubscribe"}
+        if topic is not None:
+            msg["topic"] = topic
+        return self._send(msg)
+
+
+class Subscriber:
+    """Bound receive socket plus its gateway subscriptions.
+
+    Iterating yields each decoded `pubsub` message as a dict with
+    `topic`, `node_id`, `data` and `dropped` keys.
+    `dropped` counts messages the gateway discarded for this subscriber
+    because it was not reading fast enough.
+    Closing (or leaving the `with` block) unsubscribes and removes the socket.
+    """
+
+    def __init__(
+        self,
+        topics: Iterable[str],
+        socket_path: Optional[str] = None,
+        timeout: Optional[float] = None,
+    ) -> None:
+        if socket_path is None:
+            socket_path = os.environ.get("BM_SBC_GATEWAY_IPC", DEFAULT_SOCKET_PATH)
+        self._dir = tempfile.mkdtemp(prefix="bm_sbc_sub_")
+        self.reply_path = os.path.join(self._dir, "sub.sock")
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self._sock.bind(self.reply_path)
+        self._sock.settimeout(timeout)
+        # The gateway pushes to the socket a subscribe comes from, so the
+        # requests go out on the receive socket itself.
+        self._client = Client(socket_path, sock=self._sock)
+        for topic in topics:
+            self._client.subscribe(topic)
+
+    def recv(self) -> dict[str, Any]:
+        """Block until the next `pubsub` message (or the timeout) arrives."""
+        while True:
+            msg = cbor2.loads(self._sock.recv(65536))
+            if msg.get("type") == "pubsub":
+                return msg
+
+    def __iter__(self) -> Iterator[dict[str, Any]]:
+        while True:
+            yield self.recv()
+
+    def close(self) -> None:
+        """Unsubscribe from every topic and remove the receive socket."""
+        self._client.unsubscribe()
+        self._client.close()
+        os.unlink(self.reply_path)
+        os.rmdir(self._dir)
+
+    def __enter__(self) -> "Subscriber":
+        return self
+
+    def __exit__(self, *exc_info: object) -> None:
+        self.close()
 
 
 _default_client_instance: Optional[Client] = None
@@ -171,3 +339,7 @@ def sensor_data(topic_suffix: str, data: bytes) -> None:
 
 def config_set(config_key: str, config_value: Any) -> None:
     _default_client().config_set(config_key, config_value)
+
+
+def config_set_batch(entries: dict[str, Any]) -> None:
+    _default_client().config_set_batch(entries)
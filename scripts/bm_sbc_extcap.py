@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Wireshark extcap interface for bm_sbc live capture sockets.
+
+Install by copying (or linking) this file into Wireshark's personal extcap
+directory, e.g. ~/.local/lib/wireshark/extcap/ (see Help > About >
+Folders), and making it executable.  Every bm_sbc node started with
+--pcap-live <dir>/<name>.pcap.sock then shows up as a capture interface.
+
+The directories searched are $BM_SBC_EXTCAP_DIRS (colon-separated),
+default /tmp:/run/bm_sbc.  A node on another machine can be reached by
+forwarding its socket first:
+
+    ssh -N -L /tmp/node1.pcap.sock:/tmp/bm_sbc_gateway.pcap.sock host
+
+The node sends a pcap or pcapng stream, whichever --pcap-format selects;
+this script only copies it into the FIFO Wireshark reads.
+"""
+
+import argparse
+import glob
+import os
+import signal
+import socket
+import sys
+
+VERSION = "1.0"
+SUFFIX = ".pcap.sock"
+DEFAULT_DIRS = "/tmp:/run/bm_sbc"
+
+
+def sockets():
+    dirs = os.environ.get("BM_SBC_EXTCAP_DIRS", DEFAULT_DIRS)
+    found = []
+    for d in dirs.split(":"):
+        if d:
+            found.extend(sorted(glob.glob(os.path.join(d, "*" + SUFFIX))))
+    return found
+
+
+def list_interfaces():
+    print("extcap {version=%s}{help=https://github.com/bristlemouth/bm_sbc}"
+          % VERSION)
+    for path in sockets():
+        name = os.path.basename(path)[: -len(SUFFIX)]
+        print("interface {value=%s}{display=bm_sbc %s}" % (path, name))
+
+
+def list_dlts():
+    # pcapng carries its own link types; classic pcap is Ethernet.
+    print("dlt {number=1}{name=EN10MB}{display=Ethernet}")
+
+
+def capture(path, fifo):
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        s.connect(path)
+    except OSError as e:
+        sys.stderr.write("cannot connect to %s: %s\n" % (path, e))
+        return 1
+    # Wireshark stops a capture with SIGTERM.
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    with open(fifo, "wb", buffering=0) as out:
+        while True:
+            data = s.recv(65536)
+            if not data:
+                # The node exited, or refused us (another client is
+                # attached).
+                return 0
+            try:
+                out.write(data)
+            except BrokenPipeError:
+                return 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--extcap-interfaces", action="store_true")
+    ap.add_argument("--extcap-interface")
+    ap.add_argument("--extcap-dlts", action="store_true")
+    ap.add_argument("--extcap-config", action="store_true")
+    ap.add_argument("--extcap-version")
+    ap.add_argument("--capture", action="store_true")
+    ap.add_argument("--fifo")
+    ap.add_argument("--extcap-capture-filter")
+    args, _ = ap.parse_known_args()
+
+    if args.extcap_interfaces:
+        list_interfaces()
+        return 0
+    if args.extcap_config:
+        return 0  # No options.
+    if args.extcap_dlts:
+        list_dlts()
+        return 0
+    if args.capture:
+        if not args.extcap_interface or not args.fifo:
+            sys.stderr.write("--capture needs --extcap-interface and --fifo\n")
+            return 1
+        return capture(args.extcap_interface, args.fifo)
+    ap.print_help()
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""Render a bm_trace binary trace file as bm_log text lines.
+
+Usage: bm_trace_decode.py [--follow] FILE
+
+Each record comes out in the same layout as the .log files:
+
+    2024-01-15T10:30:45.123456Z TRACE [gateway node=0x0123456789abcdef] ...
+
+The file can be copied off a device, or read in place while the process
+is still writing it.  With --follow, keep printing new records until
+interrupted.
+
+The argument parser mirrors site_parse() in src/core/bm_trace.c.
+"""
+
+import argparse
+import datetime
+import mmap
+import re
+import struct
+import sys
+import time
+
+MAGIC = b"BMTRACE1"
+HEADER = struct.Struct("<8sII Q 32s QQQ QQ QQ")
+REC_HDR = struct.Struct("<IHHQQ")
+REC_EVENT = 1
+
+SPEC = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<prec>\*|\d*))?"
+    r"(?P<len>hh|h|ll|l|z|j|t|L)?(?P<conv>[diouxXceEfFgGaAspn%])"
+)
+
+
+class Header:
+    def __init__(self, buf):
+        (magic, version, _hdr_bytes, self.node_id, app, self.strtab_off,
+         _strtab_bytes, self.strtab_used, self.ring_off, self.ring_bytes,
+         self.head, self.tail) = HEADER.unpack_from(buf, 0)
+        if magic != MAGIC:
+            raise ValueError("not a bm_trace file")
+        if version != 1:
+            raise ValueError("unsupported bm_trace version %d" % version)
+        self.app = app.split(b"\0", 1)[0].decode(errors="replace")
+
+
+def read_strtab(buf, hdr):
+    fmts = {}
+    off = hdr.strtab_off
+    end = hdr.strtab_off + hdr.strtab_used
+    while off + 16 <= end:
+        addr, length, _ = struct.unpack_from("<QII", buf, off)
+        fmts[addr] = bytes(buf[off + 16:off + 16 + length]).decode(
+            errors="replace")
+        off += (16 + length + 7) & ~7
+    return fmts
+
+
+class Args:
+    """Reads a record's argument fields in order."""
+
+    def __init__(self, data):
+        self.data = data
+        self.off = 0
+
+    def _fixed(self, fmt):
+        if self.off + 8 > len(self.data):
+            return None
+        (v,) = struct.unpack_from(fmt, self.data, self.off)
+        self.off += 8
+        return v
+
+    def int(self, signed):
+        return self._fixed("<q" if signed else "<Q")
+
+    def double(self):
+        return self._fixed("<d")
+
+    def bytes(self):
+        if self.off + 4 > len(self.data):
+            return None, 0
+        copy, full = struct.unpack_from("<HH", self.data, self.off)
+        raw = bytes(self.data[self.off + 4:self.off + 4 + copy])
+        self.off = (self.off + 4 + copy + 7) & ~7
+        return raw, full
+
+
+def render(fmt, args):
+    out = []
+    pos = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group("conv")
+        if conv == "%":
+            out.append("%")
+            continue
+        width = m.group("width")
+        prec = m.group("prec")
+        if width == "*":
+            width = args.int(True)
+        if prec == "*":
+            prec = args.int(True)
+        spec = "%" + m.group("flags")
+        if width is not None:
+            spec += str(width)
+        if prec is not None:
+            spec += "." + str(prec)
+
+        if conv == "p" and m.group("width") == "*" and fmt[pos:pos + 1] == "h":
+            pos += 1
+            raw, full = args.bytes()
+            if raw is None:
+                out.append("<?>")
+                continue
+            out.append(" ".join("%02x" % b for b in raw))
+            if full > len(raw):
+                out.append(" ...")
+            continue
+        if conv == "s":
+            raw, full = args.bytes()
+            if raw is None:
+                out.append("<?>")
+                continue
+            text = raw.decode(errors="replace")
+            if full > len(raw) and (prec is None or int(prec) > len(raw)):
+                text += "..."
+            out.append((spec + "s") % text)
+            continue
+        if conv in "eEfFgGaA":
+            v = args.double()
+            if v is None:
+                out.append("<?>")
+            elif conv in "aA":
+                out.append(float.hex(v))
+            else:
+                out.append((spec + conv) % v)
+            continue
+        if conv == "n":
+            out.append("<?>")
+            continue
+        v = args.int(conv in "di")
+        if v is None:
+            out.append("<?>")
+        elif conv == "p":
+            out.append("0x%x" % v)
+        elif conv == "c":
+            out.append((spec + "c") % chr(v & 0xff))
+        elif conv == "u":
+            out.append((spec + "d") % v)
+        else:
+            out.append((spec + conv) % v)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def timestamp(ns):
+    t = datetime.datetime.fromtimestamp(ns // 1000000000,
+                                        tz=datetime.timezone.utc)
+    return "%s.%06dZ" % (t.strftime("%Y-%m-%dT%H:%M:%S"),
+                         (ns % 1000000000) // 1000)
+
+
+def records(buf, hdr, start, end):
+    """Yield (ts_ns, fmt_addr, arg bytes) for the events in [start, end)."""
+    pos = start
+    while pos < end:
+        off = hdr.ring_off + pos % hdr.ring_bytes
+        # A pad record may be only its first 8 bytes.
+        length, rtype = struct.unpack_from("<IH", buf, off)
+        if length < 8 or length % 8 or length > hdr.ring_bytes:
+            raise ValueError("corrupt record at position %d" % pos)
+        if rtype == REC_EVENT:
+            _, _, _, ts, addr = REC_HDR.unpack_from(buf, off)
+            yield ts, addr, buf[off + REC_HDR.size:off + length]
+        pos += length
+
+
+def decode(buf, start):
+    """Print the records from position start on; return the new head."""
+    hdr = Header(buf)
+    # Records before the tail may have been overwritten.
+    start = max(start, hdr.tail)
+    fmts = read_strtab(buf, hdr)
+    prefix = "[%s node=0x%016x]" % (hdr.app, hdr.node_id)
+    for ts, addr, data in records(buf, hdr, start, hdr.head):
+        fmt = fmts.get(addr)
+        if fmt is None:
+            msg = "<format 0x%x not in table>" % addr
+        else:
+            msg = render(fmt, Args(data))
+        print("%s TRACE %s %s" % (timestamp(ts), prefix, msg))
+    return hdr.head
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("file")
+    ap.add_argument("--follow", action="store_true",
+                    help="keep printing new records")
+    opts = ap.parse_args()
+
+    with open(opts.file, "rb") as f:
+        buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        pos = decode(buf, 0)
+        while opts.follow:
+            sys.stdout.flush()
+            time.sleep(0.2)
+            pos = decode(buf, pos)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except (BrokenPipeError, KeyboardInterrupt):
+        pass
+    except ValueError as e:
+        sys.exit("bm_trace_decode: %s" % e)
@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+# scripts/gateway_ipc_bench.sh — gateway IPC ingestion benchmark
+#
+# Starts bm_sbc_ipc_test with the stub pubsub sink (BM_SBC_IPC_STUB_PUBSUB=1,
+# so sensor_data stops at the gateway instead of entering the Bristlemouth
+# stack) and sweeps bm_sbc_ipc_loadgen over a list of offered rates.  Each
+# row reports offered and ingested throughput, messages the kernel refused
+# (full socket queue), gateway CPU per message and dispatch latency
+# percentiles read back through the IPC `stats` message.
+#
+# Logging is held at warn so per-message "IPC RX" lines do not dominate the
+# measurement, and per-client rate limiting is off (BM_SBC_IPC_CLIENT_RATE=0)
+# so the sweep measures the gateway rather than the limiter.
+#
+# Usage: ./scripts/gateway_ipc_bench.sh [build_dir] [rate ...]
+#   BENCH_DURATION  seconds per rate (default: 3)
+#   BENCH_MIX       loadgen --mix spec (default: sensor_data=100)
+#   BENCH_PAYLOAD   payload bytes (default: 16)
+#   BENCH_BATCH     loadgen --batch (default: 16)
+
+set -euo pipefail
+
+REPO_ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="${1:-$REPO_ROOT/build/all}"
+shift || true
+RATES=("$@")
+if [[ ${#RATES[@]} -eq 0 ]]; then
+  RATES=(1000 10000 50000 100000 200000 0)
+fi
+DURATION="${BENCH_DURATION:-3}"
+MIX="${BENCH_MIX:-sensor_data=100}"
+PAYLOAD="${BENCH_PAYLOAD:-16}"
+BATCH="${BENCH_BATCH:-16}"
+
+SERVER="$BUILD_DIR/bm_sbc_ipc_test"
+LOADGEN="$BUILD_DIR/bm_sbc_ipc_loadgen"
+for bin in "$SERVER" "$LOADGEN"; do
+  if [[ ! -x "$bin" ]]; then
+    echo "Binary not found: $bin"
+    echo "Build with: cmake --preset all && cmake --build --preset all"
+    exit 1
+  fi
+done
+
+WORK=$(mktemp -d /tmp/bm_sbc_ipc_bench_XXXXXX)
+SOCK_PATH="$WORK/gateway_ipc.sock"
+LOG="$WORK/server.log"
+mkdir -p "$WORK/cfg"
+
+cleanup() {
+  [[ -n "${SERVER_PID:-}" ]] && kill "$SERVER_PID" 2>/dev/null || true
+  wait "$SERVER_PID" 2>/dev/null || true
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+BM_SBC_LOG_STDOUT=1 BM_SBC_LOG_LEVEL=warn BM_SBC_IPC_STUB_PUBSUB=1 \
+  BM_SBC_IPC_CLIENT_RATE=0 BM_SBC_GATEWAY_IPC="$SOCK_PATH" \
+  "$SERVER" --node-id 0x0000000000000001 \
+            --socket-dir "$WORK" \
+            --log-dir "$WORK/logs" \
+            --cfg-dir "$WORK/cfg" \
+            >"$LOG" 2>&1 &
+SERVER_PID=$!
+
+for _ in $(seq 1 30); do
+  if [[ -S "$SOCK_PATH" ]]; then break; fi
+  sleep 0.1
+done
+if [[ ! -S "$SOCK_PATH" ]]; then
+  echo "FAIL: server did not bind $SOCK_PATH"
+  cat "$LOG"
+  exit 1
+fi
+
+echo "=== gateway IPC ingestion: mix=$MIX payload=$PAYLOAD batch=$BATCH" \
+     "duration=${DURATION}s ==="
+printf "%10s %12s %12s %8s %10s %10s %8s %8s %8s\n" \
+  "rate" "offered/s" "ingested/s" "drop%" "published" "cpu/msg" \
+  "p50" "p90" "p99"
+
+# Pull "key=value" fields out of the loadgen report.
+field() { grep -oE "(^| )$1=[^ ]+" <<<"$2" | head -n1 | cut -d= -f2; }
+paren() { grep -oE "$1=[0-9]+ \([^)]*\)" <<<"$2" | head -n1 |
+          sed -E 's/.*\(([^ )]+).*/\1/'; }
+
+for rate in "${RATES[@]}"; do
+  out=$("$LOADGEN" --socket "$SOCK_PATH" --rate "$rate" \
+          --duration "$DURATION" --mix "$MIX" --payload "$PAYLOAD" \
+          --batch "$BATCH")
+  printf "%10s %12s %12s %8s %10s %10s %8s %8s %8s\n" \
+    "$([[ $rate -eq 0 ]] && echo max || echo "$rate")" \
+    "$(paren offered "$out")" \
+    "$(paren ingested "$out")" \
+    "$(paren kernel_drops "$out")" \
+    "$(field published "$out")" \
+    "$(field cpu_per_msg "$out")" \
+    "$(field 'p50<' "$out")" \
+    "$(field 'p90<' "$out")" \
+    "$(field 'p99<' "$out")"
+done
+
+if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+  echo "FAIL: bm_sbc_ipc_test exited during the run"
+  cat "$LOG"
+  exit 1
+fi
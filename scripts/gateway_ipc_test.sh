@@ -41,13 +41,14 @@ python -m pip install --quiet --disable-pip-version-check -r "$REQ_FILE"
 WORK=$(mktemp -d /tmp/bm_sbc_ipc_test_XXXXXX)
 SOCK_PATH="$WORK/gateway_ipc.sock"
 LOG="$WORK/server.log"
+ACK_LOG="$WORK/acks.log"
 CFG_DIR="$WORK/cfg"
 mkdir -p "$CFG_DIR"
 PASS=0; FAIL=0
 
 check() {
-  local desc="$1" pattern="$2"
-  if grep -qF "$pattern" "$LOG" 2>/dev/null; then
+  local desc="$1" pattern="$2" file="${3:-$LOG}"
+  if grep -qF "$pattern" "$file" 2>/dev/null; then
     echo "  PASS: $desc"
     PASS=$((PASS + 1))
   else
@@ -109,13 +110,17 @@ echo ""
 echo "=== Sending messages via Python client ==="
 PYTHONPATH="$REPO_ROOT/clients/python" \
 BM_SBC_GATEWAY_IPC="$SOCK_PATH" \
+ACK_LOG="$ACK_LOG" \
 python - <<'PY'
 import os
 import socket
+import tempfile
 
 import cbor2
 
 from bm_sbc_gateway import (
+    Client,
+    Subscriber,
     config_set,
     replay_caught_up,
     sensor_data,
@@ -149,6 +154,48 @@ sock.sendto(
     sock_path,
 )
 sock.close()
+
+# subscribe / unsubscribe round trip.  Delivery depends on the stack routing
+# local publishes back to local subscribers, so only registration is checked.
+with Subscriber(["sensor/deadbeefdeadbeef/echo"], socket_path=sock_path):
+    sensor_data("echo", b"\x01")
+
+# Acked requests: the handler's status comes back with a credit window.
+with Client(sock_path, ack=True) as acked, open(os.environ["ACK_LOG"], "w") as f:
+    ok = acked.config_set("acked_key", 1)
+    bad = acked.config_set("toolong", "x" * 60)
+    batch = acked.config_set_batch({"batch_a": 1, "batch_b": "two", "batch_c": -3})
+    # One bad entry must reject the whole batch before anything is applied.
+    bad_batch = acked.config_set_batch({"batch_ok": 5, "batch_bad": "x" * 60})
+    f.write(f"ack ok status={ok['status']} has_credits={ok['credits'] > 0}\n")
+    f.write(f"ack bad status={bad['status']}\n")
+    f.write(f"batch ok status={batch['status']}\n")
+    f.write(f"batch bad status={bad_batch['status']}\n")
+    # Per-client accounting keys on the kernel-supplied pid, so every socket
+    # this script opened counts toward one entry.
+    me = [c for c in acked.clients() if c["pid"] == os.getpid()]
+    f.write(f"clients self tracked={len(me) == 1} "
+            f"accepted={bool(me) and me[0]['accepted'] > 10} "
+            f"dropped={me[0]['dropped'] if me else -1}\n")
+
+# A client may not aim pushes at a socket it does not own, such as the
+# gateway's own, nor subscribe from an unbound socket.
+own_dir = tempfile.mkdtemp()
+own_path = os.path.join(own_dir, "own.sock")
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+sock.bind(own_path)
+sock.sendto(
+    cbor2.dumps(
+        {"v": 1, "type": "subscribe", "topic": "x", "reply_path": sock_path}
+    ),
+    sock_path,
+)
+sock.close()
+os.unlink(own_path)
+os.rmdir(own_dir)
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+sock.sendto(cbor2.dumps({"v": 1, "type": "subscribe", "topic": "x"}), sock_path)
+sock.close()
 PY
 
 # Give the server a moment to process all datagrams.
@@ -171,6 +218,22 @@ check "config_set oversized string rejected" "IPC config_set: string value too l
 check "config_set unsupported type rejected" "IPC config_set: unsupported config_value CBOR type"
 check "config_set missing key rejected"     "IPC config_set: missing/empty config_key"
 
+check "subscribe handled"                   "IPC RX subscribe topic='sensor/deadbeefdeadbeef/echo'"
+check "subscribe registered with stack"     "IPC sub: bm_sub(sensor/deadbeefdeadbeef/echo)"
+check "unsubscribe all topics"              "IPC RX unsubscribe topic='*'"
+check "unsubscribe released stack sub"      "IPC sub: bm_unsub(sensor/deadbeefdeadbeef/echo)"
+check "subscribe to a socket not owned rejected" "IPC subscribe: reply_path '$SOCK_PATH' is not the sender's socket"
+check "subscribe from unbound socket rejected" "IPC subscribe: sender is not bound to a socket path"
+check "acked config_set succeeded"          "ack ok status=0 has_credits=True"      "$ACK_LOG"
+check "acked config_set reports EINVAL"     "ack bad status=22"                     "$ACK_LOG"
+check "config_set_batch applied"            "IPC config_set_batch: 3 keys saved"
+check "config_set_batch entry logged"       "IPC config_set key='batch_b' value(str)='two'"
+check "config_set_batch bad entry rejected" "IPC config_set_batch: rejected at key='batch_bad'; nothing applied"
+check_absent "rejected batch not applied"   "key='batch_ok'"
+check "acked config_set_batch succeeded"    "batch ok status=0"                     "$ACK_LOG"
+check "acked bad config_set_batch EINVAL"   "batch bad status=22"                   "$ACK_LOG"
+check "clients reports this process"        "clients self tracked=True accepted=True dropped=0" "$ACK_LOG"
+
 check_absent "no save_config failures"      "save_config failed"
 
 if [[ -s "$CFG_DIR/config.sys.bin" ]]; then
@@ -1,6 +1,79 @@
 #include "app_runner.h"
+#include "bm_log.h"
 
-#include <time.h>
+#include <atomic>
+#include <poll.h>
+#include <pthread.h>
+
+static pthread_once_t s_runner_once = PTHREAD_ONCE_INIT;
+static std::atomic<ProcessRunner *> s_runner{nullptr};
+
+static void create_runner(void) { s_runner = process_runner_create(nullptr); }
+
+// Descriptors that end the wait between loop() calls early.
+struct WatchedFd {
+  int fd;
+  BmSbcAppFdFn fn;
+  void *ctx;
+  uint32_t gen; ///< Tells a re-watched descriptor number apart.
+};
+static WatchedFd s_watched[BM_SBC_APP_MAX_WATCHED_FDS];
+static size_t s_num_watched = 0;
+static uint32_t s_watch_gen = 0;
+
+bool bm_sbc_app_watch_fd(int fd, BmSbcAppFdFn fn, void *ctx) {
+  if (s_num_watched == BM_SBC_APP_MAX_WATCHED_FDS) {
+    return false;
+  }
+  s_watched[s_num_watched++] = WatchedFd{fd, fn, ctx, ++s_watch_gen};
+  return true;
+}
+
+void bm_sbc_app_unwatch_fd(int fd) {
+  for (size_t i = 0; i < s_num_watched; i++) {
+    if (s_watched[i].fd == fd) {
+      s_watched[i] = s_watched[--s_num_watched];
+      return;
+    }
+  }
+}
+
+// True if @p w has not been unwatched since it was copied.
+static bool still_watched(const WatchedFd &w) {
+  for (size_t i = 0; i < s_num_watched; i++) {
+    if (s_watched[i].fd == w.fd && s_watched[i].gen == w.gen) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Wait up to 1 ms, returning early for a watched descriptor.
+static void wait_between_loops(void) {
+  struct pollfd fds[BM_SBC_APP_MAX_WATCHED_FDS];
+  WatchedFd watched[BM_SBC_APP_MAX_WATCHED_FDS];
+  const size_t n = s_num_watched;
+  for (size_t i = 0; i < n; i++) {
+    watched[i] = s_watched[i];
+    fds[i] = pollfd{watched[i].fd, POLLIN, 0};
+  }
+  if (poll(fds, n, 1) <= 0) {
+    return;
+  }
+  // A callback may unwatch descriptors, so run them from the copy, and
+  // skip any unwatched since: its number may already belong to another
+  // descriptor watched in its place.
+  for (size_t i = 0; i < n; i++) {
+    if (fds[i].revents && still_watched(watched[i])) {
+      watched[i].fn(watched[i].fd, watched[i].ctx);
+    }
+  }
+}
+
+ProcessRunner *bm_sbc_process_runner(void) {
+  pthread_once(&s_runner_once, create_runner);
+  return s_runner;
+}
 
 void bm_sbc_app_run(void) {
   setup();
@@ -8,7 +81,15 @@ void bm_sbc_app_run(void) {
   // TODO: Replace with a proper scheduler-friendly cadence.
   for (;;) {
     loop();
-    struct timespec delay = {0, 1000000L}; // 1 ms yield
-    nanosleep(&delay, NULL);
+    // Only apps that have started a command pay for the poll.
+    ProcessRunner *runner = s_runner.load(std::memory_order_acquire);
+    if (runner) {
+      process_runner_poll(runner, 0);
+    }
+    // Re-read log levels on the loop thread after a SIGHUP.
+    bm_log_poll_reload();
+    // Summarise lines a rate limit held back once their window is over.
+    bm_log_ratelimit_flush();
+    wait_between_loops(); // 1 ms yield
   }
 }
@@ -8,7 +8,16 @@
 ///   void loop(void);
 ///
 /// The runner calls setup() once, then calls loop() repeatedly
-/// on a scheduler-friendly cadence.
+/// on a scheduler-friendly cadence.  Between loop() calls it also
+/// services the app's process runner, so completion callbacks for
+/// commands started with bm_sbc_process_runner() run on the loop thread,
+/// and it runs the log reload callback after a SIGHUP.
+///
+/// Between loop() calls the runner waits up to 1 ms.  File descriptors
+/// registered with bm_sbc_app_watch_fd() cut that wait short: once one is
+/// readable its callback runs and loop() is called straight away.
+
+#include "process_runner.h"
 
 /// App contract: called once at startup.
 extern void setup(void);
@@ -16,6 +25,24 @@ extern void setup(void);
 /// App contract: called repeatedly after setup().
 extern void loop(void);
 
+/// The app's shared process runner, created on first use.
+/// @return NULL if it could not be created.
+ProcessRunner *bm_sbc_process_runner(void);
+
+/// Most descriptors watched at once.
+#define BM_SBC_APP_MAX_WATCHED_FDS 8
+
+/// Called on the loop thread when a watched descriptor is readable; it
+/// must consume whatever made it readable.
+typedef void (*BmSbcAppFdFn)(int fd, void *ctx);
+
+/// Watch @p fd between loop() calls.  Loop thread only.
+/// @return false if BM_SBC_APP_MAX_WATCHED_FDS are already watched.
+bool bm_sbc_app_watch_fd(int fd, BmSbcAppFdFn fn, void *ctx);
+
+/// Stop watching @p fd.  Loop thread only.
+void bm_sbc_app_unwatch_fd(int fd);
+
 /// Run the app (calls setup once, then loop repeatedly).
 /// Does not return under normal operation.
 void bm_sbc_app_run(void);
@@ -4,17 +4,33 @@
 /// Writes OTEL-compatible semi-structured log lines to a per-process file
 /// in /var/log/bm_sbc/ (configurable).  Thread-safe via pthread mutex.
 /// Supports SIGHUP-based log rotation and optional stdout tee.
+///
+/// In asynchronous mode (bm_log_start_async()) each thread formats its
+/// line and copies it into its own single-producer ring; a writer thread
+/// merges the rings in call order and writes them out with writev().
+/// Callers never block on the file, the mutex or each other.
+///
+/// Every translation unit gets a BmLogModule from bm_log.h.  The first call
+/// from a module links it into s_modules and caches its effective level
+/// (its override, else the global level); after that a disabled call costs
+/// one load and a compare.
 
+#define _GNU_SOURCE
 #include "bm_log.h"
 
 #include <errno.h>
+#include <linux/futex.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -36,6 +52,74 @@ static const char *const k_level_names[] = {"TRACE", "DEBUG", "INFO ",
 
 #define BM_LOG_DEFAULT_DIR "/var/log/bm_sbc"
 #define BM_LOG_BUF_SIZE 1024
+#define BM_LOG_LINE_SIZE (BM_LOG_BUF_SIZE + 256)
+
+// ---------------------------------------------------------------------------
+// Asynchronous mode state
+// ---------------------------------------------------------------------------
+
+// Ring record: u32 length, u32 unused, u64 sequence, then the line, padded
+// to 8 bytes.  A length of REC_WRAP means "continue at the ring's start".
+#define REC_HDR 16u
+#define REC_WRAP UINT32_MAX
+#define RING_MIN_BYTES 4096u
+#define WRITE_BATCH 64
+
+typedef struct LogRing {
+  struct LogRing *next; // Guarded by s_rings_lock.
+  uint8_t *buf;
+  size_t cap;            // Power of two.
+  _Atomic size_t head;   // Bytes ever written; owned by the producer.
+  _Atomic size_t tail;   // Bytes ever released by the writer.
+  size_t cursor;         // Writer only: read position, ahead of tail.
+  size_t snap_head;      // Writer only: head as of this batch.
+  _Atomic bool orphaned; // The owning thread has exited.
+} LogRing;
+
+static pthread_mutex_t s_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static LogRing *s_rings = NULL;
+static pthread_key_t s_ring_key;
+static pthread_once_t s_ring_key_once = PTHREAD_ONCE_INIT;
+static __thread LogRing *t_ring = NULL;
+static __thread bool t_ring_unavailable = false;
+
+static _Atomic bool s_async = false;
+static bool s_writer_running = false; // Guarded by s_log_mutex.
+static pthread_t s_writer;
+static size_t s_ring_bytes = BM_LOG_ASYNC_DEFAULT_RING;
+static uint32_t s_flush_ms = BM_LOG_ASYNC_DEFAULT_FLUSH_MS;
+static _Atomic uint32_t s_wake = 0;
+static _Atomic bool s_writer_sleeping = false;
+static _Atomic bool s_writer_stop = false;
+static _Atomic uint64_t s_seq = 0;
+static _Atomic uint64_t s_pushed = 0;
+static _Atomic uint64_t s_written = 0;
+static _Atomic uint64_t s_dropped = 0;
+
+// ---------------------------------------------------------------------------
+// Module level state
+// ---------------------------------------------------------------------------
+
+#define MAX_MODULE_OVERRIDES 32
+
+typedef struct {
+  char name[BM_LOG_MODULE_NAME_MAX];
+  BmSbcLogLevel level;
+} ModuleOverride;
+
+static pthread_mutex_t s_modules_lock = PTHREAD_MUTEX_INITIALIZER;
+static BmLogModule *s_modules = NULL; // Registered modules.
+static ModuleOverride s_overrides[MAX_MODULE_OVERRIDES];
+static size_t s_num_overrides = 0;
+
+static pthread_mutex_t s_rl_lock = PTHREAD_MUTEX_INITIALIZER;
+static BmLogRateLimit *s_rl_sites = NULL; // Sites that have suppressed.
+static uint32_t s_rl_burst = BM_LOG_RATELIMIT_DEFAULT_BURST;
+static uint32_t s_rl_window_ms = BM_LOG_RATELIMIT_DEFAULT_WINDOW_MS;
+
+static volatile sig_atomic_t s_hup_count = 0;
+static unsigned s_hup_seen = 0;
+static void (*s_reload_cb)(void) = NULL;
 
 // ---------------------------------------------------------------------------
 // SIGHUP handler
@@ -44,6 +128,7 @@ static const char *const k_level_names[] = {"TRACE", "DEBUG", "INFO ",
 static void sighup_handler(int sig) {
   (void)sig;
   s_reopen_flag = 1;
+  s_hup_count = s_hup_count + 1;
 }
 
 // ---------------------------------------------------------------------------
@@ -53,18 +138,44 @@ static void sighup_handler(int sig) {
 /// Format the current UTC time with microsecond precision into buf.
 /// Returns the number of chars written (excluding NUL), or 0 on failure.
 static int format_timestamp(char *buf, size_t buflen) {
+  // strftime() only runs when the second changes.
+  static __thread time_t t_sec = -1;
+  static __thread char t_sec_str[32];
+  static __thread int t_sec_len = 0;
+
   struct timespec ts;
   clock_gettime(CLOCK_REALTIME, &ts);
-  struct tm tm;
-  gmtime_r(&ts.tv_sec, &tm);
-  int n = (int)strftime(buf, buflen, "%Y-%m-%dT%H:%M:%S", &tm);
-  if (n <= 0) {
+  if (ts.tv_sec != t_sec) {
+    struct tm tm;
+    gmtime_r(&ts.tv_sec, &tm);
+    t_sec_len = (int)strftime(t_sec_str, sizeof(t_sec_str),
+                              "%Y-%m-%dT%H:%M:%S", &tm);
+    t_sec = t_sec_len > 0 ? ts.tv_sec : -1;
+  }
+  if (t_sec_len <= 0 || (size_t)t_sec_len >= buflen) {
     return 0;
   }
+  memcpy(buf, t_sec_str, (size_t)t_sec_len);
   // Append .microseconds and Z
-  int extra = snprintf(buf + n, buflen - (size_t)n, ".%06ldZ",
-                       (long)(ts.tv_nsec / 1000));
-  return n + extra;
+  int extra = snprintf(buf + t_sec_len, buflen - (size_t)t_sec_len,
+                       ".%06ldZ", (long)(ts.tv_nsec / 1000));
+  return t_sec_len + extra;
+}
+
+/// Build the full log line: timestamp + level + prefix + message + newline.
+/// Returns its length.
+static int format_line(char *line, size_t linelen, BmSbcLogLevel level,
+                       const char *msg) {
+  int ts_len = format_timestamp(line, linelen);
+  int level_idx = (level >= BM_LOG_TRACE && level <= BM_LOG_FATAL) ? level : BM_LOG_INFO;
+  int total = ts_len + snprintf(line + ts_len, linelen - (size_t)ts_len,
+                                " %s %s%s\n", k_level_names[level_idx],
+                                s_prefix, msg);
+  if ((size_t)total >= linelen) {
+    total = (int)linelen - 1;
+    line[total - 1] = '\n'; // ensure newline at end
+  }
+  return total;
 }
 
 /// Write a fully formatted line to a FILE*, flushing immediately.
@@ -73,6 +184,413 @@ static void emit_line(FILE *fp, const char *line, size_t len) {
   fflush(fp);
 }
 
+/// Close and reopen the log file.  Caller holds s_log_mutex.
+static void reopen_locked(void) {
+  if (s_log_fp) {
+    fclose(s_log_fp);
+    s_log_fp = fopen(s_log_path, "a");
+    if (!s_log_fp) {
+      fprintf(stderr, "bm_log: reopen failed for %s (%s)\n", s_log_path,
+              strerror(errno));
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Asynchronous mode
+// ---------------------------------------------------------------------------
+
+static void futex_wake_writer(void) {
+  atomic_fetch_add(&s_wake, 1);
+  if (atomic_load(&s_writer_sleeping)) {
+    syscall(SYS_futex, &s_wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+static void ring_key_destructor(void *arg) {
+  // Anything this thread logs from here on goes through the mutex path, so
+  // the writer may free the ring once it is drained.
+  t_ring = NULL;
+  t_ring_unavailable = true;
+  atomic_store(&((LogRing *)arg)->orphaned, true);
+}
+
+static void make_ring_key(void) {
+  pthread_key_create(&s_ring_key, ring_key_destructor);
+}
+
+/// This thread's ring, registered on first use.  NULL if none could be
+/// allocated; the caller then writes synchronously.
+static LogRing *thread_ring(void) {
+  if (t_ring || t_ring_unavailable) {
+    return t_ring;
+  }
+  LogRing *r = (LogRing *)calloc(1, sizeof(*r));
+  if (r) {
+    r->cap = s_ring_bytes;
+    r->buf = (uint8_t *)malloc(r->cap);
+  }
+  if (!r || !r->buf) {
+    free(r);
+    t_ring_unavailable = true;
+    return NULL;
+  }
+  pthread_setspecific(s_ring_key, r);
+  pthread_mutex_lock(&s_rings_lock);
+  r->next = s_rings;
+  s_rings = r;
+  pthread_mutex_unlock(&s_rings_lock);
+  t_ring = r;
+  return r;
+}
+
+static size_t record_size(size_t len) {
+  return (REC_HDR + len + 7u) & ~(size_t)7u;
+}
+
+/// Copy one line into @p r.  Returns false, writing nothing, if it is full.
+static bool ring_push(LogRing *r, const char *line, size_t len) {
+  const size_t need = record_size(len);
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  size_t pos = head & (r->cap - 1);
+  // Records never straddle the end: pad to it with a wrap marker instead.
+  const size_t pad = r->cap - pos < need ? r->cap - pos : 0;
+  if (need + pad > r->cap - (head - tail)) {
+    return false;
+  }
+  if (pad) {
+    const uint32_t wrap = REC_WRAP;
+    memcpy(r->buf + pos, &wrap, sizeof(wrap));
+    head += pad;
+    pos = 0;
+  }
+  const uint64_t seq = atomic_fetch_add(&s_seq, 1);
+  const uint32_t len32 = (uint32_t)len;
+  memcpy(r->buf + pos, &len32, sizeof(len32));
+  memcpy(r->buf + pos + 8, &seq, sizeof(seq));
+  memcpy(r->buf + pos + REC_HDR, line, len);
+  atomic_store_explicit(&r->head, head + need, memory_order_release);
+  return true;
+}
+
+/// Queue a formatted line for the writer.  Returns false if this thread has
+/// no ring, in which case the caller writes it synchronously.
+static bool async_push(BmSbcLogLevel level, const char *line, size_t len) {
+  LogRing *r = thread_ring();
+  if (!r) {
+    return false;
+  }
+  if (!ring_push(r, line, len)) {
+    atomic_fetch_add(&s_dropped, 1);
+    futex_wake_writer();
+    return true;
+  }
+  atomic_fetch_add(&s_pushed, 1);
+  // Flush policy: the writer wakes every s_flush_ms on its own; errors and
+  // a half-full ring wake it now.
+  const size_t used = atomic_load_explicit(&r->head, memory_order_relaxed) -
+                      atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (level >= BM_LOG_ERROR || used > r->cap / 2) {
+    futex_wake_writer();
+  }
+  if (level == BM_LOG_FATAL) {
+    bm_log_flush();
+  }
+  return true;
+}
+
+/// The record at @p r's cursor, past any wrap marker, or NULL.
+static const uint8_t *ring_peek(LogRing *r) {
+  while (r->cursor != r->snap_head) {
+    const size_t pos = r->cursor & (r->cap - 1);
+    uint32_t len;
+    memcpy(&len, r->buf + pos, sizeof(len));
+    if (len != REC_WRAP) {
+      return r->buf + pos;
+    }
+    r->cursor += r->cap - pos;
+  }
+  return NULL;
+}
+
+static void writev_all(int fd, struct iovec *iov, int n) {
+  while (n > 0) {
+    ssize_t w = writev(fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    while (n > 0 && (size_t)w >= iov->iov_len) {
+      w -= (ssize_t)iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + w;
+      iov->iov_len -= (size_t)w;
+    }
+  }
+}
+
+static void write_batch(const struct iovec *iov, int n) {
+  struct iovec copy[WRITE_BATCH + 1];
+  pthread_mutex_lock(&s_log_mutex);
+  if (s_reopen_flag) {
+    s_reopen_flag = 0;
+    reopen_locked();
+  }
+  if (s_log_fp) {
+    memcpy(copy, iov, (size_t)n * sizeof(*iov));
+    writev_all(fileno(s_log_fp), copy, n);
+  }
+  if (s_also_stdout) {
+    fflush(stdout);
+    memcpy(copy, iov, (size_t)n * sizeof(*iov));
+    writev_all(STDOUT_FILENO, copy, n);
+  }
+  pthread_mutex_unlock(&s_log_mutex);
+}
+
+/// Write everything queued so far, oldest first across all rings.
+static void drain_rings(void) {
+  static uint64_t reported_dropped = 0;
+
+  pthread_mutex_lock(&s_rings_lock);
+  for (LogRing *r = s_rings; r; r = r->next) {
+    r->snap_head = atomic_load_explicit(&r->head, memory_order_acquire);
+  }
+  for (;;) {
+    struct iovec iov[WRITE_BATCH + 1];
+    int n = 0;
+    while (n < WRITE_BATCH) {
+      LogRing *best = NULL;
+      uint64_t best_seq = 0;
+      for (LogRing *r = s_rings; r; r = r->next) {
+        const uint8_t *rec = ring_peek(r);
+        uint64_t seq;
+        if (rec) {
+          memcpy(&seq, rec + 8, sizeof(seq));
+          if (!best || seq < best_seq) {
+            best = r;
+            best_seq = seq;
+          }
+        }
+      }
+      if (!best) {
+        break;
+      }
+      const uint8_t *rec = ring_peek(best);
+      uint32_t len;
+      memcpy(&len, rec, sizeof(len));
+      iov[n].iov_base = (void *)(rec + REC_HDR);
+      iov[n].iov_len = len;
+      n++;
+      best->cursor += record_size(len);
+    }
+
+    char notice[BM_LOG_LINE_SIZE];
+    const uint64_t dropped = atomic_load(&s_dropped);
+    if (n < WRITE_BATCH && dropped != reported_dropped) {
+      char msg[96];
+      snprintf(msg, sizeof(msg), "bm_log: dropped %" PRIu64
+               " line(s), ring full", dropped - reported_dropped);
+      reported_dropped = dropped;
+      iov[n].iov_base = notice;
+      iov[n].iov_len = (size_t)format_line(notice, sizeof(notice),
+                                           BM_LOG_WARN, msg);
+      n++;
+    }
+    if (n == 0) {
+      break;
+    }
+    write_batch(iov, n);
+
+    // The lines are out; hand their space back to the producers.
+    size_t lines = 0;
+    for (LogRing *r = s_rings; r; r = r->next) {
+      const size_t tail = atomic_load_explicit(&r->tail,
+                                               memory_order_relaxed);
+      for (size_t c = tail; c != r->cursor;) {
+        uint32_t len;
+        const size_t pos = c & (r->cap - 1);
+        memcpy(&len, r->buf + pos, sizeof(len));
+        if (len == REC_WRAP) {
+          c += r->cap - pos;
+        } else {
+          c += record_size(len);
+          lines++;
+        }
+      }
+      atomic_store_explicit(&r->tail, r->cursor, memory_order_release);
+    }
+    atomic_fetch_add(&s_written, lines);
+  }
+
+  // Free the rings of threads that have exited once they are empty.
+  for (LogRing **link = &s_rings; *link;) {
+    LogRing *r = *link;
+    if (atomic_load(&r->orphaned) &&
+        r->cursor == atomic_load_explicit(&r->head, memory_order_acquire)) {
+      *link = r->next;
+      free(r->buf);
+      free(r);
+    } else {
+      link = &r->next;
+    }
+  }
+  pthread_mutex_unlock(&s_rings_lock);
+}
+
+static void *writer_main(void *arg) {
+  (void)arg;
+  for (;;) {
+    // Wake requests after this load make the futex wait below return at
+    // once; those before it are covered by the drain.
+    const uint32_t seen = atomic_load(&s_wake);
+    const bool stop = atomic_load(&s_writer_stop);
+    drain_rings();
+    if (stop) {
+      return NULL;
+    }
+    struct timespec timeout = {
+        .tv_sec = s_flush_ms / 1000,
+        .tv_nsec = (long)(s_flush_ms % 1000) * 1000000L,
+    };
+    atomic_store(&s_writer_sleeping, true);
+    syscall(SYS_futex, &s_wake, FUTEX_WAIT_PRIVATE, seen, &timeout, NULL, 0);
+    atomic_store(&s_writer_sleeping, false);
+  }
+}
+
+static void stop_async(void) {
+  pthread_mutex_lock(&s_log_mutex);
+  const bool running = s_writer_running;
+  s_writer_running = false;
+  pthread_mutex_unlock(&s_log_mutex);
+  if (!running) {
+    return;
+  }
+  // Lines queued up to here are written by the writer's final drain.
+  atomic_store_explicit(&s_async, false, memory_order_release);
+  atomic_store(&s_writer_stop, true);
+  futex_wake_writer();
+  pthread_join(s_writer, NULL);
+}
+
+// ---------------------------------------------------------------------------
+// Module levels.  Callers hold s_modules_lock.
+// ---------------------------------------------------------------------------
+
+static const char *const k_spec_levels[] = {"trace", "debug", "info",
+                                            "warn",  "error", "fatal"};
+
+static const ModuleOverride *find_override_locked(const char *name) {
+  for (size_t i = 0; i < s_num_overrides; i++) {
+    if (strcmp(s_overrides[i].name, name) == 0) {
+      return &s_overrides[i];
+    }
+  }
+  return NULL;
+}
+
+static void module_refresh_locked(BmLogModule *mod) {
+  const ModuleOverride *o = find_override_locked(mod->tag);
+  __atomic_store_n(&mod->threshold, o ? (int)o->level : (int)s_min_level,
+                   __ATOMIC_RELEASE);
+}
+
+static void refresh_modules_locked(void) {
+  for (BmLogModule *m = s_modules; m; m = m->next) {
+    module_refresh_locked(m);
+  }
+}
+
+/// Derive the module's tag (a path becomes its file name without the
+/// extension), link it in and publish its threshold.
+static void module_register_locked(BmLogModule *mod) {
+  const char *name = mod->name ? mod->name : "";
+  const char *slash = strrchr(name, '/');
+  if (slash) {
+    name = slash + 1;
+  }
+  size_t len = strcspn(name, ".");
+  if (len >= sizeof(mod->tag)) {
+    len = sizeof(mod->tag) - 1;
+  }
+  memcpy(mod->tag, name, len);
+  mod->tag[len] = '\0';
+  mod->next = s_modules;
+  s_modules = mod;
+  module_refresh_locked(mod);
+}
+
+/// Set (level >= 0) or clear (-1) the override for @p name.
+static int set_override_locked(const char *name, int level) {
+  size_t i = 0;
+  while (i < s_num_overrides && strcmp(s_overrides[i].name, name) != 0) {
+    i++;
+  }
+  if (level < 0) {
+    if (i < s_num_overrides) {
+      s_overrides[i] = s_overrides[--s_num_overrides];
+    }
+    return 0;
+  }
+  if (i == s_num_overrides) {
+    if (s_num_overrides == MAX_MODULE_OVERRIDES) {
+      return -1;
+    }
+    snprintf(s_overrides[i].name, sizeof(s_overrides[i].name), "%s", name);
+    s_num_overrides++;
+  }
+  s_overrides[i].level = (BmSbcLogLevel)level;
+  return 0;
+}
+
+/// Parse "module=level,..." into @p items; "default" as the level clears
+/// the module's override (stored as level -1).
+static bool parse_spec(const char *spec, ModuleOverride *items, size_t *n) {
+  *n = 0;
+  const char *p = spec ? spec : "";
+  while (*p) {
+    size_t item_len = strcspn(p, ",");
+    const char *eq = memchr(p, '=', item_len);
+    size_t name_len = eq ? (size_t)(eq - p) : 0;
+    if (item_len == 0) {
+      p++;
+      continue;
+    }
+    if (!eq || name_len == 0 || name_len >= BM_LOG_MODULE_NAME_MAX ||
+        *n == MAX_MODULE_OVERRIDES) {
+      return false;
+    }
+    const char *lvl = eq + 1;
+    size_t lvl_len = item_len - name_len - 1;
+    int level = -2;
+    if (lvl_len == 7 && strncmp(lvl, "default", 7) == 0) {
+      level = -1;
+    }
+    for (int l = BM_LOG_TRACE; l <= BM_LOG_FATAL && level == -2; l++) {
+      if (strlen(k_spec_levels[l]) == lvl_len &&
+          strncmp(lvl, k_spec_levels[l], lvl_len) == 0) {
+        level = l;
+      }
+    }
+    if (level == -2) {
+      return false;
+    }
+    memcpy(items[*n].name, p, name_len);
+    items[*n].name[name_len] = '\0';
+    items[*n].level = (BmSbcLogLevel)level;
+    (*n)++;
+    p += item_len;
+  }
+  return true;
+}
+
 // ---------------------------------------------------------------------------
 // Public API
 // ---------------------------------------------------------------------------
@@ -121,48 +639,27 @@ int bm_log_init(const char *app_name, uint64_t node_id, const char *log_dir,
 }
 
 void bm_log_set_level(BmSbcLogLevel level) {
+  pthread_mutex_lock(&s_modules_lock);
   s_min_level = level;
+  refresh_modules_locked();
+  pthread_mutex_unlock(&s_modules_lock);
 }
 
 BmSbcLogLevel bm_log_get_level(void) {
   return s_min_level;
 }
 
-void bm_log(BmSbcLogLevel level, const char *fmt, ...) {
-  if (level < s_min_level) {
-    return;
-  }
-
+/// Format and write one line; the caller has checked the level.
+static void log_v(BmSbcLogLevel level, const char *fmt, va_list ap) {
   // Pre-init fallback: write unformatted to stderr.
   if (!s_initialized) {
-    va_list ap;
-    va_start(ap, fmt);
     vfprintf(stderr, fmt, ap);
-    va_end(ap);
     return;
   }
 
-  pthread_mutex_lock(&s_log_mutex);
-
-  // Check SIGHUP reopen flag.
-  if (s_reopen_flag) {
-    s_reopen_flag = 0;
-    if (s_log_fp) {
-      fclose(s_log_fp);
-      s_log_fp = fopen(s_log_path, "a");
-      if (!s_log_fp) {
-        fprintf(stderr, "bm_log: reopen failed for %s (%s)\n", s_log_path,
-                strerror(errno));
-      }
-    }
-  }
-
   // Format the user message into a temporary buffer.
   char msgbuf[BM_LOG_BUF_SIZE];
-  va_list ap;
-  va_start(ap, fmt);
   int msg_len = vsnprintf(msgbuf, sizeof(msgbuf), fmt, ap);
-  va_end(ap);
   if (msg_len < 0) {
     msg_len = 0;
   }
@@ -176,16 +673,20 @@ void bm_log(BmSbcLogLevel level, const char *fmt, ...) {
   }
   msgbuf[msg_len] = '\0';
 
-  // Build the full log line: timestamp + level + prefix + message + newline.
-  char line[BM_LOG_BUF_SIZE + 256];
-  int ts_len = format_timestamp(line, sizeof(line));
-  int level_idx = (level >= BM_LOG_TRACE && level <= BM_LOG_FATAL) ? level : BM_LOG_INFO;
-  int total = ts_len + snprintf(line + ts_len, sizeof(line) - (size_t)ts_len,
-                                " %s %s%s\n", k_level_names[level_idx],
-                                s_prefix, msgbuf);
-  if ((size_t)total >= sizeof(line)) {
-    total = (int)sizeof(line) - 1;
-    line[total - 1] = '\n'; // ensure newline at end
+  char line[BM_LOG_LINE_SIZE];
+  int total = format_line(line, sizeof(line), level, msgbuf);
+
+  if (atomic_load_explicit(&s_async, memory_order_acquire) &&
+      async_push(level, line, (size_t)total)) {
+    return;
+  }
+
+  pthread_mutex_lock(&s_log_mutex);
+
+  // Check SIGHUP reopen flag.
+  if (s_reopen_flag) {
+    s_reopen_flag = 0;
+    reopen_locked();
   }
 
   if (s_log_fp) {
@@ -198,20 +699,265 @@ void bm_log(BmSbcLogLevel level, const char *fmt, ...) {
   pthread_mutex_unlock(&s_log_mutex);
 }
 
-void bm_log_reopen(void) {
-  pthread_mutex_lock(&s_log_mutex);
-  if (s_log_fp) {
-    fclose(s_log_fp);
-    s_log_fp = fopen(s_log_path, "a");
-    if (!s_log_fp) {
-      fprintf(stderr, "bm_log: reopen failed for %s (%s)\n", s_log_path,
-              strerror(errno));
+void bm_log(BmSbcLogLevel level, const char *fmt, ...) {
+  if (level < s_min_level) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  log_v(level, fmt, ap);
+  va_end(ap);
+}
+
+void bm_log_module(BmLogModule *mod, BmSbcLogLevel level, const char *fmt,
+                   ...) {
+  if (__atomic_load_n(&mod->threshold, __ATOMIC_ACQUIRE) ==
+      BM_LOG_THRESHOLD_UNSET) {
+    pthread_mutex_lock(&s_modules_lock);
+    if (mod->threshold == BM_LOG_THRESHOLD_UNSET) {
+      module_register_locked(mod);
+    }
+    pthread_mutex_unlock(&s_modules_lock);
+  }
+  if ((int)level < __atomic_load_n(&mod->threshold, __ATOMIC_RELAXED)) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  log_v(level, fmt, ap);
+  va_end(ap);
+}
+
+int bm_log_set_module_level(const char *module, int level) {
+  if (!module || !*module || strlen(module) >= BM_LOG_MODULE_NAME_MAX ||
+      level < -1 || level > BM_LOG_FATAL) {
+    return -1;
+  }
+  pthread_mutex_lock(&s_modules_lock);
+  int rc = set_override_locked(module, level);
+  refresh_modules_locked();
+  pthread_mutex_unlock(&s_modules_lock);
+  return rc;
+}
+
+int bm_log_set_module_levels(const char *spec) {
+  // Check the whole spec before applying any of it.
+  ModuleOverride items[MAX_MODULE_OVERRIDES];
+  size_t n = 0;
+  if (!parse_spec(spec, items, &n)) {
+    return -1;
+  }
+  pthread_mutex_lock(&s_modules_lock);
+  int rc = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (set_override_locked(items[i].name, (int)items[i].level) != 0) {
+      rc = -1;
+    }
+  }
+  refresh_modules_locked();
+  pthread_mutex_unlock(&s_modules_lock);
+  return rc;
+}
+
+int bm_log_parse_level(const char *name) {
+  for (int l = BM_LOG_TRACE; name && l <= BM_LOG_FATAL; l++) {
+    if (strcmp(name, k_spec_levels[l]) == 0) {
+      return l;
     }
   }
+  return -1;
+}
+
+void bm_log_clear_module_levels(void) {
+  pthread_mutex_lock(&s_modules_lock);
+  s_num_overrides = 0;
+  refresh_modules_locked();
+  pthread_mutex_unlock(&s_modules_lock);
+}
+
+size_t bm_log_format_module_levels(char *buf, size_t len) {
+  pthread_mutex_lock(&s_modules_lock);
+  size_t used = 0;
+  if (len > 0) {
+    buf[0] = '\0';
+  }
+  for (size_t i = 0; i < s_num_overrides; i++) {
+    int n = snprintf(used < len ? buf + used : NULL,
+                     used < len ? len - used : 0, "%s%s=%s",
+                     i ? "," : "", s_overrides[i].name,
+                     k_spec_levels[s_overrides[i].level]);
+    used += n > 0 ? (size_t)n : 0;
+  }
+  pthread_mutex_unlock(&s_modules_lock);
+  return used;
+}
+
+// ---------------------------------------------------------------------------
+// Rate limiting
+// ---------------------------------------------------------------------------
+
+typedef struct {
+  BmLogModule *mod;
+  BmSbcLogLevel level;
+  const char *fmt;
+  uint64_t key;
+  bool keyed;
+  uint32_t suppressed;
+  uint64_t elapsed_ms;
+} Suppressed;
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+static void log_suppressed(const Suppressed *s) {
+  char key[32] = "";
+  if (s->keyed) {
+    snprintf(key, sizeof(key), " key=%" PRIu64, s->key);
+  }
+  bm_log_module(s->mod, s->level,
+                "suppressed %" PRIu32 " line(s) in %" PRIu64 " ms%s like: %s",
+                s->suppressed, s->elapsed_ms, key, s->fmt);
+}
+
+/// Take @p slot's suppressed count into @p out and start a new window.
+/// Caller holds s_rl_lock.
+static bool slot_take_locked(const BmLogRateLimit *rl, BmLogRateSlot *slot,
+                             uint64_t now, Suppressed *out) {
+  bool any = slot->suppressed > 0;
+  if (any) {
+    *out = (Suppressed){rl->mod,
+                        rl->level,
+                        rl->fmt,
+                        slot->key,
+                        rl->num_slots > 1 || slot->key != 0,
+                        slot->suppressed,
+                        now - slot->window_start_ms};
+  }
+  slot->window_start_ms = now;
+  slot->printed = 0;
+  slot->suppressed = 0;
+  return any;
+}
+
+void bm_log_set_ratelimit(uint32_t burst, uint32_t window_ms) {
+  pthread_mutex_lock(&s_rl_lock);
+  s_rl_burst = burst;
+  s_rl_window_ms = window_ms ? window_ms : BM_LOG_RATELIMIT_DEFAULT_WINDOW_MS;
+  pthread_mutex_unlock(&s_rl_lock);
+}
+
+bool bm_log_ratelimit_allow(BmLogRateLimit *rl, BmLogModule *mod,
+                            BmSbcLogLevel level, uint64_t key,
+                            const char *fmt) {
+  const uint64_t now = now_ms();
+  Suppressed ended;
+  bool have_ended = false;
+
+  pthread_mutex_lock(&s_rl_lock);
+  if (s_rl_burst == 0) {
+    pthread_mutex_unlock(&s_rl_lock);
+    return true;
+  }
+  rl->mod = mod;
+  rl->level = level;
+  rl->fmt = fmt;
+
+  BmLogRateSlot *slot = NULL;
+  for (uint8_t i = 0; i < rl->num_slots && !slot; i++) {
+    if (rl->slots[i].key == key) {
+      slot = &rl->slots[i];
+    }
+  }
+  if (!slot && rl->num_slots < BM_LOG_RATELIMIT_KEYS) {
+    slot = &rl->slots[rl->num_slots++];
+    slot->key = key;
+    slot->window_start_ms = now;
+  } else if (!slot) {
+    // Replace the key whose window started longest ago.
+    slot = &rl->slots[0];
+    for (uint8_t i = 1; i < rl->num_slots; i++) {
+      if (rl->slots[i].window_start_ms < slot->window_start_ms) {
+        slot = &rl->slots[i];
+      }
+    }
+    have_ended = slot_take_locked(rl, slot, now, &ended);
+    slot->key = key;
+  }
+
+  if (now - slot->window_start_ms >= s_rl_window_ms) {
+    have_ended = slot_take_locked(rl, slot, now, &ended) || have_ended;
+  }
+  bool allow = slot->printed < s_rl_burst;
+  if (allow) {
+    slot->printed++;
+  } else {
+    slot->suppressed++;
+    if (!rl->listed) {
+      rl->listed = true;
+      rl->next = s_rl_sites;
+      __atomic_store_n(&s_rl_sites, rl, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&s_rl_lock);
+
+  if (have_ended) {
+    log_suppressed(&ended);
+  }
+  return allow;
+}
+
+void bm_log_ratelimit_flush(void) {
+  // Nothing has been suppressed yet: skip the lock.
+  if (!__atomic_load_n(&s_rl_sites, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  const uint64_t now = now_ms();
+  for (;;) {
+    Suppressed ended;
+    bool have_ended = false;
+    pthread_mutex_lock(&s_rl_lock);
+    for (BmLogRateLimit *rl = s_rl_sites; rl && !have_ended; rl = rl->next) {
+      for (uint8_t i = 0; i < rl->num_slots && !have_ended; i++) {
+        BmLogRateSlot *slot = &rl->slots[i];
+        if (slot->suppressed > 0 &&
+            now - slot->window_start_ms >= s_rl_window_ms) {
+          have_ended = slot_take_locked(rl, slot, now, &ended);
+        }
+      }
+    }
+    pthread_mutex_unlock(&s_rl_lock);
+    if (!have_ended) {
+      return;
+    }
+    log_suppressed(&ended);
+  }
+}
+
+void bm_log_set_reload_cb(void (*cb)(void)) {
+  s_reload_cb = cb;
+}
+
+void bm_log_poll_reload(void) {
+  unsigned count = (unsigned)s_hup_count;
+  if (count != s_hup_seen) {
+    s_hup_seen = count;
+    if (s_reload_cb) {
+      s_reload_cb();
+    }
+  }
+}
+
+void bm_log_reopen(void) {
+  pthread_mutex_lock(&s_log_mutex);
+  reopen_locked();
   pthread_mutex_unlock(&s_log_mutex);
 }
 
 void bm_log_shutdown(void) {
+  stop_async();
   pthread_mutex_lock(&s_log_mutex);
   if (s_log_fp) {
     fflush(s_log_fp);
@@ -221,3 +967,57 @@ void bm_log_shutdown(void) {
   s_initialized = false;
   pthread_mutex_unlock(&s_log_mutex);
 }
+
+static size_t round_up_pow2(size_t n) {
+  size_t p = RING_MIN_BYTES;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+int bm_log_start_async(const BmLogAsyncCfg *cfg) {
+  pthread_once(&s_ring_key_once, make_ring_key);
+  pthread_mutex_lock(&s_log_mutex);
+  if (!s_initialized || s_writer_running) {
+    pthread_mutex_unlock(&s_log_mutex);
+    return s_writer_running ? 0 : -1;
+  }
+  s_ring_bytes = round_up_pow2(cfg && cfg->ring_bytes
+                                   ? cfg->ring_bytes
+                                   : BM_LOG_ASYNC_DEFAULT_RING);
+  s_flush_ms = cfg && cfg->flush_ms ? cfg->flush_ms
+                                    : BM_LOG_ASYNC_DEFAULT_FLUSH_MS;
+  atomic_store(&s_writer_stop, false);
+  if (pthread_create(&s_writer, NULL, writer_main, NULL) != 0) {
+    pthread_mutex_unlock(&s_log_mutex);
+    return -1;
+  }
+  pthread_setname_np(s_writer, "bm_log");
+  s_writer_running = true;
+  atomic_store_explicit(&s_async, true, memory_order_release);
+  pthread_mutex_unlock(&s_log_mutex);
+  return 0;
+}
+
+void bm_log_flush(void) {
+  if (!atomic_load_explicit(&s_async, memory_order_acquire)) {
+    pthread_mutex_lock(&s_log_mutex);
+    if (s_log_fp) {
+      fflush(s_log_fp);
+    }
+    pthread_mutex_unlock(&s_log_mutex);
+    return;
+  }
+  const uint64_t target = atomic_load(&s_pushed);
+  futex_wake_writer();
+  while (atomic_load(&s_written) < target &&
+         atomic_load_explicit(&s_async, memory_order_acquire)) {
+    struct timespec delay = {0, 1000000L};
+    nanosleep(&delay, NULL);
+  }
+}
+
+uint64_t bm_log_dropped(void) {
+  return atomic_load(&s_dropped);
+}
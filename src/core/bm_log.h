@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -34,7 +35,8 @@ typedef enum {
 int bm_log_init(const char *app_name, uint64_t node_id, const char *log_dir,
                 bool also_stdout);
 
-/// Set the minimum severity level.  Messages below this level are discarded.
+/// Set the minimum severity level.  Messages below this level are discarded,
+/// except from modules with their own level (bm_log_set_module_level()).
 void bm_log_set_level(BmSbcLogLevel level);
 
 /// Get the current minimum severity level.
@@ -52,21 +54,178 @@ void bm_log(BmSbcLogLevel level, const char *fmt, ...)
 /// also be called directly.
 void bm_log_reopen(void);
 
-/// Flush and close the log file.
+/// Flush and close the log file.  Stops asynchronous mode first, writing
+/// out everything already queued.
 void bm_log_shutdown(void);
 
+// ---------------------------------------------------------------------------
+// Asynchronous mode
+// ---------------------------------------------------------------------------
+
+/// Default per-thread ring size.
+#define BM_LOG_ASYNC_DEFAULT_RING (64u * 1024u)
+
+/// Default longest time a queued line waits for the writer.
+#define BM_LOG_ASYNC_DEFAULT_FLUSH_MS 50u
+
+typedef struct {
+  size_t ring_bytes; ///< Per-thread ring, rounded up to a power of two
+                     ///< (min 4 KiB); 0 uses BM_LOG_ASYNC_DEFAULT_RING.
+  uint32_t flush_ms; ///< 0 uses BM_LOG_ASYNC_DEFAULT_FLUSH_MS.
+} BmLogAsyncCfg;
+
+/// Hand file and stdout writes to a background writer thread.
+///
+/// bm_log() then formats the line on the calling thread and copies it into
+/// that thread's lock-free ring; the writer merges the rings in call order
+/// and writes them with writev().  It wakes every @c flush_ms, when a ring
+/// is half full, or at once for ERROR and above; FATAL waits until the
+/// line is written.  A line that finds its ring full is dropped and
+/// counted, and the writer logs a warning with the count.
+///
+/// Call after bm_log_init().
+/// @param cfg  NULL for defaults.
+/// @return 0 on success (or if already running), -1 on failure; logging
+///         then stays synchronous.
+int bm_log_start_async(const BmLogAsyncCfg *cfg);
+
+/// Block until every line logged so far has been written.
+void bm_log_flush(void);
+
+/// Lines dropped because their thread's ring was full.
+uint64_t bm_log_dropped(void);
+
+// ---------------------------------------------------------------------------
+// Per-module levels
+// ---------------------------------------------------------------------------
+//
+// Each translation unit is a module.  Its name is BM_LOG_MODULE if the file
+// defines it before including any header, otherwise the source file name
+// without directory or extension (so bm_core's bcmp.c is "bcmp").  A module
+// logs at its own level if one is set, and at the global level otherwise.
+
+#define BM_LOG_MODULE_NAME_MAX 32
+#define BM_LOG_THRESHOLD_UNSET (-1)
+
+typedef struct BmLogModule {
+  const char *name;
+  int threshold; ///< Effective level, or BM_LOG_THRESHOLD_UNSET until the
+                 ///< module's first call registers it.
+  struct BmLogModule *next;
+  char tag[BM_LOG_MODULE_NAME_MAX];
+} BmLogModule;
+
+/// Log through @p mod.  Use the bm_log_<level>() macros instead.
+void bm_log_module(BmLogModule *mod, BmSbcLogLevel level, const char *fmt,
+                   ...) __attribute__((format(printf, 3, 4)));
+
+/// Set @p module's level, or with @p level -1 return it to the global level.
+/// Modules not loaded yet pick the level up on their first call.
+/// @return 0, or -1 for a bad name or level or a full table (32 modules).
+int bm_log_set_module_level(const char *module, int level);
+
+/// Apply "module=level[,module=level...]", where level is a level name or
+/// "default" to drop the module's own level.  Nothing is applied if any
+/// item is malformed.
+/// @return 0 on success, -1 on a malformed spec or a full table.
+int bm_log_set_module_levels(const char *spec);
+
+/// Parse a level name ("trace" ... "fatal").
+/// @return the level, or -1 if @p name is not one.
+int bm_log_parse_level(const char *name);
+
+/// Return every module to the global level.
+void bm_log_clear_module_levels(void);
+
+/// Write the module levels in bm_log_set_module_levels() form.
+/// @return the full length, as snprintf() does.
+size_t bm_log_format_module_levels(char *buf, size_t len);
+
+/// Set the function bm_log_poll_reload() calls after a SIGHUP, e.g. to
+/// re-read levels from a config file.  The log file is reopened regardless.
+void bm_log_set_reload_cb(void (*cb)(void));
+
+/// Run the reload callback if a SIGHUP arrived since the last call.  Call
+/// from the main loop, not from a signal handler.
+void bm_log_poll_reload(void);
+
+// ---------------------------------------------------------------------------
+// Rate limiting
+// ---------------------------------------------------------------------------
+//
+// bm_log_ratelimited() lets through @c burst lines per @c window_ms from
+// one call site, or per key with bm_log_ratelimited_key() (e.g. a peer).
+// Lines past the burst are dropped and counted; once the window is over
+// the count is logged as one "suppressed" line at the same level.
+
+#define BM_LOG_RATELIMIT_DEFAULT_BURST 10u
+#define BM_LOG_RATELIMIT_DEFAULT_WINDOW_MS 5000u
+
+/// Keys tracked per call site; a new key replaces the least recent.
+#define BM_LOG_RATELIMIT_KEYS 8
+
+typedef struct {
+  uint64_t key;
+  uint64_t window_start_ms;
+  uint32_t printed;
+  uint32_t suppressed;
+} BmLogRateSlot;
+
+/// One rate-limited call site.  Zero-initialized; guarded by bm_log.
+typedef struct BmLogRateLimit {
+  BmLogModule *mod;
+  const char *fmt;
+  BmSbcLogLevel level;
+  bool listed; ///< Linked into the list bm_log_ratelimit_flush() walks.
+  struct BmLogRateLimit *next;
+  uint8_t num_slots;
+  BmLogRateSlot slots[BM_LOG_RATELIMIT_KEYS];
+} BmLogRateLimit;
+
+/// Set the burst and window for every rate-limited call site.  A burst of
+/// 0 turns rate limiting off.
+void bm_log_set_ratelimit(uint32_t burst, uint32_t window_ms);
+
+/// Count one line from @p rl under @p key.  Logs the suppressed count of a
+/// window that has ended first.  Use the bm_log_ratelimited() macros.
+/// @return true if the line should be logged.
+bool bm_log_ratelimit_allow(BmLogRateLimit *rl, BmLogModule *mod,
+                            BmSbcLogLevel level, uint64_t key,
+                            const char *fmt);
+
+/// Log the suppressed counts of windows that have ended, for call sites
+/// that have gone quiet.  Call periodically from the main loop.
+void bm_log_ratelimit_flush(void);
+
 // ---------------------------------------------------------------------------
 // Convenience macros
 // ---------------------------------------------------------------------------
 
+/// Calls below this level are compiled out everywhere.
 #ifndef BM_LOG_MIN_LEVEL
 #define BM_LOG_MIN_LEVEL BM_LOG_TRACE
 #endif
 
+/// Calls below this level are compiled out of this module.  Set it per
+/// source file, e.g. with set_source_files_properties(COMPILE_DEFINITIONS).
+#ifndef BM_LOG_MODULE_MIN_LEVEL
+#define BM_LOG_MODULE_MIN_LEVEL BM_LOG_MIN_LEVEL
+#endif
+
+// __BASE_FILE__: __FILE__ here would name this header.
+#ifndef BM_LOG_MODULE
+#define BM_LOG_MODULE __BASE_FILE__
+#endif
+
+static BmLogModule bm_log_module_ __attribute__((unused)) = {
+    BM_LOG_MODULE, BM_LOG_THRESHOLD_UNSET, NULL, {0}};
+
 #define BM_LOG_(level, fmt, ...)                                               \
   do {                                                                         \
-    if ((level) >= BM_LOG_MIN_LEVEL) {                                         \
-      bm_log((level), fmt, ##__VA_ARGS__);                                     \
+    if ((level) >= BM_LOG_MIN_LEVEL && (level) >= BM_LOG_MODULE_MIN_LEVEL &&   \
+        (int)(level) >=                                                        \
+            __atomic_load_n(&bm_log_module_.threshold, __ATOMIC_RELAXED)) {    \
+      bm_log_module(&bm_log_module_, (level), fmt, ##__VA_ARGS__);             \
     }                                                                          \
   } while (0)
 
@@ -77,6 +236,23 @@ void bm_log_shutdown(void);
 #define bm_log_error(fmt, ...) BM_LOG_(BM_LOG_ERROR, fmt, ##__VA_ARGS__)
 #define bm_log_fatal(fmt, ...) BM_LOG_(BM_LOG_FATAL, fmt, ##__VA_ARGS__)
 
+/// Log at @p level within the rate limit for (this call site, @p key).
+#define bm_log_ratelimited_key(level, key, fmt, ...)                           \
+  do {                                                                         \
+    static BmLogRateLimit bm_log_rl_;                                          \
+    if ((level) >= BM_LOG_MIN_LEVEL && (level) >= BM_LOG_MODULE_MIN_LEVEL &&   \
+        (int)(level) >=                                                        \
+            __atomic_load_n(&bm_log_module_.threshold, __ATOMIC_RELAXED) &&    \
+        bm_log_ratelimit_allow(&bm_log_rl_, &bm_log_module_, (level), (key),   \
+                               fmt)) {                                         \
+      bm_log_module(&bm_log_module_, (level), fmt, ##__VA_ARGS__);             \
+    }                                                                          \
+  } while (0)
+
+/// Log at @p level within this call site's rate limit.
+#define bm_log_ratelimited(level, fmt, ...)                                    \
+  bm_log_ratelimited_key(level, 0, fmt, ##__VA_ARGS__)
+
 #ifdef __cplusplus
 }
 #endif
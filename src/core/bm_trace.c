@@ -0,0 +1,504 @@
+/// @file bm_trace.c
+/// @brief Binary trace channel: raw arguments into a memory-mapped ring.
+///
+/// The caller's thread parses the call site's format once, then for each
+/// event copies the arguments into a record on its stack and, under a
+/// mutex, memcpy()s the record into the ring, evicting the oldest records
+/// to make room.  head is published last, so a reader of the file (or of
+/// what a crash left behind) only sees whole records.
+
+#define _GNU_SOURCE
+#include "bm_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BM_TRACE_DEFAULT_DIR "/var/log/bm_sbc"
+#define RING_MIN_BYTES 4096u
+#define STRTAB_ENTRY_HDR 16u
+#define ALIGN8(n) (((n) + 7u) & ~(size_t)7u)
+
+// ---------------------------------------------------------------------------
+// Internal state
+// ---------------------------------------------------------------------------
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BmTraceFileHeader *s_hdr = NULL; // Start of the mapping.
+static size_t s_map_bytes = 0;
+static uint8_t *s_strtab = NULL;
+static uint8_t *s_ring = NULL;
+static int s_enabled = 0;
+
+// Argument kinds, in the order the arguments are passed.
+enum {
+  K_INT,
+  K_SCHAR,
+  K_SHORT,
+  K_LONG,
+  K_LLONG,
+  K_SSIZE,
+  K_INTMAX,
+  K_PTRDIFF,
+  K_UINT,
+  K_UCHAR,
+  K_USHORT,
+  K_ULONG,
+  K_ULLONG,
+  K_SIZE,
+  K_UINTMAX,
+  K_UPTRDIFF,
+  K_DOUBLE,
+  K_LDOUBLE,
+  K_STR,
+  K_STR_STAR, // %.*s: bounded by the preceding '*' argument.
+  K_PTR,
+  K_STAR,
+  K_BYTES, // %*ph: the length was the preceding '*' argument.
+};
+
+// ---------------------------------------------------------------------------
+// Format parsing
+// ---------------------------------------------------------------------------
+
+static bool site_add(BmTraceSite *site, uint8_t kind, uint16_t limit) {
+  if (site->nargs >= sizeof(site->kinds)) {
+    return false;
+  }
+  site->kinds[site->nargs] = kind;
+  site->limits[site->nargs] = limit;
+  site->nargs++;
+  return true;
+}
+
+/// Fill in @p site from @p fmt.  Mirrors the decoder's parser.
+static void site_parse(BmTraceSite *site, const char *fmt) {
+  site->nargs = 0;
+  for (const char *p = fmt; *p; p++) {
+    if (*p != '%') {
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      continue;
+    }
+    while (*p && strchr("-+ #0", *p)) {
+      p++;
+    }
+    bool width_star = *p == '*';
+    if (width_star) {
+      p++;
+      if (!site_add(site, K_STAR, 0)) {
+        goto fail;
+      }
+    }
+    while (*p >= '0' && *p <= '9') {
+      p++;
+    }
+    bool prec_star = false;
+    long prec = -1;
+    if (*p == '.') {
+      p++;
+      if (*p == '*') {
+        p++;
+        prec_star = true;
+        if (!site_add(site, K_STAR, 0)) {
+          goto fail;
+        }
+      } else {
+        prec = 0;
+        while (*p >= '0' && *p <= '9') {
+          prec = prec * 10 + (*p++ - '0');
+        }
+      }
+    }
+    // Length modifier: 0 none, 1 hh, 2 h, 3 l, 4 ll, 5 z, 6 j, 7 t, 8 L.
+    static const char *const k_lengths[] = {"hh", "h", "ll", "l", "z",
+                                            "j",  "t", "L"};
+    static const int k_length_ids[] = {1, 2, 4, 3, 5, 6, 7, 8};
+    int len = 0;
+    for (size_t i = 0; i < sizeof(k_lengths) / sizeof(k_lengths[0]); i++) {
+      size_t n = strlen(k_lengths[i]);
+      if (strncmp(p, k_lengths[i], n) == 0) {
+        len = k_length_ids[i];
+        p += n;
+        break;
+      }
+    }
+    static const uint8_t k_signed[] = {K_INT,   K_SCHAR, K_SHORT,
+                                       K_LONG,  K_LLONG, K_SSIZE,
+                                       K_INTMAX, K_PTRDIFF, K_INT};
+    static const uint8_t k_unsigned[] = {K_UINT,    K_UCHAR, K_USHORT,
+                                         K_ULONG,   K_ULLONG, K_SIZE,
+                                         K_UINTMAX, K_UPTRDIFF, K_UINT};
+    bool ok;
+    switch (*p) {
+    case 'd':
+    case 'i':
+      ok = site_add(site, k_signed[len], 0);
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      ok = site_add(site, k_unsigned[len], 0);
+      break;
+    case 'c':
+      ok = site_add(site, K_INT, 0);
+      break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      ok = site_add(site, len == 8 ? K_LDOUBLE : K_DOUBLE, 0);
+      break;
+    case 's': {
+      uint16_t limit = BM_TRACE_MAX_ARG_BYTES;
+      if (prec >= 0 && prec < (long)limit) {
+        limit = (uint16_t)prec;
+      }
+      ok = site_add(site, prec_star ? K_STR_STAR : K_STR, limit);
+      break;
+    }
+    case 'p':
+      if (width_star && p[1] == 'h') {
+        p++;
+        ok = site_add(site, K_BYTES, BM_TRACE_MAX_ARG_BYTES);
+      } else {
+        ok = site_add(site, K_PTR, 0);
+      }
+      break;
+    default: // %n, %m, or something this parser does not know.
+      ok = false;
+      break;
+    }
+    if (!ok) {
+      goto fail;
+    }
+  }
+  return;
+fail:
+  site->nargs = 0xff;
+}
+
+// ---------------------------------------------------------------------------
+// Record encoding
+// ---------------------------------------------------------------------------
+
+static size_t put_u64(uint8_t *rec, size_t off, uint64_t v) {
+  memcpy(rec + off, &v, sizeof(v));
+  return off + 8;
+}
+
+static size_t put_bytes(uint8_t *rec, size_t off, const void *data,
+                        size_t copy, size_t full) {
+  uint16_t lens[2] = {(uint16_t)copy, (uint16_t)(full > 0xffff ? 0xffff
+                                                               : full)};
+  memcpy(rec + off, lens, sizeof(lens));
+  if (copy > 0) {
+    memcpy(rec + off + sizeof(lens), data, copy);
+  }
+  return ALIGN8(off + sizeof(lens) + copy);
+}
+
+/// Encode the arguments after the record header.
+/// @return the record length.
+static size_t encode_args(uint8_t *rec, const BmTraceSite *site,
+                          va_list ap) {
+  size_t off = BM_TRACE_REC_HDR;
+  long star = 0;
+  for (uint8_t i = 0; i < site->nargs && site->nargs != 0xff; i++) {
+    // Room for the largest fixed-size field and a string's lengths.
+    size_t room = BM_TRACE_MAX_RECORD - off;
+    if (room < 16) {
+      break;
+    }
+    switch (site->kinds[i]) {
+    case K_INT:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, int));
+      break;
+    case K_SCHAR:
+      off = put_u64(rec, off,
+                    (uint64_t)(int64_t)(signed char)va_arg(ap, int));
+      break;
+    case K_SHORT:
+      off = put_u64(rec, off, (uint64_t)(int64_t)(short)va_arg(ap, int));
+      break;
+    case K_LONG:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, long));
+      break;
+    case K_LLONG:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, long long));
+      break;
+    case K_SSIZE:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, ssize_t));
+      break;
+    case K_INTMAX:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, intmax_t));
+      break;
+    case K_PTRDIFF:
+      off = put_u64(rec, off, (uint64_t)(int64_t)va_arg(ap, ptrdiff_t));
+      break;
+    case K_UINT:
+      off = put_u64(rec, off, va_arg(ap, unsigned int));
+      break;
+    case K_UCHAR:
+      off = put_u64(rec, off, (unsigned char)va_arg(ap, unsigned int));
+      break;
+    case K_USHORT:
+      off = put_u64(rec, off, (unsigned short)va_arg(ap, unsigned int));
+      break;
+    case K_ULONG:
+      off = put_u64(rec, off, va_arg(ap, unsigned long));
+      break;
+    case K_ULLONG:
+      off = put_u64(rec, off, va_arg(ap, unsigned long long));
+      break;
+    case K_SIZE:
+      off = put_u64(rec, off, va_arg(ap, size_t));
+      break;
+    case K_UINTMAX:
+      off = put_u64(rec, off, va_arg(ap, uintmax_t));
+      break;
+    case K_UPTRDIFF:
+      off = put_u64(rec, off, (uint64_t)va_arg(ap, ptrdiff_t));
+      break;
+    case K_DOUBLE:
+    case K_LDOUBLE: {
+      double d = site->kinds[i] == K_LDOUBLE
+                     ? (double)va_arg(ap, long double)
+                     : va_arg(ap, double);
+      memcpy(rec + off, &d, sizeof(d));
+      off += 8;
+      break;
+    }
+    case K_PTR:
+      off = put_u64(rec, off, (uint64_t)(uintptr_t)va_arg(ap, void *));
+      break;
+    case K_STAR:
+      star = va_arg(ap, int);
+      off = put_u64(rec, off, (uint64_t)(int64_t)star);
+      break;
+    case K_STR:
+    case K_STR_STAR: {
+      const char *s = va_arg(ap, const char *);
+      size_t limit = site->limits[i];
+      if (site->kinds[i] == K_STR_STAR && star >= 0 &&
+          (size_t)star < limit) {
+        limit = (size_t)star;
+      }
+      if (!s) {
+        s = "(null)";
+      }
+      // Only unbounded strings can be longer than what is copied.
+      bool bounded = site->kinds[i] == K_STR_STAR ||
+                     limit < BM_TRACE_MAX_ARG_BYTES;
+      size_t full = strnlen(s, bounded ? limit : 0xffff);
+      size_t copy = full < limit ? full : limit;
+      if (copy > room - 4) {
+        copy = (room - 4) & ~(size_t)7u;
+      }
+      off = put_bytes(rec, off, s, copy, full);
+      break;
+    }
+    case K_BYTES: {
+      const uint8_t *data = va_arg(ap, const uint8_t *);
+      size_t full = star > 0 && data ? (size_t)star : 0;
+      size_t copy = full < site->limits[i] ? full : site->limits[i];
+      if (copy > room - 4) {
+        copy = (room - 4) & ~(size_t)7u;
+      }
+      off = put_bytes(rec, off, data, copy, full);
+      break;
+    }
+    }
+  }
+  return off;
+}
+
+// ---------------------------------------------------------------------------
+// Ring and format table.  Callers hold s_mutex.
+// ---------------------------------------------------------------------------
+
+/// Evict the oldest records until @p need bytes past head are free.
+static void ring_reserve(size_t need) {
+  const uint64_t size = s_hdr->ring_bytes;
+  while (s_hdr->head + need - s_hdr->tail > size) {
+    uint32_t len;
+    memcpy(&len, s_ring + s_hdr->tail % size, sizeof(len));
+    __atomic_store_n(&s_hdr->tail, s_hdr->tail + len, __ATOMIC_RELEASE);
+  }
+}
+
+static void ring_write(const uint8_t *rec, size_t len) {
+  const uint64_t size = s_hdr->ring_bytes;
+  size_t off = (size_t)(s_hdr->head % size);
+  if (off + len > size) {
+    // Records never wrap; fill the end with a pad record.
+    uint32_t pad[2] = {(uint32_t)(size - off), BM_TRACE_REC_PAD};
+    ring_reserve(pad[0]);
+    memcpy(s_ring + off, pad, sizeof(pad));
+    __atomic_store_n(&s_hdr->head, s_hdr->head + pad[0], __ATOMIC_RELEASE);
+    off = 0;
+  }
+  ring_reserve(len);
+  memcpy(s_ring + off, rec, len);
+  __atomic_store_n(&s_hdr->head, s_hdr->head + len, __ATOMIC_RELEASE);
+}
+
+/// Add @p fmt to the format table.  A full table leaves the format out;
+/// the decoder then prints the address.
+static void strtab_add(const char *fmt) {
+  size_t len = strlen(fmt);
+  size_t entry = ALIGN8(STRTAB_ENTRY_HDR + len);
+  if (s_hdr->strtab_used + entry > s_hdr->strtab_bytes) {
+    return;
+  }
+  uint8_t *p = s_strtab + s_hdr->strtab_used;
+  uint64_t addr = (uint64_t)(uintptr_t)fmt;
+  uint32_t len32[2] = {(uint32_t)len, 0};
+  memcpy(p, &addr, sizeof(addr));
+  memcpy(p + 8, len32, sizeof(len32));
+  memcpy(p + STRTAB_ENTRY_HDR, fmt, len);
+  __atomic_store_n(&s_hdr->strtab_used, s_hdr->strtab_used + entry,
+                   __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+int bm_trace_init(const char *app_name, uint64_t node_id, const char *dir,
+                  size_t ring_bytes) {
+  if (!dir) {
+    dir = BM_TRACE_DEFAULT_DIR;
+  }
+  if (!app_name) {
+    app_name = "bm_sbc";
+  }
+  if (ring_bytes == 0) {
+    ring_bytes = BM_TRACE_DEFAULT_RING;
+  }
+  if (ring_bytes < RING_MIN_BYTES) {
+    ring_bytes = RING_MIN_BYTES;
+  }
+  ring_bytes = ALIGN8(ring_bytes);
+
+  char path[512];
+  char prev[520];
+  snprintf(path, sizeof(path), "%s/%s_%016" PRIx64 ".trace", dir, app_name,
+           node_id);
+  snprintf(prev, sizeof(prev), "%s.1", path);
+
+  pthread_mutex_lock(&s_mutex);
+  if (s_hdr) {
+    pthread_mutex_unlock(&s_mutex);
+    return 0;
+  }
+
+  // Keep the previous run's trace: it may show what led up to a crash.
+  (void)mkdir(dir, 0755);
+  (void)rename(path, prev);
+
+  const size_t hdr_bytes = ALIGN8(sizeof(BmTraceFileHeader));
+  const size_t total = hdr_bytes + BM_TRACE_STRTAB_BYTES + ring_bytes;
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  void *map = MAP_FAILED;
+  if (fd >= 0 && ftruncate(fd, (off_t)total) == 0) {
+    map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int err = errno;
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (map == MAP_FAILED) {
+    pthread_mutex_unlock(&s_mutex);
+    fprintf(stderr, "bm_trace: cannot map %s (%s)\n", path, strerror(err));
+    return -1;
+  }
+
+  s_hdr = (BmTraceFileHeader *)map;
+  s_map_bytes = total;
+  s_strtab = (uint8_t *)map + hdr_bytes;
+  s_ring = s_strtab + BM_TRACE_STRTAB_BYTES;
+  memcpy(s_hdr->magic, BM_TRACE_MAGIC, sizeof(s_hdr->magic));
+  s_hdr->version = BM_TRACE_VERSION;
+  s_hdr->header_bytes = (uint32_t)hdr_bytes;
+  s_hdr->node_id = node_id;
+  snprintf(s_hdr->app_name, sizeof(s_hdr->app_name), "%s", app_name);
+  s_hdr->strtab_off = hdr_bytes;
+  s_hdr->strtab_bytes = BM_TRACE_STRTAB_BYTES;
+  s_hdr->strtab_used = 0;
+  s_hdr->ring_off = hdr_bytes + BM_TRACE_STRTAB_BYTES;
+  s_hdr->ring_bytes = ring_bytes;
+  s_hdr->head = 0;
+  s_hdr->tail = 0;
+  __atomic_store_n(&s_enabled, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&s_mutex);
+  return 0;
+}
+
+bool bm_trace_enabled(void) {
+  return __atomic_load_n(&s_enabled, __ATOMIC_RELAXED) != 0;
+}
+
+void bm_trace_record(BmTraceSite *site, const char *fmt, ...) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  // The first record from a site parses its format and registers it.
+  if (!__atomic_load_n(&site->ready, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&s_mutex);
+    if (!site->ready && s_hdr) {
+      site_parse(site, fmt);
+      strtab_add(fmt);
+      __atomic_store_n(&site->ready, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&s_mutex);
+    if (!__atomic_load_n(&site->ready, __ATOMIC_ACQUIRE)) {
+      return;
+    }
+  }
+
+  uint8_t rec[BM_TRACE_MAX_RECORD] __attribute__((aligned(8)));
+  va_list ap;
+  va_start(ap, fmt);
+  size_t len = encode_args(rec, site, ap);
+  va_end(ap);
+
+  uint32_t hdr[2] = {(uint32_t)len, BM_TRACE_REC_EVENT};
+  memcpy(rec, hdr, sizeof(hdr));
+  put_u64(rec, 8, (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+  put_u64(rec, 16, (uint64_t)(uintptr_t)fmt);
+
+  pthread_mutex_lock(&s_mutex);
+  if (s_hdr) {
+    ring_write(rec, len);
+  }
+  pthread_mutex_unlock(&s_mutex);
+}
+
+void bm_trace_shutdown(void) {
+  pthread_mutex_lock(&s_mutex);
+  __atomic_store_n(&s_enabled, 0, __ATOMIC_RELAXED);
+  if (s_hdr) {
+    msync(s_hdr, s_map_bytes, MS_ASYNC);
+    munmap(s_hdr, s_map_bytes);
+    s_hdr = NULL;
+    s_strtab = NULL;
+    s_ring = NULL;
+  }
+  pthread_mutex_unlock(&s_mutex);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/// @file bm_trace.h
+/// @brief Binary trace channel with deferred formatting.
+///
+/// bm_trace() records the address of its format string, a CLOCK_REALTIME
+/// timestamp and the raw argument values into a ring in a memory-mapped
+/// file; nothing is formatted on the device.  scripts/bm_trace_decode.py
+/// renders the file into bm_log's text format later.  Because the ring is
+/// a shared file mapping, the last records survive a crash of the process.
+///
+/// Format strings are printf's, checked by the compiler, plus the Linux
+/// kernel's "%*ph" for byte ranges: an int length and a pointer, rendered
+/// as space-separated hex.  Strings and byte ranges are copied (up to
+/// BM_TRACE_MAX_ARG_BYTES each); %n is not supported.
+///
+/// File layout (host byte order): a BmTraceFileHeader, then a table of
+/// the format strings seen so far, then the ring of records.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BM_TRACE_MAGIC "BMTRACE1"
+#define BM_TRACE_VERSION 1u
+
+/// Default ring size (not counting the header and format table).
+#define BM_TRACE_DEFAULT_RING (1024u * 1024u)
+
+/// Format string table size.
+#define BM_TRACE_STRTAB_BYTES (64u * 1024u)
+
+/// Longest string or byte range copied into a record.
+#define BM_TRACE_MAX_ARG_BYTES 512u
+
+/// Largest record, header included.
+#define BM_TRACE_MAX_RECORD 2048u
+
+/// Record types.
+#define BM_TRACE_REC_EVENT 1u
+#define BM_TRACE_REC_PAD 2u ///< Fills the ring's end; skip to offset 0.
+
+typedef struct {
+  char magic[8]; ///< BM_TRACE_MAGIC, no NUL.
+  uint32_t version;
+  uint32_t header_bytes;
+  uint64_t node_id;
+  char app_name[32];
+  uint64_t strtab_off;
+  uint64_t strtab_bytes;
+  uint64_t strtab_used;
+  uint64_t ring_off;
+  uint64_t ring_bytes;
+  /// Byte positions since the file was created; the ring holds the
+  /// records between tail and head, at (position % ring_bytes).
+  uint64_t head;
+  uint64_t tail;
+} BmTraceFileHeader;
+
+/// Format table entry: u64 address, u32 length, u32 unused, then the
+/// format string (no NUL), padded to 8 bytes.
+///
+/// Record: u32 length (header included, a multiple of 8), u16 type,
+/// u16 unused, u64 timestamp in ns since the epoch, u64 format address,
+/// then one field per argument, padded to 8 bytes.  Integer, character,
+/// pointer and '*' arguments are 8 bytes (int64 for signed conversions,
+/// uint64 otherwise), floating point is a double, and strings and byte
+/// ranges are u16 copied length, u16 original length, then the bytes.
+#define BM_TRACE_REC_HDR 24u
+
+/// One bm_trace() call site.  The format is parsed the first time the
+/// site records anything.
+typedef struct {
+  int ready;     ///< Set once the fields below are valid.
+  uint8_t nargs; ///< 0xff: the format could not be parsed.
+  uint8_t kinds[16];
+  uint16_t limits[16]; ///< Bytes to copy, for strings.
+} BmTraceSite;
+
+/// Create the trace file <dir>/<app_name>_<node_id hex16>.trace with a
+/// ring of @p ring_bytes (0 uses BM_TRACE_DEFAULT_RING).  An existing file
+/// from the previous run is kept as <name>.trace.1.
+/// @param dir  NULL uses "/var/log/bm_sbc".
+/// @return 0 on success, -1 on failure (tracing stays off).
+int bm_trace_init(const char *app_name, uint64_t node_id, const char *dir,
+                  size_t ring_bytes);
+
+/// True while a trace file is open.
+bool bm_trace_enabled(void);
+
+/// Record one event.  Use the bm_trace() macro instead.
+void bm_trace_record(BmTraceSite *site, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/// Unmap and close the trace file.
+void bm_trace_shutdown(void);
+
+/// Record an event when tracing is on.
+#define bm_trace(fmt, ...)                                                     \
+  do {                                                                         \
+    static BmTraceSite bm_trace_site_;                                         \
+    if (bm_trace_enabled()) {                                                  \
+      bm_trace_record(&bm_trace_site_, fmt, ##__VA_ARGS__);                    \
+    }                                                                          \
+  } while (0)
+
+#ifdef __cplusplus
+}
+#endif
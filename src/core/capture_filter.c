@@ -0,0 +1,519 @@
+/// @file capture_filter.c
+/// @brief Capture filter expressions compiled to a small decision program.
+///
+/// The parser builds a small expression tree, then code is generated from
+/// the end of the program backwards, so every jump target is already known
+/// when a test is emitted: a test's jumps point at the code for whatever
+/// follows it, or straight at accept/reject.  "a and b" becomes "a ? b :
+/// reject", "a or b" becomes "a ? accept : b" and "not" swaps the targets,
+/// so nothing is evaluated past the point the answer is known and the
+/// matcher needs no stack.
+
+#include "capture_filter.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frame layout.  BM frames are Ethernet II carrying IPv6 with no extension
+// headers; BCMP and the middleware's UDP port follow bm_core.
+#define ETH_HDR 14u
+#define ETH_TYPE_OFF 12u
+#define ETHERTYPE_IPV6 0x86ddu
+#define IP6_HDR 40u
+#define IP6_NH_OFF (ETH_HDR + 6u)
+#define L4_OFF (ETH_HDR + IP6_HDR)
+#define IPPROTO_UDP_ 17u
+#define IPPROTO_ICMPV6_ 58u
+#define IPPROTO_BCMP 0xbcu
+#define UDP_HDR 8u
+#define BCMP_TYPE_LEN 2u // Little-endian, first in the BCMP header.
+#define MIDDLEWARE_PORT 4321u
+// Pubsub header after the UDP header: type, version, flags (2), then the
+// topic length (2, little-endian) and the topic.
+#define PUBSUB_TOPIC_LEN_OFF 4u
+#define PUBSUB_TOPIC_OFF 6u
+
+#define ACCEPT 0xfeu
+#define REJECT 0xffu
+#define MAX_NODES (2 * CAPTURE_FILTER_MAX_INSNS)
+#define MAX_DEPTH 32
+
+enum {
+  OP_PORT,
+  OP_DIR,
+  OP_ETHERTYPE,
+  OP_IP6_NH,
+  OP_UDP_PORT,
+  OP_BCMP_TYPE,
+  OP_TOPIC,
+};
+
+enum { NODE_TEST, NODE_NOT, NODE_AND, NODE_OR };
+
+typedef struct {
+  uint8_t kind;
+  uint8_t a, b; // Children.
+  CaptureFilterInsn test;
+} Node;
+
+typedef enum {
+  TOK_END,
+  TOK_LPAREN,
+  TOK_RPAREN,
+  TOK_NOT,
+  TOK_AND,
+  TOK_OR,
+  TOK_WORD,
+  TOK_STRING,
+} TokKind;
+
+typedef struct {
+  const char *src;
+  const char *pos;
+  TokKind tok;
+  const char *text; // Word or string contents.
+  size_t text_len;
+  Node nodes[MAX_NODES];
+  size_t num_nodes;
+  int depth;
+  CaptureFilter *f;
+  char *err;
+  size_t err_len;
+  bool failed;
+} Parser;
+
+// ---------------------------------------------------------------------------
+// Parsing
+// ---------------------------------------------------------------------------
+
+static void fail(Parser *p, const char *fmt, ...) {
+  if (p->failed) {
+    return;
+  }
+  p->failed = true;
+  if (p->err && p->err_len > 0) {
+    char msg[128];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    snprintf(p->err, p->err_len, "%s at offset %d", msg,
+             (int)(p->text ? p->text - p->src : p->pos - p->src));
+  }
+}
+
+static bool is_word_char(char c) {
+  return c != '\0' && c != ' ' && c != '\t' && c != '\n' && c != '(' &&
+         c != ')' && c != '!' && c != '&' && c != '|' && c != '"';
+}
+
+static void next(Parser *p) {
+  while (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n') {
+    p->pos++;
+  }
+  p->text = p->pos;
+  p->text_len = 0;
+  const char c = *p->pos;
+  if (c == '\0') {
+    p->tok = TOK_END;
+  } else if (c == '(' || c == ')' || c == '!') {
+    p->tok = c == '(' ? TOK_LPAREN : c == ')' ? TOK_RPAREN : TOK_NOT;
+    p->pos++;
+  } else if ((c == '&' || c == '|') && p->pos[1] == c) {
+    p->tok = c == '&' ? TOK_AND : TOK_OR;
+    p->pos += 2;
+  } else if (c == '"') {
+    const char *end = strchr(p->pos + 1, '"');
+    if (!end) {
+      fail(p, "unterminated string");
+      p->tok = TOK_END;
+      return;
+    }
+    p->tok = TOK_STRING;
+    p->text = p->pos + 1;
+    p->text_len = (size_t)(end - p->text);
+    p->pos = end + 1;
+  } else if (is_word_char(c)) {
+    while (is_word_char(*p->pos)) {
+      p->pos++;
+    }
+    p->text_len = (size_t)(p->pos - p->text);
+    p->tok = !strncmp(p->text, "and", 3) && p->text_len == 3  ? TOK_AND
+             : !strncmp(p->text, "or", 2) && p->text_len == 2 ? TOK_OR
+             : !strncmp(p->text, "not", 3) && p->text_len == 3 ? TOK_NOT
+                                                                : TOK_WORD;
+  } else {
+    fail(p, "unexpected '%c'", c);
+    p->tok = TOK_END;
+  }
+}
+
+static bool is_word(const Parser *p, const char *w) {
+  return p->tok == TOK_WORD && p->text_len == strlen(w) &&
+         memcmp(p->text, w, p->text_len) == 0;
+}
+
+/// Parse a number in [0, max] from @p s (@p len bytes).
+static bool parse_num(const char *s, size_t len, unsigned long max,
+                      unsigned long *out) {
+  char buf[24];
+  if (len == 0 || len >= sizeof(buf) || s[0] == '-' || s[0] == '+') {
+    return false;
+  }
+  memcpy(buf, s, len);
+  buf[len] = '\0';
+  char *end;
+  const unsigned long v = strtoul(buf, &end, 0);
+  if (*end != '\0' || v > max) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+/// Consume a number token in [0, max].
+static uint16_t expect_num(Parser *p, const char *what, unsigned long max) {
+  unsigned long v = 0;
+  if (p->tok != TOK_WORD || !parse_num(p->text, p->text_len, max, &v)) {
+    fail(p, "expected %s (0-%lu)", what, max);
+    return 0;
+  }
+  next(p);
+  return (uint16_t)v;
+}
+
+static uint8_t new_node(Parser *p, uint8_t kind, uint8_t a, uint8_t b) {
+  if (p->num_nodes >= MAX_NODES) {
+    fail(p, "filter too long");
+    return 0;
+  }
+  Node *n = &p->nodes[p->num_nodes];
+  memset(n, 0, sizeof(*n));
+  n->kind = kind;
+  n->a = a;
+  n->b = b;
+  return (uint8_t)p->num_nodes++;
+}
+
+static uint8_t test_node(Parser *p, uint8_t op, uint16_t lo, uint16_t hi) {
+  const uint8_t i = new_node(p, NODE_TEST, 0, 0);
+  p->nodes[i].test.op = op;
+  p->nodes[i].test.lo = lo;
+  p->nodes[i].test.hi = hi;
+  return i;
+}
+
+/// Next header test: "ip6 proto N" and the bare "udp", "bcmp", "icmp6".
+static uint8_t ip6_nh_node(Parser *p, uint8_t nh) {
+  return test_node(p, OP_IP6_NH, nh, nh);
+}
+
+static uint8_t parse_topic(Parser *p) {
+  if (p->tok != TOK_WORD && p->tok != TOK_STRING) {
+    fail(p, "expected a topic prefix");
+    return 0;
+  }
+  CaptureFilter *f = p->f;
+  if (p->text_len == 0 || p->text_len > 255 ||
+      f->topic_used + p->text_len > CAPTURE_FILTER_TOPIC_BYTES) {
+    fail(p, "topic prefix empty or too long");
+    return 0;
+  }
+  const uint8_t i = test_node(p, OP_TOPIC, f->topic_used, 0);
+  p->nodes[i].test.len = (uint8_t)p->text_len;
+  memcpy(f->topics + f->topic_used, p->text, p->text_len);
+  f->topic_used = (uint16_t)(f->topic_used + p->text_len);
+  next(p);
+  return i;
+}
+
+static uint8_t parse_primitive(Parser *p) {
+  if (p->tok != TOK_WORD) {
+    fail(p, "expected a filter primitive");
+    return 0;
+  }
+  if (is_word(p, "port")) {
+    next(p);
+    return test_node(p, OP_PORT, expect_num(p, "a port", 15), 0);
+  }
+  if (is_word(p, "in") || is_word(p, "out")) {
+    const uint16_t dir =
+        is_word(p, "in") ? CAPTURE_FILTER_DIR_IN : CAPTURE_FILTER_DIR_OUT;
+    next(p);
+    return test_node(p, OP_DIR, dir, 0);
+  }
+  if (is_word(p, "ether")) {
+    next(p);
+    if (!is_word(p, "proto")) {
+      fail(p, "expected 'proto'");
+      return 0;
+    }
+    next(p);
+    return test_node(p, OP_ETHERTYPE, expect_num(p, "an ethertype", 0xffff),
+                     0);
+  }
+  if (is_word(p, "ip6")) {
+    next(p);
+    if (!is_word(p, "proto")) {
+      return test_node(p, OP_ETHERTYPE, ETHERTYPE_IPV6, 0);
+    }
+    next(p);
+    return ip6_nh_node(p, (uint8_t)expect_num(p, "a next header", 0xff));
+  }
+  if (is_word(p, "icmp6")) {
+    next(p);
+    return ip6_nh_node(p, IPPROTO_ICMPV6_);
+  }
+  if (is_word(p, "udp")) {
+    next(p);
+    if (!is_word(p, "port")) {
+      return ip6_nh_node(p, IPPROTO_UDP_);
+    }
+    next(p);
+    return test_node(p, OP_UDP_PORT, expect_num(p, "a UDP port", 0xffff), 0);
+  }
+  if (is_word(p, "bcmp")) {
+    next(p);
+    if (!is_word(p, "type")) {
+      return ip6_nh_node(p, IPPROTO_BCMP);
+    }
+    next(p);
+    // N or N-M, as one word.
+    const char *dash =
+        p->tok == TOK_WORD ? memchr(p->text, '-', p->text_len) : NULL;
+    unsigned long lo = 0;
+    unsigned long hi = 0;
+    const size_t lo_len = dash ? (size_t)(dash - p->text) : p->text_len;
+    if (p->tok != TOK_WORD || !parse_num(p->text, lo_len, 0xffff, &lo) ||
+        (dash && !parse_num(dash + 1, p->text_len - lo_len - 1, 0xffff,
+                            &hi))) {
+      fail(p, "expected a BCMP type or range");
+      return 0;
+    }
+    if (!dash) {
+      hi = lo;
+    } else if (hi < lo) {
+      fail(p, "empty BCMP type range");
+      return 0;
+    }
+    next(p);
+    return test_node(p, OP_BCMP_TYPE, (uint16_t)lo, (uint16_t)hi);
+  }
+  if (is_word(p, "topic")) {
+    next(p);
+    return parse_topic(p);
+  }
+  fail(p, "unknown primitive '%.*s'", (int)p->text_len, p->text);
+  return 0;
+}
+
+static uint8_t parse_expr(Parser *p);
+
+static uint8_t parse_factor(Parser *p) {
+  if (++p->depth > MAX_DEPTH) {
+    fail(p, "filter nested too deeply");
+    return 0;
+  }
+  uint8_t n;
+  if (p->tok == TOK_NOT) {
+    next(p);
+    n = new_node(p, NODE_NOT, parse_factor(p), 0);
+  } else if (p->tok == TOK_LPAREN) {
+    next(p);
+    n = parse_expr(p);
+    if (p->tok != TOK_RPAREN) {
+      fail(p, "expected ')'");
+    }
+    next(p);
+  } else {
+    n = parse_primitive(p);
+  }
+  p->depth--;
+  return n;
+}
+
+static uint8_t parse_term(Parser *p) {
+  uint8_t n = parse_factor(p);
+  while (!p->failed && p->tok == TOK_AND) {
+    next(p);
+    n = new_node(p, NODE_AND, n, parse_factor(p));
+  }
+  return n;
+}
+
+static uint8_t parse_expr(Parser *p) {
+  uint8_t n = parse_term(p);
+  while (!p->failed && p->tok == TOK_OR) {
+    next(p);
+    n = new_node(p, NODE_OR, n, parse_term(p));
+  }
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// Code generation
+// ---------------------------------------------------------------------------
+
+/// Emit @p node so that it continues at @p t when true and @p f when false,
+/// in front of the code emitted so far.  Returns its entry point.
+static uint8_t gen(Parser *p, uint8_t node, uint8_t t, uint8_t f) {
+  const Node *n = &p->nodes[node];
+  switch (n->kind) {
+  case NODE_NOT:
+    return gen(p, n->a, f, t);
+  case NODE_AND:
+    return gen(p, n->a, gen(p, n->b, t, f), f);
+  case NODE_OR:
+    return gen(p, n->a, t, gen(p, n->b, t, f));
+  default:
+    break;
+  }
+  CaptureFilter *cf = p->f;
+  if (cf->entry == 0) {
+    fail(p, "filter too long");
+    return REJECT;
+  }
+  CaptureFilterInsn *insn = &cf->insns[--cf->entry];
+  *insn = n->test;
+  insn->jt = t;
+  insn->jf = f;
+  return cf->entry;
+}
+
+int capture_filter_compile(CaptureFilter *f, const char *expr, char *err,
+                           size_t err_len) {
+  memset(f, 0, sizeof(*f));
+  if (err && err_len > 0) {
+    err[0] = '\0';
+  }
+  if (!expr) {
+    return 0;
+  }
+  Parser *p = (Parser *)calloc(1, sizeof(Parser));
+  if (!p) {
+    if (err && err_len > 0) {
+      snprintf(err, err_len, "out of memory");
+    }
+    return -1;
+  }
+  p->src = expr;
+  p->pos = expr;
+  p->f = f;
+  p->err = err;
+  p->err_len = err_len;
+  next(p);
+  if (p->tok == TOK_END && !p->failed) {
+    free(p);
+    return 0;
+  }
+  const uint8_t root = parse_expr(p);
+  if (!p->failed && p->tok != TOK_END) {
+    fail(p, "unexpected '%.*s'", (int)(p->text_len ? p->text_len : 1),
+         p->text);
+  }
+  if (!p->failed) {
+    f->entry = CAPTURE_FILTER_MAX_INSNS;
+    const uint8_t entry = gen(p, root, ACCEPT, REJECT);
+    if (!p->failed) {
+      // Slide the program to the front and rebase the jumps.
+      const uint8_t base = f->entry;
+      f->num_insns = (uint8_t)(CAPTURE_FILTER_MAX_INSNS - base);
+      memmove(f->insns, f->insns + base,
+              f->num_insns * sizeof(CaptureFilterInsn));
+      for (size_t i = 0; i < f->num_insns; i++) {
+        CaptureFilterInsn *insn = &f->insns[i];
+        insn->jt = insn->jt < ACCEPT ? (uint8_t)(insn->jt - base) : insn->jt;
+        insn->jf = insn->jf < ACCEPT ? (uint8_t)(insn->jf - base) : insn->jf;
+        if (insn->op == OP_PORT || insn->op == OP_DIR) {
+          f->uses_port_dir = true;
+        }
+      }
+      f->entry = (uint8_t)(entry - base);
+    }
+  }
+  const bool failed = p->failed;
+  free(p);
+  if (failed) {
+    memset(f, 0, sizeof(*f));
+    return -1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Matching
+// ---------------------------------------------------------------------------
+
+static uint16_t be16(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint16_t le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/// Next header of an IPv6 frame, or -1.
+static int ip6_nh(const uint8_t *frame, size_t len) {
+  if (len < L4_OFF || be16(frame + ETH_TYPE_OFF) != ETHERTYPE_IPV6) {
+    return -1;
+  }
+  return frame[IP6_NH_OFF];
+}
+
+static bool run_test(const CaptureFilter *f, const CaptureFilterInsn *insn,
+                     uint8_t port, uint8_t dir, const uint8_t *frame,
+                     size_t len) {
+  switch (insn->op) {
+  case OP_PORT:
+    return port == insn->lo;
+  case OP_DIR:
+    return dir == insn->lo;
+  case OP_ETHERTYPE:
+    return len >= ETH_HDR && be16(frame + ETH_TYPE_OFF) == insn->lo;
+  case OP_IP6_NH:
+    return ip6_nh(frame, len) == insn->lo;
+  case OP_UDP_PORT:
+    return ip6_nh(frame, len) == IPPROTO_UDP_ && len >= L4_OFF + UDP_HDR &&
+           (be16(frame + L4_OFF) == insn->lo ||
+            be16(frame + L4_OFF + 2) == insn->lo);
+  case OP_BCMP_TYPE: {
+    if (ip6_nh(frame, len) != IPPROTO_BCMP ||
+        len < L4_OFF + BCMP_TYPE_LEN) {
+      return false;
+    }
+    const uint16_t type = le16(frame + L4_OFF);
+    return type >= insn->lo && type <= insn->hi;
+  }
+  case OP_TOPIC: {
+    const size_t pub = L4_OFF + UDP_HDR;
+    if (ip6_nh(frame, len) != IPPROTO_UDP_ ||
+        len < pub + PUBSUB_TOPIC_OFF ||
+        be16(frame + L4_OFF + 2) != MIDDLEWARE_PORT) {
+      return false;
+    }
+    const size_t topic_len = le16(frame + pub + PUBSUB_TOPIC_LEN_OFF);
+    return topic_len >= insn->len &&
+           len >= pub + PUBSUB_TOPIC_OFF + insn->len &&
+           memcmp(frame + pub + PUBSUB_TOPIC_OFF, f->topics + insn->lo,
+                  insn->len) == 0;
+  }
+  default:
+    return false;
+  }
+}
+
+bool capture_filter_match(const CaptureFilter *f, uint8_t port, uint8_t dir,
+                          const uint8_t *frame, size_t len) {
+  if (!f || f->num_insns == 0) {
+    return true;
+  }
+  // Jumps only go forward, so this ends within num_insns steps.
+  uint8_t pc = f->entry;
+  while (pc < f->num_insns) {
+    const CaptureFilterInsn *insn = &f->insns[pc];
+    pc = run_test(f, insn, port, dir, frame, len) ? insn->jt : insn->jf;
+  }
+  return pc == ACCEPT;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/// @file capture_filter.h
+/// @brief Capture filter expressions compiled to a small decision program.
+///
+/// An expression is compiled once into a list of tests, each with a jump
+/// for true and for false; matching a frame walks the list from the entry,
+/// always forward, until it reaches accept or reject.  Frame fields are
+/// decoded only as far as the tests need them.
+///
+/// Grammar (tcpdump-like; "and"/"or"/"not" may be written &&, ||, !):
+///
+///   expr     := term { ("or" | "||") term }
+///   term     := factor { ("and" | "&&") factor }
+///   factor   := ("not" | "!") factor | "(" expr ")" | primitive
+///   primitive:= "port" N             BM port the frame used (1-15)
+///             | "in" | "out"         direction
+///             | "ether" "proto" N    ethertype
+///             | "ip6" ["proto" N]    IPv6 / IPv6 next header
+///             | "udp" ["port" N]     UDP / UDP source or destination port
+///             | "icmp6"
+///             | "bcmp" ["type" N[-M]]  BCMP / message type (range)
+///             | "topic" PREFIX       pubsub topic starts with PREFIX
+///
+/// Numbers are decimal or 0x hex; PREFIX is a word or a "quoted string".
+/// Port and direction are only known to taps that pass them (pcapng
+/// capture); elsewhere they are 0, so "port" and "in"/"out" never match.
+/// Compiling sets uses_port_dir so callers can refuse such filters there.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Longest program, in tests.
+#define CAPTURE_FILTER_MAX_INSNS 64
+
+/// Bytes of topic prefixes per filter.
+#define CAPTURE_FILTER_TOPIC_BYTES 256
+
+/// Direction values passed to capture_filter_match().
+#define CAPTURE_FILTER_DIR_IN 1
+#define CAPTURE_FILTER_DIR_OUT 2
+
+typedef struct {
+  uint8_t op;   ///< What to test.
+  uint8_t jt;   ///< Next test if true, or accept/reject.
+  uint8_t jf;   ///< Next test if false, or accept/reject.
+  uint8_t len;  ///< Topic prefix length.
+  uint16_t lo;  ///< Value, or the low end of a range; topic pool offset.
+  uint16_t hi;  ///< High end of a range.
+} CaptureFilterInsn;
+
+typedef struct {
+  uint8_t num_insns; ///< 0: matches everything.
+  uint8_t entry;
+  bool uses_port_dir; ///< Tests "port" or "in"/"out".
+  CaptureFilterInsn insns[CAPTURE_FILTER_MAX_INSNS];
+  uint16_t topic_used;
+  char topics[CAPTURE_FILTER_TOPIC_BYTES];
+} CaptureFilter;
+
+/// Compile @p expr into @p f.  An empty or NULL expression matches every
+/// frame.
+/// @param err  Receives a message naming the problem on failure.
+/// @return 0 on success, -1 on a syntax error or a program that is too
+///         large.
+int capture_filter_compile(CaptureFilter *f, const char *expr, char *err,
+                           size_t err_len);
+
+/// Run @p f on an L2 frame.
+/// @param port  BM port (1-15), or 0 if unknown.
+/// @param dir   CAPTURE_FILTER_DIR_IN/OUT, or 0 if unknown.
+bool capture_filter_match(const CaptureFilter *f, uint8_t port, uint8_t dir,
+                          const uint8_t *frame, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "completion.h"
+
+#include <string.h>
+#include <time.h>
+
+uint64_t completion_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+// Wait on @p w (locked by the caller) until its seq moves past @p seen or
+// @p until_ms passes.
+static void wait_locked(CompletionWaiter *w, uint32_t seen,
+                        uint64_t until_ms) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(until_ms / 1000);
+  ts.tv_nsec = (long)(until_ms % 1000) * 1000000L;
+  while (w->seq == seen && completion_now_ms() < until_ms) {
+    pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+  }
+}
+
+void completion_waiter_init(CompletionWaiter *w) {
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&w->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  w->seq = 0;
+}
+
+void completion_waiter_destroy(CompletionWaiter *w) {
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->lock);
+}
+
+void completion_init(Completion *c, CompletionWaiter *w) {
+  c->waiter = w;
+  c->done = false;
+  c->status = 0;
+}
+
+void completion_reset(Completion *c) {
+  pthread_mutex_lock(&c->waiter->lock);
+  c->done = false;
+  c->status = 0;
+  pthread_mutex_unlock(&c->waiter->lock);
+}
+
+bool completion_signal(Completion *c, int32_t status) {
+  CompletionWaiter *w = c->waiter;
+  pthread_mutex_lock(&w->lock);
+  bool first = !c->done;
+  if (first) {
+    c->done = true;
+    c->status = status;
+    w->seq++;
+    pthread_cond_broadcast(&w->cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return first;
+}
+
+bool completion_done(Completion *c, int32_t *status) {
+  pthread_mutex_lock(&c->waiter->lock);
+  bool done = c->done;
+  if (done && status) {
+    *status = c->status;
+  }
+  pthread_mutex_unlock(&c->waiter->lock);
+  return done;
+}
+
+bool completion_wait(Completion *c, uint32_t timeout_ms, int32_t *status) {
+  CompletionWaiter *w = c->waiter;
+  uint64_t until = completion_now_ms() + timeout_ms;
+  pthread_mutex_lock(&w->lock);
+  while (!c->done && completion_now_ms() < until) {
+    wait_locked(w, w->seq, until);
+  }
+  bool done = c->done;
+  if (done && status) {
+    *status = c->status;
+  }
+  pthread_mutex_unlock(&w->lock);
+  return done;
+}
+
+void completion_request_init(CompletionRequest *req, CompletionWaiter *w,
+                             const char *name, CompletionRetry retry,
+                             CompletionSendFn send, void *ctx) {
+  memset(req, 0, sizeof(*req));
+  req->name = name;
+  completion_init(&req->done, w);
+  req->retry = retry;
+  if (req->retry.max_attempts == 0) {
+    req->retry.max_attempts = 1;
+  }
+  req->send = send;
+  req->ctx = ctx;
+}
+
+static void settle(CompletionRequest *req, bool ok, uint64_t now,
+                   CompletionSettledFn on_settled, void *arg) {
+  req->settled = true;
+  req->settled_ms = now;
+  if (on_settled) {
+    on_settled(req, ok, arg);
+  }
+}
+
+size_t completion_request_run(CompletionRequest *const *reqs, size_t n,
+                              CompletionWaiter *w, uint64_t deadline_ms,
+                              CompletionSettledFn on_settled, void *arg) {
+  size_t completed = 0;
+  for (;;) {
+    // Snapshot seq before looking at the completions, so a signal that
+    // lands after the check still cuts the wait short.
+    pthread_mutex_lock(&w->lock);
+    uint32_t seen = w->seq;
+    pthread_mutex_unlock(&w->lock);
+
+    uint64_t now = completion_now_ms();
+    uint64_t wake = deadline_ms;
+    bool pending = false;
+    for (size_t i = 0; i < n; i++) {
+      CompletionRequest *req = reqs[i];
+      if (req->settled) {
+        continue;
+      }
+      if (completion_done(&req->done, NULL)) {
+        completed++;
+        settle(req, true, now, on_settled, arg);
+        continue;
+      }
+      uint64_t resend = req->sent_ms + req->retry.retry_ms;
+      if (now >= deadline_ms ||
+          (req->attempts >= req->retry.max_attempts && now >= resend)) {
+        settle(req, false, now, on_settled, arg);
+        continue;
+      }
+      if (req->attempts == 0 || now >= resend) {
+        req->send(req);
+        req->attempts++;
+        req->sent_ms = now;
+        resend = now + req->retry.retry_ms;
+      }
+      wake = resend < wake ? resend : wake;
+      pending = true;
+    }
+    if (!pending) {
+      return completed;
+    }
+    pthread_mutex_lock(&w->lock);
+    wait_locked(w, seen, wake);
+    pthread_mutex_unlock(&w->lock);
+  }
+}
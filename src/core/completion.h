@@ -0,0 +1,105 @@
+#pragma once
+
+/// @file completion.h
+/// @brief One-shot completions and a retrying request runner.
+///
+/// A Completion is a latch that the thread delivering a result (a bm_core
+/// reply or discovery callback) signals, and that the thread waiting for it
+/// blocks on.  It stays signalled until reset, so a result that lands before
+/// anyone waits is not lost.
+///
+/// Completions share a CompletionWaiter: its condition variable is broadcast
+/// whenever any of them is signalled, which lets one thread wait for the
+/// first of several results without polling.  completion_request_run()
+/// builds on that to drive several requests at once, each resent on its own
+/// CompletionRetry schedule until it completes, runs out of attempts or hits
+/// the shared deadline, sleeping in between until the next resend is due or
+/// a reply arrives.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond; ///< CLOCK_MONOTONIC; broadcast on every signal.
+  uint32_t seq;        ///< Bumped on every signal.
+} CompletionWaiter;
+
+typedef struct {
+  CompletionWaiter *waiter;
+  bool done;      ///< Guarded by waiter->lock.
+  int32_t status; ///< Set by the signal; meaning is the caller's.
+} Completion;
+
+typedef struct {
+  uint8_t max_attempts; ///< Sends before giving up; 0 is treated as 1.
+  uint32_t retry_ms;    ///< Wait for a reply before resending.
+} CompletionRetry;
+
+typedef struct CompletionRequest CompletionRequest;
+
+/// Issue one attempt of @p req; false if it could not be sent.  A failed
+/// send still uses up an attempt.
+typedef bool (*CompletionSendFn)(CompletionRequest *req);
+
+struct CompletionRequest {
+  const char *name;
+  Completion done; ///< Signalled by whatever delivers the reply.
+  CompletionRetry retry;
+  CompletionSendFn send;
+  void *ctx;
+  uint8_t attempts;
+  uint64_t sent_ms;
+  uint64_t settled_ms; ///< completion_now_ms() when it completed or gave up.
+  bool settled;
+};
+
+/// Called from completion_request_run() as each request settles; @p ok is
+/// false if it gave up.
+typedef void (*CompletionSettledFn)(CompletionRequest *req, bool ok,
+                                    void *arg);
+
+/// Milliseconds on CLOCK_MONOTONIC, the clock every timeout here uses.
+uint64_t completion_now_ms(void);
+
+void completion_waiter_init(CompletionWaiter *w);
+void completion_waiter_destroy(CompletionWaiter *w);
+
+void completion_init(Completion *c, CompletionWaiter *w);
+
+/// Clear @p c so it can be signalled again.
+void completion_reset(Completion *c);
+
+/// Mark @p c done with @p status and wake its waiter.
+/// @return false if it was already done; the first status is kept.
+bool completion_signal(Completion *c, int32_t status);
+
+/// Non-blocking check; copies the status to @p status (may be NULL) if done.
+bool completion_done(Completion *c, int32_t *status);
+
+/// Block until @p c is signalled or @p timeout_ms passes.
+/// @return true if it was signalled.
+bool completion_wait(Completion *c, uint32_t timeout_ms, int32_t *status);
+
+void completion_request_init(CompletionRequest *req, CompletionWaiter *w,
+                             const char *name, CompletionRetry retry,
+                             CompletionSendFn send, void *ctx);
+
+/// Drive @p reqs concurrently until each has completed or given up, or
+/// @p deadline_ms (a completion_now_ms() time) passes.  Every request in
+/// @p reqs must use @p w.  @p on_settled (may be NULL) runs on the calling
+/// thread.
+/// @return The number of requests that completed.
+size_t completion_request_run(CompletionRequest *const *reqs, size_t n,
+                              CompletionWaiter *w, uint64_t deadline_ms,
+                              CompletionSettledFn on_settled, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,7 @@
 #include "app_runner.h"
 #include "bm_log.h"
+#include "bm_trace.h"
+#include "pcap_file_sink.h"
 #include "runtime.h"
 
 int main(int argc, char **argv) {
@@ -10,6 +12,8 @@ int main(int argc, char **argv) {
   }
 
   bm_sbc_app_run();
+  pcap_file_sink_close();
+  bm_trace_shutdown();
   bm_log_shutdown();
   return 0;
 }
@@ -1,48 +1,27 @@
 #include "pcap_file_sink.h"
+#include "pcap_live.h"
 
 extern "C" {
 #include "pcap.h"
 }
 
-#include <pthread.h>
-#include <stdio.h>
-
-static FILE *s_file;
-static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static void file_write_cb(const uint8_t *data, size_t len, void *ctx) {
-  (void)ctx;
-  pthread_mutex_lock(&s_mutex);
-  if (s_file) {
-    fwrite(data, 1, len, s_file);
-    fflush(s_file);
-  }
-  pthread_mutex_unlock(&s_mutex);
-}
-
-int pcap_file_sink_open(const char *path) {
-  if (!path) {
+int pcap_file_sink_open(const char *path, const char *live_path,
+                        const PcapWriterCfg *cfg) {
+  if ((!path && !live_path) || pcap_writer_open(path, cfg) != 0) {
     return -1;
   }
-
-  pthread_mutex_lock(&s_mutex);
-  s_file = fopen(path, "wb");
-  pthread_mutex_unlock(&s_mutex);
-
-  if (!s_file) {
+  if (live_path && pcap_live_open(live_path) != 0) {
+    pcap_writer_close();
     return -1;
   }
-
-  pcap_init(file_write_cb, NULL);
+  // pcapng frames come from the devices' taps, not bm_core's stream.
+  if (!cfg || !cfg->pcapng) {
+    pcap_init(pcap_writer_write, NULL);
+  }
   return 0;
 }
 
 void pcap_file_sink_close(void) {
-  pthread_mutex_lock(&s_mutex);
-  if (s_file) {
-    fflush(s_file);
-    fclose(s_file);
-    s_file = NULL;
-  }
-  pthread_mutex_unlock(&s_mutex);
+  pcap_live_close();
+  pcap_writer_close();
 }
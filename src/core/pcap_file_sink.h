@@ -3,23 +3,34 @@
 /// @file pcap_file_sink.h
 /// @brief Linux-specific pcap file sink.
 ///
-/// Opens a file and provides the PcapWriteCb that writes to it.
-/// Thread-safe: a mutex protects all writes so that RX and TX
-/// callbacks from different threads are serialised.
+/// Opens a capture file and hands bm_core's pcap module the PcapWriteCb
+/// that feeds it.  Frames are queued to a background writer (see
+/// pcap_writer.h), so capturing adds no syscalls to the L2 path.  In
+/// pcapng mode bm_core's stream is not used; the network devices record
+/// each frame with its port and direction instead.  A live socket can
+/// stream the same capture to one client at a time (see pcap_live.h).
+
+#include "pcap_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/// Open a pcap file for writing and initialise the pcap stream.
+/// Open a pcap file and/or a live socket and initialise the pcap stream.
 ///
-/// Writes the pcap global header immediately.
+/// The pcap global header is written by the writer thread, as are all
+/// frames; the file rotates as set in @p cfg.
 ///
-/// @param path  File path to create/overwrite.
-/// @return 0 on success, -1 on failure.
-int pcap_file_sink_open(const char *path);
+/// @param path       File path to create/overwrite (the first of the
+///                   rotation), or NULL for none.
+/// @param live_path  Socket to serve live clients on, or NULL for none.
+/// @param cfg        Rotation and ring settings; NULL for one unbounded
+///                   file.
+/// @return 0 on success, -1 on failure or if both paths are NULL.
+int pcap_file_sink_open(const char *path, const char *live_path,
+                        const PcapWriterCfg *cfg);
 
-/// Flush and close the pcap file.
+/// Stop serving live clients, write out queued frames and close the file.
 void pcap_file_sink_close(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,91 @@
+/// @file pcap_live.c
+/// @brief Live capture over a Unix stream socket.
+///
+/// A thread blocks in accept() and hands each client to the pcap writer,
+/// which does all the sending.  Closing shuts the listening socket down,
+/// which wakes accept().
+
+#define _GNU_SOURCE
+#include "pcap_live.h"
+
+#include "bm_log.h"
+#include "pcap_writer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int s_listen_fd = -1;
+static pthread_t s_thread;
+static char s_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static void *accept_main(void *arg) {
+  (void)arg;
+  for (;;) {
+    const int fd = accept4(s_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return NULL; // Shut down by pcap_live_close().
+    }
+    const struct timeval tv = {.tv_sec = PCAP_LIVE_SEND_TIMEOUT_S};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (pcap_writer_attach(fd) != 0) {
+      bm_log_warn("pcap: live client refused, one is already attached");
+      close(fd);
+    }
+  }
+}
+
+int pcap_live_open(const char *path) {
+  if (s_listen_fd >= 0 || !path || strlen(path) >= sizeof(s_path)) {
+    return -1;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    bm_log_error("pcap: live socket() failed: %s", strerror(errno));
+    return -1;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 1) != 0) {
+    bm_log_error("pcap: live bind(%s) failed: %s", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  // Captures can hold anything on the bus: owner and group only.
+  if (chmod(path, 0660) != 0) {
+    bm_log_warn("pcap: chmod(%s) failed: %s", path, strerror(errno));
+  }
+  s_listen_fd = fd;
+  snprintf(s_path, sizeof(s_path), "%s", path);
+  if (pthread_create(&s_thread, NULL, accept_main, NULL) != 0) {
+    close(fd);
+    unlink(path);
+    s_listen_fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void pcap_live_close(void) {
+  if (s_listen_fd < 0) {
+    return;
+  }
+  shutdown(s_listen_fd, SHUT_RDWR);
+  pthread_join(s_thread, NULL);
+  close(s_listen_fd);
+  s_listen_fd = -1;
+  unlink(s_path);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+/// @file pcap_live.h
+/// @brief Live capture over a Unix stream socket.
+///
+/// Listens on a socket path; a client that connects (Wireshark through
+/// scripts/bm_sbc_extcap.py, or e.g. `socat - UNIX-CONNECT:<path> |
+/// tcpdump -r -`) gets the capture as a pcap or pcapng stream, whichever
+/// the writer was opened with, for as long as it stays connected.  One
+/// client at a time; others are refused.  Frames are only captured while a
+/// file or a client takes them.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Seconds a send to the client may block before it is dropped.
+#define PCAP_LIVE_SEND_TIMEOUT_S 1
+
+/// Start listening on @p path (any stale socket there is removed).  The
+/// pcap writer must already be open.
+/// @return 0 on success, -1 on failure.
+int pcap_live_open(const char *path);
+
+/// Stop listening and remove the socket.  An attached client is closed by
+/// pcap_writer_close().
+void pcap_live_close(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,753 @@
+/// @file pcap_writer.c
+/// @brief Buffered pcap capture: lock-free ring plus a writer thread.
+///
+/// The ring is a bounded multi-producer queue of fixed-size slots, each
+/// with a sequence number (Vyukov's design): a producer claims a slot with
+/// one compare-and-swap on the enqueue position and publishes it by
+/// storing the slot's sequence.  Only the writer dequeues.  It hands the
+/// slots to writev() directly and releases them once they are written.
+///
+/// Every file starts with a preamble: the classic global header taken from
+/// the start of the stream, or in pcapng mode a Section Header Block and
+/// the Interface Description Blocks built at open.  A live client gets the
+/// same preamble when the writer takes it over, then every batch the file
+/// gets.
+///
+/// Producers check s_active before anything else, so with no file and no
+/// client a frame costs one relaxed load (plus, for the classic stream,
+/// the 16-byte record header needed to stay in step with it).
+
+#define _GNU_SOURCE
+#include "pcap_writer.h"
+
+#include "bm_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define GLOBAL_HDR 24u
+#define PREAMBLE_MAX 4096u
+#define REC_HDR 16u
+#define REC_INCL_LEN_OFF 8u
+#define WRITE_BATCH 256
+
+// pcapng (draft-ietf-opsawg-pcapng).
+#define NG_SHB 0x0a0d0d0au
+#define NG_IDB 0x00000001u
+#define NG_EPB 0x00000006u
+#define NG_BYTE_ORDER_MAGIC 0x1a2b3c4du
+#define NG_OPT_END 0
+#define NG_OPT_COMMENT 1
+#define NG_OPT_IF_NAME 2
+#define NG_OPT_IF_DESCRIPTION 3
+#define NG_OPT_IF_TSRESOL 9
+#define NG_OPT_EPB_FLAGS 2
+#define NG_LINKTYPE_ETHERNET 1
+#define NG_EPB_HDR 28u
+#define NG_EPB_TRAILER 16u // epb_flags, opt_endofopt, total length.
+#define NG_MAX_FRAME (PCAP_WRITER_MAX_RECORD - NG_EPB_HDR - NG_EPB_TRAILER)
+
+typedef struct {
+  _Atomic size_t seq;
+  uint32_t len;
+  uint8_t data[PCAP_WRITER_MAX_RECORD];
+} Slot;
+
+/// A record being put together from this thread's writes.
+typedef struct {
+  uint32_t gen; // s_gen when this record started.
+  size_t have;  // Bytes in buf.
+  size_t need;  // Bytes of the record to keep; 0 until the header is in.
+  size_t skip;  // Bytes past PCAP_WRITER_MAX_RECORD still to discard.
+  bool discard; // Nobody was taking frames when the header came in.
+  uint8_t buf[PCAP_WRITER_MAX_RECORD];
+} Stage;
+
+static _Atomic bool s_open = false;
+static _Atomic bool s_active = false;    // A file or live client is open.
+static _Atomic uint32_t s_in_flight = 0; // Producers inside write().
+static _Atomic uint32_t s_gen = 1;       // Bumped by every open.
+static __thread Stage t_stage;
+
+static pthread_mutex_t s_preamble_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t s_preamble[PREAMBLE_MAX];
+static size_t s_preamble_len = 0; // Guarded by s_preamble_lock.
+static _Atomic bool s_preamble_ready = false;
+
+static Slot *s_slots = NULL;
+static size_t s_mask = 0;
+static _Atomic size_t s_enqueue = 0;
+static _Atomic size_t s_dequeue = 0; // Advanced by the writer only.
+
+static char s_path[512];
+static PcapWriterCfg s_cfg;
+static CaptureFilter s_filter; // Empty: keep everything.
+static int s_fd = -1;               // Writer only, after open.
+static bool s_has_file = false;
+static _Atomic int s_live_pending = -1;  // From pcap_writer_attach().
+static _Atomic bool s_live_busy = false; // A client is pending or attached.
+static int s_live_fd = -1;               // Writer only.
+static uint32_t s_file_index = 0;   // Writer only.
+static uint64_t s_file_bytes = 0;   // Bytes in the current file.
+static pthread_t s_writer;
+static _Atomic uint32_t s_wake = 0;
+static _Atomic bool s_writer_sleeping = false;
+static _Atomic bool s_writer_stop = false;
+
+static _Atomic uint64_t s_captured = 0;
+static _Atomic uint64_t s_written = 0;
+static _Atomic uint64_t s_dropped = 0;
+static _Atomic uint64_t s_truncated = 0;
+static _Atomic uint64_t s_filtered = 0;
+static _Atomic uint64_t s_streamed = 0;
+static _Atomic uint32_t s_live_clients = 0;
+static _Atomic uint64_t s_bytes = 0;
+static _Atomic uint32_t s_files = 0;
+static uint64_t s_reported_dropped = 0; // Writer only.
+
+static void wake_writer(void) {
+  atomic_fetch_add(&s_wake, 1);
+  if (atomic_load(&s_writer_sleeping)) {
+    syscall(SYS_futex, &s_wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Producers
+// ---------------------------------------------------------------------------
+
+/// Whether the capture filter keeps @p frame.
+static bool keep(uint8_t port, uint8_t dir, const uint8_t *frame,
+                 size_t len) {
+  if (capture_filter_match(&s_filter, port, dir, frame, len)) {
+    return true;
+  }
+  atomic_fetch_add_explicit(&s_filtered, 1, memory_order_relaxed);
+  return false;
+}
+
+static void ring_push(const uint8_t *rec, size_t len) {
+  size_t pos = atomic_load_explicit(&s_enqueue, memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &s_slots[pos & s_mask];
+    const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&s_enqueue, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The writer has not released this slot yet: the ring is full.
+      atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+      wake_writer();
+      return;
+    } else {
+      pos = atomic_load_explicit(&s_enqueue, memory_order_relaxed);
+    }
+  }
+  slot->len = (uint32_t)len;
+  memcpy(slot->data, rec, len);
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+  atomic_fetch_add_explicit(&s_captured, 1, memory_order_relaxed);
+
+  // The writer wakes every flush_ms on its own; a half-full ring wakes it
+  // now.
+  const size_t used =
+      pos + 1 - atomic_load_explicit(&s_dequeue, memory_order_relaxed);
+  if (used > (s_mask + 1) / 2) {
+    wake_writer();
+  }
+}
+
+/// Take the first GLOBAL_HDR bytes of the stream as its global header.
+/// Returns the number of bytes consumed.
+static size_t take_global(const uint8_t *data, size_t len) {
+  pthread_mutex_lock(&s_preamble_lock);
+  size_t n = GLOBAL_HDR - s_preamble_len;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(s_preamble + s_preamble_len, data, n);
+  s_preamble_len += n;
+  if (s_preamble_len == GLOBAL_HDR) {
+    atomic_store_explicit(&s_preamble_ready, true, memory_order_release);
+  }
+  pthread_mutex_unlock(&s_preamble_lock);
+  return n;
+}
+
+static void stage_bytes(Stage *t, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t n;
+    if (t->have < REC_HDR) {
+      n = REC_HDR - t->have < len ? REC_HDR - t->have : len;
+      memcpy(t->buf + t->have, data, n);
+      t->have += n;
+      if (t->have == REC_HDR) {
+        uint32_t incl;
+        memcpy(&incl, t->buf + REC_INCL_LEN_OFF, sizeof(incl));
+        t->need = REC_HDR + (size_t)incl;
+        t->discard =
+            !atomic_load_explicit(&s_active, memory_order_relaxed);
+        if (t->discard) {
+          // Skip the frame without copying it.
+          t->skip = incl;
+          t->need = REC_HDR;
+        } else if (t->need > PCAP_WRITER_MAX_RECORD) {
+          t->skip = t->need - PCAP_WRITER_MAX_RECORD;
+          t->need = PCAP_WRITER_MAX_RECORD;
+          incl = PCAP_WRITER_MAX_RECORD - REC_HDR;
+          memcpy(t->buf + REC_INCL_LEN_OFF, &incl, sizeof(incl));
+        }
+      }
+    } else if (t->have < t->need) {
+      n = t->need - t->have < len ? t->need - t->have : len;
+      memcpy(t->buf + t->have, data, n);
+      t->have += n;
+    } else {
+      n = t->skip < len ? t->skip : len;
+      t->skip -= n;
+    }
+    data += n;
+    len -= n;
+
+    if (t->have >= REC_HDR && t->have == t->need && t->skip == 0) {
+      // The classic stream carries no port or direction.
+      if (!t->discard && keep(0, 0, t->buf + REC_HDR, t->need - REC_HDR)) {
+        if (t->need == PCAP_WRITER_MAX_RECORD) {
+          uint32_t orig;
+          memcpy(&orig, t->buf + REC_INCL_LEN_OFF + 4, sizeof(orig));
+          if (orig > PCAP_WRITER_MAX_RECORD - REC_HDR) {
+            atomic_fetch_add_explicit(&s_truncated, 1,
+                                      memory_order_relaxed);
+          }
+        }
+        ring_push(t->buf, t->need);
+      }
+      t->have = 0;
+      t->need = 0;
+    }
+  }
+}
+
+void pcap_writer_write(const uint8_t *data, size_t len, void *ctx) {
+  (void)ctx;
+  if (!data || !atomic_load_explicit(&s_open, memory_order_acquire)) {
+    return;
+  }
+  atomic_fetch_add(&s_in_flight, 1);
+  // Re-check: pcap_writer_close() waits only for producers counted above.
+  if (atomic_load(&s_open) && !s_cfg.pcapng) {
+    if (!atomic_load_explicit(&s_preamble_ready, memory_order_acquire)) {
+      const size_t n = take_global(data, len);
+      data += n;
+      len -= n;
+    }
+    Stage *t = &t_stage;
+    const uint32_t gen = atomic_load_explicit(&s_gen, memory_order_relaxed);
+    if (t->gen != gen) {
+      // Left over from before a reopen.
+      memset(t, 0, offsetof(Stage, buf));
+      t->gen = gen;
+    }
+    stage_bytes(t, data, len);
+  }
+  atomic_fetch_sub(&s_in_flight, 1);
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+void pcap_writer_frame(uint8_t port, PcapWriterDir dir, const uint8_t *frame,
+                       size_t len) {
+  if (!atomic_load_explicit(&s_active, memory_order_relaxed) || !frame ||
+      !atomic_load_explicit(&s_open, memory_order_acquire) ||
+      !s_cfg.pcapng) {
+    return;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  atomic_fetch_add(&s_in_flight, 1);
+  if (atomic_load(&s_open) && s_cfg.pcapng && port >= 1 &&
+      port <= s_cfg.num_ports && keep(port, (uint8_t)dir, frame, len)) {
+    const uint64_t ns =
+        (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    const size_t cap = len < NG_MAX_FRAME ? len : NG_MAX_FRAME;
+    const size_t padded = (cap + 3u) & ~(size_t)3u;
+    const uint32_t total = (uint32_t)(NG_EPB_HDR + padded + NG_EPB_TRAILER);
+    uint8_t rec[PCAP_WRITER_MAX_RECORD];
+    uint8_t *p = put_u32(rec, NG_EPB);
+    p = put_u32(p, total);
+    p = put_u32(p, (uint32_t)(port - 1));
+    p = put_u32(p, (uint32_t)(ns >> 32));
+    p = put_u32(p, (uint32_t)ns);
+    p = put_u32(p, (uint32_t)cap);
+    p = put_u32(p, (uint32_t)len);
+    memcpy(p, frame, cap);
+    memset(p + cap, 0, padded - cap);
+    p += padded;
+    p = put_u16(p, NG_OPT_EPB_FLAGS);
+    p = put_u16(p, 4);
+    p = put_u32(p, (uint32_t)dir); // Bits 0-1: inbound 1, outbound 2.
+    p = put_u32(p, NG_OPT_END);
+    put_u32(p, total);
+    if (cap < len) {
+      atomic_fetch_add_explicit(&s_truncated, 1, memory_order_relaxed);
+    }
+    ring_push(rec, total);
+  }
+  atomic_fetch_sub(&s_in_flight, 1);
+}
+
+/// Append an option to a block being built at @p p; strings are cut to
+/// @p max bytes.  Returns the new end.
+static uint8_t *put_opt(uint8_t *p, uint16_t code, const void *val,
+                        size_t len, size_t max) {
+  if (len > max) {
+    len = max;
+  }
+  p = put_u16(p, code);
+  p = put_u16(p, (uint16_t)len);
+  memcpy(p, val, len);
+  memset(p + len, 0, ((len + 3u) & ~(size_t)3u) - len);
+  return p + ((len + 3u) & ~(size_t)3u);
+}
+
+/// Close a block started at @p start and ending at @p p: fill in both
+/// total length fields.
+static uint8_t *end_block(uint8_t *start, uint8_t *p) {
+  const uint32_t total = (uint32_t)(p - start) + 4u;
+  put_u32(start + 4, total);
+  return put_u32(p, total);
+}
+
+/// The Section Header Block and one Interface Description Block per port.
+static size_t build_pcapng_preamble(uint8_t *buf, const PcapWriterCfg *cfg) {
+  uint8_t *p = buf;
+  uint8_t *blk = p;
+  p = put_u32(p, NG_SHB);
+  p = put_u32(p, 0);
+  p = put_u32(p, NG_BYTE_ORDER_MAGIC);
+  p = put_u16(p, 1); // Version 1.0.
+  p = put_u16(p, 0);
+  p = put_u32(p, UINT32_MAX); // Section length unknown (-1).
+  p = put_u32(p, UINT32_MAX);
+  if (cfg->comment) {
+    p = put_opt(p, NG_OPT_COMMENT, cfg->comment, strlen(cfg->comment), 256);
+    p = put_u32(p, NG_OPT_END);
+  }
+  p = end_block(blk, p);
+
+  for (uint8_t i = 0; i < cfg->num_ports; i++) {
+    const PcapWriterPort *port = &cfg->ports[i];
+    blk = p;
+    p = put_u32(p, NG_IDB);
+    p = put_u32(p, 0);
+    p = put_u16(p, NG_LINKTYPE_ETHERNET);
+    p = put_u16(p, 0);
+    p = put_u32(p, NG_MAX_FRAME); // Snap length.
+    if (port->name) {
+      p = put_opt(p, NG_OPT_IF_NAME, port->name, strlen(port->name), 32);
+    }
+    if (port->description) {
+      p = put_opt(p, NG_OPT_IF_DESCRIPTION, port->description,
+                  strlen(port->description), 128);
+    }
+    const uint8_t tsresol = 9; // Nanoseconds.
+    p = put_opt(p, NG_OPT_IF_TSRESOL, &tsresol, 1, 1);
+    p = put_u32(p, NG_OPT_END);
+    p = end_block(blk, p);
+  }
+  return (size_t)(p - buf);
+}
+
+// ---------------------------------------------------------------------------
+// Writer
+// ---------------------------------------------------------------------------
+
+void pcap_writer_file_name(char *buf, size_t len, const char *path,
+                           const PcapWriterCfg *cfg, uint32_t index) {
+  if (!cfg || cfg->file_bytes == 0) {
+    snprintf(buf, len, "%s", path);
+  } else if (cfg->file_count > 0) {
+    int width = 1;
+    for (uint32_t n = cfg->file_count - 1; n >= 10; n /= 10) {
+      width++;
+    }
+    snprintf(buf, len, "%s%0*u", path, width, index);
+  } else if (index == 0) {
+    snprintf(buf, len, "%s", path);
+  } else {
+    snprintf(buf, len, "%s%u", path, index);
+  }
+}
+
+/// Write @p iov to @p fd fully, resuming after short writes.  A socket is
+/// written with MSG_NOSIGNAL so a client that went away is an EPIPE.
+static int write_all(int fd, bool sock, struct iovec *iov, int n) {
+  while (n > 0) {
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = (size_t)n};
+    ssize_t w = sock ? sendmsg(fd, &msg, MSG_NOSIGNAL) : writev(fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    while (n > 0 && (size_t)w >= iov->iov_len) {
+      w -= (ssize_t)iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + w;
+      iov->iov_len -= (size_t)w;
+    }
+  }
+  return 0;
+}
+
+static int open_file(uint32_t index) {
+  char name[sizeof(s_path) + 16];
+  pcap_writer_file_name(name, sizeof(name), s_path, &s_cfg, index);
+  int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  s_fd = fd;
+  s_file_index = index;
+  s_file_bytes = 0;
+  atomic_fetch_add(&s_files, 1);
+  return 0;
+}
+
+/// Write the preamble into a new file once it is known.
+static void write_preamble(void) {
+  if (s_fd < 0 || s_file_bytes > 0 ||
+      !atomic_load_explicit(&s_preamble_ready, memory_order_acquire)) {
+    return;
+  }
+  struct iovec iov = {s_preamble, s_preamble_len};
+  if (write_all(s_fd, false, &iov, 1) == 0) {
+    s_file_bytes = s_preamble_len;
+    atomic_fetch_add(&s_bytes, s_preamble_len);
+  }
+}
+
+static void update_active(void) {
+  atomic_store_explicit(&s_active, s_has_file || s_live_fd >= 0,
+                        memory_order_release);
+}
+
+static void live_detach(const char *why) {
+  close(s_live_fd);
+  s_live_fd = -1;
+  update_active();
+  atomic_store(&s_live_busy, false);
+  bm_log_info("pcap: live client detached (%s)", why);
+}
+
+/// Take over a client handed to pcap_writer_attach() once the preamble is
+/// known, and drop the current one if it has hung up.
+static void live_poll(void) {
+  if (s_live_fd >= 0) {
+    struct pollfd pfd = {.fd = s_live_fd, .events = POLLRDHUP};
+    if (poll(&pfd, 1, 0) > 0 &&
+        (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+      live_detach("hung up");
+    }
+  }
+  if (atomic_load(&s_live_pending) < 0 ||
+      !atomic_load_explicit(&s_preamble_ready, memory_order_acquire)) {
+    return;
+  }
+  const int fd = atomic_exchange(&s_live_pending, -1);
+  struct iovec iov = {s_preamble, s_preamble_len};
+  if (write_all(fd, true, &iov, 1) != 0) {
+    bm_log_warn("pcap: live client lost: %s", strerror(errno));
+    close(fd);
+    atomic_store(&s_live_busy, false);
+    return;
+  }
+  s_live_fd = fd;
+  atomic_fetch_add(&s_live_clients, 1);
+  update_active();
+  bm_log_info("pcap: live client attached");
+}
+
+static void rotate(void) {
+  uint32_t next = s_file_index + 1;
+  if (s_cfg.file_count > 0 && next >= s_cfg.file_count) {
+    next = 0;
+  }
+  close(s_fd);
+  s_fd = -1;
+  if (open_file(next) != 0) {
+    bm_log_ratelimited(BM_LOG_WARN, "pcap: cannot open next file: %s",
+                       strerror(errno));
+  }
+}
+
+/// Write out every record queued so far.
+static void drain(void) {
+  live_poll();
+  for (;;) {
+    write_preamble();
+    struct iovec iov[WRITE_BATCH];
+    int n = 0;
+    uint64_t batch_bytes = 0;
+    bool full = false;
+    const size_t start = atomic_load_explicit(&s_dequeue, memory_order_relaxed);
+    size_t pos = start;
+    while (n < WRITE_BATCH) {
+      Slot *slot = &s_slots[pos & s_mask];
+      if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        break;
+      }
+      // Rotate before a record would push the file past its limit, unless
+      // it would be the file's first record.
+      if (s_cfg.file_bytes > 0 &&
+          s_file_bytes + batch_bytes + slot->len > s_cfg.file_bytes &&
+          s_file_bytes + batch_bytes > s_preamble_len) {
+        full = true;
+        break;
+      }
+      iov[n].iov_base = slot->data;
+      iov[n].iov_len = slot->len;
+      batch_bytes += slot->len;
+      n++;
+      pos++;
+    }
+
+    if (n > 0) {
+      // write_all() consumes the iovecs; the client needs its own.
+      struct iovec live_iov[WRITE_BATCH];
+      if (s_live_fd >= 0) {
+        memcpy(live_iov, iov, (size_t)n * sizeof(iov[0]));
+      }
+      if (s_fd >= 0 && write_all(s_fd, false, iov, n) == 0) {
+        s_file_bytes += batch_bytes;
+        atomic_fetch_add(&s_written, (uint64_t)n);
+        atomic_fetch_add(&s_bytes, batch_bytes);
+      } else if (s_has_file) {
+        bm_log_ratelimited(BM_LOG_WARN, "pcap: write failed: %s",
+                           s_fd >= 0 ? strerror(errno) : "no file");
+      }
+      if (s_live_fd >= 0) {
+        if (write_all(s_live_fd, true, live_iov, n) == 0) {
+          atomic_fetch_add(&s_streamed, (uint64_t)n);
+        } else {
+          live_detach(strerror(errno));
+        }
+      }
+      for (size_t p = start; p != pos; p++) {
+        atomic_store_explicit(&s_slots[p & s_mask].seq, p + s_mask + 1,
+                              memory_order_release);
+      }
+      atomic_store_explicit(&s_dequeue, pos, memory_order_release);
+    }
+    if (full) {
+      rotate();
+      continue;
+    }
+    if (n < WRITE_BATCH) {
+      break;
+    }
+  }
+
+  const uint64_t dropped = atomic_load(&s_dropped);
+  if (dropped != s_reported_dropped) {
+    bm_log_warn("pcap: dropped %" PRIu64 " frame(s), writer behind",
+                dropped - s_reported_dropped);
+    s_reported_dropped = dropped;
+  }
+}
+
+static void *writer_main(void *arg) {
+  (void)arg;
+  for (;;) {
+    const uint32_t seen = atomic_load(&s_wake);
+    const bool stop = atomic_load(&s_writer_stop);
+    drain();
+    if (stop) {
+      return NULL;
+    }
+    struct timespec timeout = {
+        .tv_sec = s_cfg.flush_ms / 1000,
+        .tv_nsec = (long)(s_cfg.flush_ms % 1000) * 1000000L,
+    };
+    atomic_store(&s_writer_sleeping, true);
+    syscall(SYS_futex, &s_wake, FUTEX_WAIT_PRIVATE, seen, &timeout, NULL, 0);
+    atomic_store(&s_writer_sleeping, false);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+static size_t round_up_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+int pcap_writer_open(const char *path, const PcapWriterCfg *cfg) {
+  if (atomic_load(&s_open) || (path && strlen(path) >= sizeof(s_path))) {
+    return -1;
+  }
+  snprintf(s_path, sizeof(s_path), "%s", path ? path : "");
+  s_has_file = path != NULL;
+  s_cfg = cfg ? *cfg : (PcapWriterCfg){0};
+  if (!s_has_file) {
+    s_cfg.file_bytes = 0;
+  }
+  if (s_cfg.flush_ms == 0) {
+    s_cfg.flush_ms = PCAP_WRITER_DEFAULT_FLUSH_MS;
+  }
+  const size_t slots =
+      round_up_pow2(s_cfg.slots ? s_cfg.slots : PCAP_WRITER_DEFAULT_SLOTS);
+  s_slots = (Slot *)calloc(slots, sizeof(Slot));
+  if (!s_slots) {
+    return -1;
+  }
+  s_mask = slots - 1;
+  for (size_t i = 0; i < slots; i++) {
+    atomic_init(&s_slots[i].seq, i);
+  }
+  atomic_store(&s_enqueue, 0);
+  atomic_store(&s_dequeue, 0);
+  if (s_cfg.num_ports > PCAP_WRITER_MAX_PORTS) {
+    s_cfg.num_ports = PCAP_WRITER_MAX_PORTS;
+  }
+  if (s_cfg.pcapng) {
+    s_preamble_len = build_pcapng_preamble(s_preamble, &s_cfg);
+    atomic_store(&s_preamble_ready, true);
+  } else {
+    s_preamble_len = 0;
+    atomic_store(&s_preamble_ready, false);
+  }
+  // The strings were only needed for the preamble.
+  memset(s_cfg.ports, 0, sizeof(s_cfg.ports));
+  s_cfg.comment = NULL;
+  if (s_cfg.filter) {
+    s_filter = *s_cfg.filter;
+  } else {
+    memset(&s_filter, 0, sizeof(s_filter));
+  }
+  s_cfg.filter = NULL;
+  atomic_store(&s_captured, 0);
+  atomic_store(&s_written, 0);
+  atomic_store(&s_dropped, 0);
+  atomic_store(&s_truncated, 0);
+  atomic_store(&s_filtered, 0);
+  atomic_store(&s_streamed, 0);
+  atomic_store(&s_live_clients, 0);
+  atomic_store(&s_bytes, 0);
+  atomic_store(&s_files, 0);
+  s_reported_dropped = 0;
+  atomic_store(&s_writer_stop, false);
+
+  if (s_has_file && open_file(0) != 0) {
+    free(s_slots);
+    s_slots = NULL;
+    return -1;
+  }
+  if (pthread_create(&s_writer, NULL, writer_main, NULL) != 0) {
+    if (s_fd >= 0) {
+      close(s_fd);
+    }
+    s_fd = -1;
+    free(s_slots);
+    s_slots = NULL;
+    return -1;
+  }
+  atomic_fetch_add(&s_gen, 1);
+  atomic_store_explicit(&s_open, true, memory_order_release);
+  update_active();
+  return 0;
+}
+
+int pcap_writer_attach(int fd) {
+  bool busy = false;
+  if (fd < 0 || !atomic_load(&s_open) ||
+      !atomic_compare_exchange_strong(&s_live_busy, &busy, true)) {
+    return -1;
+  }
+  atomic_store(&s_live_pending, fd);
+  wake_writer();
+  return 0;
+}
+
+void pcap_writer_stats(PcapWriterStats *out) {
+  out->captured = atomic_load(&s_captured);
+  out->written = atomic_load(&s_written);
+  out->dropped = atomic_load(&s_dropped);
+  out->truncated = atomic_load(&s_truncated);
+  out->filtered = atomic_load(&s_filtered);
+  out->streamed = atomic_load(&s_streamed);
+  out->live_clients = atomic_load(&s_live_clients);
+  out->bytes = atomic_load(&s_bytes);
+  out->files = atomic_load(&s_files);
+}
+
+void pcap_writer_close(void) {
+  bool was_open = true;
+  if (!atomic_compare_exchange_strong(&s_open, &was_open, false)) {
+    return;
+  }
+  while (atomic_load(&s_in_flight) > 0) {
+    sched_yield();
+  }
+  atomic_store(&s_writer_stop, true);
+  wake_writer();
+  pthread_join(s_writer, NULL);
+  atomic_store(&s_active, false);
+  if (s_fd >= 0) {
+    close(s_fd);
+    s_fd = -1;
+  }
+  if (s_live_fd >= 0) {
+    close(s_live_fd);
+    s_live_fd = -1;
+  }
+  const int pending = atomic_exchange(&s_live_pending, -1);
+  if (pending >= 0) {
+    close(pending);
+  }
+  atomic_store(&s_live_busy, false);
+  free(s_slots);
+  s_slots = NULL;
+
+  PcapWriterStats st;
+  pcap_writer_stats(&st);
+  bm_log_info("pcap: %" PRIu64 " frame(s) written to %u file(s), %" PRIu64
+              " streamed, %" PRIu64 " dropped, %" PRIu64 " truncated, %" PRIu64
+              " filtered",
+              st.written, st.files, st.streamed, st.dropped, st.truncated,
+              st.filtered);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+/// @file pcap_writer.h
+/// @brief Buffered pcap capture: lock-free ring plus a writer thread.
+///
+/// pcap_writer_write() takes the byte stream bm_core's pcap module emits
+/// (the 24-byte global header, then per frame a 16-byte record header and
+/// the frame) from any thread.  Each thread reassembles whole records and
+/// pushes them into a bounded multi-producer ring without locking or
+/// making syscalls; a writer thread drains the ring with writev() in
+/// batches.  When the ring is full the record is dropped and counted.
+///
+/// Like tcpdump's -C and -W, the output can rotate: with a size limit the
+/// writer starts a new file (with its own global header) before one would
+/// exceed it, and with a file count it reuses the oldest name.
+///
+/// In pcapng mode the network devices call pcap_writer_frame() instead,
+/// once per frame per port, and the file gets an Interface Description
+/// Block for each port, Enhanced Packet Blocks flagged inbound or outbound
+/// and nanosecond timestamps.  Captures from several nodes can then be
+/// merged (e.g. with mergecap) and frames matched across hops.
+///
+/// Besides (or instead of) a file, one live client at a time can take the
+/// stream over a socket (see pcap_live.h).  It gets the file's preamble
+/// and then every record the file gets.  With neither open, producers do
+/// no more than check a flag.
+///
+/// An optional capture filter is run on each frame before it is copied
+/// into the ring; frames it rejects cost only the filter's tests.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "capture_filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Default ring size in records.
+#define PCAP_WRITER_DEFAULT_SLOTS 512u
+
+/// Largest record kept whole (record header included); longer frames are
+/// truncated, with incl_len adjusted and orig_len kept.
+#define PCAP_WRITER_MAX_RECORD 2064u
+
+/// Default time between writer passes.
+#define PCAP_WRITER_DEFAULT_FLUSH_MS 200u
+
+/// Ports a pcapng capture describes; interface i is port i + 1.
+#define PCAP_WRITER_MAX_PORTS 15
+
+typedef enum {
+  PCAP_WRITER_IN = CAPTURE_FILTER_DIR_IN,   ///< Received on the port.
+  PCAP_WRITER_OUT = CAPTURE_FILTER_DIR_OUT, ///< Sent on the port.
+} PcapWriterDir;
+
+/// A port's Interface Description Block strings; NULL leaves one out.
+typedef struct {
+  const char *name;        ///< e.g. "vpd3", "uart".
+  const char *description; ///< e.g. the peer's node id or the device.
+} PcapWriterPort;
+
+typedef struct {
+  /// Start a new file once this many bytes would be exceeded (tcpdump -C,
+  /// which counts in units of 1,000,000 bytes).  0: one unbounded file.
+  uint64_t file_bytes;
+  /// Files to rotate through (tcpdump -W).  0: no limit.  Without
+  /// file_bytes this is ignored.
+  uint32_t file_count;
+  /// Ring size in records; rounded up to a power of two.  0 uses
+  /// PCAP_WRITER_DEFAULT_SLOTS.
+  uint32_t slots;
+  /// 0 uses PCAP_WRITER_DEFAULT_FLUSH_MS.
+  uint32_t flush_ms;
+  /// Write pcapng from pcap_writer_frame() instead of the classic stream.
+  bool pcapng;
+  /// pcapng only: ports 1..num_ports get an interface.
+  uint8_t num_ports;
+  PcapWriterPort ports[PCAP_WRITER_MAX_PORTS];
+  /// pcapng only: Section Header Block comment, e.g. the node id.  NULL
+  /// for none.
+  const char *comment;
+  /// Frames to keep; copied at open.  NULL keeps everything.
+  const CaptureFilter *filter;
+} PcapWriterCfg;
+
+typedef struct {
+  uint64_t captured; ///< Records queued.
+  uint64_t written;  ///< Records written to a file.
+  uint64_t dropped;  ///< Records lost because the ring was full.
+  uint64_t truncated; ///< Records cut to PCAP_WRITER_MAX_RECORD.
+  uint64_t filtered; ///< Frames the capture filter rejected.
+  uint64_t streamed; ///< Records sent to live clients.
+  uint32_t live_clients; ///< Live clients attached so far.
+  uint64_t bytes;    ///< Bytes written, global headers included.
+  uint32_t files;    ///< Files opened so far.
+} PcapWriterStats;
+
+/// Create the ring and start the writer.  With cfg->file_bytes set, files
+/// are named like tcpdump's: @p path, path1, path2... or, with a file
+/// count, path0...path<count-1> (zero-padded to the same width).
+/// @param path  NULL to capture only while a live client is attached.
+/// @param cfg   NULL for one unbounded file and the defaults.
+/// @return 0 on success, -1 on failure (nothing is captured).
+int pcap_writer_open(const char *path, const PcapWriterCfg *cfg);
+
+/// Hand the writer a connected stream socket to copy the capture to.  The
+/// writer sends the preamble, then each record, and closes @p fd when the
+/// client hangs up, a send fails or times out (set SO_SNDTIMEO), or the
+/// writer closes.
+/// @return 0 if taken, -1 if not open or a client is already attached
+///         (the caller keeps @p fd).
+int pcap_writer_attach(int fd);
+
+/// Append pcap stream bytes.  Safe from any thread; never blocks.
+/// Matches bm_core's PcapWriteCb.  Ignored in pcapng mode.
+void pcap_writer_write(const uint8_t *data, size_t len, void *ctx);
+
+/// pcapng mode: record @p frame as seen on @p port (1..num_ports), time
+/// stamped now.  Safe from any thread; never blocks.  Ignored otherwise.
+void pcap_writer_frame(uint8_t port, PcapWriterDir dir, const uint8_t *frame,
+                       size_t len);
+
+/// Snapshot of the counters.
+void pcap_writer_stats(PcapWriterStats *out);
+
+/// Write out everything queued, stop the writer and close the file.
+void pcap_writer_close(void);
+
+/// Name of file @p index under the rotation scheme described above.
+void pcap_writer_file_name(char *buf, size_t len, const char *path,
+                           const PcapWriterCfg *cfg, uint32_t index);
+
+#ifdef __cplusplus
+}
+#endif
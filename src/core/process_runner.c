@@ -0,0 +1,480 @@
+#define _GNU_SOURCE
+#include "process_runner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Without a pidfd nothing wakes poll() when a child exits, so the wait is
+// capped at this and exits are noticed by waitpid(WNOHANG).
+#define REAP_POLL_MS 10
+
+// Upper bound on max_running: each child takes two pollfds.
+#define MAX_RUNNING_LIMIT 64
+
+typedef struct Job {
+  struct Job *next;
+  char name[32];
+  char **argv; ///< One allocation: pointers, then the strings.
+  uint32_t timeout_ms;
+  uint32_t flags;
+  ProcessDoneFn done;
+  void *arg;
+  pid_t pid;
+  int pidfd;
+  int outfd;
+  bool reaped;
+  int status;
+  int spawn_errno;
+  bool timed_out;
+  char *out;
+  size_t out_len;
+  bool truncated;
+  uint64_t submit_us;
+  uint64_t start_us;
+  uint64_t exit_us;
+} Job;
+
+struct ProcessRunner {
+  pthread_mutex_t lock;
+  Job *queue_head; ///< Guarded by lock, like everything up to stats.
+  Job *queue_tail;
+  size_t queued;
+  size_t nrunning;
+  ProcessStats stats[PROCESS_RUNNER_MAX_STATS];
+  size_t nstats;
+  Job *running; ///< Poller only.
+  uint32_t max_running;
+  size_t capture_max;
+  int wake_fd; ///< Submissions wake a blocked poll.
+};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+bool process_result_ok(const ProcessResult *r) {
+  return r->spawn_errno == 0 && !r->timed_out && WIFEXITED(r->status) &&
+         WEXITSTATUS(r->status) == 0;
+}
+
+ProcessRunner *process_runner_create(const ProcessRunnerCfg *cfg) {
+  ProcessRunner *r = (ProcessRunner *)calloc(1, sizeof(*r));
+  if (!r) {
+    return NULL;
+  }
+  r->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (r->wake_fd < 0) {
+    free(r);
+    return NULL;
+  }
+  pthread_mutex_init(&r->lock, NULL);
+  r->max_running = cfg && cfg->max_running
+                       ? cfg->max_running
+                       : PROCESS_RUNNER_DEFAULT_MAX_RUNNING;
+  if (r->max_running > MAX_RUNNING_LIMIT) {
+    r->max_running = MAX_RUNNING_LIMIT;
+  }
+  r->capture_max = cfg && cfg->capture_max ? cfg->capture_max
+                                           : PROCESS_RUNNER_DEFAULT_CAPTURE;
+  return r;
+}
+
+static void free_job(Job *j) {
+  free(j->argv);
+  free(j->out);
+  free(j);
+}
+
+void process_runner_destroy(ProcessRunner *r) {
+  if (!r) {
+    return;
+  }
+  for (Job *j = r->running; j;) {
+    Job *next = j->next;
+    if (!j->reaped) {
+      kill(j->pid, SIGKILL);
+      waitpid(j->pid, NULL, 0);
+    }
+    if (j->pidfd >= 0) {
+      close(j->pidfd);
+    }
+    if (j->outfd >= 0) {
+      close(j->outfd);
+    }
+    free_job(j);
+    j = next;
+  }
+  for (Job *j = r->queue_head; j;) {
+    Job *next = j->next;
+    free_job(j);
+    j = next;
+  }
+  close(r->wake_fd);
+  pthread_mutex_destroy(&r->lock);
+  free(r);
+}
+
+bool process_runner_spawn(ProcessRunner *r, const char *name,
+                          const char *const argv[], uint32_t timeout_ms,
+                          ProcessDoneFn done, void *arg) {
+  return process_runner_spawn_flags(r, name, argv, timeout_ms, 0, done, arg);
+}
+
+bool process_runner_spawn_flags(ProcessRunner *r, const char *name,
+                                const char *const argv[],
+                                uint32_t timeout_ms, uint32_t flags,
+                                ProcessDoneFn done, void *arg) {
+  if (!argv || !argv[0]) {
+    errno = EINVAL;
+    return false;
+  }
+  size_t argc = 0;
+  size_t strings = 0;
+  for (; argv[argc]; argc++) {
+    strings += strlen(argv[argc]) + 1;
+  }
+  Job *j = (Job *)calloc(1, sizeof(*j));
+  char **copy = (char **)malloc((argc + 1) * sizeof(char *) + strings);
+  if (!j || !copy) {
+    free(j);
+    free(copy);
+    return false;
+  }
+  char *p = (char *)(copy + argc + 1);
+  for (size_t i = 0; i < argc; i++) {
+    size_t len = strlen(argv[i]) + 1;
+    memcpy(p, argv[i], len);
+    copy[i] = p;
+    p += len;
+  }
+  copy[argc] = NULL;
+  j->argv = copy;
+  snprintf(j->name, sizeof(j->name), "%s", name ? name : argv[0]);
+  j->timeout_ms = timeout_ms;
+  j->flags = flags;
+  j->done = done;
+  j->arg = arg;
+  j->pidfd = -1;
+  j->outfd = -1;
+  j->submit_us = now_us();
+
+  pthread_mutex_lock(&r->lock);
+  if (r->queue_tail) {
+    r->queue_tail->next = j;
+  } else {
+    r->queue_head = j;
+  }
+  r->queue_tail = j;
+  r->queued++;
+  pthread_mutex_unlock(&r->lock);
+
+  uint64_t one = 1;
+  (void)!write(r->wake_fd, &one, sizeof(one));
+  return true;
+}
+
+bool process_runner_shell(ProcessRunner *r, const char *name,
+                          const char *cmd, uint32_t timeout_ms,
+                          ProcessDoneFn done, void *arg) {
+  return process_runner_shell_flags(r, name, cmd, timeout_ms, 0, done, arg);
+}
+
+bool process_runner_shell_flags(ProcessRunner *r, const char *name,
+                                const char *cmd, uint32_t timeout_ms,
+                                uint32_t flags, ProcessDoneFn done,
+                                void *arg) {
+  const char *const argv[] = {"/bin/sh", "-c", cmd, NULL};
+  return process_runner_spawn_flags(r, name ? name : "sh", argv, timeout_ms,
+                                    flags, done, arg);
+}
+
+// Start @p j with stdin on /dev/null and stdout + stderr on a pipe, or left
+// as the caller's with PROCESS_RUNNER_NO_CAPTURE.
+static void start_job(Job *j) {
+  j->start_us = now_us();
+  const bool capture = !(j->flags & PROCESS_RUNNER_NO_CAPTURE);
+  int pipefd[2] = {-1, -1};
+  if (capture && pipe2(pipefd, O_CLOEXEC) != 0) {
+    j->spawn_errno = errno;
+    return;
+  }
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY,
+                                   0);
+  if (capture) {
+    posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDERR_FILENO);
+  }
+
+  // The child gets default dispositions and an empty mask whatever the
+  // calling thread had blocked or ignored.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t mask;
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  sigset_t defaults;
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGPIPE);
+  sigaddset(&defaults, SIGCHLD);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setflags(&attr,
+                           POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+  int rc = posix_spawnp(&j->pid, j->argv[0], &fa, &attr, j->argv, environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+  if (capture) {
+    close(pipefd[1]);
+  }
+  if (rc != 0) {
+    if (capture) {
+      close(pipefd[0]);
+    }
+    j->spawn_errno = rc;
+    return;
+  }
+  if (capture) {
+    j->outfd = pipefd[0];
+    fcntl(j->outfd, F_SETFL, fcntl(j->outfd, F_GETFL) | O_NONBLOCK);
+  }
+#ifdef SYS_pidfd_open
+  j->pidfd = (int)syscall(SYS_pidfd_open, j->pid, 0);
+#endif
+}
+
+// Read what the child has written so far; past capture_max it is discarded.
+static void read_output(ProcessRunner *r, Job *j) {
+  while (j->outfd >= 0) {
+    char scratch[512];
+    char *dst = scratch;
+    size_t room = sizeof(scratch);
+    if (j->out_len < r->capture_max) {
+      if (!j->out && !(j->out = (char *)malloc(r->capture_max + 1))) {
+        j->out_len = r->capture_max;
+        continue;
+      }
+      dst = j->out + j->out_len;
+      room = r->capture_max - j->out_len;
+    }
+    ssize_t n = read(j->outfd, dst, room);
+    if (n > 0) {
+      if (dst == scratch) {
+        j->truncated = true;
+      } else {
+        j->out_len += (size_t)n;
+      }
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      close(j->outfd);
+      j->outfd = -1;
+    }
+    return;
+  }
+}
+
+static ProcessStats *stats_for(ProcessRunner *r, const char *name) {
+  for (size_t i = 0; i < r->nstats; i++) {
+    if (strcmp(r->stats[i].name, name) == 0) {
+      return &r->stats[i];
+    }
+  }
+  if (r->nstats == PROCESS_RUNNER_MAX_STATS) {
+    return NULL;
+  }
+  ProcessStats *s = &r->stats[r->nstats++];
+  memset(s, 0, sizeof(*s));
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  return s;
+}
+
+// Count @p j, call its callback and free it.
+static void finish_job(ProcessRunner *r, Job *j) {
+  ProcessResult res;
+  memset(&res, 0, sizeof(res));
+  res.name = j->name;
+  res.spawn_errno = j->spawn_errno;
+  res.status = j->status;
+  res.timed_out = j->timed_out;
+  res.output = j->out ? j->out : "";
+  res.output_len = j->out_len;
+  if (j->out) {
+    j->out[j->out_len] = '\0';
+  }
+  res.output_truncated = j->truncated;
+  res.queued_us = j->start_us - j->submit_us;
+  res.run_us = j->spawn_errno ? 0 : j->exit_us - j->start_us;
+
+  pthread_mutex_lock(&r->lock);
+  ProcessStats *s = stats_for(r, j->name);
+  if (s) {
+    s->runs++;
+    s->failures += !process_result_ok(&res);
+    s->timeouts += res.timed_out;
+    s->total_queued_us += res.queued_us;
+    s->total_run_us += res.run_us;
+    s->max_run_us = res.run_us > s->max_run_us ? res.run_us : s->max_run_us;
+  }
+  pthread_mutex_unlock(&r->lock);
+
+  if (j->done) {
+    j->done(&res, j->arg);
+  }
+  free_job(j);
+}
+
+// Start queued jobs while there is room; those that fail to spawn go to
+// @p done.
+static void start_queued(ProcessRunner *r, Job **done) {
+  for (;;) {
+    pthread_mutex_lock(&r->lock);
+    Job *j = NULL;
+    if (r->queue_head && r->nrunning < r->max_running) {
+      j = r->queue_head;
+      r->queue_head = j->next;
+      if (!r->queue_head) {
+        r->queue_tail = NULL;
+      }
+      r->queued--;
+      r->nrunning++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    if (!j) {
+      return;
+    }
+    j->next = NULL;
+    start_job(j);
+    if (j->spawn_errno) {
+      pthread_mutex_lock(&r->lock);
+      r->nrunning--;
+      pthread_mutex_unlock(&r->lock);
+      j->next = *done;
+      *done = j;
+    } else {
+      j->next = r->running;
+      r->running = j;
+    }
+  }
+}
+
+void process_runner_poll(ProcessRunner *r, uint32_t timeout_ms) {
+  Job *done = NULL;
+  start_queued(r, &done);
+
+  // Wait for output, an exit or a submission, no longer than the nearest
+  // timeout.
+  struct pollfd fds[1 + 2 * MAX_RUNNING_LIMIT];
+  nfds_t nfds = 0;
+  fds[nfds++] = (struct pollfd){.fd = r->wake_fd, .events = POLLIN};
+  uint64_t now = now_us();
+  uint64_t wait_us = (uint64_t)timeout_ms * 1000ull;
+  for (Job *j = r->running; j; j = j->next) {
+    if (j->outfd >= 0) {
+      fds[nfds++] = (struct pollfd){.fd = j->outfd, .events = POLLIN};
+    }
+    if (j->pidfd >= 0) {
+      fds[nfds++] = (struct pollfd){.fd = j->pidfd, .events = POLLIN};
+    } else if (wait_us > REAP_POLL_MS * 1000ull) {
+      wait_us = REAP_POLL_MS * 1000ull;
+    }
+    if (j->timeout_ms && !j->timed_out) {
+      uint64_t deadline = j->start_us + (uint64_t)j->timeout_ms * 1000ull;
+      uint64_t left = deadline > now ? deadline - now : 0;
+      wait_us = left < wait_us ? left : wait_us;
+    }
+  }
+  if (!done && (r->running || wait_us > 0)) {
+    poll(fds, nfds, (int)((wait_us + 999) / 1000));
+  }
+  uint64_t drained;
+  (void)!read(r->wake_fd, &drained, sizeof(drained));
+
+  now = now_us();
+  for (Job **link = &r->running; *link;) {
+    Job *j = *link;
+    read_output(r, j);
+    if (!j->reaped && waitpid(j->pid, &j->status, WNOHANG) == j->pid) {
+      j->reaped = true;
+      j->exit_us = now_us();
+    }
+    if (!j->reaped && j->timeout_ms && !j->timed_out &&
+        now >= j->start_us + (uint64_t)j->timeout_ms * 1000ull) {
+      kill(j->pid, SIGKILL);
+      j->timed_out = true;
+    }
+    if (!j->reaped) {
+      link = &j->next;
+      continue;
+    }
+    // Exited: take what is left in the pipe without waiting for EOF, which
+    // a backgrounded grandchild could hold off indefinitely.
+    read_output(r, j);
+    if (j->outfd >= 0) {
+      close(j->outfd);
+      j->outfd = -1;
+    }
+    if (j->pidfd >= 0) {
+      close(j->pidfd);
+      j->pidfd = -1;
+    }
+    *link = j->next;
+    pthread_mutex_lock(&r->lock);
+    r->nrunning--;
+    pthread_mutex_unlock(&r->lock);
+    j->next = done;
+    done = j;
+  }
+  start_queued(r, &done);
+
+  // Callbacks last, in completion order, with no lock held: they may
+  // submit more work.
+  Job *ordered = NULL;
+  while (done) {
+    Job *next = done->next;
+    done->next = ordered;
+    ordered = done;
+    done = next;
+  }
+  while (ordered) {
+    Job *next = ordered->next;
+    finish_job(r, ordered);
+    ordered = next;
+  }
+}
+
+size_t process_runner_pending(ProcessRunner *r) {
+  pthread_mutex_lock(&r->lock);
+  size_t n = r->queued + r->nrunning;
+  pthread_mutex_unlock(&r->lock);
+  return n;
+}
+
+size_t process_runner_get_stats(ProcessRunner *r, ProcessStats *out,
+                                size_t max) {
+  pthread_mutex_lock(&r->lock);
+  size_t n = r->nstats < max ? r->nstats : max;
+  memcpy(out, r->stats, n * sizeof(*out));
+  pthread_mutex_unlock(&r->lock);
+  return n;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+/// @file process_runner.h
+/// @brief Non-blocking child process execution with output capture.
+///
+/// system() and popen() block the caller for a whole fork/exec/wait, which
+/// is slow on small boards and stalls whatever loop made the call.  A runner
+/// instead starts commands with posix_spawn() (vfork-speed, no page-table
+/// copy), captures their stdout and stderr through a pipe, and reports each
+/// exit to a callback.  Nothing blocks: process_runner_poll() reads pipes,
+/// reaps exits (via a pidfd where the kernel has them, otherwise
+/// waitpid(WNOHANG) on the child's own pid, so other code's waitpid() and
+/// pclose() keep working), enforces timeouts and starts queued commands.
+/// Callbacks run on the thread calling process_runner_poll().
+///
+/// At most @c max_running children run at once; further submissions queue
+/// in order.  Per-name counters record runs, failures and timing.
+///
+/// Submitting is thread-safe; polling must happen on one thread.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Default children running at once.
+#define PROCESS_RUNNER_DEFAULT_MAX_RUNNING 4
+
+/// Default bytes of output kept per run.
+#define PROCESS_RUNNER_DEFAULT_CAPTURE 4096
+
+/// Distinct command names with their own counters.
+#define PROCESS_RUNNER_MAX_STATS 16
+
+/// Flag for process_runner_spawn_flags(): the child writes to the caller's
+/// own stdout and stderr and nothing is captured.  For fire-and-forget
+/// commands that may leave background processes behind, which would get
+/// SIGPIPE writing to a capture pipe once the runner closes it.
+#define PROCESS_RUNNER_NO_CAPTURE (1u << 0)
+
+typedef struct ProcessRunner ProcessRunner;
+
+typedef struct {
+  uint32_t max_running; ///< 0: PROCESS_RUNNER_DEFAULT_MAX_RUNNING.
+  size_t capture_max;   ///< 0: PROCESS_RUNNER_DEFAULT_CAPTURE.
+} ProcessRunnerCfg;
+
+typedef struct {
+  const char *name;
+  int spawn_errno;       ///< Non-zero if the command never started.
+  int status;            ///< waitpid() status, when it started.
+  bool timed_out;        ///< Killed with SIGKILL at its timeout.
+  const char *output;    ///< stdout + stderr, NUL-terminated.
+  size_t output_len;
+  bool output_truncated; ///< More than capture_max bytes were written.
+  uint64_t queued_us;    ///< Submission to spawn.
+  uint64_t run_us;       ///< Spawn to exit.
+} ProcessResult;
+
+/// True if @p r started, was not killed and exited 0.
+bool process_result_ok(const ProcessResult *r);
+
+typedef void (*ProcessDoneFn)(const ProcessResult *result, void *arg);
+
+typedef struct {
+  char name[32];
+  uint64_t runs;
+  uint64_t failures;     ///< Spawn errors, timeouts and non-zero exits.
+  uint64_t timeouts;
+  uint64_t total_queued_us;
+  uint64_t total_run_us;
+  uint64_t max_run_us;
+} ProcessStats;
+
+/// @return The runner, or NULL with errno set.
+ProcessRunner *process_runner_create(const ProcessRunnerCfg *cfg);
+
+/// Kill and reap anything still running and free @p r; pending callbacks
+/// are not called.
+void process_runner_destroy(ProcessRunner *r);
+
+/// Queue @p argv (NULL-terminated; argv[0] is looked up on PATH).
+/// @param name        Label for the counters; NULL uses argv[0].
+/// @param timeout_ms  0 for none.
+/// @param done        May be NULL.
+/// @return false if the command could not be queued.
+bool process_runner_spawn(ProcessRunner *r, const char *name,
+                          const char *const argv[], uint32_t timeout_ms,
+                          ProcessDoneFn done, void *arg);
+
+/// Queue @p cmd for /bin/sh -c, as system() would run it.
+bool process_runner_shell(ProcessRunner *r, const char *name,
+                          const char *cmd, uint32_t timeout_ms,
+                          ProcessDoneFn done, void *arg);
+
+/// process_runner_spawn() with PROCESS_RUNNER_* @p flags.
+bool process_runner_spawn_flags(ProcessRunner *r, const char *name,
+                                const char *const argv[],
+                                uint32_t timeout_ms, uint32_t flags,
+                                ProcessDoneFn done, void *arg);
+
+/// process_runner_shell() with PROCESS_RUNNER_* @p flags.
+bool process_runner_shell_flags(ProcessRunner *r, const char *name,
+                                const char *cmd, uint32_t timeout_ms,
+                                uint32_t flags, ProcessDoneFn done,
+                                void *arg);
+
+/// Do all pending work, waiting up to @p timeout_ms for some if there is
+/// none (0 never blocks).
+void process_runner_poll(ProcessRunner *r, uint32_t timeout_ms);
+
+/// Commands running or queued.
+size_t process_runner_pending(ProcessRunner *r);
+
+/// Copy up to @p max per-name counters into @p out.
+/// @return The number copied.
+size_t process_runner_get_stats(ProcessRunner *r, ProcessStats *out,
+                                size_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,8 @@
 #include "runtime.h"
 #include "bm_config.h"
 #include "bm_log.h"
+#include "bm_trace.h"
+#include "capture_filter.h"
 #include "gateway_device.h"
 #include "pcap_file_sink.h"
 #include "platform_linux.h"
@@ -29,6 +31,7 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 static const char *k_usage =
@@ -38,18 +41,39 @@ static const char *k_usage =
     "  --init       <path>    TOML init file (provides all settings below).\n"
     "  --node-id    <hex64>   This node's 64-bit Bristlemouth node ID.\n"
     "  --cfg-dir    <path>    Directory for config partition files.\n"
+    "  --cfg-backend <name>   Config partition storage: file/journal\n"
+    "                         (default: file).\n"
+    "  --cfg-commit-ms <ms>   Journal group-commit window; 0 syncs every\n"
+    "                         save (default: 0).\n"
     "  --peer       <hex64>   A peer node ID; repeat up to 15 times.\n"
     "                         (16 peers triggers a truncation warning)\n"
     "  --socket-dir <path>    Unix socket directory (default: /tmp).\n"
     "  --uart       <device>  Serial device path for UART gateway mode.\n"
     "  --baud       <rate>    Baud rate for UART (default: 115200).\n"
     "  --pcap       <path>    Write captured L2 frames to a pcap file.\n"
+    "  --pcap-size  <MB>      Start a new pcap file every <MB> million\n"
+    "                         bytes (like tcpdump -C).\n"
+    "  --pcap-count <n>       Rotate through <n> pcap files (like\n"
+    "                         tcpdump -W).\n"
+    "  --pcap-format <fmt>    pcap (default), or pcapng with one interface\n"
+    "                         per port, direction and ns timestamps.\n"
+    "  --pcap-filter <expr>   Only capture frames matching <expr>, e.g.\n"
+    "                         'bcmp type 0xa0-0xa7 or port 3'.\n"
+    "  --pcap-live  <path>    Stream the capture to a client of this Unix\n"
+    "                         socket (e.g. Wireshark via bm_sbc_extcap.py).\n"
     "\n"
     "  --log-dir    <path>    Log file directory (default: /var/log/bm_sbc).\n"
     "  --log-level  <level>   Minimum log level: "
     "trace/debug/info/warn/error/fatal\n"
     "                         (default: info).\n"
     "  --log-stdout           Also write logs to stdout.\n"
+    "  --log-async            Write logs from a background thread.\n"
+    "  --log-modules <spec>   Per-module levels, e.g. vpd=debug,bcmp=trace.\n"
+    "  --log-ratelimit <n>/<ms>  Lines per call site per window before\n"
+    "                         repeats are summarised; 0 disables\n"
+    "                         (default: 10/5000).\n"
+    "  --trace-kb   <KiB>     Binary trace ring size; 0 disables\n"
+    "                         (default: 0).\n"
     "CLI flags override values from the init file.\n";
 
 // App name passed in from main() (which is compiled per-app target and
@@ -57,6 +81,12 @@ static const char *k_usage =
 // bm_app_name can reference it at any time after init.
 const char *bm_sbc_app_name_runtime = "bm_sbc";
 
+// Kept for re-reading log levels from the init file on SIGHUP.  The
+// pre-file values (environment and CLI) still win over the file.
+static char s_init_path[512];
+static int s_cli_log_level = -1;
+static char s_cli_log_modules[256];
+
 /// Parse a hex64 string (with optional "0x"/"0X" prefix) into a uint64_t.
 /// Returns true on success and sets *out.
 static bool parse_hex64(const char *s, uint64_t *out) {
@@ -85,6 +115,74 @@ static int parse_log_level(const char *s) {
   return -1;
 }
 
+/// Parse a config backend name to PlatformCfgBackend.  Returns -1 on failure.
+static int parse_cfg_backend(const char *s) {
+  if (strcmp(s, "file") == 0)
+    return PLATFORM_CFG_BACKEND_FILE;
+  if (strcmp(s, "journal") == 0)
+    return PLATFORM_CFG_BACKEND_JOURNAL;
+  return -1;
+}
+
+/// Parse a non-negative millisecond count.  Returns -1 on failure.
+static long parse_ms(const char *s) {
+  char *end = NULL;
+  long ms = strtol(s, &end, 10);
+  if (!*s || !end || *end != '\0' || ms < 0 || ms > 60000)
+    return -1;
+  return ms;
+}
+
+/// Parse a trace ring size in KiB (at most 64 MiB).  Returns -1 on failure.
+static long parse_trace_kb(const char *s) {
+  char *end = NULL;
+  long kb = strtol(s, &end, 10);
+  if (!*s || !end || *end != '\0' || kb < 0 || kb > 65536)
+    return -1;
+  return kb;
+}
+
+/// Parse a pcap rotation setting (file size in MB, or file count).
+/// Returns -1 on failure.
+static long parse_pcap_limit(const char *s) {
+  char *end = NULL;
+  long n = strtol(s, &end, 10);
+  if (!*s || !end || *end != '\0' || n < 1 || n > 100000)
+    return -1;
+  return n;
+}
+
+/// Parse a pcap format name: 0 for pcap, 1 for pcapng, -1 on failure.
+static int parse_pcap_format(const char *s) {
+  if (strcmp(s, "pcap") == 0)
+    return 0;
+  if (strcmp(s, "pcapng") == 0)
+    return 1;
+  return -1;
+}
+
+/// Parse a "<burst>/<window_ms>" rate limit, or "0" to disable it.
+static bool parse_ratelimit(const char *s, uint32_t *burst,
+                            uint32_t *window_ms) {
+  char *end = NULL;
+  long n = strtol(s, &end, 10);
+  if (!*s || !end || n < 0 || n > 100000)
+    return false;
+  if (*end == '\0' && n == 0) {
+    *burst = 0;
+    *window_ms = 0;
+    return true;
+  }
+  if (*end != '/')
+    return false;
+  long ms = parse_ms(end + 1);
+  if (ms <= 0)
+    return false;
+  *burst = (uint32_t)n;
+  *window_ms = (uint32_t)ms;
+  return true;
+}
+
 /// Load settings from a TOML init file.  Values are written into the
 /// provided output parameters only when present in the file — callers
 /// should pre-fill defaults before calling.
@@ -94,9 +192,17 @@ static int parse_log_level(const char *s) {
 /// must NOT be free()'d individually — toml_free() releases everything.
 static int load_init_file(const char *path, VirtualPortCfg *vpc,
                           bool *node_id_set, char *cfg_dir, size_t cfg_dir_sz,
+                          int *cfg_backend, long *cfg_commit_ms,
                           char *uart_path, size_t uart_path_sz, int *baud_rate,
-                          char *pcap_path, size_t pcap_path_sz, char *log_dir,
-                          size_t log_dir_sz, int *log_level, bool *log_stdout) {
+                          char *pcap_path, size_t pcap_path_sz,
+                          long *pcap_size_mb, long *pcap_count,
+                          int *pcap_format, char *pcap_filter,
+                          size_t pcap_filter_sz, char *pcap_live,
+                          size_t pcap_live_sz, char *log_dir,
+                          size_t log_dir_sz, int *log_level, bool *log_stdout,
+                          bool *log_async, char *log_modules,
+                          size_t log_modules_sz, char *log_ratelimit,
+                          size_t log_ratelimit_sz, long *trace_kb) {
   toml_result_t res = toml_parse_file_ex(path);
   if (!res.ok) {
     fprintf(stderr, "bm_sbc: TOML parse error in %s: %s\n", path, res.errmsg);
@@ -122,6 +228,29 @@ static int load_init_file(const char *path, VirtualPortCfg *vpc,
     cfg_dir[cfg_dir_sz - 1] = '\0';
   }
 
+  // cfg-backend (string)
+  d = toml_get(root, "cfg-backend");
+  if (d.type == TOML_STRING) {
+    *cfg_backend = parse_cfg_backend(d.u.s);
+    if (*cfg_backend < 0) {
+      fprintf(stderr, "bm_sbc: invalid cfg-backend in %s: %s\n", path, d.u.s);
+      toml_free(res);
+      return 1;
+    }
+  }
+
+  // cfg-commit-ms (int)
+  d = toml_get(root, "cfg-commit-ms");
+  if (d.type == TOML_INT64) {
+    if (d.u.int64 < 0 || d.u.int64 > 60000) {
+      fprintf(stderr, "bm_sbc: invalid cfg-commit-ms in %s: %lld\n", path,
+              (long long)d.u.int64);
+      toml_free(res);
+      return 1;
+    }
+    *cfg_commit_ms = (long)d.u.int64;
+  }
+
   // socket-dir (string)
   d = toml_get(root, "socket-dir");
   if (d.type == TOML_STRING) {
@@ -169,6 +298,53 @@ static int load_init_file(const char *path, VirtualPortCfg *vpc,
     pcap_path[pcap_path_sz - 1] = '\0';
   }
 
+  // pcap-size (int, MB) and pcap-count (int)
+  d = toml_get(root, "pcap-size");
+  if (d.type == TOML_INT64) {
+    if (d.u.int64 < 1 || d.u.int64 > 100000) {
+      fprintf(stderr, "bm_sbc: invalid pcap-size in %s: %lld\n", path,
+              (long long)d.u.int64);
+      toml_free(res);
+      return 1;
+    }
+    *pcap_size_mb = (long)d.u.int64;
+  }
+  d = toml_get(root, "pcap-count");
+  if (d.type == TOML_INT64) {
+    if (d.u.int64 < 1 || d.u.int64 > 100000) {
+      fprintf(stderr, "bm_sbc: invalid pcap-count in %s: %lld\n", path,
+              (long long)d.u.int64);
+      toml_free(res);
+      return 1;
+    }
+    *pcap_count = (long)d.u.int64;
+  }
+
+  // pcap-format (string)
+  d = toml_get(root, "pcap-format");
+  if (d.type == TOML_STRING) {
+    *pcap_format = parse_pcap_format(d.u.s);
+    if (*pcap_format < 0) {
+      fprintf(stderr, "bm_sbc: invalid pcap-format in %s: %s\n", path, d.u.s);
+      toml_free(res);
+      return 1;
+    }
+  }
+
+  // pcap-filter (string); compiled at startup.
+  d = toml_get(root, "pcap-filter");
+  if (d.type == TOML_STRING) {
+    strncpy(pcap_filter, d.u.s, pcap_filter_sz - 1);
+    pcap_filter[pcap_filter_sz - 1] = '\0';
+  }
+
+  // pcap-live (string)
+  d = toml_get(root, "pcap-live");
+  if (d.type == TOML_STRING) {
+    strncpy(pcap_live, d.u.s, pcap_live_sz - 1);
+    pcap_live[pcap_live_sz - 1] = '\0';
+  }
+
   // log-dir (string)
   d = toml_get(root, "log-dir");
   if (d.type == TOML_STRING) {
@@ -194,10 +370,81 @@ static int load_init_file(const char *path, VirtualPortCfg *vpc,
     *log_stdout = d.u.boolean;
   }
 
+  // log-async (bool)
+  d = toml_get(root, "log-async");
+  if (d.type == TOML_BOOLEAN) {
+    *log_async = d.u.boolean;
+  }
+
+  // log-modules (string)
+  d = toml_get(root, "log-modules");
+  if (d.type == TOML_STRING) {
+    strncpy(log_modules, d.u.s, log_modules_sz - 1);
+    log_modules[log_modules_sz - 1] = '\0';
+  }
+
+  // log-ratelimit (string)
+  d = toml_get(root, "log-ratelimit");
+  if (d.type == TOML_STRING) {
+    strncpy(log_ratelimit, d.u.s, log_ratelimit_sz - 1);
+    log_ratelimit[log_ratelimit_sz - 1] = '\0';
+  }
+
+  // trace-kb (int)
+  d = toml_get(root, "trace-kb");
+  if (d.type == TOML_INT64) {
+    if (d.u.int64 < 0 || d.u.int64 > 65536) {
+      fprintf(stderr, "bm_sbc: invalid trace-kb in %s: %lld\n", path,
+              (long long)d.u.int64);
+      toml_free(res);
+      return 1;
+    }
+    *trace_kb = (long)d.u.int64;
+  }
+
   toml_free(res);
   return 0;
 }
 
+/// SIGHUP: re-read log-level and log-modules from the init file.  Module
+/// levels the file no longer sets go back to the global level.
+static void reload_log_levels(void) {
+  if (s_init_path[0] == '\0') {
+    return;
+  }
+  toml_result_t res = toml_parse_file_ex(s_init_path);
+  if (!res.ok) {
+    bm_log_warn("bm_sbc: reload: TOML parse error in %s: %s", s_init_path,
+                res.errmsg);
+    return;
+  }
+  int level = s_cli_log_level;
+  toml_datum_t d = toml_get(res.toptab, "log-level");
+  if (level < 0 && d.type == TOML_STRING) {
+    level = parse_log_level(d.u.s);
+  }
+  char modules[256] = {0};
+  d = toml_get(res.toptab, "log-modules");
+  if (d.type == TOML_STRING) {
+    strncpy(modules, d.u.s, sizeof(modules) - 1);
+  }
+  toml_free(res);
+  if (s_cli_log_modules[0] != '\0') {
+    strncpy(modules, s_cli_log_modules, sizeof(modules) - 1);
+  }
+
+  if (level >= 0) {
+    bm_log_set_level((BmSbcLogLevel)level);
+  }
+  bm_log_clear_module_levels();
+  if (bm_log_set_module_levels(modules) != 0) {
+    bm_log_warn("bm_sbc: reload: invalid log-modules: %s", modules);
+  }
+  bm_log_format_module_levels(modules, sizeof(modules));
+  bm_log_info("log levels reloaded: level=%d modules=%s",
+              (int)bm_log_get_level(), modules);
+}
+
 // Read Serial and Model from /proc/cpuinfo and build a device name.
 // Returns "rpi_<serial>" if Model contains "Raspberry Pi", otherwise
 // just "<serial>". Falls back to BM_SBC_DEVICE_NAME if unavailable.
@@ -240,13 +487,24 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
           sizeof(vpc.socket_dir) - 1);
   bool node_id_set = false;
   char cfg_dir[512] = {0};
+  int cfg_backend = -1;     // -1 = not set
+  long cfg_commit_ms = -1;  // -1 = not set
   char uart_path[128] = {0};
   char pcap_path[256] = {0};
+  long pcap_size_mb = -1; // -1 = not set
+  long pcap_count = -1;   // -1 = not set
+  int pcap_format = -1;   // -1 = not set
+  char pcap_filter[256] = {0};
+  char pcap_live[sizeof(sockaddr_un::sun_path)] = {0};
   int baud_rate = 115200;
   char init_path[512] = {0};
   char log_dir[256] = {0};
   int log_level = -1; // -1 = not set
   bool log_stdout_flag = false;
+  bool log_async_flag = false;
+  char log_modules[256] = {0};
+  char log_ratelimit[32] = {0};
+  long trace_kb = -1; // -1 = not set
 
   // Seed log vars from environment variables; CLI flags and TOML will override.
   {
@@ -259,20 +517,43 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     env = getenv("BM_SBC_LOG_STDOUT");
     if (env && strcmp(env, "1") == 0)
       log_stdout_flag = true;
+    env = getenv("BM_SBC_LOG_ASYNC");
+    if (env && strcmp(env, "1") == 0)
+      log_async_flag = true;
+    env = getenv("BM_SBC_LOG_MODULES");
+    if (env)
+      strncpy(log_modules, env, sizeof(log_modules) - 1);
+    env = getenv("BM_SBC_LOG_RATELIMIT");
+    if (env)
+      strncpy(log_ratelimit, env, sizeof(log_ratelimit) - 1);
+    env = getenv("BM_SBC_TRACE_KB");
+    if (env)
+      trace_kb = parse_trace_kb(env); // -1 if invalid
   }
 
   static const struct option long_opts[] = {
       {"init", required_argument, NULL, 'i'},
       {"node-id", required_argument, NULL, 'n'},
       {"cfg-dir", required_argument, NULL, 'c'},
+      {"cfg-backend", required_argument, NULL, 'k'},
+      {"cfg-commit-ms", required_argument, NULL, 'm'},
       {"peer", required_argument, NULL, 'p'},
       {"socket-dir", required_argument, NULL, 's'},
       {"uart", required_argument, NULL, 'u'},
       {"baud", required_argument, NULL, 'b'},
       {"pcap", required_argument, NULL, 'w'},
+      {"pcap-size", required_argument, NULL, 'C'},
+      {"pcap-count", required_argument, NULL, 'W'},
+      {"pcap-format", required_argument, NULL, 'f'},
+      {"pcap-filter", required_argument, NULL, 'F'},
+      {"pcap-live", required_argument, NULL, 'L'},
       {"log-dir", required_argument, NULL, 'd'},
       {"log-level", required_argument, NULL, 'l'},
       {"log-stdout", no_argument, NULL, 'o'},
+      {"log-async", no_argument, NULL, 'a'},
+      {"log-modules", required_argument, NULL, 'g'},
+      {"log-ratelimit", required_argument, NULL, 'r'},
+      {"trace-kb", required_argument, NULL, 't'},
       {NULL, 0, NULL, 0},
   };
 
@@ -296,6 +577,24 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
       strncpy(cfg_dir, optarg, sizeof(cfg_dir) - 1);
       break;
     }
+    case 'k': {
+      cfg_backend = parse_cfg_backend(optarg);
+      if (cfg_backend < 0) {
+        fprintf(stderr, "bm_sbc: invalid --cfg-backend: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
+    case 'm': {
+      cfg_commit_ms = parse_ms(optarg);
+      if (cfg_commit_ms < 0) {
+        fprintf(stderr, "bm_sbc: invalid --cfg-commit-ms value: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
     case 'p': {
       if (vpc.num_peers >= VIRTUAL_PORT_CFG_MAX_PEERS) {
         fprintf(stderr, "bm_sbc: too many --peer flags (max %d); ignoring %s\n",
@@ -333,6 +632,41 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
       strncpy(pcap_path, optarg, sizeof(pcap_path) - 1);
       break;
     }
+    case 'C': {
+      pcap_size_mb = parse_pcap_limit(optarg);
+      if (pcap_size_mb < 0) {
+        fprintf(stderr, "bm_sbc: invalid --pcap-size value: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
+    case 'W': {
+      pcap_count = parse_pcap_limit(optarg);
+      if (pcap_count < 0) {
+        fprintf(stderr, "bm_sbc: invalid --pcap-count value: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
+    case 'f': {
+      pcap_format = parse_pcap_format(optarg);
+      if (pcap_format < 0) {
+        fprintf(stderr, "bm_sbc: invalid --pcap-format: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
+    case 'F': {
+      strncpy(pcap_filter, optarg, sizeof(pcap_filter) - 1);
+      break;
+    }
+    case 'L': {
+      strncpy(pcap_live, optarg, sizeof(pcap_live) - 1);
+      break;
+    }
     case 'd': {
       strncpy(log_dir, optarg, sizeof(log_dir) - 1);
       break;
@@ -350,6 +684,27 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
       log_stdout_flag = true;
       break;
     }
+    case 'a': {
+      log_async_flag = true;
+      break;
+    }
+    case 'g': {
+      strncpy(log_modules, optarg, sizeof(log_modules) - 1);
+      break;
+    }
+    case 'r': {
+      strncpy(log_ratelimit, optarg, sizeof(log_ratelimit) - 1);
+      break;
+    }
+    case 't': {
+      trace_kb = parse_trace_kb(optarg);
+      if (trace_kb < 0) {
+        fprintf(stderr, "bm_sbc: invalid --trace-kb value: %s\n", optarg);
+        fprintf(stderr, "%s", k_usage);
+        return 1;
+      }
+      break;
+    }
     default: {
       fprintf(stderr, "bm_sbc: unrecognised option\n");
       fprintf(stderr, "%s", k_usage);
@@ -365,6 +720,8 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     uint64_t cli_node_id = vpc.own_node_id;
     char cli_cfg_dir[512];
     strncpy(cli_cfg_dir, cfg_dir, sizeof(cli_cfg_dir));
+    int cli_cfg_backend = cfg_backend;
+    long cli_cfg_commit_ms = cfg_commit_ms;
     char cli_socket_dir[sizeof(vpc.socket_dir)];
     strncpy(cli_socket_dir, vpc.socket_dir, sizeof(cli_socket_dir));
     uint8_t cli_num_peers = vpc.num_peers;
@@ -375,10 +732,23 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     int cli_baud_rate = baud_rate;
     char cli_pcap_path[256];
     strncpy(cli_pcap_path, pcap_path, sizeof(cli_pcap_path));
+    long cli_pcap_size_mb = pcap_size_mb;
+    long cli_pcap_count = pcap_count;
+    int cli_pcap_format = pcap_format;
+    char cli_pcap_filter[256];
+    strncpy(cli_pcap_filter, pcap_filter, sizeof(cli_pcap_filter));
+    char cli_pcap_live[sizeof(pcap_live)];
+    strncpy(cli_pcap_live, pcap_live, sizeof(cli_pcap_live));
     char cli_log_dir[256];
     strncpy(cli_log_dir, log_dir, sizeof(cli_log_dir));
     int cli_log_level = log_level;
     bool cli_log_stdout_flag = log_stdout_flag;
+    bool cli_log_async_flag = log_async_flag;
+    char cli_log_modules[256];
+    strncpy(cli_log_modules, log_modules, sizeof(cli_log_modules));
+    char cli_log_ratelimit[32];
+    strncpy(cli_log_ratelimit, log_ratelimit, sizeof(cli_log_ratelimit));
+    long cli_trace_kb = trace_kb;
 
     // Reset to defaults before loading from file.
     memset(&vpc, 0, sizeof(vpc));
@@ -386,17 +756,35 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
             sizeof(vpc.socket_dir) - 1);
     node_id_set = false;
     memset(cfg_dir, 0, sizeof(cfg_dir));
+    cfg_backend = -1;
+    cfg_commit_ms = -1;
     memset(uart_path, 0, sizeof(uart_path));
     memset(pcap_path, 0, sizeof(pcap_path));
+    pcap_size_mb = -1;
+    pcap_count = -1;
+    pcap_format = -1;
+    memset(pcap_filter, 0, sizeof(pcap_filter));
+    memset(pcap_live, 0, sizeof(pcap_live));
     baud_rate = 115200;
     memset(log_dir, 0, sizeof(log_dir));
     log_level = -1;
     log_stdout_flag = false;
+    log_async_flag = false;
+    memset(log_modules, 0, sizeof(log_modules));
+    memset(log_ratelimit, 0, sizeof(log_ratelimit));
+    trace_kb = -1;
 
     int rc = load_init_file(init_path, &vpc, &node_id_set, cfg_dir,
-                            sizeof(cfg_dir), uart_path, sizeof(uart_path),
-                            &baud_rate, pcap_path, sizeof(pcap_path), log_dir,
-                            sizeof(log_dir), &log_level, &log_stdout_flag);
+                            sizeof(cfg_dir), &cfg_backend, &cfg_commit_ms,
+                            uart_path, sizeof(uart_path), &baud_rate,
+                            pcap_path, sizeof(pcap_path), &pcap_size_mb,
+                            &pcap_count, &pcap_format, pcap_filter,
+                            sizeof(pcap_filter), pcap_live,
+                            sizeof(pcap_live), log_dir, sizeof(log_dir),
+                            &log_level, &log_stdout_flag,
+                            &log_async_flag, log_modules,
+                            sizeof(log_modules), log_ratelimit,
+                            sizeof(log_ratelimit), &trace_kb);
     if (rc != 0) {
       return rc;
     }
@@ -409,6 +797,12 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     if (cli_cfg_dir[0] != '\0') {
       strncpy(cfg_dir, cli_cfg_dir, sizeof(cfg_dir) - 1);
     }
+    if (cli_cfg_backend >= 0) {
+      cfg_backend = cli_cfg_backend;
+    }
+    if (cli_cfg_commit_ms >= 0) {
+      cfg_commit_ms = cli_cfg_commit_ms;
+    }
     if (strcmp(cli_socket_dir, VIRTUAL_PORT_DEFAULT_SOCKET_DIR) != 0) {
       strncpy(vpc.socket_dir, cli_socket_dir, sizeof(vpc.socket_dir) - 1);
     }
@@ -425,6 +819,21 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     if (cli_pcap_path[0] != '\0') {
       strncpy(pcap_path, cli_pcap_path, sizeof(pcap_path) - 1);
     }
+    if (cli_pcap_size_mb >= 0) {
+      pcap_size_mb = cli_pcap_size_mb;
+    }
+    if (cli_pcap_count >= 0) {
+      pcap_count = cli_pcap_count;
+    }
+    if (cli_pcap_format >= 0) {
+      pcap_format = cli_pcap_format;
+    }
+    if (cli_pcap_filter[0] != '\0') {
+      strncpy(pcap_filter, cli_pcap_filter, sizeof(pcap_filter) - 1);
+    }
+    if (cli_pcap_live[0] != '\0') {
+      strncpy(pcap_live, cli_pcap_live, sizeof(pcap_live) - 1);
+    }
     if (cli_log_dir[0] != '\0') {
       strncpy(log_dir, cli_log_dir, sizeof(log_dir) - 1);
     }
@@ -434,6 +843,23 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
     if (cli_log_stdout_flag) {
       log_stdout_flag = true;
     }
+    if (cli_log_async_flag) {
+      log_async_flag = true;
+    }
+    if (cli_log_modules[0] != '\0') {
+      strncpy(log_modules, cli_log_modules, sizeof(log_modules) - 1);
+    }
+    if (cli_log_ratelimit[0] != '\0') {
+      strncpy(log_ratelimit, cli_log_ratelimit, sizeof(log_ratelimit) - 1);
+    }
+    if (cli_trace_kb >= 0) {
+      trace_kb = cli_trace_kb;
+    }
+
+    strncpy(s_init_path, init_path, sizeof(s_init_path) - 1);
+    s_cli_log_level = cli_log_level;
+    strncpy(s_cli_log_modules, cli_log_modules,
+            sizeof(s_cli_log_modules) - 1);
   }
 
   if (!node_id_set) {
@@ -444,6 +870,11 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
 
   // --- Config partition persistence --------------------------------------
   if (cfg_dir[0] != '\0') {
+    if (cfg_backend >= 0) {
+      platform_linux_set_cfg_backend(
+          (PlatformCfgBackend)cfg_backend,
+          cfg_commit_ms > 0 ? (uint32_t)cfg_commit_ms : 0);
+    }
     platform_linux_set_cfg_dir(cfg_dir);
     bm_debug("bm_sbc: cfg-dir=%s\n", cfg_dir);
   }
@@ -460,6 +891,29 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
   if (log_level >= 0) {
     bm_log_set_level((BmSbcLogLevel)log_level);
   }
+  if (log_modules[0] != '\0' && bm_log_set_module_levels(log_modules) != 0) {
+    bm_log_error("bm_sbc: invalid log-modules: %s", log_modules);
+    return 1;
+  }
+  if (log_ratelimit[0] != '\0') {
+    uint32_t burst, window_ms;
+    if (!parse_ratelimit(log_ratelimit, &burst, &window_ms)) {
+      bm_log_error("bm_sbc: invalid log-ratelimit: %s", log_ratelimit);
+      return 1;
+    }
+    bm_log_set_ratelimit(burst, window_ms);
+  }
+  bm_log_set_reload_cb(reload_log_levels);
+
+  if (log_async_flag && bm_log_start_async(NULL) != 0) {
+    bm_log_warn("bm_sbc: async logging unavailable; logging synchronously");
+  }
+
+  if (trace_kb > 0 &&
+      bm_trace_init(app_name, vpc.own_node_id, log_dir[0] ? log_dir : NULL,
+                    (size_t)trace_kb * 1024u) != 0) {
+    bm_log_warn("bm_sbc: binary trace unavailable");
+  }
 
   // --- First structured log line ------------------------------------------
   bool gateway_mode = (uart_path[0] != '\0');
@@ -510,13 +964,72 @@ int bm_sbc_runtime_init(int argc, char **argv, const char *app_name) {
   BmErr err = BmOK;
   bm_err_check(err, bm_l2_init(net_dev));
 
-  if (pcap_path[0] != '\0') {
-    if (pcap_file_sink_open(pcap_path) != 0) {
-      bm_log_error("failed to open pcap file: %s", pcap_path);
+  if (pcap_path[0] != '\0' || pcap_live[0] != '\0') {
+    PcapWriterCfg pcap_cfg;
+    memset(&pcap_cfg, 0, sizeof(pcap_cfg));
+    if (pcap_size_mb > 0) {
+      pcap_cfg.file_bytes = (uint64_t)pcap_size_mb * 1000000u;
+    }
+    if (pcap_count > 0) {
+      pcap_cfg.file_count = (uint32_t)pcap_count;
+    }
+    // pcapng: one interface per port, tapped in the devices themselves.
+    char port_names[PCAP_WRITER_MAX_PORTS][16];
+    char port_descs[PCAP_WRITER_MAX_PORTS][128];
+    char comment[96];
+    if (pcap_format == 1) {
+      pcap_cfg.pcapng = true;
+      pcap_cfg.num_ports = PCAP_WRITER_MAX_PORTS;
+      for (uint8_t p = 1; p <= PCAP_WRITER_MAX_PORTS; p++) {
+        PcapWriterPort *port = &pcap_cfg.ports[p - 1];
+        port->name = port_names[p - 1];
+        port->description = port_descs[p - 1];
+        if (gateway_mode && p == GATEWAY_UART_PORT) {
+          snprintf(port_names[p - 1], sizeof(port_names[0]), "uart");
+          snprintf(port_descs[p - 1], sizeof(port_descs[0]), "%s", uart_path);
+        } else {
+          snprintf(port_names[p - 1], sizeof(port_names[0]), "vpd%u", p);
+          if (p <= vpc.num_peers) {
+            snprintf(port_descs[p - 1], sizeof(port_descs[0]),
+                     "peer 0x%016" PRIx64, vpc.peer_ids[p - 1]);
+          } else {
+            port->description = NULL;
+          }
+        }
+      }
+      snprintf(comment, sizeof(comment), "%s node=0x%016" PRIx64, app_name,
+               vpc.own_node_id);
+      pcap_cfg.comment = comment;
+    }
+    CaptureFilter filter;
+    char filter_err[160];
+    if (capture_filter_compile(&filter, pcap_filter, filter_err,
+                               sizeof(filter_err)) != 0) {
+      bm_log_error("invalid pcap filter '%s': %s", pcap_filter, filter_err);
       return 1;
     }
-    bm_l2_register_pcap_callback(pcap_write_packet);
-    bm_log_info("pcap capture -> %s", pcap_path);
+    // The classic pcap tap has no port or direction, so such a filter
+    // would quietly capture nothing.
+    if (filter.uses_port_dir && !pcap_cfg.pcapng) {
+      bm_log_error("pcap filter '%s' tests port or direction, which needs "
+                   "--pcap-format pcapng", pcap_filter);
+      return 1;
+    }
+    pcap_cfg.filter = &filter;
+    if (pcap_file_sink_open(pcap_path[0] ? pcap_path : NULL,
+                            pcap_live[0] ? pcap_live : NULL,
+                            &pcap_cfg) != 0) {
+      bm_log_error("failed to open pcap capture: %s%s%s", pcap_path,
+                   pcap_path[0] && pcap_live[0] ? ", " : "", pcap_live);
+      return 1;
+    }
+    if (!pcap_cfg.pcapng) {
+      bm_l2_register_pcap_callback(pcap_write_packet);
+    }
+    bm_log_info("pcap capture -> %s%s%s (%s%s%s)", pcap_path,
+                pcap_live[0] ? (pcap_path[0] ? ", live " : "live ") : "",
+                pcap_live, pcap_cfg.pcapng ? "pcapng" : "pcap",
+                pcap_filter[0] ? ", filter: " : "", pcap_filter);
   }
 
   bm_err_check(err, timer_callback_handler_init());
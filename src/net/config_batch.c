@@ -0,0 +1,79 @@
+#include "config_batch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+typedef struct {
+  uint8_t *old;   ///< Value before the batch; NULL if the key was unset.
+  size_t old_len;
+} Undo;
+
+// Read @p key's current value into a new buffer in @p u.
+static bool record(const ConfigBatchStore *s, const ConfigBatchKey *k,
+                   Undo *u) {
+  u->old = (uint8_t *)malloc(s->max_value);
+  if (!u->old) {
+    return false;
+  }
+  u->old_len = s->max_value;
+  if (!s->get(s->ctx, k->key, k->key_len, u->old, &u->old_len)) {
+    free(u->old);
+    u->old = NULL;
+    u->old_len = 0;
+  }
+  return true;
+}
+
+// Put @p key back as @p u recorded it.
+static bool restore(const ConfigBatchStore *s, const ConfigBatchKey *k,
+                    const Undo *u, uint8_t *scratch) {
+  if (u->old) {
+    return s->set(s->ctx, k->key, k->key_len, u->old, u->old_len);
+  }
+  size_t len = s->max_value;
+  if (!s->get(s->ctx, k->key, k->key_len, scratch, &len)) {
+    return true; // Never got set.
+  }
+  return s->remove(s->ctx, k->key, k->key_len);
+}
+
+int config_batch_apply(const ConfigBatchStore *store,
+                       const ConfigBatchKey *keys, size_t count,
+                       ConfigBatchApplyFn apply, void *arg, size_t *failed) {
+  if (count == 0 || count > CONFIG_BATCH_MAX_ENTRIES) {
+    return -EINVAL;
+  }
+  Undo undo[CONFIG_BATCH_MAX_ENTRIES] = {{0}};
+  bool ok = true;
+  size_t changed = 0; // Entries that may differ from the store.
+  for (size_t n = 0; n < count && ok; n++) {
+    ok = record(store, &keys[n], &undo[n]);
+    if (ok) {
+      // A failed entry may have been changed before it failed; put it
+      // back too.
+      changed = n + 1;
+      ok = apply(n, arg);
+    }
+    if (!ok) {
+      *failed = n;
+    }
+  }
+
+  int rc = 0;
+  if (!ok) {
+    rc = -ENOMEM;
+    uint8_t *scratch = (uint8_t *)malloc(store->max_value);
+    for (size_t n = changed; n-- > 0;) {
+      if (!scratch || !restore(store, &keys[n], &undo[n], scratch)) {
+        rc = -EFAULT;
+      }
+    }
+    free(scratch);
+  } else if (!store->save(store->ctx)) {
+    rc = -EIO;
+  }
+  for (size_t n = 0; n < changed; n++) {
+    free(undo[n].old);
+  }
+  return rc;
+}
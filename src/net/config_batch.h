@@ -0,0 +1,69 @@
+#pragma once
+
+/// @file config_batch.h
+/// @brief Apply several config keys as one change: all of them, or none.
+///
+/// The config partition has no transactions: each set_config_*() changes
+/// the in-memory partition on its own, and the next save_config() persists
+/// whatever is there.  A batch that runs out of room part-way through
+/// would leave its first keys set, to be saved by the next unrelated
+/// config_set.
+///
+/// config_batch_apply() reads each key's stored value (as CBOR, which
+/// keeps its type) just before the key is changed.  If an entry cannot be
+/// applied, the keys already changed are put back newest first, and keys
+/// the batch added are removed, so the partition is as it was; the store
+/// is saved only once every entry is in.
+///
+/// The store is reached through ConfigBatchStore, so the gateway hands it
+/// the system partition and the tests a fake.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Most entries in one batch.
+#define CONFIG_BATCH_MAX_ENTRIES 32
+
+typedef struct {
+  /// Copy @p key's value, CBOR encoded, into @p buf.  @p len is the size of
+  /// @p buf on entry and the value's length on return.  false if unset.
+  bool (*get)(void *ctx, const char *key, size_t key_len, uint8_t *buf,
+              size_t *len);
+  /// Set @p key to a CBOR encoded value, with the type it encodes.
+  bool (*set)(void *ctx, const char *key, size_t key_len, const uint8_t *buf,
+              size_t len);
+  bool (*remove)(void *ctx, const char *key, size_t key_len);
+  bool (*save)(void *ctx);
+  void *ctx;
+  size_t max_value; ///< Longest value get() can return.
+} ConfigBatchStore;
+
+typedef struct {
+  const char *key;
+  size_t key_len;
+} ConfigBatchKey;
+
+/// Set entry @p n of the batch in the store; false if it could not be set.
+typedef bool (*ConfigBatchApplyFn)(size_t n, void *arg);
+
+/// Apply entries [0, @p count) with @p apply, then save the store once.
+///
+/// @param keys    The key each entry sets; no key appears twice.
+/// @param failed  Set to the entry that could not be applied.
+/// @return 0 once saved; -EINVAL if @p count is 0 or over
+///         CONFIG_BATCH_MAX_ENTRIES; -ENOMEM if an entry could not be
+///         applied and the store was put back as it was; -EFAULT if it
+///         could not be put back either (not saved); -EIO if every entry
+///         was applied but the save failed.
+int config_batch_apply(const ConfigBatchStore *store,
+                       const ConfigBatchKey *keys, size_t count,
+                       ConfigBatchApplyFn apply, void *arg, size_t *failed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,8 @@
 #include "gateway_device.h"
 #include "bm_log.h"
+#include "completion.h"
 #include "messages/neighbors.h"
+#include "pcap_writer.h"
 #include "uart_l2_transport.h"
 #include "virtual_port_device.h"
 #include "l2.h"
@@ -14,6 +16,9 @@ static struct {
   NetworkDevice vpd; ///< Underlying VirtualPortDevice.
   uint8_t vpd_ports; ///< Number of VPD ports (cached).
   uint8_t uart_port; ///< Port number for the UART link.
+  CompletionWaiter uart_waiter;
+  Completion uart_up;         ///< Set while the UART neighbor is up.
+  uint64_t uart_neighbor_id;  ///< Written before uart_up is signalled.
 } s_gw;
 
 // ---------------------------------------------------------------------------
@@ -33,6 +38,9 @@ static BmErr gw_send(void *self, uint8_t *data, size_t length, uint8_t port) {
     // Flood: send on all VPD ports + UART.
     BmErr vpd_err = s_gw.vpd.trait->send(s_gw.vpd.self, data, length, 0);
     int uart_err = uart_l2_send(data, length);
+    if (uart_err == 0) {
+      pcap_writer_frame(s_gw.uart_port, PCAP_WRITER_OUT, data, length);
+    }
     // Return error only if both failed.
     if (vpd_err != BmOK && uart_err != 0) {
       return vpd_err;
@@ -47,7 +55,11 @@ static BmErr gw_send(void *self, uint8_t *data, size_t length, uint8_t port) {
 
   if (port == s_gw.uart_port) {
     // Send on UART.
-    return uart_l2_send(data, length) == 0 ? BmOK : BmEIO;
+    if (uart_l2_send(data, length) != 0) {
+      return BmEIO;
+    }
+    pcap_writer_frame(s_gw.uart_port, PCAP_WRITER_OUT, data, length);
+    return BmOK;
   }
 
   return BmEINVAL;
@@ -141,6 +153,12 @@ static void gw_neighbor_discovery_cb(bool up, BcmpNeighbor *neighbor) {
     return;
   }
   bm_log_info("UART link %s (port %u)", up ? "up" : "down", neighbor->port);
+  if (up) {
+    s_gw.uart_neighbor_id = neighbor->node_id;
+    completion_signal(&s_gw.uart_up, 0);
+  } else {
+    completion_reset(&s_gw.uart_up);
+  }
   if (s_gw.vpd.callbacks && s_gw.vpd.callbacks->link_change) {
     s_gw.vpd.callbacks->link_change(neighbor->port - 1, up);
   }
@@ -159,6 +177,9 @@ NetworkDevice gateway_device_get(NetworkDevice *vpd_dev) {
                        : raw_vpd_ports;
   s_gw.uart_port = s_gw.vpd_ports + 1;
 
+  completion_waiter_init(&s_gw.uart_waiter);
+  completion_init(&s_gw.uart_up, &s_gw.uart_waiter);
+
   // Register a callback for when neighbors appear and disappear
   // and use it to tell L2 that the link is up/down.
   bcmp_neighbor_register_discovery_callback(gw_neighbor_discovery_cb);
@@ -176,6 +197,9 @@ NetworkDevice gateway_device_get(NetworkDevice *vpd_dev) {
 
 void gateway_uart_rx_cb(const uint8_t *frame, size_t len, void *ctx) {
   (void)ctx;
+  if (len > 0) {
+    pcap_writer_frame(s_gw.uart_port, PCAP_WRITER_IN, frame, len);
+  }
 
   // If the port is down, but we have received bytes, link up
   if (!bm_l2_get_port_state(GATEWAY_UART_PORT - 1)) {
@@ -188,3 +212,18 @@ void gateway_uart_rx_cb(const uint8_t *frame, size_t len, void *ctx) {
     s_gw.vpd.callbacks->receive(s_gw.uart_port, (uint8_t *)frame, len);
   }
 }
+
+bool gateway_device_has_uart(void) {
+  // uart_up has no waiter until gateway_device_get() has run.
+  return s_gw.uart_up.waiter != NULL;
+}
+
+bool gateway_device_wait_uart_neighbor(uint64_t *node_id,
+                                       uint32_t timeout_ms) {
+  if (!gateway_device_has_uart() ||
+      !completion_wait(&s_gw.uart_up, timeout_ms, NULL)) {
+    return false;
+  }
+  *node_id = s_gw.uart_neighbor_id;
+  return true;
+}
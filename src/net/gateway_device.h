@@ -11,6 +11,7 @@
 /// UART RX frames are delivered via callbacks->receive(uart_port, data, len).
 
 #include "network_device.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -37,6 +38,20 @@ NetworkDevice gateway_device_get(NetworkDevice *vpd_dev);
 /// device's callbacks->receive() with the UART port number.
 void gateway_uart_rx_cb(const uint8_t *frame, size_t len, void *ctx);
 
+/// true once gateway_device_get() has built the device, i.e. the runtime
+/// was started with a UART link (`--uart`).
+bool gateway_device_has_uart(void);
+
+/// Block until a neighbor is up on the UART port or @p timeout_ms passes.
+/// Woken directly by neighbor discovery; returns at once if the neighbor
+/// came up before the call.
+///
+/// @param node_id  Set to the neighbor's node id on success.
+/// @return         true if the neighbor is up; false at once if there is
+///                 no UART link (see gateway_device_has_uart()).
+bool gateway_device_wait_uart_neighbor(uint64_t *node_id,
+                                       uint32_t timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,14 @@
 #include "gateway_ipc.h"
 
+#include "app_runner.h"
 #include "bm_log.h"
+#include "completion.h"
+#include "config_batch.h"
+#include "gateway_ipc_shm.h"
+#include "gateway_ipc_sub.h"
+#include "ipc_peer.h"
+#include "ipc_ratelimit.h"
+#include "unit_watcher.h"
 #include "bm_os.h"
 #include "bm_service_request.h"
 #include "cbor.h"
@@ -9,6 +17,7 @@
 #include "spotter.h"
 #include <array>
 #include <string>
+#include <vector>
 extern "C" {
 #include "device.h"
 }
@@ -16,13 +25,16 @@ extern "C" {
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 namespace {
@@ -32,19 +44,80 @@ constexpr size_t MAX_TOPIC_LEN = 255;
 constexpr size_t MAX_FILE_NAME_LEN = 63;
 constexpr size_t MAX_LOG_LINE_LEN = 1024;
 
+// shm_register carries the ring memfd and its eventfd doorbell.
+constexpr size_t MAX_RX_FDS = 2;
+
+// Datagrams pulled per recvmmsg().  At least the kernel's default
+// max_dgram_qlen, so one call normally empties the queue.
+constexpr size_t RX_BATCH = 16;
+
+// Used when /proc/sys/net/unix/max_dgram_qlen is unreadable (kernel default).
+constexpr uint32_t DEFAULT_MAX_DGRAM_QLEN = 10;
+
+// Encoded ack: five small keys, a 64-bit req_id and two small ints.
+constexpr size_t ACK_BUF_BYTES = 64;
+
+// Encoded stats reply: ten keys, eight uint64 counters and the histogram.
+constexpr size_t STATS_BUF_BYTES = 512;
+
+// Encoded clients reply: about 64 bytes per tracked client.
+constexpr size_t CLIENTS_BUF_BYTES = 128 + 64 * IPC_RATELIMIT_MAX_CLIENTS;
+
+// Per-client admission defaults, overridable with $BM_SBC_IPC_CLIENT_RATE
+// and $BM_SBC_IPC_CLIENT_BURST (rate 0 disables limiting).  The control
+// bucket defaults to IPC_RATELIMIT_CRITICAL_RATE/_BURST, overridable with
+// $BM_SBC_IPC_CONTROL_RATE and $BM_SBC_IPC_CONTROL_BURST.
+constexpr uint32_t DEFAULT_CLIENT_RATE = 2000;
+constexpr uint32_t DEFAULT_CLIENT_BURST = 4000;
+
 // Published for sensor_data messages: "sensor/<node_id hex16>/<topic_suffix>".
 // The suffix from the client must not begin with a slash.
 constexpr const char *SENSOR_TOPIC_PREFIX_FMT = "sensor/%016" PRIx64 "/";
 // "sensor/" + 16 hex chars + "/".
 constexpr size_t SENSOR_TOPIC_PREFIX_LEN = 7 + 16 + 1;
 
+// sensor_data held while the mote's node id (part of every sensor topic) is
+// still unknown; past this the gateway answers BmEBUSY until it is set.
+constexpr size_t MAX_DEFERRED_BYTES = 256 * 1024;
+
 // Poweroff service request (bm_service_request API is seconds-granular, so
 // 100 ms is not expressible — use the smallest allowed value and cap total
 // attempts instead).
 constexpr uint32_t POWEROFF_TIMEOUT_S = 1;
 
 int g_ipc_fd = -1;
-uint64_t mote_node_id = 0;
+// Bound socket path; a client may not name it as its reply path.
+char g_ipc_path[sizeof(sockaddr_un::sun_path)] = {0};
+uint64_t mote_node_id = 0; // 0 until the mote is known
+
+// Deferred sensor_data, as [u32 len][shm sensor record] entries.
+std::vector<uint8_t> g_deferred;
+bool g_deferred_full = false;
+
+// Flow-control state for acks (see ack_credits()).
+uint32_t g_rx_qlen = DEFAULT_MAX_DGRAM_QLEN;
+uint32_t g_rx_pending = 0;
+bool g_stack_busy = false;
+
+GatewayIpcStats g_stats = {};
+GatewayIpcPublishFn g_publish_fn = nullptr;
+
+IpcRateLimit g_ratelimit;
+
+// Out-of-band data that arrived alongside a datagram.  Handlers that take
+// ownership of an fd overwrite its slot with -1; whatever is left is closed
+// after dispatch so a client cannot leak descriptors into the gateway.
+// from is the sender's address, used to route acks; pid/uid come from
+// SCM_CREDENTIALS and key the sender's rate-limit entry.
+struct RxMeta {
+  int fds[MAX_RX_FDS];
+  size_t num_fds;
+  struct sockaddr_un from;
+  socklen_t from_len;
+  uint32_t pid;
+  uint32_t uid;
+  IpcClient *client;
+};
 
 static struct {
   BmTaskHandle handle = NULL;
@@ -59,6 +132,34 @@ static struct {
   size_t request_retry = 0;
 } power_off_task;
 
+uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void record_dispatch(uint64_t ns, BmErr status) {
+  size_t bucket = 0;
+  for (uint64_t v = ns; v > 1 && bucket < GATEWAY_IPC_LAT_BUCKETS - 1;
+       v >>= 1) {
+    bucket++;
+  }
+  g_stats.dispatch_ns_hist[bucket]++;
+  g_stats.dispatch_ns_total += ns;
+  if (status != BmOK) {
+    g_stats.dispatch_errors++;
+  }
+}
+
+// Record a Bristlemouth stack call that failed for lack of queue space, so
+// acks sent for the rest of this poll advertise zero credits.
+void note_stack_status(BmErr err) {
+  if (err == BmENOMEM || err == BmEAGAIN || err == BmEBUSY) {
+    g_stack_busy = true;
+  }
+}
+
 bool cbor_get_text(const CborValue *map, const char *key, char *out,
                    size_t out_cap, size_t *out_len) {
   CborValue v;
@@ -91,7 +192,7 @@ bool cbor_get_bool(const CborValue *map, const char *key, bool *out) {
 }
 
 // Returns a pointer+length into the source buffer for a byte string at key.
-// No copy required because the CBOR source buffer is the recvfrom() buffer,
+// No copy required because the CBOR source buffer is the receive buffer,
 // which stays valid for the lifetime of the handler.
 bool cbor_get_bytes_view(const CborValue *map, const char *key,
                          const uint8_t **out_ptr, size_t *out_len) {
@@ -143,62 +244,157 @@ static inline void cleanup_power_off_task(void) {
   power_off_task.handle = NULL;
 }
 
-template <std::size_t N>
-static inline void run_command_get_output(const std::string &cmd,
-                                          std::array<char, N> &buf) {
-  FILE *fp = popen(cmd.c_str(), "r");
-  if (fp == NULL) {
-    return;
+// A command run on the app's process runner by a task that waits for it.
+struct WaitedCommand {
+  CompletionWaiter waiter;
+  Completion done;
+  std::array<char, 256> output;
+};
+
+static void on_waited_command_done(const ProcessResult *r, void *arg) {
+  auto *cmd = static_cast<WaitedCommand *>(arg);
+  if (!process_result_ok(r)) {
+    bm_log_warn("%s failed (spawn_errno=%d status=%d%s)", r->name,
+                r->spawn_errno, r->status, r->timed_out ? " timed out" : "");
+  }
+  snprintf(cmd->output.data(), cmd->output.size(), "%s", r->output);
+  completion_signal(&cmd->done, process_result_ok(r) ? 0 : -1);
+}
+
+// Run @p argv and block the calling task, not the app loop, until it exits.
+// The runner kills it at @p timeout_ms, so the callback always comes.
+static bool run_command_wait(WaitedCommand *cmd, const char *name,
+                             const char *const argv[], uint32_t timeout_ms) {
+  ProcessRunner *runner = bm_sbc_process_runner();
+  cmd->output[0] = '\0';
+  completion_reset(&cmd->done);
+  if (!runner || !process_runner_spawn(runner, name, argv, timeout_ms,
+                                       on_waited_command_done, cmd)) {
+    bm_log_error("%s: could not start: %s", name, strerror(errno));
+    return false;
+  }
+  int32_t status = -1;
+  while (!completion_wait(&cmd->done, timeout_ms + 1000, &status)) {
+    bm_log_warn("%s: still waiting for the app loop to reap it", name);
   }
+  return status == 0;
+}
 
-  // Only set the buffer if an error did not occur
-  int err = ferror(fp);
-  if (!err) {
-    fgets(buf.data(), buf.size(), fp);
-    // Strip newline if it exists
-    buf.data()[strcspn(buf.data(), "\n")] = '\0';
+// Value of @p key in `systemctl show` output, or "" if it is absent.
+static std::string show_property(const char *output, const char *key) {
+  const size_t key_len = strlen(key);
+  for (const char *line = output; *line;) {
+    const char *end = strchrnul(line, '\n');
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == '=') {
+      return std::string(line + key_len + 1, end);
+    }
+    line = *end ? end + 1 : end;
   }
-  pclose(fp);
+  return "";
 }
 
-static inline void wait_for_hydrotwin(void) {
-  // Stop cobs_to_shm
-  const std::string cobs_to_shm = "cobs_to_shm";
-  const std::string disable_cobs_to_shm =
-      "systemctl stop " + cobs_to_shm + ".service";
-  bm_log_info("%s: disabling %s, %s", __func__, cobs_to_shm.c_str(),
-              disable_cobs_to_shm.c_str());
-  system(disable_cobs_to_shm.c_str());
-
-  const std::string service_name = "hydrotwind.service";
-  const std::string service_active = "systemctl is-active " + service_name;
-  const std::string property = "ExecMainStatus";
-  const std::string service_return =
-      "systemctl show " + service_name + " -p " + property;
-
-  int exited_code = 1;
-  std::array<char, 128> buf = {};
+constexpr uint32_t SYSTEMCTL_TIMEOUT_MS = 30000;
+
+constexpr const char *HYDROTWIN_UNIT = "hydrotwind.service";
+
+// How often a watcher is re-read even without a change event.
+constexpr uint32_t HYDROTWIN_RECHECK_MS = 1000;
+
+// ExecMainStatus from one `systemctl show`.
+static bool query_hydrotwin_exit_status(WaitedCommand *cmd, int32_t *status) {
+  const char *const show_status[] = {"systemctl", "show", HYDROTWIN_UNIT,
+                                     "-p", "ExecMainStatus", NULL};
+  if (!run_command_wait(cmd, "hydrotwind show", show_status,
+                        SYSTEMCTL_TIMEOUT_MS)) {
+    return false;
+  }
+  const std::string value =
+      show_property(cmd->output.data(), "ExecMainStatus");
+  if (value.empty()) {
+    return false;
+  }
+  *status = atoi(value.c_str());
+  return true;
+}
+
+// Block on unit state changes until hydrotwind has stopped with status 0.
+// @return false if no watcher backend works; nothing has been waited for.
+static bool watch_hydrotwin_exit(WaitedCommand *cmd) {
+  UnitWatcher *w = unit_watcher_open(HYDROTWIN_UNIT);
+  if (!w) {
+    return false;
+  }
+  bm_log_info("%s: watching %s (%s)", __func__, HYDROTWIN_UNIT,
+              unit_watcher_backend(w));
+
+  bool ok = true;
+  for (;;) {
+    UnitStatus st;
+    int rc = unit_watcher_wait_stopped(w, &st, HYDROTWIN_RECHECK_MS);
+    if (rc == 0) {
+      continue;
+    }
+    if (rc < 0) {
+      bm_log_warn("%s: unit watcher failed: %s", __func__, strerror(errno));
+      ok = false;
+      break;
+    }
+    int32_t exited_code = st.exec_main_status;
+    if ((st.exec_main_status_known ||
+         query_hydrotwin_exit_status(cmd, &exited_code)) &&
+        exited_code == 0) {
+      break;
+    }
+    // Stopped with an error: wait for it to run again.
+    if (unit_watcher_wait(w, HYDROTWIN_RECHECK_MS) < 0) {
+      ok = false;
+      break;
+    }
+  }
+  unit_watcher_close(w);
+  return ok;
+}
+
+// Fallback for watch_hydrotwin_exit(): one `systemctl show` per 100 ms.
+static void poll_hydrotwin_exit(WaitedCommand *cmd) {
+  const char *const show_hydrotwin[] = {
+      "systemctl",   "show", HYDROTWIN_UNIT, "-p",
+      "ActiveState", "-p",   "ExecMainStatus", NULL};
   static constexpr int sleep_time_us = 100000;
 
-  while (exited_code) {
+  for (;;) {
     usleep(sleep_time_us);
-    memset(buf.data(), 0, sizeof(buf));
-
-    run_command_get_output(service_active, buf);
+    if (!run_command_wait(cmd, "hydrotwind show", show_hydrotwin,
+                          SYSTEMCTL_TIMEOUT_MS)) {
+      continue;
+    }
 
     // If the process is active, retry
-    if (!strcmp(buf.data(), "active")) {
+    if (show_property(cmd->output.data(), "ActiveState") == "active") {
       continue;
     }
 
-    run_command_get_output(service_return, buf);
-
-    // Set exited based on the output of the command
-    const char *eq = strchr(buf.data(), '=');
-    if (eq) {
-      exited_code = atoi(eq + 1);
+    const std::string exited_code =
+        show_property(cmd->output.data(), "ExecMainStatus");
+    if (!exited_code.empty() && atoi(exited_code.c_str()) == 0) {
+      break;
     }
   }
+}
+
+static inline void wait_for_hydrotwin(WaitedCommand *cmd) {
+  // Stop cobs_to_shm
+  const char *const stop_cobs_to_shm[] = {"systemctl", "stop",
+                                          "cobs_to_shm.service", NULL};
+  bm_log_info("%s: disabling cobs_to_shm, systemctl stop cobs_to_shm.service",
+              __func__);
+  run_command_wait(cmd, "cobs_to_shm stop", stop_cobs_to_shm,
+                   SYSTEMCTL_TIMEOUT_MS);
+
+  if (!watch_hydrotwin_exit(cmd)) {
+    bm_log_warn("%s: no unit watcher; polling systemctl", __func__);
+    poll_hydrotwin_exit(cmd);
+  }
 
   bm_log_info("%s: hydrotwin service inactive, powering off", __func__);
 }
@@ -217,8 +413,12 @@ static void request_power_off(void *arg) {
   }
   poweroff_service_len = static_cast<size_t>(n);
 
+  WaitedCommand cmd;
+  completion_waiter_init(&cmd.waiter);
+  completion_init(&cmd.done, &cmd.waiter);
+
   bm_log_info("replay_caught_up: waiting for hydrotwin service to finish");
-  wait_for_hydrotwin();
+  wait_for_hydrotwin(&cmd);
 
   bm_log_info("replay_caught_up: requesting %s (timeout=%us)", poweroff_service,
               POWEROFF_TIMEOUT_S);
@@ -245,9 +445,10 @@ static void request_power_off(void *arg) {
     }
 
     if (acknowledged) {
-      int rc = system("systemctl poweroff");
-      if (rc != 0) {
-        bm_log_error("systemctl poweroff returned %d", rc);
+      const char *const poweroff[] = {"systemctl", "poweroff", NULL};
+      if (!run_command_wait(&cmd, "poweroff", poweroff,
+                            SYSTEMCTL_TIMEOUT_MS)) {
+        bm_log_error("systemctl poweroff failed");
       } else {
         break;
       }
@@ -263,15 +464,16 @@ static void request_power_off(void *arg) {
         power_off_task.request_retry_max);
   }
 
+  completion_waiter_destroy(&cmd.waiter);
   cleanup_power_off_task();
 }
 
-void handle_replay_caught_up(const CborValue *) {
+BmErr handle_replay_caught_up(const CborValue *) {
   bm_log_info("IPC RX replay_caught_up");
 
   // A replay event is already being handled
   if (power_off_task.queue.handle || power_off_task.handle) {
-    return;
+    return BmOK;
   }
 
   // Reset retries and create task to handle sending service request,
@@ -280,18 +482,18 @@ void handle_replay_caught_up(const CborValue *) {
   power_off_task.request_retry = 0;
   power_off_task.queue.handle =
       bm_queue_create(power_off_task.queue.count, sizeof(size_t));
-  bm_task_create(request_power_off, power_off_task.name,
-                 power_off_task.stack_size, NULL, power_off_task.priority,
-                 power_off_task.handle);
+  return bm_task_create(request_power_off, power_off_task.name,
+                        power_off_task.stack_size, NULL,
+                        power_off_task.priority, power_off_task.handle);
 }
 
-void handle_spotter_log(const CborValue *map) {
+BmErr handle_spotter_log(const CborValue *map) {
   char data[MAX_LOG_LINE_LEN + 1] = {0};
   size_t data_len = 0;
   if (!cbor_get_text(map, "data", data, sizeof(data), &data_len) ||
       data_len == 0) {
     bm_log_warn("IPC spotter_log: missing/empty data");
-    return;
+    return BmEINVAL;
   }
 
   char file_name[MAX_FILE_NAME_LEN + 1] = {0};
@@ -301,9 +503,11 @@ void handle_spotter_log(const CborValue *map) {
   bool print_timestamp = false;
   cbor_get_bool(map, "print_timestamp", &print_timestamp);
 
-  bm_log_info("IPC RX spotter_log data_len=%zu file_name='%s' "
-              "print_timestamp=%d",
-              data_len, have_file_name ? file_name : "", print_timestamp);
+  bm_log_ratelimited(BM_LOG_INFO,
+                     "IPC RX spotter_log data_len=%zu file_name='%s' "
+                     "print_timestamp=%d",
+                     data_len, have_file_name ? file_name : "",
+                     print_timestamp);
 
   BmErr err =
       spotter_log(0, have_file_name ? file_name : nullptr,
@@ -311,14 +515,16 @@ void handle_spotter_log(const CborValue *map) {
   if (err != BmOK) {
     bm_log_warn("IPC spotter_log: spotter_log failed, err=%d", err);
   }
+  note_stack_status(err);
+  return err;
 }
 
-void handle_spotter_tx(const CborValue *map) {
+BmErr handle_spotter_tx(const CborValue *map) {
   const uint8_t *data = nullptr;
   size_t data_len = 0;
   if (!cbor_get_bytes_view(map, "data", &data, &data_len) || data_len == 0) {
     bm_log_warn("IPC spotter_tx: missing/empty data");
-    return;
+    return BmEINVAL;
   }
 
   bool iridium_fallback = false;
@@ -327,57 +533,270 @@ void handle_spotter_tx(const CborValue *map) {
                                      ? BmNetworkTypeCellularIriFallback
                                      : BmNetworkTypeCellularOnly;
 
-  bm_log_info("IPC RX spotter_tx data_len=%zu iridium_fallback=%d", data_len,
-              iridium_fallback);
+  bm_log_ratelimited(BM_LOG_INFO,
+                     "IPC RX spotter_tx data_len=%zu iridium_fallback=%d",
+                     data_len, iridium_fallback);
 
   BmErr err = spotter_tx_data(data, static_cast<uint16_t>(data_len), net_type);
   if (err != BmOK) {
     bm_log_warn("IPC spotter_tx: spotter_tx_data failed, err=%d", err);
   }
+  note_stack_status(err);
+  return err;
 }
 
-void handle_sensor_data(const CborValue *map) {
-  char topic_suffix[MAX_TOPIC_LEN + 1] = {0};
-  size_t suffix_len = 0;
-  if (!cbor_get_text(map, "topic_suffix", topic_suffix, sizeof(topic_suffix),
-                     &suffix_len) ||
-      suffix_len == 0) {
+bool check_topic_suffix(const char *topic_suffix, size_t suffix_len) {
+  if (suffix_len == 0) {
     bm_log_warn("IPC sensor_data: missing/empty topic_suffix");
-    return;
+    return false;
   }
   if (topic_suffix[0] == '/') {
     bm_log_warn("IPC sensor_data: topic_suffix must not begin with '/'");
-    return;
+    return false;
   }
 
   if (SENSOR_TOPIC_PREFIX_LEN + suffix_len > MAX_TOPIC_LEN) {
     bm_log_warn("IPC sensor_data: topic too long (%zu)",
                 SENSOR_TOPIC_PREFIX_LEN + suffix_len);
-    return;
+    return false;
   }
-  char topic[MAX_TOPIC_LEN + 1] = {0};
-  int n = snprintf(topic, sizeof(topic), SENSOR_TOPIC_PREFIX_FMT, mote_node_id);
+  return true;
+}
+
+// Build "sensor/<node_id hex16>/<topic_suffix>" into topic (MAX_TOPIC_LEN + 1
+// bytes).  The suffix need not be NUL-terminated.
+bool build_sensor_topic(const char *topic_suffix, size_t suffix_len,
+                        char *topic) {
+  if (!check_topic_suffix(topic_suffix, suffix_len)) {
+    return false;
+  }
+  int n = snprintf(topic, MAX_TOPIC_LEN + 1, SENSOR_TOPIC_PREFIX_FMT,
+                   mote_node_id);
   if (n < 0 || static_cast<size_t>(n) != SENSOR_TOPIC_PREFIX_LEN) {
     bm_log_warn("IPC sensor_data: failed to format topic prefix");
-    return;
+    return false;
   }
   memcpy(topic + SENSOR_TOPIC_PREFIX_LEN, topic_suffix, suffix_len);
   topic[SENSOR_TOPIC_PREFIX_LEN + suffix_len] = '\0';
+  return true;
+}
+
+BmErr publish_sensor_data(const char *topic, const uint8_t *data,
+                          size_t data_len) {
+  if (data_len > UINT16_MAX) {
+    bm_log_warn("IPC sensor_data: data too long (%zu)", data_len);
+    return BmEINVAL;
+  }
+  uint16_t len = static_cast<uint16_t>(data_len);
+  BmErr err = g_publish_fn ? g_publish_fn(topic, data, len)
+                           : bm_pub(topic, data, len, 0,
+                                    BM_COMMON_PUB_SUB_VERSION);
+  if (err != BmOK) {
+    bm_log_warn("IPC sensor_data: bm_pub(%s) failed, err=%d", topic, err);
+  } else {
+    g_stats.published++;
+  }
+  note_stack_status(err);
+  return err;
+}
+
+// Hold one sensor_data until the mote is known, in the shm record layout so
+// gateway_ipc_set_mote_node_id() can replay it through shm_sensor_record().
+BmErr defer_sensor_data(const char *topic_suffix, size_t suffix_len,
+                        const uint8_t *data, size_t data_len) {
+  uint32_t rec_len = static_cast<uint32_t>(GATEWAY_IPC_SHM_SENSOR_HDR_BYTES +
+                                           suffix_len + data_len);
+  if (g_deferred.size() + sizeof(rec_len) + rec_len > MAX_DEFERRED_BYTES) {
+    if (!g_deferred_full) {
+      bm_log_warn("IPC sensor_data: mote not known yet and %zu bytes held; "
+                  "refusing until it is",
+                  g_deferred.size());
+      g_deferred_full = true;
+    }
+    return BmEBUSY;
+  }
+  uint16_t len16 = static_cast<uint16_t>(suffix_len);
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&rec_len);
+  g_deferred.insert(g_deferred.end(), p, p + sizeof(rec_len));
+  p = reinterpret_cast<const uint8_t *>(&len16);
+  g_deferred.insert(g_deferred.end(), p, p + sizeof(len16));
+  p = reinterpret_cast<const uint8_t *>(topic_suffix);
+  g_deferred.insert(g_deferred.end(), p, p + suffix_len);
+  g_deferred.insert(g_deferred.end(), data, data + data_len);
+  return BmOK;
+}
+
+BmErr handle_sensor_data(const CborValue *map) {
+  char topic_suffix[MAX_TOPIC_LEN + 1] = {0};
+  size_t suffix_len = 0;
+  if (!cbor_get_text(map, "topic_suffix", topic_suffix, sizeof(topic_suffix),
+                     &suffix_len)) {
+    suffix_len = 0;
+  }
+  if (!check_topic_suffix(topic_suffix, suffix_len)) {
+    return BmEINVAL;
+  }
 
   const uint8_t *data = nullptr;
   size_t data_len = 0;
   if (!cbor_get_bytes_view(map, "data", &data, &data_len)) {
     bm_log_warn("IPC sensor_data: missing data");
+    return BmEINVAL;
+  }
+
+  if (mote_node_id == 0) {
+    bm_log_debug("IPC RX sensor_data topic_suffix='%s' data_len=%zu "
+                 "(held until the mote is known)",
+                 topic_suffix, data_len);
+    return defer_sensor_data(topic_suffix, suffix_len, data, data_len);
+  }
+  char topic[MAX_TOPIC_LEN + 1] = {0};
+  if (!build_sensor_topic(topic_suffix, suffix_len, topic)) {
+    return BmEINVAL;
+  }
+
+  bm_log_ratelimited(BM_LOG_INFO, "IPC RX sensor_data topic='%s' data_len=%zu",
+                     topic, data_len);
+
+  return publish_sensor_data(topic, data, data_len);
+}
+
+// Sink for records drained from shared-memory rings.  Same topic rules as the
+// datagram path; logged at debug because this is the high-rate path.
+void shm_sensor_record(const uint8_t *rec, size_t len) {
+  if (len < GATEWAY_IPC_SHM_SENSOR_HDR_BYTES) {
+    bm_log_warn("IPC shm sensor_data: short record (%zu bytes)", len);
     return;
   }
+  uint16_t suffix_len = 0;
+  memcpy(&suffix_len, rec, sizeof(suffix_len));
+  if (suffix_len > len - GATEWAY_IPC_SHM_SENSOR_HDR_BYTES) {
+    bm_log_warn("IPC shm sensor_data: topic_suffix_len %u exceeds record",
+                suffix_len);
+    return;
+  }
+  const char *suffix =
+      reinterpret_cast<const char *>(rec + GATEWAY_IPC_SHM_SENSOR_HDR_BYTES);
+  char topic[MAX_TOPIC_LEN + 1] = {0};
+  if (!build_sensor_topic(suffix, suffix_len, topic)) {
+    return;
+  }
+  const uint8_t *data = rec + GATEWAY_IPC_SHM_SENSOR_HDR_BYTES + suffix_len;
+  size_t data_len = len - GATEWAY_IPC_SHM_SENSOR_HDR_BYTES - suffix_len;
+  bm_log_debug("IPC shm sensor_data topic='%s' data_len=%zu", topic, data_len);
+  publish_sensor_data(topic, data, data_len);
+}
 
-  bm_log_info("IPC RX sensor_data topic='%s' data_len=%zu", topic, data_len);
+BmErr handle_shm_register(const CborValue *map, RxMeta *meta) {
+  char name[GATEWAY_IPC_SHM_MAX_NAME_LEN + 1] = {0};
+  size_t name_len = 0;
+  if (!cbor_get_text(map, "name", name, sizeof(name), &name_len) ||
+      name_len == 0) {
+    bm_log_warn("IPC shm_register: missing/empty name");
+    return BmEINVAL;
+  }
+  if (meta->num_fds < 1) {
+    bm_log_warn("IPC shm_register '%s': no memfd attached (SCM_RIGHTS)", name);
+    return BmEINVAL;
+  }
+
+  bm_log_info("IPC RX shm_register name='%s' fds=%zu", name, meta->num_fds);
+
+  // The registry owns both fds from here on, success or not.
+  int mem_fd = meta->fds[0];
+  int doorbell_fd = meta->num_fds > 1 ? meta->fds[1] : -1;
+  meta->fds[0] = -1;
+  if (meta->num_fds > 1) {
+    meta->fds[1] = -1;
+  }
+  return gateway_ipc_shm_register(name, mem_fd, doorbell_fd) == 0 ? BmOK
+                                                                  : BmEINVAL;
+}
+
+BmErr handle_shm_unregister(const CborValue *map) {
+  char name[GATEWAY_IPC_SHM_MAX_NAME_LEN + 1] = {0};
+  size_t name_len = 0;
+  if (!cbor_get_text(map, "name", name, sizeof(name), &name_len) ||
+      name_len == 0) {
+    bm_log_warn("IPC shm_unregister: missing/empty name");
+    return BmEINVAL;
+  }
+  bm_log_info("IPC RX shm_unregister name='%s'", name);
+  if (gateway_ipc_shm_unregister(name) != 0) {
+    bm_log_warn("IPC shm_unregister: no ring named '%s'", name);
+    return BmENOENT;
+  }
+  return BmOK;
+}
 
-  BmErr err = bm_pub(topic, data, static_cast<uint16_t>(data_len), 0,
-                     BM_COMMON_PUB_SUB_VERSION);
+// Shared by subscribe/unsubscribe: the reply path is the socket the request
+// came from (ipc_peer.h).  A reply_path in the request must name that same
+// socket, so a client can neither aim pushes at someone else's socket nor
+// drop another client's subscriptions.
+BmErr get_reply_path(const CborValue *map, const RxMeta *meta,
+                     const char *what, char *out, size_t out_cap) {
+  char named[sizeof(sockaddr_un::sun_path)] = {0};
+  bool have_named = cbor_get_text(map, "reply_path", named, sizeof(named),
+                                  nullptr);
+  int rc = ipc_peer_reply_path(&meta->from, meta->from_len,
+                               have_named ? named : nullptr, out, out_cap);
+  if (rc == -EPERM) {
+    bm_log_warn("IPC %s: reply_path '%s' is not the sender's socket '%s'",
+                what, named, out);
+    return BmEPERM;
+  }
+  if (rc != 0) {
+    bm_log_warn("IPC %s: sender is not bound to a socket path", what);
+    return BmEINVAL;
+  }
+  return BmOK;
+}
+
+BmErr handle_subscribe(const CborValue *map, const RxMeta *meta) {
+  char reply_path[sizeof(sockaddr_un::sun_path)] = {0};
+  BmErr err = get_reply_path(map, meta, "subscribe", reply_path,
+                             sizeof(reply_path));
   if (err != BmOK) {
-    bm_log_warn("IPC sensor_data: bm_pub(%s) failed, err=%d", topic, err);
+    return err;
   }
+  char topic[MAX_TOPIC_LEN + 1] = {0};
+  size_t topic_len = 0;
+  if (!cbor_get_text(map, "topic", topic, sizeof(topic), &topic_len) ||
+      topic_len == 0) {
+    bm_log_warn("IPC subscribe: missing/empty topic");
+    return BmEINVAL;
+  }
+
+  bm_log_info("IPC RX subscribe topic='%s' reply_path='%s'", topic,
+              reply_path);
+  // Inputs are validated above, so a failure here means the client or topic
+  // table is full (or the stack refused the subscription).
+  return gateway_ipc_sub_add(reply_path, topic, topic_len) == 0 ? BmOK
+                                                                : BmENOMEM;
+}
+
+BmErr handle_unsubscribe(const CborValue *map, const RxMeta *meta) {
+  char reply_path[sizeof(sockaddr_un::sun_path)] = {0};
+  BmErr err = get_reply_path(map, meta, "unsubscribe", reply_path,
+                             sizeof(reply_path));
+  if (err != BmOK) {
+    return err;
+  }
+  // No topic ⇒ drop every subscription held by this reply path.
+  char topic[MAX_TOPIC_LEN + 1] = {0};
+  size_t topic_len = 0;
+  bool have_topic =
+      cbor_get_text(map, "topic", topic, sizeof(topic), &topic_len) &&
+      topic_len > 0;
+
+  bm_log_info("IPC RX unsubscribe topic='%s' reply_path='%s'",
+              have_topic ? topic : "*", reply_path);
+  if (gateway_ipc_sub_remove(reply_path, have_topic ? topic : nullptr,
+                             topic_len) != 0) {
+    bm_log_warn("IPC unsubscribe: no subscription for '%s'", reply_path);
+    return BmENOENT;
+  }
+  return BmOK;
 }
 
 // A stored text string is CBOR-encoded into MAX_CONFIG_BUFFER_SIZE_BYTES
@@ -387,158 +806,747 @@ void handle_sensor_data(const CborValue *map) {
 // MAX_STR_LEN_BYTES because cbor_encode_text_string overflows the buffer.)
 constexpr size_t MAX_IPC_CONFIG_STR_BYTES = MAX_CONFIG_BUFFER_SIZE_BYTES - 2;
 
-bool apply_config_string(const char *key, size_t key_len, const CborValue *v) {
-  size_t str_len = 0;
-  if (cbor_value_get_string_length(v, &str_len) != CborNoError) {
-    bm_log_warn("IPC config_set: failed to read string length");
-    return false;
-  }
-  if (str_len > MAX_IPC_CONFIG_STR_BYTES) {
-    bm_log_warn(
-        "IPC config_set: string value too long (max %zu bytes, got %zu)",
-        MAX_IPC_CONFIG_STR_BYTES, str_len);
-    return false;
-  }
-  char value[MAX_IPC_CONFIG_STR_BYTES + 1] = {0};
-  size_t cap = sizeof(value) - 1;
-  if (cbor_value_copy_text_string(v, value, &cap, nullptr) != CborNoError) {
-    bm_log_warn("IPC config_set: failed to read string value");
+// Most entries accepted in one config_set_batch.  The datagram size limit
+// is usually reached first.
+constexpr size_t MAX_CONFIG_BATCH = CONFIG_BATCH_MAX_ENTRIES;
+
+// One validated config_set value, ready to hand to set_config_*().
+struct ConfigEntry {
+  char key[MAX_KEY_LEN_BYTES + 1];
+  size_t key_len;
+  enum { STR, UINT, INT, FLOAT } kind;
+  char str[MAX_IPC_CONFIG_STR_BYTES + 1];
+  size_t str_len;
+  uint32_t u;
+  int32_t i;
+  float f;
+};
+
+// Decode and range-check a config_value without touching the partition.
+// what names the message type in warnings.
+bool parse_config_value(const CborValue *v, ConfigEntry *e, const char *what) {
+  if (cbor_value_is_text_string(v)) {
+    size_t str_len = 0;
+    if (cbor_value_get_string_length(v, &str_len) != CborNoError) {
+      bm_log_warn("IPC %s: failed to read string length", what);
+      return false;
+    }
+    if (str_len > MAX_IPC_CONFIG_STR_BYTES) {
+      bm_log_warn("IPC %s: string value too long (max %zu bytes, got %zu)",
+                  what, MAX_IPC_CONFIG_STR_BYTES, str_len);
+      return false;
+    }
+    size_t cap = sizeof(e->str) - 1;
+    if (cbor_value_copy_text_string(v, e->str, &cap, nullptr) != CborNoError) {
+      bm_log_warn("IPC %s: failed to read string value", what);
+      return false;
+    }
+    e->str[cap] = '\0';
+    e->str_len = cap;
+    e->kind = ConfigEntry::STR;
+  } else if (cbor_value_is_unsigned_integer(v)) {
+    uint64_t u = 0;
+    cbor_value_get_uint64(v, &u);
+    if (u > UINT32_MAX) {
+      bm_log_warn("IPC %s: uint value %" PRIu64 " out of range", what, u);
+      return false;
+    }
+    e->u = static_cast<uint32_t>(u);
+    e->kind = ConfigEntry::UINT;
+  } else if (cbor_value_is_integer(v)) {
+    int64_t i = 0;
+    cbor_value_get_int64(v, &i);
+    if (i < INT32_MIN || i > INT32_MAX) {
+      bm_log_warn("IPC %s: int value %" PRId64 " out of range", what, i);
+      return false;
+    }
+    e->i = static_cast<int32_t>(i);
+    e->kind = ConfigEntry::INT;
+  } else if (cbor_value_is_double(v) || cbor_value_is_float(v)) {
+    double d = 0.0;
+    if (cbor_value_is_double(v)) {
+      cbor_value_get_double(v, &d);
+    } else {
+      float f = 0.0f;
+      cbor_value_get_float(v, &f);
+      d = f;
+    }
+    e->f = static_cast<float>(d);
+    e->kind = ConfigEntry::FLOAT;
+  } else {
+    bm_log_warn("IPC %s: unsupported config_value CBOR type", what);
     return false;
   }
-  value[cap] = '\0';
-  bm_log_info("IPC config_set key='%s' value(str)='%s'", key, value);
-  return set_config_string(BM_CFG_PARTITION_SYSTEM, key, key_len, value, cap);
+  return true;
 }
 
-bool apply_config_uint(const char *key, size_t key_len, const CborValue *v) {
-  uint64_t u = 0;
-  cbor_value_get_uint64(v, &u);
-  if (u > UINT32_MAX) {
-    bm_log_warn("IPC config_set: uint value %" PRIu64 " out of range", u);
-    return false;
+// Write one entry into the in-memory system partition (no save).
+bool apply_config_entry(const ConfigEntry &e) {
+  switch (e.kind) {
+  case ConfigEntry::STR:
+    bm_log_info("IPC config_set key='%s' value(str)='%s'", e.key, e.str);
+    return set_config_string(BM_CFG_PARTITION_SYSTEM, e.key, e.key_len, e.str,
+                             e.str_len);
+  case ConfigEntry::UINT:
+    bm_log_info("IPC config_set key='%s' value(uint)=%" PRIu32, e.key, e.u);
+    return set_config_uint(BM_CFG_PARTITION_SYSTEM, e.key, e.key_len, e.u);
+  case ConfigEntry::INT:
+    bm_log_info("IPC config_set key='%s' value(int)=%" PRId32, e.key, e.i);
+    return set_config_int(BM_CFG_PARTITION_SYSTEM, e.key, e.key_len, e.i);
+  case ConfigEntry::FLOAT:
+    bm_log_info("IPC config_set key='%s' value(float)=%f", e.key,
+                static_cast<double>(e.f));
+    return set_config_float(BM_CFG_PARTITION_SYSTEM, e.key, e.key_len, e.f);
   }
-  bm_log_info("IPC config_set key='%s' value(uint)=%" PRIu64, key, u);
-  return set_config_uint(BM_CFG_PARTITION_SYSTEM, key, key_len,
-                         static_cast<uint32_t>(u));
+  return false;
 }
 
-bool apply_config_int(const char *key, size_t key_len, const CborValue *v) {
-  int64_t i = 0;
-  cbor_value_get_int64(v, &i);
-  if (i < INT32_MIN || i > INT32_MAX) {
-    bm_log_warn("IPC config_set: int value %" PRId64 " out of range", i);
-    return false;
-  }
-  bm_log_info("IPC config_set key='%s' value(int)=%" PRId64, key, i);
-  return set_config_int(BM_CFG_PARTITION_SYSTEM, key, key_len,
-                        static_cast<int32_t>(i));
+// The system partition, for config_batch_apply().  Values are read and
+// restored as CBOR, which carries their type.
+bool system_cfg_get(void *, const char *key, size_t key_len, uint8_t *buf,
+                    size_t *len) {
+  return get_config_cbor(BM_CFG_PARTITION_SYSTEM, key, key_len, buf, len);
 }
 
-bool apply_config_float(const char *key, size_t key_len, const CborValue *v) {
-  double d = 0.0;
-  if (cbor_value_is_double(v)) {
-    cbor_value_get_double(v, &d);
-  } else {
-    float f = 0.0f;
-    cbor_value_get_float(v, &f);
-    d = f;
-  }
-  bm_log_info("IPC config_set key='%s' value(float)=%f", key, d);
-  return set_config_float(BM_CFG_PARTITION_SYSTEM, key, key_len,
-                          static_cast<float>(d));
+bool system_cfg_set(void *, const char *key, size_t key_len,
+                    const uint8_t *buf, size_t len) {
+  return set_config_cbor(BM_CFG_PARTITION_SYSTEM, key, key_len,
+                         const_cast<uint8_t *>(buf), len);
 }
 
-void handle_config_set(const CborValue *map) {
+bool system_cfg_remove(void *, const char *key, size_t key_len) {
+  return remove_key(BM_CFG_PARTITION_SYSTEM, key, key_len);
+}
+
+bool system_cfg_save(void *) {
+  return save_config(BM_CFG_PARTITION_SYSTEM, false);
+}
+
+const ConfigBatchStore k_system_cfg = {
+    system_cfg_get,  system_cfg_set, system_cfg_remove,
+    system_cfg_save, nullptr,        MAX_CONFIG_BUFFER_SIZE_BYTES,
+};
+
+BmErr handle_config_set(const CborValue *map) {
   bm_log_info("IPC RX config_set");
 
-  char key[MAX_KEY_LEN_BYTES + 1] = {0};
-  size_t key_len = 0;
-  if (!cbor_get_text(map, "config_key", key, sizeof(key), &key_len) ||
-      key_len == 0) {
+  ConfigEntry e = {};
+  if (!cbor_get_text(map, "config_key", e.key, sizeof(e.key), &e.key_len) ||
+      e.key_len == 0) {
     bm_log_warn("IPC config_set: missing/empty config_key");
-    return;
+    return BmEINVAL;
   }
 
   CborValue v;
   if (cbor_value_map_find_value(map, "config_value", &v) != CborNoError ||
       cbor_value_get_type(&v) == CborInvalidType) {
     bm_log_warn("IPC config_set: missing config_value");
-    return;
+    return BmEINVAL;
   }
 
-  bool ok;
-  if (cbor_value_is_text_string(&v)) {
-    ok = apply_config_string(key, key_len, &v);
-  } else if (cbor_value_is_unsigned_integer(&v)) {
-    ok = apply_config_uint(key, key_len, &v);
-  } else if (cbor_value_is_integer(&v)) {
-    ok = apply_config_int(key, key_len, &v);
-  } else if (cbor_value_is_double(&v) || cbor_value_is_float(&v)) {
-    ok = apply_config_float(key, key_len, &v);
-  } else {
-    bm_log_warn("IPC config_set: unsupported config_value CBOR type");
-    return;
+  // parse_config_value() already logged the specific failure reason.
+  if (!parse_config_value(&v, &e, "config_set")) {
+    return BmEINVAL;
   }
-
-  // Per-type helpers already logged the specific failure reason.
-  if (!ok) {
-    return;
+  if (!apply_config_entry(e)) {
+    bm_log_warn("IPC config_set: set_config failed for key='%s'", e.key);
+    return BmEINVAL;
   }
 
   if (!save_config(BM_CFG_PARTITION_SYSTEM, false)) {
-    bm_log_warn("IPC config_set: save_config failed for key='%s'", key);
+    bm_log_warn("IPC config_set: save_config failed for key='%s'", e.key);
+    return BmEIO;
   }
+  return BmOK;
 }
 
-void dispatch(const uint8_t *buf, size_t len) {
-  CborParser parser;
-  CborValue root;
-  if (cbor_parser_init(buf, len, 0, &parser, &root) != CborNoError ||
-      !cbor_value_is_map(&root)) {
-    bm_log_warn("IPC: malformed datagram (%zu bytes)", len);
+// {"entries": {key: value, ...}}: every entry is decoded and checked before
+// any is applied, then the partition is saved once for the whole batch.  An
+// entry that does not fit undoes the ones before it (config_batch.h).
+BmErr handle_config_set_batch(const CborValue *map) {
+  static ConfigEntry batch[MAX_CONFIG_BATCH];
+  ConfigBatchKey keys[MAX_CONFIG_BATCH];
+
+  CborValue entries;
+  size_t count = 0;
+  if (cbor_value_map_find_value(map, "entries", &entries) != CborNoError ||
+      !cbor_value_is_map(&entries) ||
+      cbor_value_get_map_length(&entries, &count) != CborNoError) {
+    bm_log_warn("IPC config_set_batch: entries must be a definite-length map");
+    return BmEINVAL;
+  }
+  bm_log_info("IPC RX config_set_batch entries=%zu", count);
+  if (count == 0 || count > MAX_CONFIG_BATCH) {
+    bm_log_warn("IPC config_set_batch: %zu entries (allowed 1-%zu)", count,
+                MAX_CONFIG_BATCH);
+    return BmEINVAL;
+  }
+
+  CborValue it;
+  if (cbor_value_enter_container(&entries, &it) != CborNoError) {
+    return BmEINVAL;
+  }
+  for (size_t n = 0; n < count; n++) {
+    ConfigEntry &e = batch[n];
+    e = {};
+    size_t key_len = 0;
+    if (!cbor_value_is_text_string(&it) ||
+        cbor_value_get_string_length(&it, &key_len) != CborNoError ||
+        key_len == 0 || key_len > MAX_KEY_LEN_BYTES) {
+      bm_log_warn("IPC config_set_batch: entry %zu: key must be 1-%d bytes "
+                  "of text",
+                  n, MAX_KEY_LEN_BYTES);
+      return BmEINVAL;
+    }
+    e.key_len = sizeof(e.key) - 1;
+    if (cbor_value_copy_text_string(&it, e.key, &e.key_len, &it) !=
+        CborNoError) {
+      return BmEINVAL;
+    }
+    e.key[e.key_len] = '\0';
+    keys[n] = {e.key, e.key_len};
+    for (size_t prev = 0; prev < n; prev++) {
+      if (batch[prev].key_len == e.key_len &&
+          memcmp(batch[prev].key, e.key, e.key_len) == 0) {
+        bm_log_warn("IPC config_set_batch: duplicate key='%s'", e.key);
+        return BmEINVAL;
+      }
+    }
+    if (!parse_config_value(&it, &e, "config_set_batch")) {
+      bm_log_warn("IPC config_set_batch: rejected at key='%s'; nothing applied",
+                  e.key);
+      return BmEINVAL;
+    }
+    if (cbor_value_advance(&it) != CborNoError) {
+      return BmEINVAL;
+    }
+  }
+
+  size_t failed = 0;
+  int rc = config_batch_apply(
+      &k_system_cfg, keys, count,
+      [](size_t n, void *) { return apply_config_entry(batch[n]); }, nullptr,
+      &failed);
+  if (rc == -ENOMEM || rc == -EFAULT) {
+    // Validation covers everything set_config_*() checks except running
+    // out of room in the partition.
+    bm_log_error("IPC config_set_batch: set_config failed for key='%s' "
+                 "(entry %zu of %zu); %s",
+                 batch[failed].key, failed + 1, count,
+                 rc == -ENOMEM ? "nothing applied"
+                               : "could not undo the entries before it");
+    return BmENOMEM;
+  }
+  if (rc != 0) {
+    bm_log_warn("IPC config_set_batch: save_config failed (%zu keys)", count);
+    return BmEIO;
+  }
+  bm_log_info("IPC config_set_batch: %zu keys saved", count);
+  return BmOK;
+}
+
+// Send an encoded reply to the sender's own bound address.  Best effort: a
+// full client queue loses the reply, never the gateway's time.
+void send_reply(const RxMeta *meta, const uint8_t *buf, size_t len,
+                const char *what) {
+  if (sendto(g_ipc_fd, buf, len, MSG_DONTWAIT,
+             reinterpret_cast<const struct sockaddr *>(&meta->from),
+             meta->from_len) < 0) {
+    bm_log_debug("IPC: %s reply not sent: %s", what, strerror(errno));
+  }
+}
+
+bool sender_is_bound(const RxMeta *meta) {
+  return ipc_peer_is_bound(meta->from_len);
+}
+
+// Reply with {"v":1,"type":"stats", <GatewayIpcStats fields>}; with
+// "reset": true the counters restart from zero after the snapshot.
+BmErr handle_stats(const CborValue *map, RxMeta *meta) {
+  bool reset = false;
+  cbor_get_bool(map, "reset", &reset);
+  if (!sender_is_bound(meta)) {
+    bm_log_warn("IPC stats: request from an unbound socket");
+    return BmEINVAL;
+  }
+
+  const GatewayIpcStats &st = g_stats;
+  const struct {
+    const char *key;
+    uint64_t value;
+  } counters[] = {
+      {"rx_datagrams", st.rx_datagrams},
+      {"rx_batches", st.rx_batches},
+      {"dispatch_errors", st.dispatch_errors},
+      {"rate_limited", st.rate_limited},
+      {"published", st.published},
+      {"shm_records", st.shm_records},
+      {"poll_cpu_ns", st.poll_cpu_ns},
+      {"dispatch_ns_total", st.dispatch_ns_total},
+  };
+  constexpr size_t num_counters = sizeof(counters) / sizeof(counters[0]);
+
+  uint8_t buf[STATS_BUF_BYTES];
+  CborEncoder enc, map_enc, hist;
+  cbor_encoder_init(&enc, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&enc, &map_enc, 3 + num_counters);
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "v"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map_enc, 1));
+  err =
+      static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "type"));
+  err =
+      static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "stats"));
+  for (const auto &c : counters) {
+    err = static_cast<CborError>(err |
+                                 cbor_encode_text_stringz(&map_enc, c.key));
+    err = static_cast<CborError>(err | cbor_encode_uint(&map_enc, c.value));
+  }
+  err = static_cast<CborError>(
+      err | cbor_encode_text_stringz(&map_enc, "dispatch_ns_hist"));
+  err = static_cast<CborError>(
+      err |
+      cbor_encoder_create_array(&map_enc, &hist, GATEWAY_IPC_LAT_BUCKETS));
+  for (uint64_t count : st.dispatch_ns_hist) {
+    err = static_cast<CborError>(err | cbor_encode_uint(&hist, count));
+  }
+  err = static_cast<CborError>(err |
+                               cbor_encoder_close_container(&map_enc, &hist));
+  err = static_cast<CborError>(err |
+                               cbor_encoder_close_container(&enc, &map_enc));
+  if (err != CborNoError) {
+    bm_log_warn("IPC stats: failed to encode reply");
+    return BmENOMEM;
+  }
+  send_reply(meta, buf, cbor_encoder_get_buffer_size(&enc, buf), "stats");
+
+  if (reset) {
+    gateway_ipc_reset_stats();
+  }
+  return BmOK;
+}
+
+// Reply with {"v":1,"type":"clients","rate","burst","clients":[{"pid","uid",
+// "accepted","dropped","limited"}...]} for every tracked sender.
+BmErr handle_clients(RxMeta *meta) {
+  if (!sender_is_bound(meta)) {
+    bm_log_warn("IPC clients: request from an unbound socket");
+    return BmEINVAL;
+  }
+  size_t count = 0;
+  for (const IpcClient &c : g_ratelimit.clients) {
+    count += c.in_use;
+  }
+
+  uint8_t buf[CLIENTS_BUF_BYTES];
+  CborEncoder enc, map_enc, list, entry;
+  cbor_encoder_init(&enc, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&enc, &map_enc, 5);
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "v"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map_enc, 1));
+  err =
+      static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "type"));
+  err = static_cast<CborError>(err |
+                               cbor_encode_text_stringz(&map_enc, "clients"));
+  err =
+      static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "rate"));
+  err = static_cast<CborError>(err |
+                               cbor_encode_uint(&map_enc, g_ratelimit.rate));
+  err =
+      static_cast<CborError>(err | cbor_encode_text_stringz(&map_enc, "burst"));
+  err = static_cast<CborError>(err |
+                               cbor_encode_uint(&map_enc, g_ratelimit.burst));
+  err = static_cast<CborError>(err |
+                               cbor_encode_text_stringz(&map_enc, "clients"));
+  err = static_cast<CborError>(
+      err | cbor_encoder_create_array(&map_enc, &list, count));
+  for (const IpcClient &c : g_ratelimit.clients) {
+    if (!c.in_use) {
+      continue;
+    }
+    err = static_cast<CborError>(err |
+                                 cbor_encoder_create_map(&list, &entry, 5));
+    err = static_cast<CborError>(err | cbor_encode_text_stringz(&entry, "pid"));
+    err = static_cast<CborError>(err | cbor_encode_uint(&entry, c.pid));
+    err = static_cast<CborError>(err | cbor_encode_text_stringz(&entry, "uid"));
+    err = static_cast<CborError>(err | cbor_encode_uint(&entry, c.uid));
+    err = static_cast<CborError>(err |
+                                 cbor_encode_text_stringz(&entry, "accepted"));
+    err = static_cast<CborError>(err | cbor_encode_uint(&entry, c.accepted));
+    err = static_cast<CborError>(err |
+                                 cbor_encode_text_stringz(&entry, "dropped"));
+    err = static_cast<CborError>(err | cbor_encode_uint(&entry, c.dropped));
+    err = static_cast<CborError>(err |
+                                 cbor_encode_text_stringz(&entry, "limited"));
+    err = static_cast<CborError>(err | cbor_encode_boolean(&entry, c.limited));
+    err = static_cast<CborError>(err |
+                                 cbor_encoder_close_container(&list, &entry));
+  }
+  err = static_cast<CborError>(err |
+                               cbor_encoder_close_container(&map_enc, &list));
+  err = static_cast<CborError>(err |
+                               cbor_encoder_close_container(&enc, &map_enc));
+  if (err != CborNoError) {
+    bm_log_warn("IPC clients: failed to encode reply");
+    return BmENOMEM;
+  }
+  send_reply(meta, buf, cbor_encoder_get_buffer_size(&enc, buf), "clients");
+  return BmOK;
+}
+
+// {"level": name, "modules": "module=level,..."}: change log levels at run
+// time.  Either key may be left out; "module=default" drops a module's own
+// level.
+BmErr handle_log_level(const CborValue *map) {
+  char level[16];
+  char modules[256];
+  int lvl = -1;
+  if (cbor_get_text(map, "level", level, sizeof(level), nullptr)) {
+    lvl = bm_log_parse_level(level);
+    if (lvl < 0) {
+      bm_log_warn("IPC log_level: unknown level '%s'", level);
+      return BmEINVAL;
+    }
+  }
+  if (cbor_get_text(map, "modules", modules, sizeof(modules), nullptr) &&
+      bm_log_set_module_levels(modules) != 0) {
+    bm_log_warn("IPC log_level: invalid modules '%s'", modules);
+    return BmEINVAL;
+  }
+  if (lvl >= 0) {
+    bm_log_set_level(static_cast<BmSbcLogLevel>(lvl));
+  }
+  bm_log_format_module_levels(modules, sizeof(modules));
+  bm_log_info("IPC log_level: level=%d modules=%s",
+              static_cast<int>(bm_log_get_level()), modules);
+  return BmOK;
+}
+
+BmErr route(const char *type, const CborValue *root, RxMeta *meta) {
+  if (strcmp(type, "replay_caught_up") == 0) {
+    return handle_replay_caught_up(root);
+  } else if (strcmp(type, "spotter_log") == 0) {
+    return handle_spotter_log(root);
+  } else if (strcmp(type, "spotter_tx") == 0) {
+    return handle_spotter_tx(root);
+  } else if (strcmp(type, "sensor_data") == 0) {
+    return handle_sensor_data(root);
+  } else if (strcmp(type, "config_set_batch") == 0) {
+    return handle_config_set_batch(root);
+  } else if (strcmp(type, "config_set") == 0) {
+    return handle_config_set(root);
+  } else if (strcmp(type, "shm_register") == 0) {
+    return handle_shm_register(root, meta);
+  } else if (strcmp(type, "shm_unregister") == 0) {
+    return handle_shm_unregister(root);
+  } else if (strcmp(type, "subscribe") == 0) {
+    return handle_subscribe(root, meta);
+  } else if (strcmp(type, "unsubscribe") == 0) {
+    return handle_unsubscribe(root, meta);
+  } else if (strcmp(type, "stats") == 0) {
+    return handle_stats(root, meta);
+  } else if (strcmp(type, "clients") == 0) {
+    return handle_clients(meta);
+  } else if (strcmp(type, "log_level") == 0) {
+    return handle_log_level(root);
+  }
+  bm_log_warn("IPC: unknown type '%s'", type);
+  return BmEINVAL;
+}
+
+// Datagrams the sender may still queue before its sendto() would block:
+// the listener's kernel queue limit minus what this poll has received but
+// not yet dispatched, and no more than the sender's own bucket holds.
+// Zero while the stack itself is pushing back.
+uint32_t ack_credits(const RxMeta *meta) {
+  if (g_stack_busy) {
+    return 0;
+  }
+  uint32_t credits = g_rx_qlen > g_rx_pending ? g_rx_qlen - g_rx_pending : 0;
+  if (g_ratelimit.rate != 0 && meta->client) {
+    uint64_t tokens = meta->client->tokens_milli / IPC_RATELIMIT_MILLI;
+    if (tokens < credits) {
+      credits = static_cast<uint32_t>(tokens);
+    }
+  }
+  return credits;
+}
+
+// Reply {"v":1,"type":"ack","req_id","status","credits"}.
+void send_ack(const RxMeta *meta, uint64_t req_id, BmErr status) {
+  if (!sender_is_bound(meta)) {
+    bm_log_warn("IPC: req_id %" PRIu64 " from an unbound socket; no ack sent",
+                req_id);
+    return;
+  }
+  uint8_t buf[ACK_BUF_BYTES];
+  CborEncoder enc, map;
+  cbor_encoder_init(&enc, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&enc, &map, 5);
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "v"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, 1));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "type"));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "ack"));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "req_id"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, req_id));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "status"));
+  err = static_cast<CborError>(err | cbor_encode_int(&map, status));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "credits"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, ack_credits(meta)));
+  err = static_cast<CborError>(err | cbor_encoder_close_container(&enc, &map));
+  if (err != CborNoError) {
+    bm_log_warn("IPC: failed to encode ack for req_id %" PRIu64, req_id);
     return;
   }
+  send_reply(meta, buf, cbor_encoder_get_buffer_size(&enc, buf), "ack");
+}
 
+// Control messages are charged to a small bucket of their own: Hydrotwin
+// relies on replay_caught_up and config_set getting through while a client
+// floods the socket with data, but each config_set costs an fsync, so a
+// client looping on one is still throttled.  spotter_log is the first thing
+// shed.
+IpcPriority type_priority(const char *type) {
+  static const char *const critical[] = {
+      "replay_caught_up", "config_set", "config_set_batch",
+      "subscribe",        "unsubscribe", "shm_register",
+      "shm_unregister",   "stats",      "clients",
+      "log_level",
+  };
+  for (const char *t : critical) {
+    if (strcmp(type, t) == 0) {
+      return IPC_PRIO_CRITICAL;
+    }
+  }
+  if (strcmp(type, "spotter_log") == 0) {
+    return IPC_PRIO_BULK;
+  }
+  return IPC_PRIO_NORMAL;
+}
+
+// Charge the sender's token bucket.  Bulk messages are also shed for the
+// rest of a poll once the stack has pushed back, leaving its room for
+// sensor data.
+bool admit(RxMeta *meta, IpcPriority prio) {
+  IpcClient *c = meta->client;
+  bool was_limited = c->limited;
+  bool ok;
+  if (prio == IPC_PRIO_BULK && g_stack_busy) {
+    ipc_ratelimit_refuse(c);
+    ok = false;
+  } else {
+    ok = ipc_ratelimit_admit(&g_ratelimit, c, prio, clock_ns(CLOCK_MONOTONIC));
+  }
+  if (!ok) {
+    g_stats.rate_limited++;
+    if (!was_limited && c->limited) {
+      bm_log_warn("IPC: client pid=%" PRIu32 " uid=%" PRIu32
+                  " is being throttled; dropping its messages",
+                  c->pid, c->uid);
+    }
+  } else if (was_limited && !c->limited) {
+    bm_log_info("IPC: client pid=%" PRIu32 " uid=%" PRIu32
+                " no longer throttled after %" PRIu64 " drops",
+                c->pid, c->uid, c->burst_drops);
+  }
+  return ok;
+}
+
+BmErr dispatch_map(const CborValue *root, RxMeta *meta) {
   CborValue v_field;
-  if (cbor_value_map_find_value(&root, "v", &v_field) != CborNoError ||
+  if (cbor_value_map_find_value(root, "v", &v_field) != CborNoError ||
       !cbor_value_is_integer(&v_field)) {
     bm_log_warn("IPC: missing schema version");
-    return;
+    return BmEINVAL;
   }
   int schema_version = 0;
   cbor_value_get_int(&v_field, &schema_version);
   if (schema_version != 1) {
     bm_log_warn("IPC: unsupported schema version %d", schema_version);
-    return;
+    return BmEINVAL;
   }
 
   char type[32] = {0};
   size_t type_len = 0;
-  if (!cbor_get_text(&root, "type", type, sizeof(type), &type_len) ||
+  if (!cbor_get_text(root, "type", type, sizeof(type), &type_len) ||
       type_len == 0) {
     bm_log_warn("IPC: missing type field");
-    return;
+    return BmEINVAL;
+  }
+  if (!admit(meta, type_priority(type))) {
+    return BmEBUSY;
   }
+  return route(type, root, meta);
+}
 
-  if (strcmp(type, "replay_caught_up") == 0) {
-    handle_replay_caught_up(&root);
-  } else if (strcmp(type, "spotter_log") == 0) {
-    handle_spotter_log(&root);
-  } else if (strcmp(type, "spotter_tx") == 0) {
-    handle_spotter_tx(&root);
-  } else if (strcmp(type, "sensor_data") == 0) {
-    handle_sensor_data(&root);
-  } else if (strcmp(type, "config_set") == 0) {
-    handle_config_set(&root);
-  } else {
-    bm_log_warn("IPC: unknown type '%s'", type);
+BmErr dispatch(const uint8_t *buf, size_t len, RxMeta *meta) {
+  CborParser parser;
+  CborValue root;
+  if (cbor_parser_init(buf, len, 0, &parser, &root) != CborNoError ||
+      !cbor_value_is_map(&root)) {
+    bm_log_warn("IPC: malformed datagram (%zu bytes)", len);
+    return BmEINVAL;
+  }
+
+  // Optional: the sender wants an ack carrying the handler's status.
+  uint64_t req_id = 0;
+  CborValue req_field;
+  bool want_ack =
+      cbor_value_map_find_value(&root, "req_id", &req_field) == CborNoError &&
+      cbor_value_is_unsigned_integer(&req_field) &&
+      cbor_value_get_uint64(&req_field, &req_id) == CborNoError;
+
+  BmErr status = dispatch_map(&root, meta);
+  if (want_ack) {
+    send_ack(meta, req_id, status);
+  }
+  return status;
+}
+
+// Collect the sender's SCM_CREDENTIALS and any SCM_RIGHTS descriptors from
+// a received message into meta.  Descriptors beyond MAX_RX_FDS are closed
+// immediately.
+void collect_rx_cmsgs(struct msghdr *msg, RxMeta *meta) {
+  meta->num_fds = 0;
+  meta->pid = 0;
+  meta->uid = IPC_RATELIMIT_UID_UNKNOWN;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
+    if (cmsg->cmsg_type == SCM_CREDENTIALS &&
+        cmsg->cmsg_len >= CMSG_LEN(sizeof(struct ucred))) {
+      struct ucred cred;
+      memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+      meta->pid = static_cast<uint32_t>(cred.pid);
+      meta->uid = cred.uid;
+      continue;
+    }
+    if (cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    const uint8_t *data = CMSG_DATA(cmsg);
+    for (size_t i = 0; i < count; i++) {
+      int fd;
+      memcpy(&fd, data + i * sizeof(int), sizeof(int));
+      if (meta->num_fds < MAX_RX_FDS) {
+        meta->fds[meta->num_fds++] = fd;
+      } else {
+        close(fd);
+      }
+    }
   }
 }
 
+void close_rx_fds(RxMeta *meta) {
+  for (size_t i = 0; i < meta->num_fds; i++) {
+    if (meta->fds[i] >= 0) {
+      close(meta->fds[i]);
+    }
+  }
+  meta->num_fds = 0;
+}
+
+void drain_socket(void) {
+  static uint8_t bufs[RX_BATCH][IPC_RECV_BUF_BYTES];
+  static union {
+    struct cmsghdr align;
+    uint8_t bytes[CMSG_SPACE(sizeof(struct ucred)) +
+                  CMSG_SPACE(MAX_RX_FDS * sizeof(int))];
+  } controls[RX_BATCH];
+  static struct sockaddr_un froms[RX_BATCH];
+  struct iovec iovs[RX_BATCH];
+  struct mmsghdr msgs[RX_BATCH];
+
+  for (;;) {
+    for (size_t i = 0; i < RX_BATCH; i++) {
+      iovs[i] = {bufs[i], sizeof(bufs[i])};
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_name = &froms[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = controls[i].bytes;
+      msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].bytes);
+    }
+
+    int got = recvmmsg(g_ipc_fd, msgs, RX_BATCH, MSG_CMSG_CLOEXEC, nullptr);
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      bm_log_warn("IPC: recvmmsg failed: %s", strerror(errno));
+      return;
+    }
+
+    if (got > 0) {
+      g_stats.rx_batches++;
+      g_stats.rx_datagrams += static_cast<uint64_t>(got);
+    }
+    for (int i = 0; i < got; i++) {
+      struct msghdr *msg = &msgs[i].msg_hdr;
+      g_rx_pending = static_cast<uint32_t>(got - i - 1);
+
+      RxMeta meta = {};
+      collect_rx_cmsgs(msg, &meta);
+      meta.from = froms[i];
+      meta.from_len = msg->msg_namelen;
+      meta.client = ipc_ratelimit_client(&g_ratelimit, meta.pid, meta.uid,
+                                         clock_ns(CLOCK_MONOTONIC));
+      if (msg->msg_flags & MSG_CTRUNC) {
+        bm_log_warn("IPC: ancillary data truncated; dropping datagram");
+      } else if (msgs[i].msg_len > 0) {
+        uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        BmErr status = dispatch(bufs[i], msgs[i].msg_len, &meta);
+        record_dispatch(clock_ns(CLOCK_MONOTONIC) - t0, status);
+      }
+      close_rx_fds(&meta);
+    }
+    g_rx_pending = 0;
+
+    // A short batch means the socket queue was empty when it was read.
+    if (got < static_cast<int>(RX_BATCH)) {
+      return;
+    }
+  }
+}
+
+uint32_t env_u32(const char *name, uint32_t fallback) {
+  const char *env = getenv(name);
+  if (!env || !*env) {
+    return fallback;
+  }
+  char *end = nullptr;
+  unsigned long v = strtoul(env, &end, 10);
+  if (!end || *end != '\0' || v > UINT32_MAX) {
+    bm_log_warn("IPC: ignoring invalid %s='%s'", name, env);
+    return fallback;
+  }
+  return static_cast<uint32_t>(v);
+}
+
+// The listener's datagram queue limit is the net.unix.max_dgram_qlen sysctl.
+uint32_t read_max_dgram_qlen(void) {
+  uint32_t qlen = DEFAULT_MAX_DGRAM_QLEN;
+  FILE *f = fopen("/proc/sys/net/unix/max_dgram_qlen", "r");
+  if (f) {
+    unsigned v = 0;
+    if (fscanf(f, "%u", &v) == 1 && v > 0) {
+      qlen = v;
+    }
+    fclose(f);
+  }
+  return qlen;
+}
+
 } // namespace
 
 int gateway_ipc_init(uint64_t mote_node_id_arg) {
-  mote_node_id = mote_node_id_arg;
+  gateway_ipc_set_mote_node_id(mote_node_id_arg);
 
   if (g_ipc_fd >= 0) {
     return 0;
@@ -586,8 +1594,26 @@ int gateway_ipc_init(uint64_t mote_node_id_arg) {
     bm_log_warn("IPC: chmod(%s) failed: %s", path, strerror(errno));
   }
 
+  // Every datagram then carries its sender's pid/uid for rate limiting.
+  int one = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &one, sizeof(one)) < 0) {
+    bm_log_warn("IPC: SO_PASSCRED failed: %s; clients share one rate limit",
+                strerror(errno));
+  }
+  ipc_ratelimit_init(&g_ratelimit,
+                     env_u32("BM_SBC_IPC_CLIENT_RATE", DEFAULT_CLIENT_RATE),
+                     env_u32("BM_SBC_IPC_CLIENT_BURST", DEFAULT_CLIENT_BURST));
+  ipc_ratelimit_set_critical(
+      &g_ratelimit,
+      env_u32("BM_SBC_IPC_CONTROL_RATE", IPC_RATELIMIT_CRITICAL_RATE),
+      env_u32("BM_SBC_IPC_CONTROL_BURST", IPC_RATELIMIT_CRITICAL_BURST));
+
   g_ipc_fd = fd;
-  bm_log_info("IPC: listening on %s", path);
+  g_rx_qlen = read_max_dgram_qlen();
+  strncpy(g_ipc_path, path, sizeof(g_ipc_path) - 1);
+  bm_log_info("IPC: listening on %s (per-client rate %" PRIu32
+              "/s, burst %" PRIu32 ")",
+              path, g_ratelimit.rate, g_ratelimit.burst);
   return 0;
 }
 
@@ -595,23 +1621,39 @@ void gateway_ipc_poll(void) {
   if (g_ipc_fd < 0) {
     return;
   }
+  uint64_t cpu0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+  g_stack_busy = false;
+  drain_socket();
+  // Records stay in their rings until the mote (and so the topic) is known.
+  if (mote_node_id != 0) {
+    g_stats.shm_records += gateway_ipc_shm_drain(shm_sensor_record);
+  }
+  gateway_ipc_sub_flush(g_ipc_fd);
+  g_stats.poll_cpu_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+}
 
-  uint8_t buf[IPC_RECV_BUF_BYTES];
-  for (;;) {
-    ssize_t n = recvfrom(g_ipc_fd, buf, sizeof(buf), 0, nullptr, nullptr);
-    if (n < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        return;
-      }
-      if (errno == EINTR) {
-        continue;
-      }
-      bm_log_warn("IPC: recvfrom failed: %s", strerror(errno));
-      return;
-    }
-    if (n == 0) {
-      continue;
-    }
-    dispatch(buf, static_cast<size_t>(n));
+void gateway_ipc_set_mote_node_id(uint64_t node_id) {
+  mote_node_id = node_id;
+  if (node_id == 0 || g_deferred.empty()) {
+    return;
+  }
+  size_t n = 0;
+  for (size_t pos = 0; pos < g_deferred.size(); n++) {
+    uint32_t rec_len = 0;
+    memcpy(&rec_len, &g_deferred[pos], sizeof(rec_len));
+    pos += sizeof(rec_len);
+    shm_sensor_record(&g_deferred[pos], rec_len);
+    pos += rec_len;
   }
+  bm_log_info("IPC: mote %016" PRIx64 " known; published %zu held "
+              "sensor_data",
+              node_id, n);
+  std::vector<uint8_t>().swap(g_deferred);
+  g_deferred_full = false;
 }
+
+void gateway_ipc_set_publish_fn(GatewayIpcPublishFn fn) { g_publish_fn = fn; }
+
+void gateway_ipc_get_stats(GatewayIpcStats *out) { *out = g_stats; }
+
+void gateway_ipc_reset_stats(void) { g_stats = GatewayIpcStats(); }
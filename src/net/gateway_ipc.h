@@ -1,18 +1,64 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "bm_os.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define GATEWAY_IPC_SOCKET_PATH "/run/bm_sbc/gateway_ipc.sock"
 
+// Shared-memory sensor_data record (one shm_ring record, see shm_ring.h and
+// docs/gateway-ipc.md):
+//   [topic_suffix_len (2 B, host order)] [topic_suffix] [data]
+// Published exactly like a sensor_data datagram with the same fields.
+#define GATEWAY_IPC_SHM_SENSOR_HDR_BYTES 2
+
+// Dispatch latency histogram: bucket b counts datagrams whose handler took
+// [2^b, 2^(b+1)) ns (bucket 0 also holds 0-1 ns).
+#define GATEWAY_IPC_LAT_BUCKETS 32
+
+// Ingestion counters since start-up or the last reset (see the `stats`
+// message in docs/gateway-ipc.md).
+typedef struct {
+  uint64_t rx_datagrams;    // datagrams received
+  uint64_t rx_batches;      // recvmmsg() calls that returned data
+  uint64_t dispatch_errors; // handlers that returned a non-BmOK status
+  uint64_t rate_limited;    // datagrams refused by a client's token bucket
+  uint64_t published;       // sensor_data publishes accepted (socket + shm)
+  uint64_t shm_records;     // records drained from shared-memory rings
+  uint64_t poll_cpu_ns;     // thread CPU time spent in gateway_ipc_poll()
+  uint64_t dispatch_ns_total;
+  uint64_t dispatch_ns_hist[GATEWAY_IPC_LAT_BUCKETS];
+} GatewayIpcStats;
+
+// Replaces bm_pub() for sensor_data (socket and shm).  Used by ipc_test to
+// measure ingestion without the network stack; NULL restores bm_pub().
+typedef BmErr (*GatewayIpcPublishFn)(const char *topic, const uint8_t *data,
+                                     uint16_t data_len);
+void gateway_ipc_set_publish_fn(GatewayIpcPublishFn fn);
+
+// Copy the current counters into out.  Call from the main-loop thread.
+void gateway_ipc_get_stats(GatewayIpcStats *out);
+void gateway_ipc_reset_stats(void);
+
 // Bind the Unix-domain SOCK_DGRAM listener. Safe to call once from setup().
 // Returns 0 on success, -1 on failure (error already logged).
 int gateway_ipc_init(uint64_t mote_node_id_arg);
 
-// Drain any datagrams currently queued on the IPC socket without blocking.
+// Set the mote's node id once it is known, if gateway_ipc_init() was given 0.
+// Until then sensor_data datagrams are held (up to 256 KiB, then refused with
+// BmEBUSY) and shared-memory rings are left undrained; setting the id
+// publishes the held messages in arrival order.  Call from the main-loop
+// thread.
+void gateway_ipc_set_mote_node_id(uint64_t node_id);
+
+// Drain any datagrams currently queued on the IPC socket, then any records
+// waiting in registered shared-memory rings, then send pubsub messages queued
+// for subscribed clients, without blocking.
 // Call once per main-loop iteration.
 void gateway_ipc_poll(void);
 
@@ -0,0 +1,218 @@
+#include "gateway_ipc_shm.h"
+
+#include "app_runner.h"
+#include "bm_log.h"
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct ShmSlot {
+  bool active = false;
+  char name[GATEWAY_IPC_SHM_MAX_NAME_LEN + 1] = {0};
+  int mem_fd = -1;
+  int doorbell_fd = -1;
+  void *map = nullptr;
+  size_t map_len = 0;
+  ShmRing ring = {};
+  uint64_t records = 0;
+  bool watched = false; ///< The doorbell wakes the app runner.
+  bool rung = false;    ///< Records may be waiting; drain on the next poll.
+};
+
+ShmSlot g_slots[GATEWAY_IPC_SHM_MAX_RINGS];
+
+void release_slot(ShmSlot *slot) {
+  if (slot->watched) {
+    bm_sbc_app_unwatch_fd(slot->doorbell_fd);
+  }
+  if (slot->map) {
+    munmap(slot->map, slot->map_len);
+  }
+  if (slot->mem_fd >= 0) {
+    close(slot->mem_fd);
+  }
+  if (slot->doorbell_fd >= 0) {
+    close(slot->doorbell_fd);
+  }
+  *slot = ShmSlot();
+}
+
+ShmSlot *find_slot(const char *name) {
+  for (ShmSlot &slot : g_slots) {
+    if (slot.active && strcmp(slot.name, name) == 0) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+// Reject memfds the client could still shrink: a shrink after mmap() would
+// turn every later read of the tail of the mapping into SIGBUS here.
+bool has_shrink_seal(int fd) {
+  int seals = fcntl(fd, F_GET_SEALS);
+  return seals >= 0 && (seals & F_SEAL_SHRINK);
+}
+
+// Runs on the loop thread when a doorbell is written: clear its counter and
+// mark the ring for the next drain, which follows immediately.
+void doorbell_rang(int fd, void *ctx) {
+  ShmSlot *slot = static_cast<ShmSlot *>(ctx);
+  uint64_t count = 0;
+  while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+  slot->rung = true;
+}
+
+} // namespace
+
+int gateway_ipc_shm_register(const char *name, int mem_fd, int doorbell_fd) {
+  ShmSlot candidate;
+  candidate.mem_fd = mem_fd;
+  candidate.doorbell_fd = doorbell_fd;
+
+  size_t name_len = strlen(name);
+  if (name_len == 0 || name_len > GATEWAY_IPC_SHM_MAX_NAME_LEN) {
+    bm_log_warn("IPC shm_register: name must be 1-%d bytes",
+                GATEWAY_IPC_SHM_MAX_NAME_LEN);
+    release_slot(&candidate);
+    return -1;
+  }
+  memcpy(candidate.name, name, name_len + 1);
+
+  struct stat st;
+  if (fstat(mem_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    bm_log_warn("IPC shm_register '%s': ring fd is not a memfd", name);
+    release_slot(&candidate);
+    return -1;
+  }
+  if (!has_shrink_seal(mem_fd)) {
+    bm_log_warn("IPC shm_register '%s': memfd must carry F_SEAL_SHRINK", name);
+    release_slot(&candidate);
+    return -1;
+  }
+  size_t max_len = SHM_RING_REGION_BYTES(SHM_RING_MAX_CAPACITY);
+  size_t map_len = static_cast<size_t>(st.st_size);
+  if (map_len > max_len) {
+    map_len = max_len;
+  }
+  if (map_len < SHM_RING_REGION_BYTES(SHM_RING_MIN_CAPACITY)) {
+    bm_log_warn("IPC shm_register '%s': region too small (%zu bytes)", name,
+                map_len);
+    release_slot(&candidate);
+    return -1;
+  }
+
+  void *map =
+      mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  if (map == MAP_FAILED) {
+    bm_log_warn("IPC shm_register '%s': mmap failed: %s", name,
+                strerror(errno));
+    release_slot(&candidate);
+    return -1;
+  }
+  candidate.map = map;
+  candidate.map_len = map_len;
+
+  if (shm_ring_attach(&candidate.ring, map, map_len) != 0) {
+    bm_log_warn("IPC shm_register '%s': region is not an initialised ring",
+                name);
+    release_slot(&candidate);
+    return -1;
+  }
+
+  // The consumer owns the doorbell, so switching it to non-blocking is
+  // harmless to a producer that only ever writes it.
+  if (doorbell_fd >= 0) {
+    int flags = fcntl(doorbell_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(doorbell_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      bm_log_warn("IPC shm_register '%s': doorbell fcntl failed: %s", name,
+                  strerror(errno));
+      release_slot(&candidate);
+      return -1;
+    }
+  }
+
+  ShmSlot *slot = find_slot(name);
+  if (slot) {
+    bm_log_info("IPC shm_register '%s': replacing existing ring", name);
+    release_slot(slot);
+  } else {
+    for (ShmSlot &s : g_slots) {
+      if (!s.active) {
+        slot = &s;
+        break;
+      }
+    }
+  }
+  if (!slot) {
+    bm_log_warn("IPC shm_register '%s': all %d ring slots in use", name,
+                GATEWAY_IPC_SHM_MAX_RINGS);
+    release_slot(&candidate);
+    return -1;
+  }
+
+  candidate.active = true;
+  // Records pushed before registration have had no doorbell of their own.
+  candidate.rung = true;
+  *slot = candidate;
+  // Without a doorbell (or a free watch slot) the ring is checked on every
+  // poll instead.
+  slot->watched = doorbell_fd >= 0 &&
+                  bm_sbc_app_watch_fd(doorbell_fd, doorbell_rang, slot);
+  bm_log_info("IPC shm_register '%s': capacity=%u max_record=%zu", name,
+              slot->ring.capacity, shm_ring_max_record(&slot->ring));
+  return 0;
+}
+
+int gateway_ipc_shm_unregister(const char *name) {
+  ShmSlot *slot = find_slot(name);
+  if (!slot) {
+    return -1;
+  }
+  bm_log_info("IPC shm_unregister '%s' after %llu records", name,
+              static_cast<unsigned long long>(slot->records));
+  release_slot(slot);
+  return 0;
+}
+
+size_t gateway_ipc_shm_drain(GatewayIpcShmSink sink) {
+  size_t total = 0;
+  for (ShmSlot &slot : g_slots) {
+    if (!slot.active || (slot.watched && !slot.rung)) {
+      continue;
+    }
+    slot.rung = false;
+
+    size_t drained = 0;
+    while (drained < GATEWAY_IPC_SHM_DRAIN_BUDGET) {
+      size_t len = 0;
+      bool corrupt = false;
+      const uint8_t *rec = shm_ring_peek(&slot.ring, &len, &corrupt);
+      if (!rec) {
+        if (corrupt) {
+          bm_log_warn("IPC shm ring '%s' corrupt; unregistering", slot.name);
+          release_slot(&slot);
+        }
+        break;
+      }
+      sink(rec, len);
+      shm_ring_pop(&slot.ring);
+      drained++;
+    }
+    if (slot.active) {
+      slot.records += drained;
+      // Out of budget: the rest is drained next poll without a doorbell.
+      slot.rung = drained == GATEWAY_IPC_SHM_DRAIN_BUDGET;
+    }
+    total += drained;
+  }
+  return total;
+}
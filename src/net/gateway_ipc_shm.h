@@ -0,0 +1,50 @@
+#pragma once
+
+/// @file gateway_ipc_shm.h
+/// @brief Registry of client shared-memory rings drained by gateway IPC.
+///
+/// A client creates a sealed memfd formatted with shm_ring_init() plus an
+/// eventfd doorbell, and hands both to the gateway in a `shm_register`
+/// datagram (SCM_RIGHTS).  The doorbell is watched by the app runner, so a
+/// write to it ends the runner's wait and gateway_ipc_poll() drains that
+/// ring in a batch straight away; rings whose doorbell has not rung are
+/// skipped without a syscall.  A ring registered without a doorbell is
+/// checked on every poll.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Maximum number of rings registered at once.
+#define GATEWAY_IPC_SHM_MAX_RINGS 4
+
+/// Maximum length of a ring's registration name (excluding NUL).
+#define GATEWAY_IPC_SHM_MAX_NAME_LEN 31
+
+/// Maximum number of records drained from one ring per poll.
+#define GATEWAY_IPC_SHM_DRAIN_BUDGET 256
+
+/// Invoked once per drained record.  @p rec is only valid during the call.
+typedef void (*GatewayIpcShmSink)(const uint8_t *rec, size_t len);
+
+/// Map @p mem_fd and register it under @p name, replacing any ring already
+/// registered under the same name.  Ownership of both fds passes to the
+/// registry whether or not registration succeeds.
+/// @return 0 on success, -1 on failure (error already logged).
+int gateway_ipc_shm_register(const char *name, int mem_fd, int doorbell_fd);
+
+/// Unmap and forget the ring registered under @p name.
+/// @return 0 on success, -1 if no such ring is registered.
+int gateway_ipc_shm_unregister(const char *name);
+
+/// Drain up to GATEWAY_IPC_SHM_DRAIN_BUDGET records from every ring whose
+/// doorbell rang (or that has none) into @p sink.  Rings whose producer wrote an impossible record are dropped.
+/// @return Total number of records drained.
+size_t gateway_ipc_shm_drain(GatewayIpcShmSink sink);
+
+#ifdef __cplusplus
+}
+#endif
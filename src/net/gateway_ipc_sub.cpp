@@ -0,0 +1,329 @@
+#include "gateway_ipc_sub.h"
+
+#include "bm_log.h"
+#include "cbor.h"
+#include "pubsub.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <vector>
+
+namespace {
+
+constexpr size_t MAX_SUB_TOPIC_LEN = 255;
+
+static_assert(GATEWAY_IPC_SUB_MAX_TOPICS <= 32,
+              "topic membership is tracked in a uint32_t mask");
+
+struct SubTopic {
+  bool active = false;
+  char name[MAX_SUB_TOPIC_LEN + 1] = {0};
+  uint16_t len = 0;
+  uint32_t refs = 0;
+};
+
+struct PushSlot {
+  uint16_t len;
+  uint8_t buf[GATEWAY_IPC_SUB_MAX_PUSH_BYTES];
+};
+
+struct SubClient {
+  bool active = false;
+  struct sockaddr_un addr = {};
+  socklen_t addr_len = 0;
+  uint32_t topics = 0; ///< Bit i set ⇒ subscribed to g_topics[i].
+  std::vector<PushSlot> queue;
+  size_t head = 0; ///< Next slot to fill (callback side).
+  size_t tail = 0; ///< Next slot to send (poll side).
+  size_t count = 0;
+  uint64_t delivered = 0;
+  uint64_t dropped = 0;
+};
+
+// The pubsub callback runs on the Bristlemouth stack's thread; everything
+// else runs on the main loop.  The main loop is the only writer of the topic
+// and client tables, and takes s_lock for every write; the callback takes it
+// for the whole fan-out.  bm_sub()/bm_unsub() are never called with s_lock
+// held, so the stack's own locks are never taken inside ours.
+pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+SubTopic g_topics[GATEWAY_IPC_SUB_MAX_TOPICS];
+SubClient g_clients[GATEWAY_IPC_SUB_MAX_CLIENTS];
+
+SubClient *find_client(const char *reply_path) {
+  for (SubClient &c : g_clients) {
+    if (c.active && strcmp(c.addr.sun_path, reply_path) == 0) {
+      return &c;
+    }
+  }
+  return nullptr;
+}
+
+int find_topic(const char *topic, size_t topic_len) {
+  for (size_t i = 0; i < GATEWAY_IPC_SUB_MAX_TOPICS; i++) {
+    const SubTopic &t = g_topics[i];
+    if (t.active && t.len == topic_len &&
+        memcmp(t.name, topic, topic_len) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// Encode {"v":1,"type":"pubsub","topic","node_id","data","dropped"}.
+bool encode_push(PushSlot *slot, uint64_t node_id, const char *topic,
+                 uint16_t topic_len, const uint8_t *data, uint16_t data_len,
+                 uint64_t dropped) {
+  CborEncoder enc, map;
+  cbor_encoder_init(&enc, slot->buf, sizeof(slot->buf), 0);
+  CborError err = cbor_encoder_create_map(&enc, &map, 6);
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "v"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, 1));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "type"));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "pubsub"));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "topic"));
+  err = static_cast<CborError>(err |
+                               cbor_encode_text_string(&map, topic, topic_len));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "node_id"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, node_id));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "data"));
+  err = static_cast<CborError>(err |
+                               cbor_encode_byte_string(&map, data, data_len));
+  err = static_cast<CborError>(err | cbor_encode_text_stringz(&map, "dropped"));
+  err = static_cast<CborError>(err | cbor_encode_uint(&map, dropped));
+  err = static_cast<CborError>(err | cbor_encoder_close_container(&enc, &map));
+  if (err != CborNoError) {
+    return false;
+  }
+  slot->len =
+      static_cast<uint16_t>(cbor_encoder_get_buffer_size(&enc, slot->buf));
+  return true;
+}
+
+void on_pubsub(uint64_t node_id, const char *topic, uint16_t topic_len,
+               const uint8_t *data, uint16_t data_len, uint8_t /*type*/,
+               uint8_t /*version*/) {
+  pthread_mutex_lock(&s_lock);
+  int idx = find_topic(topic, topic_len);
+  if (idx >= 0) {
+    uint32_t bit = 1u << idx;
+    for (SubClient &c : g_clients) {
+      if (!c.active || !(c.topics & bit)) {
+        continue;
+      }
+      if (c.count == c.queue.size() ||
+          !encode_push(&c.queue[c.head], node_id, topic, topic_len, data,
+                       data_len, c.dropped)) {
+        c.dropped++;
+        continue;
+      }
+      c.head = (c.head + 1) % c.queue.size();
+      c.count++;
+    }
+  }
+  pthread_mutex_unlock(&s_lock);
+}
+
+// Caller holds s_lock.  Returns the topic bits that lost their last client;
+// the caller unsubscribes those from the stack once s_lock is released.
+uint32_t drop_client_locked(SubClient *c, uint32_t topics) {
+  uint32_t released = 0;
+  for (size_t i = 0; i < GATEWAY_IPC_SUB_MAX_TOPICS; i++) {
+    uint32_t bit = 1u << i;
+    if (!(c->topics & topics & bit)) {
+      continue;
+    }
+    c->topics &= ~bit;
+    if (--g_topics[i].refs == 0) {
+      g_topics[i].active = false;
+      released |= bit;
+    }
+  }
+  if (c->topics == 0) {
+    bm_log_info("IPC sub: client '%s' removed, delivered=%llu dropped=%llu",
+                c->addr.sun_path, static_cast<unsigned long long>(c->delivered),
+                static_cast<unsigned long long>(c->dropped));
+    *c = SubClient();
+  }
+  return released;
+}
+
+// Called without s_lock.  A released slot is only reused by the main loop,
+// so its name stays valid until bm_unsub_wl() returns.
+void unsub_released(uint32_t released) {
+  for (size_t i = 0; i < GATEWAY_IPC_SUB_MAX_TOPICS; i++) {
+    if (!(released & (1u << i))) {
+      continue;
+    }
+    BmErr err = bm_unsub_wl(g_topics[i].name, g_topics[i].len, on_pubsub);
+    if (err != BmOK) {
+      bm_log_warn("IPC sub: bm_unsub(%s) failed, err=%d", g_topics[i].name,
+                  err);
+    } else {
+      bm_log_info("IPC sub: bm_unsub(%s)", g_topics[i].name);
+    }
+  }
+}
+
+// Send as much of one client's queue as its socket will take.  Caller holds
+// s_lock.  Returns false if the client is gone and should be dropped.
+bool flush_client_locked(int fd, SubClient *c, size_t *sent) {
+  struct mmsghdr msgs[GATEWAY_IPC_SUB_QUEUE_DEPTH];
+  struct iovec iovs[GATEWAY_IPC_SUB_QUEUE_DEPTH];
+  while (c->count > 0) {
+    size_t n = c->count;
+    for (size_t i = 0; i < n; i++) {
+      PushSlot &slot = c->queue[(c->tail + i) % c->queue.size()];
+      iovs[i].iov_base = slot.buf;
+      iovs[i].iov_len = slot.len;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &c->addr;
+      msgs[i].msg_hdr.msg_namelen = c->addr_len;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int r = sendmmsg(fd, msgs, static_cast<unsigned int>(n), MSG_DONTWAIT);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true; // Client's receive queue is full; retry next poll.
+      }
+      if (errno == ECONNREFUSED || errno == ENOENT) {
+        bm_log_warn("IPC sub: client '%s' is gone: %s", c->addr.sun_path,
+                    strerror(errno));
+        return false;
+      }
+      // Unexpected per-message failure: drop the head so one bad
+      // datagram cannot wedge the queue.
+      bm_log_warn("IPC sub: sendmmsg to '%s' failed: %s", c->addr.sun_path,
+                  strerror(errno));
+      r = 1;
+      c->dropped++;
+    } else {
+      c->delivered += static_cast<uint64_t>(r);
+      *sent += static_cast<size_t>(r);
+    }
+    c->tail = (c->tail + static_cast<size_t>(r)) % c->queue.size();
+    c->count -= static_cast<size_t>(r);
+    if (static_cast<size_t>(r) < n) {
+      return true;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int gateway_ipc_sub_add(const char *reply_path, const char *topic,
+                        size_t topic_len) {
+  size_t path_len = strlen(reply_path);
+  if (path_len == 0 || path_len >= sizeof(sockaddr_un::sun_path)) {
+    bm_log_warn("IPC subscribe: invalid reply_path length %zu", path_len);
+    return -1;
+  }
+  if (topic_len == 0 || topic_len > MAX_SUB_TOPIC_LEN) {
+    bm_log_warn("IPC subscribe: invalid topic length %zu", topic_len);
+    return -1;
+  }
+
+  SubClient *client = find_client(reply_path);
+  if (!client) {
+    for (SubClient &c : g_clients) {
+      if (!c.active) {
+        client = &c;
+        break;
+      }
+    }
+    if (!client) {
+      bm_log_warn("IPC subscribe: all %d client slots in use",
+                  GATEWAY_IPC_SUB_MAX_CLIENTS);
+      return -1;
+    }
+  }
+
+  int idx = find_topic(topic, topic_len);
+  if (idx >= 0 && client->active && (client->topics & (1u << idx))) {
+    return 0;
+  }
+  if (idx < 0) {
+    for (size_t i = 0; i < GATEWAY_IPC_SUB_MAX_TOPICS; i++) {
+      if (!g_topics[i].active) {
+        idx = static_cast<int>(i);
+        break;
+      }
+    }
+    if (idx < 0) {
+      bm_log_warn("IPC subscribe: all %d topic slots in use",
+                  GATEWAY_IPC_SUB_MAX_TOPICS);
+      return -1;
+    }
+    SubTopic &t = g_topics[idx];
+    memcpy(t.name, topic, topic_len);
+    t.name[topic_len] = '\0';
+    t.len = static_cast<uint16_t>(topic_len);
+    BmErr err = bm_sub_wl(t.name, t.len, on_pubsub);
+    if (err != BmOK) {
+      bm_log_warn("IPC subscribe: bm_sub(%s) failed, err=%d", t.name, err);
+      return -1;
+    }
+    bm_log_info("IPC sub: bm_sub(%s)", t.name);
+  }
+
+  pthread_mutex_lock(&s_lock);
+  if (!client->active) {
+    client->queue.resize(GATEWAY_IPC_SUB_QUEUE_DEPTH);
+    client->addr.sun_family = AF_UNIX;
+    memcpy(client->addr.sun_path, reply_path, path_len + 1);
+    client->addr_len =
+        static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path_len + 1);
+    client->active = true;
+  }
+  g_topics[idx].active = true;
+  g_topics[idx].refs++;
+  client->topics |= 1u << idx;
+  pthread_mutex_unlock(&s_lock);
+  return 0;
+}
+
+int gateway_ipc_sub_remove(const char *reply_path, const char *topic,
+                           size_t topic_len) {
+  SubClient *client = find_client(reply_path);
+  if (!client) {
+    return -1;
+  }
+  uint32_t topics = UINT32_MAX;
+  if (topic) {
+    int idx = find_topic(topic, topic_len);
+    if (idx < 0 || !(client->topics & (1u << idx))) {
+      return -1;
+    }
+    topics = 1u << idx;
+  }
+
+  pthread_mutex_lock(&s_lock);
+  uint32_t released = drop_client_locked(client, topics);
+  pthread_mutex_unlock(&s_lock);
+  unsub_released(released);
+  return 0;
+}
+
+size_t gateway_ipc_sub_flush(int fd) {
+  size_t sent = 0;
+  uint32_t released = 0;
+  pthread_mutex_lock(&s_lock);
+  for (SubClient &c : g_clients) {
+    if (c.active && !flush_client_locked(fd, &c, &sent)) {
+      released |= drop_client_locked(&c, UINT32_MAX);
+    }
+  }
+  pthread_mutex_unlock(&s_lock);
+  unsub_released(released);
+  return sent;
+}
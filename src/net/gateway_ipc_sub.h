@@ -0,0 +1,55 @@
+#pragma once
+
+/// @file gateway_ipc_sub.h
+/// @brief Push-based Bristlemouth pubsub subscriptions for local IPC clients.
+///
+/// A client sends a `subscribe` datagram naming an exact topic from its own
+/// SOCK_DGRAM socket, bound to a path; that path is the reply path.  The
+/// gateway calls bm_sub() once per distinct topic and fans each matching
+/// message out to every subscribed client as a `pubsub` datagram.
+///
+/// Messages are queued per client from the pubsub callback and sent from
+/// gateway_ipc_poll() with sendmmsg(MSG_DONTWAIT), so a client that stops
+/// reading only fills its own bounded queue — the overflow is counted and
+/// dropped, and the Bristlemouth stack never waits on a socket.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Maximum number of subscribed clients (distinct reply paths).
+#define GATEWAY_IPC_SUB_MAX_CLIENTS 8
+
+/// Maximum number of distinct topics subscribed across all clients.
+#define GATEWAY_IPC_SUB_MAX_TOPICS 16
+
+/// Pushes queued per client before new messages are dropped.
+#define GATEWAY_IPC_SUB_QUEUE_DEPTH 32
+
+/// Largest encoded `pubsub` datagram; larger messages are counted as drops.
+#define GATEWAY_IPC_SUB_MAX_PUSH_BYTES 4096
+
+/// Subscribe the client at @p reply_path to @p topic (exact match).
+/// Subscribing twice to the same topic is a no-op.
+/// @return 0 on success, -1 on failure (error already logged).
+int gateway_ipc_sub_add(const char *reply_path, const char *topic,
+                        size_t topic_len);
+
+/// Unsubscribe the client at @p reply_path from @p topic, or from every
+/// topic when @p topic is NULL.  A client left with no topics is forgotten
+/// along with anything still queued for it.
+/// @return 0 on success, -1 if no such subscription exists.
+int gateway_ipc_sub_remove(const char *reply_path, const char *topic,
+                           size_t topic_len);
+
+/// Send queued pushes to every client through @p fd without blocking.
+/// Clients whose socket has gone away are unsubscribed.
+/// @return Number of datagrams sent.
+size_t gateway_ipc_sub_flush(int fd);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+#include "ipc_peer.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+bool ipc_peer_is_bound(socklen_t from_len) {
+  return from_len > offsetof(struct sockaddr_un, sun_path);
+}
+
+int ipc_peer_reply_path(const struct sockaddr_un *from, socklen_t from_len,
+                        const char *named, char *out, size_t cap) {
+  // Autobound and other abstract addresses start with a NUL.
+  if (!ipc_peer_is_bound(from_len) || from->sun_path[0] == '\0') {
+    return -EINVAL;
+  }
+  // The kernel may or may not count the path's terminator.
+  size_t max = from_len - offsetof(struct sockaddr_un, sun_path);
+  if (max > sizeof(from->sun_path)) {
+    max = sizeof(from->sun_path);
+  }
+  const size_t len = strnlen(from->sun_path, max);
+  if (len >= cap) {
+    return -EINVAL;
+  }
+  memcpy(out, from->sun_path, len);
+  out[len] = '\0';
+  if (named && strcmp(named, out) != 0) {
+    return -EPERM;
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/// @file ipc_peer.h
+/// @brief The sender of a datagram on the gateway IPC socket.
+///
+/// The IPC socket is world-writable and the gateway usually runs as root,
+/// so an address a client writes into a message is not trusted: pushes go
+/// only to the address the kernel reports the datagram came from.  A
+/// subscriber must therefore send subscribe/unsubscribe from the socket the
+/// pushes are for, bound to a filesystem path (the subscription table is
+/// keyed by path, so abstract and unbound senders cannot subscribe).
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// true if a sender whose address is @p from_len bytes can be replied to.
+bool ipc_peer_is_bound(socklen_t from_len);
+
+/// The reply path for a subscribe/unsubscribe from @p from: the sender's
+/// own socket path.
+///
+/// @param named  reply_path carried by the request, or NULL if none.  It
+///               must be the sender's own path.
+/// @param out    Receives the path, NUL terminated.
+/// @return 0; -EINVAL if the sender is not bound to a filesystem path (or
+///         it does not fit @p out); -EPERM if @p named is another socket.
+int ipc_peer_reply_path(const struct sockaddr_un *from, socklen_t from_len,
+                        const char *named, char *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,118 @@
+#include "ipc_ratelimit.h"
+
+#include <string.h>
+
+static uint64_t bucket_cap(const IpcRateLimit *rl) {
+  return (uint64_t)rl->burst * IPC_RATELIMIT_MILLI;
+}
+
+static uint64_t critical_cap(const IpcRateLimit *rl) {
+  return (uint64_t)rl->critical_burst * IPC_RATELIMIT_MILLI;
+}
+
+// Refill a bucket of @p cap milli-messages at @p rate messages/s.
+static void refill(uint32_t rate, uint64_t cap, uint64_t *tokens_milli,
+                   uint64_t *refill_ns, uint64_t now_ns) {
+  if (now_ns <= *refill_ns) {
+    return;
+  }
+  uint64_t elapsed = now_ns - *refill_ns;
+  // ns * msg/s / 1e6 = milli-messages.  Past one full refill the bucket is
+  // simply topped up, which also keeps the product from overflowing.
+  uint64_t full_ns = cap * 1000000ull / rate + 1;
+  uint64_t add = elapsed >= full_ns ? cap : elapsed * rate / 1000000ull;
+  if (add == 0) {
+    // Leave refill_ns alone so closely spaced calls still accumulate.
+    return;
+  }
+  *tokens_milli = *tokens_milli + add > cap ? cap : *tokens_milli + add;
+  *refill_ns = now_ns;
+}
+
+void ipc_ratelimit_init(IpcRateLimit *rl, uint32_t rate, uint32_t burst) {
+  memset(rl, 0, sizeof(*rl));
+  rl->rate = rate;
+  rl->burst = burst ? burst : 1;
+  ipc_ratelimit_set_critical(rl, IPC_RATELIMIT_CRITICAL_RATE,
+                             IPC_RATELIMIT_CRITICAL_BURST);
+}
+
+void ipc_ratelimit_set_critical(IpcRateLimit *rl, uint32_t rate,
+                                uint32_t burst) {
+  rl->critical_rate = rate;
+  rl->critical_burst = burst ? burst : 1;
+}
+
+IpcClient *ipc_ratelimit_client(IpcRateLimit *rl, uint32_t pid, uint32_t uid,
+                                uint64_t now_ns) {
+  IpcClient *free_slot = NULL, *oldest = NULL;
+  for (size_t i = 0; i < IPC_RATELIMIT_MAX_CLIENTS; i++) {
+    IpcClient *c = &rl->clients[i];
+    if (!c->in_use) {
+      if (!free_slot) {
+        free_slot = c;
+      }
+    } else if (c->pid == pid && c->uid == uid) {
+      c->seen_ns = now_ns;
+      return c;
+    } else if (!oldest || c->seen_ns < oldest->seen_ns) {
+      oldest = c;
+    }
+  }
+  IpcClient *slot = free_slot ? free_slot : oldest;
+  memset(slot, 0, sizeof(*slot));
+  slot->in_use = true;
+  slot->pid = pid;
+  slot->uid = uid;
+  slot->tokens_milli = bucket_cap(rl);
+  slot->refill_ns = now_ns;
+  slot->critical_milli = critical_cap(rl);
+  slot->critical_refill_ns = now_ns;
+  slot->seen_ns = now_ns;
+  return slot;
+}
+
+bool ipc_ratelimit_admit(IpcRateLimit *rl, IpcClient *c, IpcPriority prio,
+                         uint64_t now_ns) {
+  bool ok = true;
+  if (rl->rate != 0 && prio == IPC_PRIO_CRITICAL) {
+    if (rl->critical_rate != 0) {
+      refill(rl->critical_rate, critical_cap(rl), &c->critical_milli,
+             &c->critical_refill_ns, now_ns);
+      ok = c->critical_milli >= IPC_RATELIMIT_MILLI;
+      if (ok) {
+        c->critical_milli -= IPC_RATELIMIT_MILLI;
+      }
+    }
+  } else if (rl->rate != 0) {
+    refill(rl->rate, bucket_cap(rl), &c->tokens_milli, &c->refill_ns,
+           now_ns);
+    uint64_t need = IPC_RATELIMIT_MILLI;
+    if (prio == IPC_PRIO_BULK) {
+      need += bucket_cap(rl) / 2;
+    }
+    ok = c->tokens_milli >= need;
+    if (ok) {
+      c->tokens_milli -= IPC_RATELIMIT_MILLI;
+    }
+  }
+
+  if (!ok) {
+    ipc_ratelimit_refuse(c);
+    return false;
+  }
+  c->accepted++;
+  if (prio != IPC_PRIO_CRITICAL) {
+    c->limited = false;
+  }
+  return true;
+}
+
+void ipc_ratelimit_refuse(IpcClient *c) {
+  c->dropped++;
+  if (!c->limited) {
+    c->limited = true;
+    c->burst_drops = 0;
+  }
+  c->burst_drops++;
+}
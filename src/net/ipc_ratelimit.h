@@ -0,0 +1,101 @@
+#pragma once
+
+/// @file ipc_ratelimit.h
+/// @brief Per-client token buckets for the gateway IPC socket.
+///
+/// Every datagram on the IPC socket carries the sender's SCM_CREDENTIALS, so
+/// the gateway can tell clients apart even though they share one kernel
+/// queue.  Each (pid, uid) gets a bucket refilled at @c rate messages per
+/// second up to @c burst.  Message types map to a priority:
+///
+///   CRITICAL  charged to a second, smaller bucket of the client's own
+///             (control traffic), so a flood of data cannot hold control
+///             messages back and a flood of control messages (config_set
+///             costs an fsync each) is still limited
+///   NORMAL    admitted while the bucket holds one token
+///   BULK      admitted only while the bucket is more than half full, so a
+///             client's bulk traffic cannot starve its own normal traffic
+///
+/// The table is fixed-size; a new client evicts the least recently seen one.
+/// Time is passed in by the caller, so the module has no clock of its own.
+///
+/// Buckets are keyed by pid, so a client that forks, or is evicted and comes
+/// back, starts again with a full burst: the limits contain runaway
+/// producers, not a sender working around them on purpose.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Clients tracked at once.
+#define IPC_RATELIMIT_MAX_CLIENTS 16
+
+/// Bucket arithmetic is done in thousandths of a message.
+#define IPC_RATELIMIT_MILLI 1000u
+
+/// Default control-message bucket: refill per second and size.
+#define IPC_RATELIMIT_CRITICAL_RATE 20u
+#define IPC_RATELIMIT_CRITICAL_BURST 50u
+
+/// uid recorded for datagrams that arrived without credentials.
+#define IPC_RATELIMIT_UID_UNKNOWN UINT32_MAX
+
+typedef enum {
+  IPC_PRIO_CRITICAL,
+  IPC_PRIO_NORMAL,
+  IPC_PRIO_BULK,
+} IpcPriority;
+
+typedef struct {
+  bool in_use;
+  uint32_t pid;
+  uint32_t uid;
+  uint64_t tokens_milli;
+  uint64_t refill_ns;          ///< Time the bucket was last refilled.
+  uint64_t critical_milli;     ///< Control-message bucket.
+  uint64_t critical_refill_ns; ///< Time it was last refilled.
+  uint64_t seen_ns;            ///< Time of the client's last datagram.
+  uint64_t accepted;
+  uint64_t dropped;
+  bool limited;                ///< Last non-critical message was dropped.
+  uint64_t burst_drops;        ///< Drops since @c limited was last set.
+} IpcClient;
+
+typedef struct {
+  uint32_t rate;           ///< Refill, messages per second; 0: unlimited.
+  uint32_t burst;          ///< Bucket size in messages.
+  uint32_t critical_rate;  ///< Control bucket refill; 0: control unlimited.
+  uint32_t critical_burst; ///< Control bucket size in messages.
+  IpcClient clients[IPC_RATELIMIT_MAX_CLIENTS];
+} IpcRateLimit;
+
+/// Reset @p rl and set its limits.  @p burst is raised to at least 1.  The
+/// control bucket gets IPC_RATELIMIT_CRITICAL_RATE/_BURST.
+void ipc_ratelimit_init(IpcRateLimit *rl, uint32_t rate, uint32_t burst);
+
+/// Set the control bucket's limits; @p burst is raised to at least 1.  Call
+/// before any client is tracked.
+void ipc_ratelimit_set_critical(IpcRateLimit *rl, uint32_t rate,
+                                uint32_t burst);
+
+/// Find the entry for (@p pid, @p uid), claiming a free or the least recently
+/// seen slot for a new client.  A new client starts with a full bucket.
+IpcClient *ipc_ratelimit_client(IpcRateLimit *rl, uint32_t pid, uint32_t uid,
+                                uint64_t now_ns);
+
+/// Refill @p c to @p now_ns and decide whether one message of priority
+/// @p prio is admitted; updates the client's counters either way.
+bool ipc_ratelimit_admit(IpcRateLimit *rl, IpcClient *c, IpcPriority prio,
+                         uint64_t now_ns);
+
+/// Count a message the caller refused for its own reasons (e.g. load
+/// shedding) exactly like a bucket refusal.
+void ipc_ratelimit_refuse(IpcClient *c);
+
+#ifdef __cplusplus
+}
+#endif
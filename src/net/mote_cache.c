@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "mote_cache.h"
+#include "config_file.h"
+#include "crc32c.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_MAGIC 0x4341434du // "MCAC"
+#define CACHE_VERSION 1u
+#define HDR_SIZE 28u
+#define CRC_SIZE 4u
+
+static uint32_t checksum(const uint8_t *buf, size_t len) {
+  return crc32c_finalize(crc32c_update(0xFFFFFFFF, buf, len));
+}
+
+static uint16_t rd16(const uint8_t *p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t rd32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t rd64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint8_t *read_all(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  size_t cap = HDR_SIZE + MOTE_CACHE_APP_NAME_MAX + MOTE_CACHE_CBOR_MAX +
+               CRC_SIZE + 1;
+  uint8_t *buf = (uint8_t *)malloc(cap);
+  size_t n = buf ? fread(buf, 1, cap, f) : 0;
+  bool err = ferror(f) != 0;
+  fclose(f);
+  // A full buffer means the file is larger than any valid cache.
+  if (!buf || err || n == cap) {
+    free(buf);
+    return NULL;
+  }
+  *len = n;
+  return buf;
+}
+
+bool mote_cache_load(const char *path, uint64_t node_id, MoteCache *out) {
+  memset(out, 0, sizeof(*out));
+  size_t len = 0;
+  uint8_t *buf = read_all(path, &len);
+  if (!buf) {
+    return false;
+  }
+  bool ok = len >= HDR_SIZE + CRC_SIZE && rd32(buf) == CACHE_MAGIC &&
+            rd16(buf + 4) == CACHE_VERSION;
+  uint16_t name_len = ok ? rd16(buf + 6) : 0;
+  uint32_t cbor_len = ok ? rd32(buf + 24) : 0;
+  ok = ok && name_len <= MOTE_CACHE_APP_NAME_MAX &&
+       cbor_len <= MOTE_CACHE_CBOR_MAX &&
+       len == HDR_SIZE + name_len + cbor_len + CRC_SIZE &&
+       rd32(buf + len - CRC_SIZE) == checksum(buf, len - CRC_SIZE) &&
+       rd64(buf + 8) == node_id;
+  if (ok) {
+    out->node_id = node_id;
+    out->git_sha = rd32(buf + 16);
+    out->sys_config_crc = rd32(buf + 20);
+    memcpy(out->app_name, buf + HDR_SIZE, name_len);
+    out->app_name[name_len] = '\0';
+    ok = mote_cache_set_cbor(out, buf + HDR_SIZE + name_len, cbor_len);
+  }
+  free(buf);
+  if (!ok) {
+    mote_cache_free(out);
+  }
+  return ok;
+}
+
+bool mote_cache_store(const char *path, const MoteCache *c) {
+  size_t name_len = strnlen(c->app_name, MOTE_CACHE_APP_NAME_MAX);
+  if (c->cbor_len > MOTE_CACHE_CBOR_MAX) {
+    return false;
+  }
+  size_t len = HDR_SIZE + name_len + c->cbor_len + CRC_SIZE;
+  uint8_t *buf = (uint8_t *)malloc(len);
+  if (!buf) {
+    return false;
+  }
+  uint32_t magic = CACHE_MAGIC;
+  uint16_t version = CACHE_VERSION;
+  uint16_t name_len16 = (uint16_t)name_len;
+  uint32_t cbor_len32 = (uint32_t)c->cbor_len;
+  memcpy(buf, &magic, 4);
+  memcpy(buf + 4, &version, 2);
+  memcpy(buf + 6, &name_len16, 2);
+  memcpy(buf + 8, &c->node_id, 8);
+  memcpy(buf + 16, &c->git_sha, 4);
+  memcpy(buf + 20, &c->sys_config_crc, 4);
+  memcpy(buf + 24, &cbor_len32, 4);
+  memcpy(buf + HDR_SIZE, c->app_name, name_len);
+  if (c->cbor_len) {
+    memcpy(buf + HDR_SIZE + name_len, c->cbor, c->cbor_len);
+  }
+  uint32_t crc = checksum(buf, len - CRC_SIZE);
+  memcpy(buf + len - CRC_SIZE, &crc, CRC_SIZE);
+  bool ok = config_file_replace(path, buf, len);
+  free(buf);
+  return ok;
+}
+
+bool mote_cache_matches(const MoteCache *c, uint32_t git_sha,
+                        uint32_t sys_config_crc, const char *app_name) {
+  return c->cbor && c->git_sha == git_sha &&
+         c->sys_config_crc == sys_config_crc &&
+         strncmp(c->app_name, app_name, MOTE_CACHE_APP_NAME_MAX) == 0;
+}
+
+bool mote_cache_set_cbor(MoteCache *c, const uint8_t *cbor, size_t len) {
+  uint8_t *copy = NULL;
+  if (len > MOTE_CACHE_CBOR_MAX || !(copy = (uint8_t *)malloc(len + 1))) {
+    return false;
+  }
+  memcpy(copy, cbor, len);
+  free(c->cbor);
+  c->cbor = copy;
+  c->cbor_len = len;
+  return true;
+}
+
+void mote_cache_free(MoteCache *c) {
+  free(c->cbor);
+  c->cbor = NULL;
+  c->cbor_len = 0;
+}
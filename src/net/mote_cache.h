@@ -0,0 +1,61 @@
+#pragma once
+
+/// @file mote_cache.h
+/// @brief On-disk cache of the gateway's mote identity and system config map.
+///
+/// The gateway writes its init log from the mote's app name and CBOR config
+/// map, both fetched over the UART at every boot.  The mote rarely changes
+/// between boots, so the last answers are kept here, keyed by node id, along
+/// with the mote's git SHA and system config CRC from sys_info.  The next
+/// boot serves the init log straight from the cache and only fetches the map
+/// again if sys_info reports a different SHA, CRC or app name.
+///
+/// File layout (little-endian), replaced atomically on every store:
+///
+///   u32 magic, u16 version, u16 app_name_len, u64 node_id,
+///   u32 git_sha, u32 sys_config_crc, u32 cbor_len,
+///   app_name[app_name_len], cbor[cbor_len], u32 crc32c of all the above
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Longest app name kept.
+#define MOTE_CACHE_APP_NAME_MAX 64
+
+/// Largest config map kept.
+#define MOTE_CACHE_CBOR_MAX (256u * 1024u)
+
+typedef struct {
+  uint64_t node_id;
+  uint32_t git_sha;
+  uint32_t sys_config_crc;
+  char app_name[MOTE_CACHE_APP_NAME_MAX + 1];
+  uint8_t *cbor; ///< malloc'd; freed by mote_cache_free().
+  size_t cbor_len;
+} MoteCache;
+
+/// Load the cache at @p path if it is intact and belongs to @p node_id.
+/// @return false if it is missing, corrupt or for another mote; @p out is
+///         then left empty.
+bool mote_cache_load(const char *path, uint64_t node_id, MoteCache *out);
+
+/// Replace the cache at @p path with @p c.
+bool mote_cache_store(const char *path, const MoteCache *c);
+
+/// True if sys_info still describes the mote @p c was taken from.
+bool mote_cache_matches(const MoteCache *c, uint32_t git_sha,
+                        uint32_t sys_config_crc, const char *app_name);
+
+/// Replace @p c's map with a copy of @p cbor.
+bool mote_cache_set_cbor(MoteCache *c, const uint8_t *cbor, size_t len);
+
+void mote_cache_free(MoteCache *c);
+
+#ifdef __cplusplus
+}
+#endif
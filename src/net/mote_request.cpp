@@ -0,0 +1,239 @@
+#include "mote_request.h"
+#include "bm_log.h"
+#include "bm_os.h"
+#include "config_cbor_map_service.h"
+#include "config_cbor_map_srv_reply_msg.h"
+#include "sys_info_service.h"
+#include "sys_info_svc_reply_msg.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace {
+
+std::atomic<MoteSysInfo *> g_sys_info{nullptr};
+std::atomic<MoteConfigMap *> g_config_map{nullptr};
+std::atomic<MoteConfigGet *> g_config_gets[MOTE_CONFIG_GET_SLOTS];
+
+template <typename T> bool claim(std::atomic<T *> &slot, T *q) {
+  T *expected = nullptr;
+  return slot.compare_exchange_strong(expected, q);
+}
+
+template <typename T> void release(std::atomic<T *> &slot, T *q) {
+  T *expected = q;
+  slot.compare_exchange_strong(expected, nullptr);
+}
+
+/**************** sys info ****************/
+
+bool sys_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
+                       const char *service, size_t reply_len,
+                       uint8_t *reply_data) {
+  (void)msg_id;
+  (void)service_strlen;
+  (void)service;
+  MoteSysInfo *q = g_sys_info.load();
+  if (!q) {
+    return false;
+  }
+  if (!ack || !reply_data) {
+    bm_log_warn("Sys info request not acknowledged");
+    return false;
+  }
+
+  SysInfoReplyData reply = {0, 0, 0, 0, NULL};
+  CborError err = sys_info_reply_decode(&reply, reply_data, reply_len);
+  bool ok = err == CborNoError && reply.app_name &&
+            reply.app_name_strlen > 0 &&
+            reply.app_name_strlen <= MAX_STR_LEN_BYTES;
+  if (err != CborNoError) {
+    bm_log_error("Failed to decode sys info reply, err=%d", err);
+  } else if (!ok) {
+    bm_log_warn("Sys info reply has no usable app name");
+  }
+  if (ok && !completion_done(&q->req.done, NULL)) {
+    memcpy(q->app_name, reply.app_name, reply.app_name_strlen);
+    q->app_name[reply.app_name_strlen] = '\0';
+    q->git_sha = reply.git_sha;
+    q->sys_config_crc = reply.sys_config_crc;
+    completion_signal(&q->req.done, 0);
+  }
+  if (reply.app_name) {
+    bm_free(reply.app_name);
+  }
+  return ok;
+}
+
+bool send_sys_info(CompletionRequest *req) {
+  MoteSysInfo *q = static_cast<MoteSysInfo *>(req->ctx);
+  bool sent =
+      sys_info_service_request(q->node_id, sys_info_reply_cb, q->timeout_s);
+  if (!sent) {
+    bm_log_warn("Failed to send sys info request");
+  }
+  return sent;
+}
+
+/**************** config map ****************/
+
+bool config_map_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
+                         const char *service, size_t reply_len,
+                         uint8_t *reply_data) {
+  (void)msg_id;
+  (void)service_strlen;
+  (void)service;
+  MoteConfigMap *q = g_config_map.load();
+  if (!q) {
+    return false;
+  }
+  if (!ack || !reply_data) {
+    bm_log_warn("Config map request not acknowledged");
+    return false;
+  }
+
+  ConfigCborMapReplyData reply = {0, 0, false, 0, NULL};
+  CborError err = config_cbor_map_reply_decode(&reply, reply_data, reply_len);
+  bool ok = err == CborNoError && reply.success && reply.cbor_data &&
+            reply.cbor_encoded_map_len > 0;
+  if (err != CborNoError) {
+    bm_log_error("Failed to decode config map reply, err=%d", err);
+  } else if (!ok) {
+    bm_log_warn("Config map reply unsuccessful or empty");
+  }
+  // A late reply to an earlier attempt is dropped.
+  if (ok && !completion_done(&q->req.done, NULL)) {
+    q->cbor = reply.cbor_data;
+    q->cbor_len = reply.cbor_encoded_map_len;
+    reply.cbor_data = NULL;
+    completion_signal(&q->req.done, 0);
+  }
+  if (reply.cbor_data) {
+    bm_free(reply.cbor_data);
+  }
+  return ok;
+}
+
+bool send_config_map(CompletionRequest *req) {
+  MoteConfigMap *q = static_cast<MoteConfigMap *>(req->ctx);
+  bool sent = config_cbor_map_service_request(
+      q->node_id, q->partition_id, config_map_reply_cb, q->timeout_s);
+  if (!sent) {
+    bm_log_warn("Failed to send config map request");
+  }
+  return sent;
+}
+
+/**************** config get ****************/
+
+BmErr config_get_reply(size_t slot, uint8_t *payload) {
+  MoteConfigGet *q = g_config_gets[slot].load();
+  if (!q || !payload) {
+    return BmENODATA;
+  }
+  BmConfigValue *msg = reinterpret_cast<BmConfigValue *>(payload);
+  uint8_t value[MOTE_CONFIG_VALUE_MAX] = {0};
+  size_t value_len = sizeof(value);
+  BmErr err = bcmp_config_decode_value(q->type, msg->data, msg->data_length,
+                                       value, &value_len);
+  if (err != BmOK) {
+    bm_log_error("Failed to decode %s bcmp value, err=%d", q->key, err);
+    return err;
+  }
+  if (!completion_done(&q->req.done, NULL)) {
+    memcpy(q->value, value, value_len);
+    q->value_len = value_len;
+    completion_signal(&q->req.done, 0);
+  }
+  return BmOK;
+}
+
+// bcmp_config_get() takes a bare function pointer, so each slot gets its own
+// trampoline.
+template <size_t Slot> BmErr config_get_reply_cb(uint8_t *payload) {
+  return config_get_reply(Slot, payload);
+}
+
+const BmConfigReplyCb k_config_get_cbs[MOTE_CONFIG_GET_SLOTS] = {
+    config_get_reply_cb<0>,
+    config_get_reply_cb<1>,
+    config_get_reply_cb<2>,
+    config_get_reply_cb<3>,
+};
+
+bool send_config_get(CompletionRequest *req) {
+  MoteConfigGet *q = static_cast<MoteConfigGet *>(req->ctx);
+  if (q->slot < 0) {
+    return false; // No reply slot; see mote_config_get_init().
+  }
+  BmErr err = BmOK;
+  bool sent = bcmp_config_get(q->node_id, q->partition, strlen(q->key),
+                              q->key, &err, k_config_get_cbs[q->slot]);
+  if (!sent) {
+    bm_log_warn("Failed to send bcmp config get for %s, err=%d", q->key,
+                err);
+  }
+  return sent;
+}
+
+} // namespace
+
+bool mote_sys_info_init(MoteSysInfo *q, CompletionWaiter *w,
+                        uint64_t node_id, uint32_t timeout_s,
+                        CompletionRetry retry) {
+  memset(q, 0, sizeof(*q));
+  q->node_id = node_id;
+  q->timeout_s = timeout_s;
+  completion_request_init(&q->req, w, "sys_info", retry, send_sys_info, q);
+  return claim(g_sys_info, q);
+}
+
+void mote_sys_info_release(MoteSysInfo *q) { release(g_sys_info, q); }
+
+bool mote_config_map_init(MoteConfigMap *q, CompletionWaiter *w,
+                          uint64_t node_id, uint32_t partition_id,
+                          uint32_t timeout_s, CompletionRetry retry) {
+  memset(q, 0, sizeof(*q));
+  q->node_id = node_id;
+  q->partition_id = partition_id;
+  q->timeout_s = timeout_s;
+  completion_request_init(&q->req, w, "config_map", retry, send_config_map,
+                          q);
+  return claim(g_config_map, q);
+}
+
+void mote_config_map_release(MoteConfigMap *q) {
+  release(g_config_map, q);
+  if (q->cbor) {
+    bm_free(q->cbor);
+    q->cbor = NULL;
+    q->cbor_len = 0;
+  }
+}
+
+bool mote_config_get_init(MoteConfigGet *q, CompletionWaiter *w,
+                          uint64_t node_id, BmConfigPartition partition,
+                          const char *key, ConfigDataTypes type,
+                          CompletionRetry retry) {
+  memset(q, 0, sizeof(*q));
+  q->node_id = node_id;
+  q->partition = partition;
+  q->key = key;
+  q->type = type;
+  q->slot = -1;
+  completion_request_init(&q->req, w, key, retry, send_config_get, q);
+  for (int i = 0; i < MOTE_CONFIG_GET_SLOTS; i++) {
+    if (claim(g_config_gets[i], q)) {
+      q->slot = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void mote_config_get_release(MoteConfigGet *q) {
+  if (q->slot >= 0) {
+    release(g_config_gets[q->slot], q);
+    q->slot = -1;
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/// @file mote_request.h
+/// @brief Completion-based wrappers for the queries the gateway makes of its
+///        mote: sys info, the CBOR config map and single config gets.
+///
+/// Each query is a CompletionRequest (completion.h) whose send function
+/// issues the bm_core request and whose completion is signalled from the
+/// bm_core reply callback once a reply has decoded, so the waiting thread
+/// wakes as soon as the reply lands.  Replies that do not decode are logged
+/// and left for the retry policy.  Run them with completion_request_run().
+///
+/// The bm_core reply callbacks carry no context pointer, so each query kind
+/// routes replies through a small table of slots: one slot each for sys info
+/// and the config map, and MOTE_CONFIG_GET_SLOTS for config gets.  A query
+/// holds its slot from init until release; a reply that arrives after
+/// release is dropped.  A reply callback may still be running as release
+/// returns, so queries should not live on a stack frame that goes away.
+
+#include "completion.h"
+#include "messages/config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Config gets that can be outstanding at once.
+#define MOTE_CONFIG_GET_SLOTS 4
+
+/// Largest decoded config get value.
+#define MOTE_CONFIG_VALUE_MAX 1024
+
+typedef struct {
+  CompletionRequest req;
+  uint64_t node_id;
+  uint32_t timeout_s; ///< bm_core service request timeout.
+  uint32_t git_sha;
+  uint32_t sys_config_crc;
+  char app_name[MAX_STR_LEN_BYTES + 1];
+} MoteSysInfo;
+
+typedef struct {
+  CompletionRequest req;
+  uint64_t node_id;
+  uint32_t partition_id;
+  uint32_t timeout_s;
+  uint8_t *cbor; ///< Encoded map (bm_malloc'd), owned until release.
+  size_t cbor_len;
+} MoteConfigMap;
+
+typedef struct {
+  CompletionRequest req;
+  uint64_t node_id;
+  BmConfigPartition partition;
+  const char *key; ///< Must outlive the query.
+  ConfigDataTypes type;
+  int slot;
+  uint8_t value[MOTE_CONFIG_VALUE_MAX];
+  size_t value_len;
+} MoteConfigGet;
+
+/// Prepare a sys info query.
+/// @return false if another one holds the slot.
+bool mote_sys_info_init(MoteSysInfo *q, CompletionWaiter *w,
+                        uint64_t node_id, uint32_t timeout_s,
+                        CompletionRetry retry);
+void mote_sys_info_release(MoteSysInfo *q);
+
+/// Prepare a config map query for @p partition_id.
+/// @return false if another one holds the slot.
+bool mote_config_map_init(MoteConfigMap *q, CompletionWaiter *w,
+                          uint64_t node_id, uint32_t partition_id,
+                          uint32_t timeout_s, CompletionRetry retry);
+/// Free the map and release the slot.
+void mote_config_map_release(MoteConfigMap *q);
+
+/// Prepare a get of @p key, decoded as @p type.
+/// @return false if all MOTE_CONFIG_GET_SLOTS are taken.
+bool mote_config_get_init(MoteConfigGet *q, CompletionWaiter *w,
+                          uint64_t node_id, BmConfigPartition partition,
+                          const char *key, ConfigDataTypes type,
+                          CompletionRetry retry);
+void mote_config_get_release(MoteConfigGet *q);
+
+#ifdef __cplusplus
+}
+#endif
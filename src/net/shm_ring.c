@@ -0,0 +1,166 @@
+#include "shm_ring.h"
+
+#include <string.h>
+
+// head/tail are shared with another process, so every cross-side access goes
+// through the GCC/Clang __atomic builtins (usable from both C and C++).
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static size_t record_span(size_t len) {
+  return (SHM_RING_LEN_BYTES + len + (SHM_RING_ALIGN - 1)) &
+         ~(size_t)(SHM_RING_ALIGN - 1);
+}
+
+static uint32_t read_len_word(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void write_len_word(uint8_t *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+
+static bool is_pow2(uint32_t v) { return v && (v & (v - 1)) == 0; }
+
+int shm_ring_init(ShmRing *ring, void *mem, size_t mem_len) {
+  if (!ring || !mem ||
+      mem_len < SHM_RING_REGION_BYTES(SHM_RING_MIN_CAPACITY)) {
+    return -1;
+  }
+  size_t avail = mem_len - SHM_RING_HDR_BYTES;
+  uint32_t capacity = SHM_RING_MIN_CAPACITY;
+  while ((size_t)capacity * 2 <= avail && capacity * 2 <= SHM_RING_MAX_CAPACITY) {
+    capacity *= 2;
+  }
+
+  ShmRingHeader *hdr = (ShmRingHeader *)mem;
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->version = SHM_RING_VERSION;
+  hdr->capacity = capacity;
+  // Magic last, so a consumer never sees a half-formatted header as valid.
+  STORE_RELEASE(&hdr->magic, SHM_RING_MAGIC);
+
+  ring->hdr = hdr;
+  ring->data = (uint8_t *)mem + SHM_RING_HDR_BYTES;
+  ring->capacity = capacity;
+  ring->pending = 0;
+  return 0;
+}
+
+int shm_ring_attach(ShmRing *ring, void *mem, size_t mem_len) {
+  if (!ring || !mem || mem_len < SHM_RING_HDR_BYTES) {
+    return -1;
+  }
+  ShmRingHeader *hdr = (ShmRingHeader *)mem;
+  if (LOAD_ACQUIRE(&hdr->magic) != SHM_RING_MAGIC ||
+      hdr->version != SHM_RING_VERSION) {
+    return -1;
+  }
+  uint32_t capacity = hdr->capacity;
+  if (!is_pow2(capacity) || capacity < SHM_RING_MIN_CAPACITY ||
+      capacity > SHM_RING_MAX_CAPACITY ||
+      SHM_RING_REGION_BYTES((size_t)capacity) > mem_len) {
+    return -1;
+  }
+  ring->hdr = hdr;
+  ring->data = (uint8_t *)mem + SHM_RING_HDR_BYTES;
+  ring->capacity = capacity;
+  ring->pending = LOAD_RELAXED(&hdr->tail);
+  return 0;
+}
+
+size_t shm_ring_max_record(const ShmRing *ring) {
+  // Half the ring, so a record always fits after a worst-case wrap.
+  return ring->capacity / 2 - SHM_RING_LEN_BYTES;
+}
+
+uint8_t *shm_ring_reserve(ShmRing *ring, size_t len) {
+  if (len > shm_ring_max_record(ring)) {
+    return NULL;
+  }
+  size_t span = record_span(len);
+  uint64_t head = LOAD_RELAXED(&ring->hdr->head);
+  uint64_t tail = LOAD_ACQUIRE(&ring->hdr->tail);
+  size_t off = (size_t)(head & (ring->capacity - 1));
+  size_t to_end = ring->capacity - off;
+  size_t need = span > to_end ? to_end + span : span;
+  if ((head - tail) + need > ring->capacity) {
+    return NULL;
+  }
+  if (span > to_end) {
+    // Offsets are 8-aligned, so at least one length word fits before the end.
+    write_len_word(ring->data + off, SHM_RING_WRAP_MARKER);
+    head += to_end;
+    off = 0;
+  }
+  write_len_word(ring->data + off, (uint32_t)len);
+  ring->pending = head + span;
+  return ring->data + off + SHM_RING_LEN_BYTES;
+}
+
+void shm_ring_commit(ShmRing *ring) {
+  STORE_RELEASE(&ring->hdr->head, ring->pending);
+}
+
+int shm_ring_push(ShmRing *ring, const void *rec, size_t len) {
+  uint8_t *dst = shm_ring_reserve(ring, len);
+  if (!dst) {
+    return -1;
+  }
+  if (len) {
+    memcpy(dst, rec, len);
+  }
+  shm_ring_commit(ring);
+  return 0;
+}
+
+const uint8_t *shm_ring_peek(ShmRing *ring, size_t *len, bool *corrupt) {
+  if (corrupt) {
+    *corrupt = false;
+  }
+  uint64_t tail = LOAD_RELAXED(&ring->hdr->tail);
+  uint64_t head = LOAD_ACQUIRE(&ring->hdr->head);
+  for (;;) {
+    if (head == tail) {
+      return NULL;
+    }
+    uint64_t used = head - tail;
+    if (used > ring->capacity || (tail & (SHM_RING_ALIGN - 1)) != 0) {
+      break;
+    }
+    size_t off = (size_t)(tail & (ring->capacity - 1));
+    uint32_t word = read_len_word(ring->data + off);
+    if (word == SHM_RING_WRAP_MARKER) {
+      size_t to_end = ring->capacity - off;
+      if (to_end > used) {
+        break;
+      }
+      tail += to_end;
+      STORE_RELEASE(&ring->hdr->tail, tail);
+      continue;
+    }
+    size_t span = record_span(word);
+    if (word > shm_ring_max_record(ring) || off + span > ring->capacity ||
+        span > used) {
+      break;
+    }
+    ring->pending = tail + span;
+    *len = word;
+    return ring->data + off + SHM_RING_LEN_BYTES;
+  }
+  if (corrupt) {
+    *corrupt = true;
+  }
+  return NULL;
+}
+
+void shm_ring_pop(ShmRing *ring) {
+  STORE_RELEASE(&ring->hdr->tail, ring->pending);
+}
+
+size_t shm_ring_used(const ShmRing *ring) {
+  uint64_t head = LOAD_ACQUIRE(&ring->hdr->head);
+  uint64_t tail = LOAD_ACQUIRE(&ring->hdr->tail);
+  return (size_t)(head - tail);
+}
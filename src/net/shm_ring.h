@@ -0,0 +1,116 @@
+#pragma once
+
+/// @file shm_ring.h
+/// @brief Single-producer / single-consumer byte ring for shared memory.
+///
+/// The ring lives entirely inside a caller-supplied memory region (normally a
+/// memfd mapped by two processes), so it carries no pointers — only offsets.
+///
+/// Region layout:
+///   [ShmRingHeader (192 B)] [data area (capacity bytes, power of two)]
+///
+/// Record layout inside the data area (8-byte aligned):
+///   [len (4 B, little-endian host order)] [payload (len B)] [pad to 8]
+///
+/// A record never straddles the end of the data area.  When the space left
+/// before the end is too small the producer writes SHM_RING_WRAP_MARKER as
+/// the length word and continues at offset 0.
+///
+/// head and tail are free-running 64-bit byte positions.  The producer
+/// publishes head with a release store after writing the record; the
+/// consumer loads head with an acquire load (and symmetrically for tail).
+/// The consumer treats every length word as untrusted input.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// "BMSR" — identifies an initialised ring region.
+#define SHM_RING_MAGIC 0x52534d42u
+#define SHM_RING_VERSION 1u
+
+/// Header size; head and tail each own a 64-byte cache line.
+#define SHM_RING_HDR_BYTES 192u
+
+/// Record alignment and length-word size.
+#define SHM_RING_ALIGN 8u
+#define SHM_RING_LEN_BYTES 4u
+
+/// Length word that tells the consumer to continue at offset 0.
+#define SHM_RING_WRAP_MARKER 0xFFFFFFFFu
+
+/// Smallest and largest data areas accepted by shm_ring_attach().
+#define SHM_RING_MIN_CAPACITY 4096u
+#define SHM_RING_MAX_CAPACITY (16u * 1024u * 1024u)
+
+/// Total region size needed for a data area of @p capacity bytes.
+#define SHM_RING_REGION_BYTES(capacity) (SHM_RING_HDR_BYTES + (capacity))
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity; ///< Data area size in bytes (power of two).
+  uint32_t flags;    ///< Reserved, zero.
+  uint8_t pad0[48];
+  uint64_t head; ///< Producer position; written by the producer only.
+  uint8_t pad1[56];
+  uint64_t tail; ///< Consumer position; written by the consumer only.
+  uint8_t pad2[56];
+} ShmRingHeader;
+
+/// Process-local view of a ring region.
+typedef struct {
+  ShmRingHeader *hdr;
+  uint8_t *data;
+  uint32_t capacity;
+  /// Producer: position of the reserved-but-uncommitted record.
+  /// Consumer: position just past the record returned by shm_ring_peek().
+  uint64_t pending;
+} ShmRing;
+
+/// Format @p mem as an empty ring and attach @p ring to it (producer side).
+/// The data area is sized to the largest power of two that fits.
+/// @return 0 on success, -1 if @p mem_len is too small.
+int shm_ring_init(ShmRing *ring, void *mem, size_t mem_len);
+
+/// Attach to an already-initialised region (consumer side).  Validates the
+/// magic, version and capacity against @p mem_len.
+/// @return 0 on success, -1 if the region is not a valid ring.
+int shm_ring_attach(ShmRing *ring, void *mem, size_t mem_len);
+
+/// Largest payload a single record may carry in this ring.
+size_t shm_ring_max_record(const ShmRing *ring);
+
+/// Reserve space for a @p len byte record (producer side).
+/// @return Pointer to write the payload into, or NULL if the ring is full
+///         or @p len exceeds shm_ring_max_record().  Nothing is visible to
+///         the consumer until shm_ring_commit().
+uint8_t *shm_ring_reserve(ShmRing *ring, size_t len);
+
+/// Publish the record reserved by the last shm_ring_reserve() call.
+void shm_ring_commit(ShmRing *ring);
+
+/// Reserve, copy and commit in one call.
+/// @return 0 on success, -1 if the ring is full or the record too large.
+int shm_ring_push(ShmRing *ring, const void *rec, size_t len);
+
+/// Return the oldest committed record without consuming it (consumer side).
+/// @param len  Set to the payload length on success.
+/// @param corrupt  Set to true if the producer wrote an impossible length;
+///                 the ring must then be abandoned.  May be NULL.
+/// @return Pointer to the payload, or NULL if the ring is empty or corrupt.
+const uint8_t *shm_ring_peek(ShmRing *ring, size_t *len, bool *corrupt);
+
+/// Consume the record returned by the last successful shm_ring_peek().
+void shm_ring_pop(ShmRing *ring);
+
+/// Bytes currently committed and not yet consumed.
+size_t shm_ring_used(const ShmRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
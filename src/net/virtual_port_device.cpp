@@ -1,6 +1,8 @@
+#define BM_LOG_MODULE "vpd"
 #include "virtual_port_device.h"
 #include "bm_config.h"       // bm_debug()
-#include "bm_log.h"         // bm_log_warn()
+#include "bm_log.h"         // bm_log_warn(), bm_log_ratelimited_key()
+#include "pcap_writer.h"     // pcap_writer_frame()
 #include <errno.h>           // errno
 #include <pthread.h>         // pthread_mutex_t, pthread_t, pthread_create, pthread_join
 #include <stdio.h>           // snprintf
@@ -130,6 +132,7 @@ static void *vpd_rx_thread(void *arg) {
     if (port_num < 1 || port_num > VIRTUAL_PORT_MAX_PEERS) { continue; }
     uint8_t *frame     = VIRTUAL_PORT_DGRAM_FRAME_PTR(buf);
     size_t   frame_len = VIRTUAL_PORT_FRAME_LEN((size_t)n);
+    pcap_writer_frame(port_num, PCAP_WRITER_IN, frame, frame_len);
     // Snapshot callback pointer under lock; invoke outside lock.
     pthread_mutex_lock(&s->lock);
     void (*rcv)(uint8_t, uint8_t *, size_t) = s->callbacks.receive;
@@ -308,8 +311,12 @@ static BmErr vpd_send(void *self, uint8_t *data, size_t length, uint8_t port) {
       memcpy(VIRTUAL_PORT_DGRAM_FRAME_PTR(dgram), data, length);
       size_t dlen = VIRTUAL_PORT_DGRAM_LEN(length);
       if (sendto(sfd, dgram, dlen, 0, (struct sockaddr *)&dst, sizeof(dst)) < 0) {
-        bm_debug("vpd_send: flood peer %d failed errno=%d\n", i + 1, errno);
+        bm_log_ratelimited_key(BM_LOG_DEBUG, (uint64_t)(i + 1),
+                               "vpd_send: flood peer %d failed errno=%d",
+                               i + 1, errno);
         err = BmEIO;
+      } else {
+        pcap_writer_frame((uint8_t)(i + 1), PCAP_WRITER_OUT, data, length);
       }
     }
   } else {
@@ -326,8 +333,12 @@ static BmErr vpd_send(void *self, uint8_t *data, size_t length, uint8_t port) {
     memcpy(VIRTUAL_PORT_DGRAM_FRAME_PTR(dgram), data, length);
     size_t dlen = VIRTUAL_PORT_DGRAM_LEN(length);
     if (sendto(sfd, dgram, dlen, 0, (struct sockaddr *)&dst, sizeof(dst)) < 0) {
-      bm_debug("vpd_send: unicast port %d failed errno=%d\n", port, errno);
+      bm_log_ratelimited_key(BM_LOG_DEBUG, port,
+                             "vpd_send: unicast port %d failed errno=%d",
+                             port, errno);
       err = BmEIO;
+    } else {
+      pcap_writer_frame(port, PCAP_WRITER_OUT, data, length);
     }
   }
   return err;
@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include "config_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool config_file_read(const char *path, uint32_t offset, uint8_t *buf,
+                      size_t len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    // File doesn't exist yet — return zeros so config_init() creates a fresh
+    // partition, which will be written back on first save.
+    memset(buf, 0, len);
+    return true;
+  }
+  if (fseek(f, (long)offset, SEEK_SET) != 0) {
+    fclose(f);
+    memset(buf, 0, len);
+    return true;
+  }
+  size_t n = fread(buf, 1, len, f);
+  bool ok = !ferror(f);
+  fclose(f);
+  // Zero-fill any remainder (file may be shorter than requested length).
+  if (n < len) {
+    memset(buf + n, 0, len - n);
+  }
+  return ok;
+}
+
+// Best-effort fsync of the directory holding @p path, so a rename into it
+// is durable across power loss.
+static void fsync_parent_dir(const char *path) {
+  char copy[PATH_MAX];
+  snprintf(copy, sizeof(copy), "%s", path);
+  int dfd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dfd >= 0) {
+    fsync(dfd);
+    close(dfd);
+  }
+}
+
+bool config_file_replace(const char *path, const uint8_t *buf, size_t len) {
+  char tmp_path[PATH_MAX + 8];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t w = write(fd, buf, len);
+  if (w != (ssize_t)len || fsync(fd) != 0) {
+    close(fd);
+    unlink(tmp_path);
+    return false;
+  }
+  if (close(fd) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  if (rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  fsync_parent_dir(path);
+  return true;
+}
+
+bool config_file_write(const char *path, uint32_t offset, const uint8_t *buf,
+                       size_t len) {
+  // Stage final contents: the existing file (which may extend past the
+  // written range) with [offset, offset+len) replaced.
+  size_t final_size = (size_t)offset + len;
+  struct stat st;
+  if (stat(path, &st) == 0 && (size_t)st.st_size > final_size) {
+    final_size = (size_t)st.st_size;
+  }
+  uint8_t *staging = (uint8_t *)calloc(1, final_size);
+  if (!staging) {
+    return false;
+  }
+  if (!config_file_read(path, 0, staging, final_size)) {
+    free(staging);
+    return false;
+  }
+  memcpy(staging + offset, buf, len);
+  bool ok = config_file_replace(path, staging, final_size);
+  free(staging);
+  return ok;
+}
+
+// Caller holds the lock.  Replaces any current mapping with one of the file
+// now at m->path.
+static bool remap_locked(ConfigFileMap *m) {
+  if (m->map) {
+    munmap((void *)m->map, m->len);
+    m->map = NULL;
+  }
+  m->len = 0;
+  m->valid = false;
+  int fd = open(m->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    m->valid = errno == ENOENT;
+    return m->valid;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size > 0) {
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    m->map = (const uint8_t *)p;
+    m->len = (size_t)st.st_size;
+  }
+  close(fd);
+  m->valid = true;
+  return true;
+}
+
+bool config_file_map(ConfigFileMap *m, const char *path) {
+  pthread_mutex_init(&m->lock, NULL);
+  snprintf(m->path, sizeof(m->path), "%s", path);
+  m->map = NULL;
+  m->len = 0;
+  return remap_locked(m);
+}
+
+void config_file_unmap(ConfigFileMap *m) {
+  if (m->map) {
+    munmap((void *)m->map, m->len);
+  }
+  m->map = NULL;
+  m->len = 0;
+  m->valid = false;
+  pthread_mutex_destroy(&m->lock);
+}
+
+void config_file_map_read(ConfigFileMap *m, uint32_t offset, uint8_t *buf,
+                          size_t len) {
+  pthread_mutex_lock(&m->lock);
+  if (!m->valid) {
+    config_file_read(m->path, offset, buf, len);
+    pthread_mutex_unlock(&m->lock);
+    return;
+  }
+  size_t avail = 0;
+  if (offset < m->len) {
+    avail = m->len - offset < len ? m->len - offset : len;
+    memcpy(buf, m->map + offset, avail);
+  }
+  memset(buf + avail, 0, len - avail);
+  pthread_mutex_unlock(&m->lock);
+}
+
+bool config_file_map_write(ConfigFileMap *m, uint32_t offset,
+                           const uint8_t *buf, size_t len) {
+  pthread_mutex_lock(&m->lock);
+  if (!m->valid) {
+    // The mapping went away; write through and try to map again.
+    bool ok = config_file_write(m->path, offset, buf, len);
+    remap_locked(m);
+    pthread_mutex_unlock(&m->lock);
+    return ok;
+  }
+  size_t final_size = (size_t)offset + len;
+  if (m->len > final_size) {
+    final_size = m->len;
+  }
+  uint8_t *staging = (uint8_t *)calloc(1, final_size);
+  if (!staging) {
+    pthread_mutex_unlock(&m->lock);
+    return false;
+  }
+  if (m->map) {
+    memcpy(staging, m->map, m->len);
+  }
+  memcpy(staging + offset, buf, len);
+  bool ok = config_file_replace(m->path, staging, final_size);
+  free(staging);
+  if (ok) {
+    remap_locked(m);
+  }
+  pthread_mutex_unlock(&m->lock);
+  return ok;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/// @file config_file.h
+/// @brief Whole-file config partition storage (the default backend).
+///
+/// A partition is a plain file holding the raw partition image.  Every write
+/// stages the complete new contents in "<path>.tmp", fsyncs it, renames it
+/// over the target and fsyncs the directory, so a crash leaves either the
+/// old or the new image, never a mix.
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Read [@p offset, @p offset + @p len) of @p path.  Bytes past the end of
+/// the file, or of a file that does not exist, read as zero.
+/// @return false only on an I/O error after the file was opened.
+bool config_file_read(const char *path, uint32_t offset, uint8_t *buf,
+                      size_t len);
+
+/// Replace [@p offset, @p offset + @p len) of @p path atomically, keeping
+/// the rest of the existing contents.
+/// @return true on success; on failure the target is left untouched.
+bool config_file_write(const char *path, uint32_t offset, const uint8_t *buf,
+                       size_t len);
+
+/// Write @p len bytes as the complete new contents of @p path, atomically.
+bool config_file_replace(const char *path, const uint8_t *buf, size_t len);
+
+/// A partition file mapped read-only, so reads are a memcpy instead of an
+/// open/seek/read/close.  Writes go through config_file_replace() and then
+/// map the new file; the rename leaves the old inode (and any mapping of
+/// it) intact, so a mapping never sees a half-written image.
+typedef struct {
+  pthread_mutex_t lock;
+  char path[PATH_MAX];
+  const uint8_t *map; ///< NULL while the file is missing or empty.
+  size_t len;
+  bool valid; ///< False after a failed remap; reads then use the file.
+} ConfigFileMap;
+
+/// Map @p path (a missing file maps as empty).
+/// @return false if the file exists but could not be mapped; @p m is still
+///         usable and falls back to uncached reads.
+bool config_file_map(ConfigFileMap *m, const char *path);
+
+/// Drop the mapping of @p m.
+void config_file_unmap(ConfigFileMap *m);
+
+/// config_file_read() served from the mapping.
+void config_file_map_read(ConfigFileMap *m, uint32_t offset, uint8_t *buf,
+                          size_t len);
+
+/// config_file_write() that stages from the mapping and remaps the result.
+bool config_file_map_write(ConfigFileMap *m, uint32_t offset,
+                           const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+#include "config_journal.h"
+#include "config_file.h"
+#include "crc32c.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC 0x4a474643u // "CFGJ"
+#define RECORD_HDR_SIZE 16u
+#define SEG_HDR_SIZE 8u
+
+// Most segments one record carries; later changes fold into the last one.
+#define MAX_SEGS 64u
+
+// Unchanged bytes bridged inside one segment rather than starting a new one;
+// below a segment header's size, bridging is the smaller record.
+#define SEG_MERGE_GAP SEG_HDR_SIZE
+
+typedef struct {
+  uint32_t offset;
+  uint32_t len;
+} Seg;
+
+struct ConfigJournal {
+  pthread_mutex_t lock;
+  pthread_cond_t wake; ///< Flusher: work arrived or stop requested.
+  char base_path[PATH_MAX];
+  int fd; ///< Journal, opened O_APPEND.
+  uint8_t *image;
+  size_t image_len;
+  size_t image_cap;
+  uint64_t journal_bytes;
+  uint32_t window_ms;
+  uint32_t compact_bytes;
+  bool dirty;              ///< Appended but not yet fdatasynced.
+  uint64_t dirty_since_ns; ///< When the oldest unsynced record was appended.
+  bool compact_wanted;
+  bool stop;
+  bool has_flusher;
+  pthread_t flusher;
+  ConfigJournalStats stats;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t rd32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void wr32(uint8_t *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+
+// CRC over magic, payload_len and nseg, then the payload.
+static uint32_t record_crc(const uint8_t *hdr, const uint8_t *payload,
+                           size_t payload_len) {
+  uint32_t crc = crc32c_update(0xFFFFFFFF, hdr, 12);
+  crc = crc32c_update(crc, payload, payload_len);
+  return crc32c_finalize(crc);
+}
+
+// Grow the image to at least @p len bytes, zero-filling the new tail.
+static bool image_reserve(ConfigJournal *j, size_t len) {
+  if (len <= j->image_len) {
+    return true;
+  }
+  if (len > CONFIG_JOURNAL_MAX_IMAGE) {
+    errno = EFBIG;
+    return false;
+  }
+  if (len > j->image_cap) {
+    size_t cap = j->image_cap ? j->image_cap : 4096;
+    while (cap < len) {
+      cap *= 2;
+    }
+    uint8_t *grown = (uint8_t *)realloc(j->image, cap);
+    if (!grown) {
+      return false;
+    }
+    j->image = grown;
+    j->image_cap = cap;
+  }
+  memset(j->image + j->image_len, 0, len - j->image_len);
+  j->image_len = len;
+  return true;
+}
+
+static bool load_base(ConfigJournal *j) {
+  struct stat st;
+  if (stat(j->base_path, &st) != 0) {
+    return errno == ENOENT;
+  }
+  if ((size_t)st.st_size > CONFIG_JOURNAL_MAX_IMAGE) {
+    errno = EFBIG;
+    return false;
+  }
+  if (!image_reserve(j, (size_t)st.st_size)) {
+    return false;
+  }
+  return config_file_read(j->base_path, 0, j->image, j->image_len);
+}
+
+// Check that the segments of one record fit its payload and the image
+// limit; returns the number of segments or -1.
+static int check_segments(const uint8_t *payload, size_t payload_len,
+                          uint32_t nseg) {
+  size_t pos = 0;
+  for (uint32_t i = 0; i < nseg; i++) {
+    if (payload_len - pos < SEG_HDR_SIZE) {
+      return -1;
+    }
+    uint32_t off = rd32(payload + pos);
+    uint32_t len = rd32(payload + pos + 4);
+    pos += SEG_HDR_SIZE;
+    if (len > payload_len - pos ||
+        (uint64_t)off + len > CONFIG_JOURNAL_MAX_IMAGE) {
+      return -1;
+    }
+    pos += len;
+  }
+  return pos == payload_len ? (int)nseg : -1;
+}
+
+static bool apply_segments(ConfigJournal *j, const uint8_t *payload,
+                           uint32_t nseg) {
+  size_t pos = 0;
+  for (uint32_t i = 0; i < nseg; i++) {
+    uint32_t off = rd32(payload + pos);
+    uint32_t len = rd32(payload + pos + 4);
+    pos += SEG_HDR_SIZE;
+    if (!image_reserve(j, (size_t)off + len)) {
+      return false;
+    }
+    memcpy(j->image + off, payload + pos, len);
+    pos += len;
+  }
+  return true;
+}
+
+// Apply every intact record, then cut the journal back to the last one.
+static bool replay(ConfigJournal *j) {
+  struct stat st;
+  if (fstat(j->fd, &st) != 0) {
+    return false;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size == 0) {
+    return true;
+  }
+  uint8_t *data = (uint8_t *)malloc(size);
+  if (!data) {
+    return false;
+  }
+  ssize_t n = pread(j->fd, data, size, 0);
+  if (n < 0) {
+    free(data);
+    return false;
+  }
+  size = (size_t)n;
+
+  size_t pos = 0;
+  while (size - pos >= RECORD_HDR_SIZE) {
+    const uint8_t *hdr = data + pos;
+    uint32_t payload_len = rd32(hdr + 4);
+    uint32_t nseg = rd32(hdr + 8);
+    if (rd32(hdr) != JOURNAL_MAGIC ||
+        payload_len > size - pos - RECORD_HDR_SIZE) {
+      break;
+    }
+    const uint8_t *payload = hdr + RECORD_HDR_SIZE;
+    if (record_crc(hdr, payload, payload_len) != rd32(hdr + 12) ||
+        check_segments(payload, payload_len, nseg) < 0) {
+      break;
+    }
+    if (!apply_segments(j, payload, nseg)) {
+      free(data);
+      return false;
+    }
+    pos += RECORD_HDR_SIZE + payload_len;
+    j->stats.replayed++;
+  }
+  free(data);
+
+  if (pos < size) {
+    j->stats.torn_bytes = size - pos;
+    if (ftruncate(j->fd, (off_t)pos) != 0 || fsync(j->fd) != 0) {
+      return false;
+    }
+    j->stats.fsyncs++;
+  }
+  j->journal_bytes = pos;
+  return true;
+}
+
+static uint8_t old_byte(const ConfigJournal *j, size_t abs) {
+  return abs < j->image_len ? j->image[abs] : 0;
+}
+
+// Find the ranges of @p buf that differ from the image at @p offset.
+static size_t diff_segments(const ConfigJournal *j, uint32_t offset,
+                            const uint8_t *buf, size_t len, Seg *segs) {
+  size_t n = 0;
+  size_t i = 0;
+  while (i < len) {
+    if (buf[i] == old_byte(j, (size_t)offset + i)) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    size_t end = ++i;
+    size_t gap = 0;
+    while (i < len) {
+      if (buf[i] != old_byte(j, (size_t)offset + i)) {
+        end = i + 1;
+        gap = 0;
+      } else if (++gap >= SEG_MERGE_GAP) {
+        break;
+      }
+      i++;
+    }
+    if (n == MAX_SEGS) {
+      segs[n - 1].len = (uint32_t)(offset + end - segs[n - 1].offset);
+    } else {
+      segs[n].offset = (uint32_t)(offset + start);
+      segs[n].len = (uint32_t)(end - start);
+      n++;
+    }
+  }
+  return n;
+}
+
+// Caller holds the lock.  The base file is made durable before the journal
+// is truncated, so a crash in between only replays records already in it.
+static bool compact_locked(ConfigJournal *j) {
+  j->compact_wanted = false;
+  if (!config_file_replace(j->base_path, j->image, j->image_len)) {
+    return false;
+  }
+  j->stats.fsyncs += 2; // tmp file + directory
+  // Saves up to here are all durable in the base file.
+  j->dirty = false;
+  if (ftruncate(j->fd, 0) != 0) {
+    return false;
+  }
+  j->journal_bytes = 0;
+  j->stats.compactions++;
+  return true;
+}
+
+// Caller holds the lock; drops it around the fdatasync so saves can keep
+// appending while the disk catches up.
+static bool flush_locked(ConfigJournal *j) {
+  j->dirty = false;
+  int fd = j->fd;
+  pthread_mutex_unlock(&j->lock);
+  bool ok = fdatasync(fd) == 0;
+  pthread_mutex_lock(&j->lock);
+  j->stats.fsyncs++;
+  return ok;
+}
+
+static void *flusher_main(void *arg) {
+  ConfigJournal *j = (ConfigJournal *)arg;
+  pthread_mutex_lock(&j->lock);
+  for (;;) {
+    while (!j->dirty && !j->compact_wanted && !j->stop) {
+      pthread_cond_wait(&j->wake, &j->lock);
+    }
+    // Hold the first save of a group for the rest of its window so
+    // everything that lands meanwhile shares one fdatasync.
+    while (j->dirty && !j->stop) {
+      uint64_t deadline =
+          j->dirty_since_ns + (uint64_t)j->window_ms * 1000000ull;
+      if (now_ns() >= deadline) {
+        break;
+      }
+      struct timespec ts = {(time_t)(deadline / 1000000000ull),
+                            (long)(deadline % 1000000000ull)};
+      pthread_cond_timedwait(&j->wake, &j->lock, &ts);
+    }
+    if (j->compact_wanted) {
+      compact_locked(j);
+    } else if (j->dirty) {
+      flush_locked(j);
+    }
+    if (j->stop && !j->dirty) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&j->lock);
+  return NULL;
+}
+
+ConfigJournal *config_journal_open(const char *base_path,
+                                   const char *journal_path,
+                                   const ConfigJournalCfg *cfg) {
+  ConfigJournal *j = (ConfigJournal *)calloc(1, sizeof(*j));
+  if (!j) {
+    return NULL;
+  }
+  snprintf(j->base_path, sizeof(j->base_path), "%s", base_path);
+  j->window_ms = cfg ? cfg->commit_window_ms : 0;
+  j->compact_bytes = cfg && cfg->compact_bytes
+                         ? cfg->compact_bytes
+                         : CONFIG_JOURNAL_DEFAULT_COMPACT_BYTES;
+  j->fd = open(journal_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (j->fd < 0 || !load_base(j) || !replay(j)) {
+    goto fail;
+  }
+
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&j->wake, &attr);
+  pthread_condattr_destroy(&attr);
+  if (j->window_ms) {
+    int rc = pthread_create(&j->flusher, NULL, flusher_main, j);
+    if (rc != 0) {
+      pthread_cond_destroy(&j->wake);
+      pthread_mutex_destroy(&j->lock);
+      errno = rc;
+      goto fail;
+    }
+    j->has_flusher = true;
+  }
+  return j;
+
+fail:;
+  int saved = errno;
+  if (j->fd >= 0) {
+    close(j->fd);
+  }
+  free(j->image);
+  free(j);
+  errno = saved;
+  return NULL;
+}
+
+void config_journal_close(ConfigJournal *j) {
+  if (!j) {
+    return;
+  }
+  if (j->has_flusher) {
+    pthread_mutex_lock(&j->lock);
+    j->stop = true;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->flusher, NULL);
+  }
+  close(j->fd);
+  pthread_cond_destroy(&j->wake);
+  pthread_mutex_destroy(&j->lock);
+  free(j->image);
+  free(j);
+}
+
+void config_journal_read(ConfigJournal *j, uint32_t offset, uint8_t *buf,
+                         size_t len) {
+  pthread_mutex_lock(&j->lock);
+  size_t avail = 0;
+  if (offset < j->image_len) {
+    avail = j->image_len - offset;
+    if (avail > len) {
+      avail = len;
+    }
+    memcpy(buf, j->image + offset, avail);
+  }
+  memset(buf + avail, 0, len - avail);
+  pthread_mutex_unlock(&j->lock);
+}
+
+bool config_journal_write(ConfigJournal *j, uint32_t offset,
+                          const uint8_t *buf, size_t len) {
+  if ((uint64_t)offset + len > CONFIG_JOURNAL_MAX_IMAGE) {
+    errno = EFBIG;
+    return false;
+  }
+  pthread_mutex_lock(&j->lock);
+  j->stats.writes++;
+
+  Seg segs[MAX_SEGS];
+  size_t nseg = diff_segments(j, offset, buf, len, segs);
+  // Growing the image only adds zeros, which reads past its end return
+  // anyway, so it needs no record of its own.
+  if (!image_reserve(j, (size_t)offset + len) || nseg == 0) {
+    bool ok = nseg == 0 && j->image_len >= (size_t)offset + len;
+    pthread_mutex_unlock(&j->lock);
+    return ok;
+  }
+
+  size_t payload_len = 0;
+  for (size_t i = 0; i < nseg; i++) {
+    payload_len += SEG_HDR_SIZE + segs[i].len;
+  }
+  uint8_t *rec = (uint8_t *)malloc(RECORD_HDR_SIZE + payload_len);
+  if (!rec) {
+    pthread_mutex_unlock(&j->lock);
+    return false;
+  }
+  uint8_t *p = rec + RECORD_HDR_SIZE;
+  for (size_t i = 0; i < nseg; i++) {
+    wr32(p, segs[i].offset);
+    wr32(p + 4, segs[i].len);
+    memcpy(p + SEG_HDR_SIZE, buf + (segs[i].offset - offset), segs[i].len);
+    p += SEG_HDR_SIZE + segs[i].len;
+  }
+  wr32(rec, JOURNAL_MAGIC);
+  wr32(rec + 4, (uint32_t)payload_len);
+  wr32(rec + 8, (uint32_t)nseg);
+  wr32(rec + 12, record_crc(rec, rec + RECORD_HDR_SIZE, payload_len));
+
+  size_t total = RECORD_HDR_SIZE + payload_len;
+  ssize_t w = write(j->fd, rec, total);
+  free(rec);
+  if (w != (ssize_t)total) {
+    int err = w < 0 ? errno : ENOSPC;
+    // Drop a partial record so the next append does not land behind it; if
+    // that fails too, replay still stops at the torn record.
+    if (ftruncate(j->fd, (off_t)j->journal_bytes) != 0) {
+      err = errno;
+    }
+    pthread_mutex_unlock(&j->lock);
+    errno = err;
+    return false;
+  }
+  for (size_t i = 0; i < nseg; i++) {
+    memcpy(j->image + segs[i].offset, buf + (segs[i].offset - offset),
+           segs[i].len);
+  }
+  j->journal_bytes += total;
+  j->stats.records++;
+  j->stats.bytes_appended += total;
+
+  bool ok = true;
+  bool compact = j->journal_bytes >= j->compact_bytes;
+  if (!j->has_flusher) {
+    j->dirty = true;
+    // A failed compaction leaves the record in the journal; sync that.
+    if (!compact || !compact_locked(j)) {
+      ok = flush_locked(j);
+    }
+  } else {
+    if (!j->dirty) {
+      j->dirty = true;
+      j->dirty_since_ns = now_ns();
+    }
+    j->compact_wanted = j->compact_wanted || compact;
+    pthread_cond_signal(&j->wake);
+  }
+  pthread_mutex_unlock(&j->lock);
+  return ok;
+}
+
+bool config_journal_sync(ConfigJournal *j) {
+  pthread_mutex_lock(&j->lock);
+  bool ok = j->dirty ? flush_locked(j) : true;
+  pthread_mutex_unlock(&j->lock);
+  return ok;
+}
+
+bool config_journal_compact(ConfigJournal *j) {
+  pthread_mutex_lock(&j->lock);
+  bool ok = compact_locked(j);
+  pthread_mutex_unlock(&j->lock);
+  return ok;
+}
+
+void config_journal_get_stats(ConfigJournal *j, ConfigJournalStats *out) {
+  pthread_mutex_lock(&j->lock);
+  *out = j->stats;
+  pthread_mutex_unlock(&j->lock);
+}
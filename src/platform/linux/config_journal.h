@@ -0,0 +1,96 @@
+#pragma once
+
+/// @file config_journal.h
+/// @brief Journaled, write-coalescing config partition store.
+///
+/// The default backend (config_file.h) rewrites, fsyncs and renames the whole
+/// partition on every save, costing two fsyncs even when one byte changed.
+/// This store instead keeps the partition image in memory and, per save,
+/// appends one record holding only the byte ranges that differ:
+///
+///   <base>        the partition image as of the last compaction (the same
+///                 format the file backend uses, so backends can be switched)
+///   <journal>     records appended since, each
+///                   u32 magic, u32 payload_len, u32 nseg, u32 crc32c
+///                   nseg x { u32 offset, u32 len, u8 data[len] }
+///                 with the CRC over the first three words and the payload
+///
+/// A record is the unit of atomicity: on open the journal is replayed over
+/// the base image up to the first short or corrupt record, and that torn
+/// tail is truncated away, so a crash mid-append loses at most the save
+/// being written.  Once the journal outgrows @c compact_bytes the image is
+/// written over the base file (tmp + fsync + rename) and the journal is
+/// truncated; a crash between the two just replays records that are already
+/// in the base, which is harmless.
+///
+/// With @c commit_window_ms == 0 each save fdatasyncs the journal before
+/// returning.  Otherwise saves return once the record is in the page cache
+/// and a flusher thread issues one fdatasync per window for every save that
+/// landed in it (group commit).  A process crash loses nothing either way;
+/// power loss can lose saves from the last open window.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Journal size that triggers compaction when @c compact_bytes is 0.
+#define CONFIG_JOURNAL_DEFAULT_COMPACT_BYTES (64u * 1024u)
+
+/// Largest partition image the store accepts.
+#define CONFIG_JOURNAL_MAX_IMAGE (16u * 1024u * 1024u)
+
+typedef struct ConfigJournal ConfigJournal;
+
+typedef struct {
+  uint32_t commit_window_ms; ///< 0: fdatasync inside every write.
+  uint32_t compact_bytes;    ///< 0: CONFIG_JOURNAL_DEFAULT_COMPACT_BYTES.
+} ConfigJournalCfg;
+
+typedef struct {
+  uint64_t writes;          ///< config_journal_write() calls.
+  uint64_t records;         ///< Records appended (unchanged writes add none).
+  uint64_t bytes_appended;  ///< Journal bytes written, headers included.
+  uint64_t fsyncs;          ///< fdatasync/fsync calls, compaction included.
+  uint64_t compactions;
+  uint64_t replayed;        ///< Records applied when the store was opened.
+  uint64_t torn_bytes;      ///< Journal tail discarded when it was opened.
+} ConfigJournalStats;
+
+/// Open (creating if needed) the store made of @p base_path and
+/// @p journal_path, replaying the journal into memory.
+/// @return The store, or NULL with errno set.
+ConfigJournal *config_journal_open(const char *base_path,
+                                   const char *journal_path,
+                                   const ConfigJournalCfg *cfg);
+
+/// Flush outstanding saves, stop the flusher and free @p j.
+void config_journal_close(ConfigJournal *j);
+
+/// Copy [@p offset, @p offset + @p len) of the image into @p buf; bytes past
+/// the end of the image read as zero.
+void config_journal_read(ConfigJournal *j, uint32_t offset, uint8_t *buf,
+                         size_t len);
+
+/// Replace [@p offset, @p offset + @p len) of the image and journal the
+/// bytes that changed.
+/// @return false if the record could not be appended; the image is then
+///         unchanged.
+bool config_journal_write(ConfigJournal *j, uint32_t offset,
+                          const uint8_t *buf, size_t len);
+
+/// Make every save so far durable now, without waiting for the window.
+bool config_journal_sync(ConfigJournal *j);
+
+/// Fold the journal into the base file now.
+bool config_journal_compact(ConfigJournal *j);
+
+/// Snapshot @p j's counters into @p out.
+void config_journal_get_stats(ConfigJournal *j, ConfigJournalStats *out);
+
+#ifdef __cplusplus
+}
+#endif
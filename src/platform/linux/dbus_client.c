@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+#include "dbus_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NATIVE_ENDIAN 'l'
+#else
+#define NATIVE_ENDIAN 'B'
+#endif
+
+#define HDR_FIXED 16u
+#define FIELDS_MAX (1u << 26)
+#define BODY_MAX (1u << 27)
+#define RX_MAX (1u << 20)
+#define CALL_MAX_ARGS 8
+#define SYSTEM_BUS_PATH "/run/dbus/system_bus_socket"
+
+enum {
+  FIELD_PATH = 1,
+  FIELD_INTERFACE = 2,
+  FIELD_MEMBER = 3,
+  FIELD_ERROR_NAME = 4,
+  FIELD_REPLY_SERIAL = 5,
+  FIELD_DESTINATION = 6,
+  FIELD_SENDER = 7,
+  FIELD_SIGNATURE = 8,
+};
+
+static size_t align_up(size_t off, size_t a) {
+  return (off + a - 1) & ~(a - 1);
+}
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+/**************** Encoding ****************/
+
+typedef struct {
+  uint8_t *p;
+  size_t cap;
+  size_t off;
+  bool ok;
+} Writer;
+
+static void w_bytes(Writer *w, const void *b, size_t n) {
+  if (!w->ok || w->off + n > w->cap) {
+    w->ok = false;
+    return;
+  }
+  memcpy(w->p + w->off, b, n);
+  w->off += n;
+}
+
+static void w_pad(Writer *w, size_t a) {
+  static const uint8_t zeros[8] = {0};
+  w_bytes(w, zeros, align_up(w->off, a) - w->off);
+}
+
+static void w_u8(Writer *w, uint8_t v) { w_bytes(w, &v, 1); }
+
+static void w_u32(Writer *w, uint32_t v) {
+  w_pad(w, 4);
+  w_bytes(w, &v, 4);
+}
+
+static void w_str(Writer *w, const char *s) {
+  size_t n = strlen(s);
+  w_u32(w, (uint32_t)n);
+  w_bytes(w, s, n + 1);
+}
+
+static void w_sig(Writer *w, const char *s) {
+  size_t n = strlen(s);
+  if (n > 255) {
+    w->ok = false;
+    return;
+  }
+  w_u8(w, (uint8_t)n);
+  w_bytes(w, s, n + 1);
+}
+
+static void w_field(Writer *w, uint8_t code, char type, const char *s) {
+  if (!s) {
+    return;
+  }
+  const char sig[2] = {type, '\0'};
+  w_pad(w, 8);
+  w_u8(w, code);
+  w_sig(w, sig);
+  if (type == 'g') {
+    w_sig(w, s);
+  } else {
+    w_str(w, s);
+  }
+}
+
+size_t dbus_msg_encode(const DbusMsg *m, uint8_t *out, size_t cap) {
+  Writer w = {out, cap, 0, true};
+  w_u8(&w, NATIVE_ENDIAN);
+  w_u8(&w, m->type);
+  w_u8(&w, m->flags);
+  w_u8(&w, 1);
+  w_u32(&w, (uint32_t)m->body_len);
+  w_u32(&w, m->serial);
+  const size_t fields_len_off = w.off;
+  w_u32(&w, 0);
+  const size_t fields_off = w.off;
+  w_field(&w, FIELD_PATH, 'o', m->path);
+  w_field(&w, FIELD_INTERFACE, 's', m->interface);
+  w_field(&w, FIELD_MEMBER, 's', m->member);
+  w_field(&w, FIELD_ERROR_NAME, 's', m->error_name);
+  if (m->reply_serial) {
+    w_pad(&w, 8);
+    w_u8(&w, FIELD_REPLY_SERIAL);
+    w_sig(&w, "u");
+    w_u32(&w, m->reply_serial);
+  }
+  w_field(&w, FIELD_DESTINATION, 's', m->destination);
+  w_field(&w, FIELD_SENDER, 's', m->sender);
+  if (m->signature && m->signature[0]) {
+    w_field(&w, FIELD_SIGNATURE, 'g', m->signature);
+  }
+  if (!w.ok) {
+    return 0;
+  }
+  uint32_t fields_len = (uint32_t)(w.off - fields_off);
+  memcpy(out + fields_len_off, &fields_len, 4);
+  w_pad(&w, 8);
+  if (m->body_len) {
+    w_bytes(&w, m->body, m->body_len);
+  }
+  return w.ok ? w.off : 0;
+}
+
+size_t dbus_msg_put_string(uint8_t *body, size_t cap, size_t off,
+                           const char *s) {
+  Writer w = {body, cap, off, true};
+  w_str(&w, s);
+  return w.ok ? w.off : 0;
+}
+
+/**************** Decoding ****************/
+
+typedef struct {
+  const uint8_t *p;
+  size_t len;
+  size_t off;
+} Reader;
+
+static bool r_pad(Reader *r, size_t a) {
+  size_t to = align_up(r->off, a);
+  if (to > r->len) {
+    return false;
+  }
+  r->off = to;
+  return true;
+}
+
+static bool r_u8(Reader *r, uint8_t *v) {
+  if (r->off + 1 > r->len) {
+    return false;
+  }
+  *v = r->p[r->off++];
+  return true;
+}
+
+static bool r_u32(Reader *r, uint32_t *v) {
+  if (!r_pad(r, 4) || r->off + 4 > r->len) {
+    return false;
+  }
+  memcpy(v, r->p + r->off, 4);
+  r->off += 4;
+  return true;
+}
+
+// A string of @p n bytes plus its NUL at the current offset.
+static bool r_chars(Reader *r, size_t n, const char **out) {
+  if (r->off + n + 1 > r->len || r->p[r->off + n] != '\0') {
+    return false;
+  }
+  *out = (const char *)r->p + r->off;
+  r->off += n + 1;
+  return true;
+}
+
+static bool r_str(Reader *r, const char **out) {
+  uint32_t n;
+  return r_u32(r, &n) && r_chars(r, n, out);
+}
+
+static bool r_sig(Reader *r, const char **out) {
+  uint8_t n;
+  return r_u8(r, &n) && r_chars(r, n, out);
+}
+
+size_t dbus_msg_size(const uint8_t *buf, size_t len) {
+  if (len < HDR_FIXED) {
+    return 0;
+  }
+  if (buf[0] != NATIVE_ENDIAN || buf[3] != 1) {
+    return SIZE_MAX;
+  }
+  uint32_t body_len;
+  uint32_t fields_len;
+  memcpy(&body_len, buf + 4, 4);
+  memcpy(&fields_len, buf + 12, 4);
+  if (fields_len > FIELDS_MAX || body_len > BODY_MAX) {
+    return SIZE_MAX;
+  }
+  return align_up(HDR_FIXED + fields_len, 8) + body_len;
+}
+
+bool dbus_msg_decode(const uint8_t *buf, size_t len, DbusMsg *out) {
+  memset(out, 0, sizeof(*out));
+  size_t size = dbus_msg_size(buf, len);
+  if (size == 0 || size == SIZE_MAX || size > len) {
+    return false;
+  }
+  uint32_t fields_len;
+  memcpy(&fields_len, buf + 12, 4);
+  out->type = buf[1];
+  out->flags = buf[2];
+  memcpy(&out->serial, buf + 8, 4);
+
+  Reader r = {buf, HDR_FIXED + fields_len, HDR_FIXED};
+  while (r.off < r.len) {
+    uint8_t code;
+    const char *sig;
+    if (!r_pad(&r, 8) || !r_u8(&r, &code) || !r_sig(&r, &sig) ||
+        strlen(sig) != 1) {
+      return false;
+    }
+    const char *s = NULL;
+    uint32_t u = 0;
+    bool ok = false;
+    switch (sig[0]) {
+    case 's':
+    case 'o':
+      ok = r_str(&r, &s);
+      break;
+    case 'g':
+      ok = r_sig(&r, &s);
+      break;
+    case 'u':
+      ok = r_u32(&r, &u);
+      break;
+    default:
+      break;
+    }
+    if (!ok) {
+      return false;
+    }
+    switch (code) {
+    case FIELD_PATH:
+      out->path = s;
+      break;
+    case FIELD_INTERFACE:
+      out->interface = s;
+      break;
+    case FIELD_MEMBER:
+      out->member = s;
+      break;
+    case FIELD_ERROR_NAME:
+      out->error_name = s;
+      break;
+    case FIELD_REPLY_SERIAL:
+      out->reply_serial = u;
+      break;
+    case FIELD_DESTINATION:
+      out->destination = s;
+      break;
+    case FIELD_SENDER:
+      out->sender = s;
+      break;
+    case FIELD_SIGNATURE:
+      out->signature = s;
+      break;
+    default:
+      break;
+    }
+  }
+  out->body = buf + align_up(HDR_FIXED + fields_len, 8);
+  out->body_len = size - (size_t)(out->body - buf);
+  return true;
+}
+
+bool dbus_msg_read_string(const DbusMsg *m, size_t *off, const char **out) {
+  Reader r = {m->body, m->body_len, *off};
+  if (!r_str(&r, out)) {
+    return false;
+  }
+  *off = r.off;
+  return true;
+}
+
+bool dbus_msg_read_variant(const DbusMsg *m, size_t *off, char *type,
+                           const char **str, int32_t *num) {
+  Reader r = {m->body, m->body_len, *off};
+  const char *sig;
+  if (!r_sig(&r, &sig) || strlen(sig) != 1) {
+    return false;
+  }
+  *type = sig[0];
+  uint32_t u;
+  switch (sig[0]) {
+  case 's':
+  case 'o':
+    if (!r_str(&r, str)) {
+      return false;
+    }
+    break;
+  case 'i':
+  case 'u':
+  case 'b':
+    if (!r_u32(&r, &u)) {
+      return false;
+    }
+    *num = (int32_t)u;
+    break;
+  default:
+    return false;
+  }
+  *off = r.off;
+  return true;
+}
+
+/**************** Connection ****************/
+
+static bool send_all(int fd, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (len) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+// Read one CRLF-terminated auth line.
+static bool recv_line(int fd, char *line, size_t cap, uint32_t timeout_ms) {
+  size_t n = 0;
+  const uint64_t deadline = now_ms() + timeout_ms;
+  while (n + 1 < cap) {
+    uint64_t now = now_ms();
+    struct pollfd p = {.fd = fd, .events = POLLIN};
+    if (now >= deadline ||
+        poll(&p, 1, (int)(deadline - now)) <= 0 ||
+        recv(fd, line + n, 1, 0) != 1) {
+      return false;
+    }
+    if (++n >= 2 && line[n - 2] == '\r' && line[n - 1] == '\n') {
+      line[n - 2] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool authenticate(int fd) {
+  char uid[16];
+  snprintf(uid, sizeof(uid), "%u", (unsigned)geteuid());
+  char line[64] = "AUTH EXTERNAL ";
+  size_t n = strlen(line);
+  for (const char *p = uid; *p; p++) {
+    n += (size_t)snprintf(line + n, sizeof(line) - n, "%02x", *p);
+  }
+  snprintf(line + n, sizeof(line) - n, "\r\n");
+  char reply[256];
+  return send_all(fd, "", 1) && send_all(fd, line, strlen(line)) &&
+         recv_line(fd, reply, sizeof(reply), 5000) &&
+         strncmp(reply, "OK ", 3) == 0 && send_all(fd, "BEGIN\r\n", 7);
+}
+
+// The socket path in a "unix:path=..." bus address.
+static bool system_bus_path(char *out, size_t cap) {
+  const char *addr = getenv("DBUS_SYSTEM_BUS_ADDRESS");
+  const char *prefix = "unix:path=";
+  if (!addr || strncmp(addr, prefix, strlen(prefix)) != 0) {
+    return (size_t)snprintf(out, cap, "%s", SYSTEM_BUS_PATH) < cap;
+  }
+  addr += strlen(prefix);
+  size_t n = strcspn(addr, ",;");
+  return (size_t)snprintf(out, cap, "%.*s", (int)n, addr) < cap;
+}
+
+bool dbus_client_open(DbusClient *c, const char *socket_path) {
+  memset(c, 0, sizeof(*c));
+  c->fd = -1;
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (socket_path) {
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+      errno = ENAMETOOLONG;
+      return false;
+    }
+    strcpy(addr.sun_path, socket_path);
+  } else if (!system_bus_path(addr.sun_path, sizeof(addr.sun_path))) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (c->fd < 0) {
+    return false;
+  }
+  DbusMsg reply;
+  if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      !authenticate(c->fd) ||
+      !dbus_client_call(c, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                        "org.freedesktop.DBus", "Hello", NULL, 0, &reply,
+                        5000)) {
+    int err = errno ? errno : ECONNREFUSED;
+    dbus_client_close(c);
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+void dbus_client_close(DbusClient *c) {
+  if (c->fd >= 0) {
+    close(c->fd);
+  }
+  free(c->rx);
+  memset(c, 0, sizeof(*c));
+  c->fd = -1;
+}
+
+int dbus_client_recv(DbusClient *c, DbusMsg *out, uint32_t timeout_ms) {
+  if (c->rx_used) {
+    memmove(c->rx, c->rx + c->rx_used, c->rx_len - c->rx_used);
+    c->rx_len -= c->rx_used;
+    c->rx_used = 0;
+  }
+  const uint64_t deadline = now_ms() + timeout_ms;
+  for (;;) {
+    size_t need = dbus_msg_size(c->rx, c->rx_len);
+    if (need == SIZE_MAX || need > RX_MAX) {
+      errno = EPROTO;
+      return -1;
+    }
+    if (need && need <= c->rx_len) {
+      if (!dbus_msg_decode(c->rx, need, out)) {
+        errno = EPROTO;
+        return -1;
+      }
+      c->rx_used = need;
+      return 1;
+    }
+    size_t want = need ? need : HDR_FIXED;
+    if (want > c->rx_cap) {
+      size_t cap = c->rx_cap ? c->rx_cap * 2 : 4096;
+      cap = cap < want ? want : cap;
+      uint8_t *rx = (uint8_t *)realloc(c->rx, cap);
+      if (!rx) {
+        return -1;
+      }
+      c->rx = rx;
+      c->rx_cap = cap;
+    }
+    uint64_t now = now_ms();
+    struct pollfd p = {.fd = c->fd, .events = POLLIN};
+    int rc = poll(&p, 1, now < deadline ? (int)(deadline - now) : 0);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      return rc;
+    }
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, c->rx_cap - c->rx_len, 0);
+    if (n == 0) {
+      errno = ECONNRESET;
+      return -1;
+    }
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return -1;
+    }
+    c->rx_len += (size_t)n;
+  }
+}
+
+bool dbus_client_call(DbusClient *c, const char *destination,
+                      const char *path, const char *interface,
+                      const char *member, const char *const *args,
+                      size_t nargs, DbusMsg *reply, uint32_t timeout_ms) {
+  uint8_t body[1024];
+  char sig[CALL_MAX_ARGS + 1] = "";
+  size_t body_len = 0;
+  if (nargs > CALL_MAX_ARGS) {
+    errno = E2BIG;
+    return false;
+  }
+  for (size_t i = 0; i < nargs; i++) {
+    body_len = dbus_msg_put_string(body, sizeof(body), body_len, args[i]);
+    if (!body_len) {
+      errno = E2BIG;
+      return false;
+    }
+    sig[i] = 's';
+  }
+  DbusMsg m = {
+      .type = DBUS_MSG_METHOD_CALL,
+      .serial = ++c->serial,
+      .path = path,
+      .interface = interface,
+      .member = member,
+      .destination = destination,
+      .signature = sig,
+      .body = body,
+      .body_len = body_len,
+  };
+  uint8_t msg[2048];
+  size_t len = dbus_msg_encode(&m, msg, sizeof(msg));
+  if (!len) {
+    errno = E2BIG;
+    return false;
+  }
+  if (!send_all(c->fd, msg, len)) {
+    return false;
+  }
+
+  const uint64_t deadline = now_ms() + timeout_ms;
+  for (;;) {
+    uint64_t now = now_ms();
+    int rc = dbus_client_recv(c, reply,
+                              now < deadline ? (uint32_t)(deadline - now) : 0);
+    if (rc <= 0) {
+      if (rc == 0) {
+        errno = ETIMEDOUT;
+      }
+      return false;
+    }
+    if ((reply->type == DBUS_MSG_METHOD_RETURN ||
+         reply->type == DBUS_MSG_ERROR) &&
+        reply->reply_serial == m.serial) {
+      if (reply->type == DBUS_MSG_ERROR) {
+        errno = EIO;
+        return false;
+      }
+      return true;
+    }
+    if (reply->type == DBUS_MSG_SIGNAL && c->on_signal) {
+      c->on_signal(reply, c->signal_arg);
+    }
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+/// @file dbus_client.h
+/// @brief Minimal D-Bus client: wire format and a blocking connection.
+///
+/// Just enough of the D-Bus protocol to call methods with string arguments
+/// on the system bus and receive signals, without libdbus or sd-bus.  Only
+/// native-endian messages are accepted, which is what a local bus daemon
+/// sends.  Authentication is EXTERNAL (the socket's peer credentials).
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DBUS_MSG_METHOD_CALL 1
+#define DBUS_MSG_METHOD_RETURN 2
+#define DBUS_MSG_ERROR 3
+#define DBUS_MSG_SIGNAL 4
+
+/// A message to encode, or one decoded in place (strings point into the
+/// buffer it was decoded from).
+typedef struct {
+  uint8_t type;
+  uint8_t flags;
+  uint32_t serial;
+  uint32_t reply_serial; ///< 0 if absent.
+  const char *path;
+  const char *interface;
+  const char *member;
+  const char *error_name;
+  const char *destination;
+  const char *sender;
+  const char *signature; ///< Body signature; NULL or "" for no body.
+  const uint8_t *body;
+  size_t body_len;
+} DbusMsg;
+
+/// Encode @p m into @p out.
+/// @return The message length, or 0 if it does not fit.
+size_t dbus_msg_encode(const DbusMsg *m, uint8_t *out, size_t cap);
+
+/// Size of the message starting at @p buf.
+/// @return 0 if fewer than 16 bytes are available, SIZE_MAX if the header
+///         is not a valid native-endian message, else the full length.
+size_t dbus_msg_size(const uint8_t *buf, size_t len);
+
+/// Decode the @p len byte message at @p buf.
+bool dbus_msg_decode(const uint8_t *buf, size_t len, DbusMsg *out);
+
+/// Append string @p s to a body being built at offset @p off.
+/// @return The new offset, or 0 if it does not fit.
+size_t dbus_msg_put_string(uint8_t *body, size_t cap, size_t off,
+                           const char *s);
+
+/// Read a string or object path from @p m's body at @p *off.
+bool dbus_msg_read_string(const DbusMsg *m, size_t *off, const char **out);
+
+/// Read a variant holding a string, object path, int32, uint32 or boolean.
+/// @param type  Set to the contained type code.
+/// @param str   Set for 's' and 'o'.
+/// @param num   Set for 'i', 'u' and 'b'.
+bool dbus_msg_read_variant(const DbusMsg *m, size_t *off, char *type,
+                           const char **str, int32_t *num);
+
+typedef void (*DbusSignalFn)(const DbusMsg *m, void *arg);
+
+typedef struct {
+  int fd;
+  uint32_t serial;
+  uint8_t *rx;
+  size_t rx_len;
+  size_t rx_cap;
+  size_t rx_used; ///< Bytes of the message last returned by recv.
+  /// Signals that arrive while dbus_client_call() waits for its reply.
+  DbusSignalFn on_signal;
+  void *signal_arg;
+} DbusClient;
+
+/// Connect, authenticate and register with the bus at @p socket_path.
+/// @param socket_path  NULL for the system bus ($DBUS_SYSTEM_BUS_ADDRESS or
+///                     /run/dbus/system_bus_socket).
+bool dbus_client_open(DbusClient *c, const char *socket_path);
+
+void dbus_client_close(DbusClient *c);
+
+/// Receive the next message, waiting up to @p timeout_ms.  @p out is valid
+/// until the next call.
+/// @return 1 with a message, 0 on timeout, -1 on error with errno set.
+int dbus_client_recv(DbusClient *c, DbusMsg *out, uint32_t timeout_ms);
+
+/// Call @p member with string arguments and wait for its reply.
+/// @return true on a method return in @p reply (valid until the next recv
+///         or call); false on an error reply, timeout or I/O error.
+bool dbus_client_call(DbusClient *c, const char *destination,
+                      const char *path, const char *interface,
+                      const char *member, const char *const *args,
+                      size_t nargs, DbusMsg *reply, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
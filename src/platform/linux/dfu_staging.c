@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "dfu_staging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct DfuStaging {
+  int fd;
+  uint8_t *buf;
+  uint32_t cap;
+  uint64_t buf_off;  ///< File offset of buf[0].
+  uint32_t buf_len;  ///< Bytes buffered; 0 when nothing is pending.
+  bool erase_fill;
+  bool no_zero_range; ///< fallocate(ZERO_RANGE) unsupported here.
+  bool no_punch_hole; ///< fallocate(PUNCH_HOLE) unsupported here.
+  bool failed;        ///< A write failed; every later call fails too.
+  DfuStagingStats stats;
+};
+
+static bool pwrite_all(DfuStaging *s, const uint8_t *p, size_t len,
+                       off_t off) {
+  while (len > 0) {
+    s->stats.pwrites++;
+    ssize_t w = pwrite(s->fd, p, len, off);
+    if (w < 0 && errno == EINTR) {
+      continue;
+    }
+    if (w <= 0) {
+      return false;
+    }
+    p += w;
+    off += w;
+    len -= (size_t)w;
+  }
+  return true;
+}
+
+bool dfu_staging_flush(DfuStaging *s) {
+  if (s->failed) {
+    errno = EIO;
+    return false;
+  }
+  if (s->buf_len == 0) {
+    return true;
+  }
+  bool ok = pwrite_all(s, s->buf, s->buf_len, (off_t)s->buf_off);
+  s->buf_len = 0;
+  s->failed = !ok;
+  return ok;
+}
+
+DfuStaging *dfu_staging_open(const char *path, const DfuStagingCfg *cfg) {
+  DfuStaging *s = (DfuStaging *)calloc(1, sizeof(*s));
+  if (!s) {
+    return NULL;
+  }
+  s->cap = cfg && cfg->buffer_bytes ? cfg->buffer_bytes
+                                    : DFU_STAGING_DEFAULT_BUFFER_BYTES;
+  s->erase_fill = cfg && cfg->erase_fill;
+  s->buf = (uint8_t *)malloc(s->cap);
+  s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (!s->buf || s->fd < 0) {
+    int err = errno;
+    if (s->fd >= 0) {
+      close(s->fd);
+    }
+    free(s->buf);
+    free(s);
+    errno = err;
+    return NULL;
+  }
+  return s;
+}
+
+bool dfu_staging_close(DfuStaging *s) {
+  bool ok = dfu_staging_flush(s);
+  ok = close(s->fd) == 0 && ok;
+  free(s->buf);
+  free(s);
+  return ok;
+}
+
+bool dfu_staging_write(DfuStaging *s, uint32_t offset, const void *src,
+                       uint32_t len) {
+  s->stats.writes++;
+  s->stats.bytes += len;
+  if (s->buf_len > 0 && offset != s->buf_off + s->buf_len &&
+      !dfu_staging_flush(s)) {
+    return false;
+  }
+  if (s->failed) {
+    errno = EIO;
+    return false;
+  }
+  const uint8_t *p = (const uint8_t *)src;
+  uint64_t off = offset;
+  while (len > 0) {
+    if (s->buf_len == 0) {
+      s->buf_off = off;
+    }
+    // Fill up to the next buffer-sized boundary of the file, so every flush
+    // after the first is aligned.
+    const uint32_t room = s->cap - (uint32_t)(s->buf_off % s->cap) -
+                          s->buf_len;
+    const uint32_t n = len < room ? len : room;
+    memcpy(s->buf + s->buf_len, p, n);
+    s->buf_len += n;
+    p += n;
+    off += n;
+    len -= n;
+    if (n == room && !dfu_staging_flush(s)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Write zeros over [off, off + len) through the (empty) buffer.
+static bool zero_fill(DfuStaging *s, off_t off, off_t len) {
+  memset(s->buf, 0, s->cap);
+  s->stats.zero_filled += (uint64_t)len;
+  while (len > 0) {
+    const size_t n = len < (off_t)s->cap ? (size_t)len : s->cap;
+    if (!pwrite_all(s, s->buf, n, off)) {
+      return false;
+    }
+    off += (off_t)n;
+    len -= (off_t)n;
+  }
+  return true;
+}
+
+static bool unsupported(int err) {
+  return err == EOPNOTSUPP || err == ENOSYS;
+}
+
+bool dfu_staging_erase(DfuStaging *s, uint32_t offset, uint32_t len) {
+  // Buffered bytes in the range were written before the erase, so they go
+  // out first and are then zeroed with the rest.
+  if (!dfu_staging_flush(s)) {
+    return false;
+  }
+  s->stats.erases++;
+  if (len == 0) {
+    return true;
+  }
+  const off_t off = (off_t)offset;
+  const off_t end = off + (off_t)len;
+  if (s->erase_fill) {
+    return zero_fill(s, off, (off_t)len);
+  }
+  if (!s->no_zero_range) {
+    s->stats.erase_calls++;
+    if (fallocate(s->fd, FALLOC_FL_ZERO_RANGE, off, (off_t)len) == 0) {
+      return true;
+    }
+    if (!unsupported(errno)) {
+      return false;
+    }
+    s->no_zero_range = true;
+  }
+
+  // Only the part inside the file needs clearing; extending the file with
+  // ftruncate() reads back as zeros.
+  struct stat st;
+  if (fstat(s->fd, &st) != 0) {
+    return false;
+  }
+  const off_t inside = end < st.st_size ? end : st.st_size;
+  if (inside > off) {
+    bool cleared = false;
+    if (!s->no_punch_hole) {
+      s->stats.erase_calls++;
+      cleared = fallocate(s->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                          off, inside - off) == 0;
+      if (!cleared && !unsupported(errno)) {
+        return false;
+      }
+      s->no_punch_hole = !cleared;
+    }
+    if (!cleared && !zero_fill(s, off, inside - off)) {
+      return false;
+    }
+  }
+  if (end > st.st_size) {
+    s->stats.erase_calls++;
+    return ftruncate(s->fd, end) == 0;
+  }
+  return true;
+}
+
+bool dfu_staging_sync(DfuStaging *s) {
+  return dfu_staging_flush(s) && fsync(s->fd) == 0;
+}
+
+void dfu_staging_get_stats(const DfuStaging *s, DfuStagingStats *out) {
+  *out = s->stats;
+}
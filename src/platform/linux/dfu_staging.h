@@ -0,0 +1,76 @@
+#pragma once
+
+/// @file dfu_staging.h
+/// @brief The file a DFU image is received into before it replaces the
+///        running binary.
+///
+/// The DFU client writes the image in small chunks as they arrive over the
+/// mesh.  Rather than one pwrite() per chunk, contiguous writes collect in
+/// a write-behind buffer that goes to the file in one pwrite() each time it
+/// reaches a @c buffer_bytes boundary of the file, or when a write does not
+/// follow on from the last one.  dfu_staging_flush() (or _sync/_close)
+/// writes out whatever is left; an I/O error in a deferred write is sticky
+/// and fails every later call, so it is always reported before the image
+/// is used.
+///
+/// Erasing zeroes a range without writing it: fallocate(ZERO_RANGE) where
+/// the filesystem has it, otherwise a punched hole plus ftruncate() to
+/// extend the file, and only as a last resort a zero-fill through the
+/// buffer.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Write-behind buffer size when @c buffer_bytes is 0.
+#define DFU_STAGING_DEFAULT_BUFFER_BYTES (64u * 1024u)
+
+typedef struct DfuStaging DfuStaging;
+
+typedef struct {
+  uint32_t buffer_bytes; ///< 0: DFU_STAGING_DEFAULT_BUFFER_BYTES.
+  bool erase_fill;       ///< Erase by writing zeros, not fallocate().
+} DfuStagingCfg;
+
+typedef struct {
+  uint64_t writes;        ///< dfu_staging_write() calls.
+  uint64_t bytes;         ///< Bytes passed to dfu_staging_write().
+  uint64_t pwrites;       ///< pwrite() calls, zero-fill included.
+  uint64_t erases;        ///< dfu_staging_erase() calls.
+  uint64_t erase_calls;   ///< fallocate()/ftruncate() calls for erases.
+  uint64_t zero_filled;   ///< Erased bytes that had to be written as zeros.
+} DfuStagingStats;
+
+/// Create (or truncate) the staging file at @p path.
+/// @return The staging file, or NULL with errno set.
+DfuStaging *dfu_staging_open(const char *path, const DfuStagingCfg *cfg);
+
+/// Write out anything still buffered, close the file and free @p s.
+/// @return false if that last write failed, or an earlier one had.
+bool dfu_staging_close(DfuStaging *s);
+
+/// Write [@p offset, @p offset + @p len) of the image.  The bytes may stay
+/// buffered until a later call.
+/// @return false on an I/O error, this call's or a deferred one's.
+bool dfu_staging_write(DfuStaging *s, uint32_t offset, const void *src,
+                       uint32_t len);
+
+/// Zero [@p offset, @p offset + @p len), extending the file if needed.
+bool dfu_staging_erase(DfuStaging *s, uint32_t offset, uint32_t len);
+
+/// Write out anything still buffered.
+bool dfu_staging_flush(DfuStaging *s);
+
+/// dfu_staging_flush() and fsync(), so the image is durable.
+bool dfu_staging_sync(DfuStaging *s);
+
+/// Snapshot @p s's counters into @p out.
+void dfu_staging_get_stats(const DfuStaging *s, DfuStagingStats *out);
+
+#ifdef __cplusplus
+}
+#endif
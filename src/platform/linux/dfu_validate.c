@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "dfu_validate.h"
+#include "crc32c.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint8_t k_elf_magic[4] = {0x7f, 'E', 'L', 'F'};
+
+void dfu_validate_init(DfuValidator *v, const char *marker,
+                       uint16_t machine) {
+  memset(v, 0, sizeof(*v));
+  snprintf(v->marker, sizeof(v->marker), "%s", marker);
+  v->marker_len = strlen(v->marker);
+  v->machine = machine;
+  v->in_order = true;
+  v->crc = 0xFFFFFFFFu;
+}
+
+// Check as much of the ELF header as the first @p have bytes hold.
+//   bytes  0-3   e_ident magic  (\x7f E L F)
+//   bytes 18-19  e_machine, little-endian
+static void check_header(DfuValidator *v, size_t have) {
+  if (have >= sizeof(k_elf_magic) &&
+      memcmp(v->hdr, k_elf_magic, sizeof(k_elf_magic)) != 0) {
+    snprintf(v->problem, sizeof(v->problem), "bad ELF magic");
+  } else if (have >= DFU_VALIDATE_HDR_BYTES) {
+    const uint16_t e_machine = (uint16_t)(v->hdr[18] | (v->hdr[19] << 8));
+    if (e_machine != v->machine) {
+      snprintf(v->problem, sizeof(v->problem),
+               "wrong architecture (e_machine=0x%04x, expected 0x%04x)",
+               (unsigned)e_machine, (unsigned)v->machine);
+    }
+  }
+}
+
+static void search_marker(DfuValidator *v, const uint8_t *p, size_t len) {
+  const size_t keep = v->marker_len - 1;
+  // A marker that starts in the previous chunk and ends in this one.
+  if (v->tail_len > 0) {
+    uint8_t win[2 * DFU_VALIDATE_MAX_MARKER];
+    const size_t head = len < keep ? len : keep;
+    memcpy(win, v->tail, v->tail_len);
+    memcpy(win + v->tail_len, p, head);
+    if (memmem(win, v->tail_len + head, v->marker, v->marker_len)) {
+      v->marker_found = true;
+      return;
+    }
+  }
+  if (memmem(p, len, v->marker, v->marker_len)) {
+    v->marker_found = true;
+    return;
+  }
+  // Carry the last marker_len - 1 bytes seen into the next search.
+  if (len >= keep) {
+    memcpy(v->tail, p + len - keep, keep);
+    v->tail_len = keep;
+  } else {
+    const size_t old = v->tail_len < keep - len ? v->tail_len : keep - len;
+    memmove(v->tail, v->tail + v->tail_len - old, old);
+    memcpy(v->tail + old, p, len);
+    v->tail_len = old + len;
+  }
+}
+
+bool dfu_validate_update(DfuValidator *v, uint32_t offset, const void *data,
+                         size_t len) {
+  if (v->problem[0]) {
+    return false;
+  }
+  if (!v->in_order || offset != v->len) {
+    v->in_order = false;
+    return true;
+  }
+  const uint8_t *p = (const uint8_t *)data;
+  if (v->len < DFU_VALIDATE_HDR_BYTES) {
+    const size_t want = DFU_VALIDATE_HDR_BYTES - (size_t)v->len;
+    const size_t n = len < want ? len : want;
+    memcpy(v->hdr + v->len, p, n);
+    check_header(v, (size_t)v->len + n);
+  }
+  v->crc = crc32c_update(v->crc, p, len);
+  if (!v->marker_found && v->marker_len > 0 && len > 0) {
+    search_marker(v, p, len);
+  }
+  v->len += len;
+  return v->problem[0] == '\0';
+}
+
+void dfu_validate_erase(DfuValidator *v, uint32_t offset, uint32_t len) {
+  if (len > 0 && offset < v->len) {
+    v->in_order = false;
+  }
+}
+
+bool dfu_validate_finish(const DfuValidator *v, char *err, size_t err_len) {
+  if (v->problem[0]) {
+    snprintf(err, err_len, "%s", v->problem);
+  } else if (!v->in_order) {
+    snprintf(err, err_len, "image not received in order");
+  } else if (v->len < DFU_VALIDATE_HDR_BYTES) {
+    snprintf(err, err_len, "image too small (%llu bytes)",
+             (unsigned long long)v->len);
+  } else if (v->marker_len > 0 && !v->marker_found) {
+    snprintf(err, err_len, "marker \"%s\" not found", v->marker);
+  } else {
+    return true;
+  }
+  return false;
+}
+
+uint32_t dfu_validate_crc(const DfuValidator *v) {
+  return crc32c_finalize(v->crc);
+}
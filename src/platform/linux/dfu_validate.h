@@ -0,0 +1,73 @@
+#pragma once
+
+/// @file dfu_validate.h
+/// @brief DFU image checks run on the chunks as they are received.
+///
+/// Each chunk written to the staging file is fed through here in file
+/// order, so by the time the transfer ends the image has already been
+/// checked and set_pending only reads the verdict:
+///
+///   - the ELF header: magic, then e_machine once the first 20 bytes are
+///     in.  A bad header is known after the first chunk, and
+///     dfu_validate_update() returns false so the transfer can be aborted.
+///   - the app-identity marker ("BM_SBC_IMAGE:<app_name>" in .rodata),
+///     found with memmem() over each chunk plus the last marker-length - 1
+///     bytes of the one before, so a marker split across chunks is seen.
+///   - a running CRC-32C over the image, logged with the swap.
+///
+/// The checks need the bytes in order.  A write that does not start where
+/// the previous one ended (a gap, or a rewrite of bytes already seen), or
+/// an erase over bytes already seen, clears @c in_order; the caller then
+/// resets the validator and feeds it the finished file instead.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Longest marker, terminator excluded.
+#define DFU_VALIDATE_MAX_MARKER 63
+
+/// ELF header bytes checked.
+#define DFU_VALIDATE_HDR_BYTES 20
+
+typedef struct {
+  char marker[DFU_VALIDATE_MAX_MARKER + 1];
+  size_t marker_len;
+  uint16_t machine;    ///< Expected e_machine.
+  bool in_order;       ///< Every byte so far arrived in file order.
+  uint64_t len;        ///< Bytes checked: [0, len) of the image.
+  uint32_t crc;        ///< Running CRC-32C of [0, len), not finalized.
+  uint8_t hdr[DFU_VALIDATE_HDR_BYTES];
+  char problem[96];    ///< First check that failed; "" while none has.
+  bool marker_found;
+  uint8_t tail[DFU_VALIDATE_MAX_MARKER]; ///< Last bytes, for split markers.
+  size_t tail_len;
+} DfuValidator;
+
+/// Start checking a new image for @p marker (truncated to
+/// DFU_VALIDATE_MAX_MARKER) built for ELF machine @p machine.
+void dfu_validate_init(DfuValidator *v, const char *marker, uint16_t machine);
+
+/// Account for [@p offset, @p offset + @p len) of the image being written.
+/// @return false once the image is known to be bad.
+bool dfu_validate_update(DfuValidator *v, uint32_t offset, const void *data,
+                         size_t len);
+
+/// Account for [@p offset, @p offset + @p len) being erased.
+void dfu_validate_erase(DfuValidator *v, uint32_t offset, uint32_t len);
+
+/// The verdict on the image seen so far.
+/// @param err  Receives what is wrong with the image when it is not valid.
+/// @return true if [0, len) is a complete, valid image.
+bool dfu_validate_finish(const DfuValidator *v, char *err, size_t err_len);
+
+/// Finalized CRC-32C of the bytes checked.
+uint32_t dfu_validate_crc(const DfuValidator *v);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,10 @@
 #include "platform_linux.h"
 #include "bm_config.h"
+#include "config_file.h"
+#include "config_journal.h"
+#include "dfu_staging.h"
+#include "dfu_validate.h"
+#include "pcap_file_sink.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -8,7 +13,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -31,6 +35,11 @@ int platform_linux_init(void) { return 0; }
 static char s_cfg_dir[512] = {0};
 static char s_cfg_paths[BM_CFG_PARTITION_COUNT][512];
 static bool s_cfg_dir_set = false;
+static PlatformCfgBackend s_cfg_backend = PLATFORM_CFG_BACKEND_FILE;
+static uint32_t s_cfg_commit_window_ms = 0;
+static ConfigJournal *s_cfg_journals[BM_CFG_PARTITION_COUNT];
+// File backend: each partition file mapped once, remapped after each write.
+static ConfigFileMap s_cfg_maps[BM_CFG_PARTITION_COUNT];
 
 static const char *k_partition_filenames[BM_CFG_PARTITION_COUNT] = {
     "config.user.bin",
@@ -38,6 +47,64 @@ static const char *k_partition_filenames[BM_CFG_PARTITION_COUNT] = {
     "config.hw.bin",
 };
 
+static const char *k_partition_journals[BM_CFG_PARTITION_COUNT] = {
+    "config.user.jnl",
+    "config.sys.jnl",
+    "config.hw.jnl",
+};
+
+void platform_linux_set_cfg_backend(PlatformCfgBackend backend,
+                                    uint32_t commit_window_ms) {
+  s_cfg_backend = backend;
+  s_cfg_commit_window_ms = commit_window_ms;
+}
+
+// Fold each journal into its .bin file on a clean exit, so the last commit
+// window is durable and the files are readable by the file backend again.
+static void close_cfg_journals(void) {
+  for (int i = 0; i < BM_CFG_PARTITION_COUNT; i++) {
+    if (s_cfg_journals[i]) {
+      config_journal_compact(s_cfg_journals[i]);
+    }
+    config_journal_close(s_cfg_journals[i]);
+    s_cfg_journals[i] = NULL;
+  }
+}
+
+static void sync_cfg_journals(void) {
+  for (int i = 0; i < BM_CFG_PARTITION_COUNT; i++) {
+    if (s_cfg_journals[i]) {
+      config_journal_sync(s_cfg_journals[i]);
+    }
+  }
+}
+
+static void open_cfg_journals(const char *dir) {
+  ConfigJournalCfg cfg = {s_cfg_commit_window_ms, 0};
+  for (int i = 0; i < BM_CFG_PARTITION_COUNT; i++) {
+    char jnl_path[512];
+    snprintf(jnl_path, sizeof(jnl_path), "%s/%s", dir,
+             k_partition_journals[i]);
+    s_cfg_journals[i] = config_journal_open(s_cfg_paths[i], jnl_path, &cfg);
+    if (!s_cfg_journals[i]) {
+      bm_log_error("config: cannot open journal %s (%s) — using whole-file "
+                   "writes for this partition",
+                   jnl_path, strerror(errno));
+      continue;
+    }
+    ConfigJournalStats st;
+    config_journal_get_stats(s_cfg_journals[i], &st);
+    if (st.torn_bytes) {
+      bm_log_warn("config: %s: discarded %" PRIu64
+                  " bytes of an interrupted save",
+                  jnl_path, st.torn_bytes);
+    }
+  }
+  atexit(close_cfg_journals);
+  bm_log_info("config: journal backend, commit window %" PRIu32 " ms",
+              s_cfg_commit_window_ms);
+}
+
 void platform_linux_set_cfg_dir(const char *dir) {
   if (!dir) {
     return;
@@ -57,6 +124,16 @@ void platform_linux_set_cfg_dir(const char *dir) {
              k_partition_filenames[i]);
   }
   s_cfg_dir_set = true;
+  if (s_cfg_backend == PLATFORM_CFG_BACKEND_JOURNAL) {
+    open_cfg_journals(dir);
+  }
+  for (int i = 0; i < BM_CFG_PARTITION_COUNT; i++) {
+    if (!s_cfg_journals[i] &&
+        !config_file_map(&s_cfg_maps[i], s_cfg_paths[i])) {
+      bm_log_warn("config: cannot map %s (%s) — reading it uncached",
+                  s_cfg_paths[i], strerror(errno));
+    }
+  }
 }
 
 bool bm_config_read(BmConfigPartition partition, uint32_t offset,
@@ -70,30 +147,16 @@ bool bm_config_read(BmConfigPartition partition, uint32_t offset,
     memset(buffer, 0, length);
     return true;
   }
-  FILE *f = fopen(s_cfg_paths[partition], "rb");
-  if (!f) {
-    // File doesn't exist yet — return zeros so config_init() creates a fresh
-    // partition, which will be written back via bm_config_write on first save.
-    memset(buffer, 0, length);
+  if (s_cfg_journals[partition]) {
+    config_journal_read(s_cfg_journals[partition], offset, buffer, length);
     return true;
   }
-  if (fseek(f, (long)offset, SEEK_SET) != 0) {
-    fclose(f);
-    memset(buffer, 0, length);
-    return true;
-  }
-  size_t n = fread(buffer, 1, length, f);
-  fclose(f);
-  // Zero-fill any remainder (file may be shorter than requested length).
-  if (n < length) {
-    memset(buffer + n, 0, length - n);
-  }
+  // A missing file reads as zeros so config_init() creates a fresh
+  // partition, which will be written back via bm_config_write on first save.
+  config_file_map_read(&s_cfg_maps[partition], offset, buffer, length);
   return true;
 }
 
-// Atomic write: stage the new contents in a sibling tempfile,
-// fsync, then rename over the target.
-// On any failure the target is left untouched.
 bool bm_config_write(BmConfigPartition partition, uint32_t offset,
                      uint8_t *buffer, size_t length, uint32_t timeout_ms) {
   (void)timeout_ms;
@@ -109,76 +172,20 @@ bool bm_config_write(BmConfigPartition partition, uint32_t offset,
         (unsigned)partition);
     return false;
   }
-
-  const char *target = s_cfg_paths[partition];
-
-  // Stage final contents in a tempfile we'll rename into place.
-  size_t final_size = (size_t)offset + length;
-  uint8_t *staging = (uint8_t *)calloc(1, final_size);
-  if (!staging) {
-    return false;
-  }
-  FILE *existing = fopen(target, "rb");
-  if (existing) {
-    // Read up to final_size bytes of existing content so we don't clobber
-    // unmodified regions outside [offset, offset+length).
-    fread(staging, 1, final_size, existing);
-    // If existing file is longer than final_size, fold its tail in too.
-    if (fseek(existing, 0, SEEK_END) == 0) {
-      long actual = ftell(existing);
-      if (actual > (long)final_size) {
-        size_t extra = (size_t)actual - final_size;
-        uint8_t *grown = (uint8_t *)realloc(staging, (size_t)actual);
-        if (!grown) {
-          free(staging);
-          fclose(existing);
-          return false;
-        }
-        staging = grown;
-        if (fseek(existing, (long)final_size, SEEK_SET) == 0) {
-          fread(staging + final_size, 1, extra, existing);
-        }
-        final_size = (size_t)actual;
-      }
+  if (s_cfg_journals[partition]) {
+    if (!config_journal_write(s_cfg_journals[partition], offset, buffer,
+                              length)) {
+      bm_log_error("bm_config_write: journal append for partition %u "
+                   "failed: %s",
+                   (unsigned)partition, strerror(errno));
+      return false;
     }
-    fclose(existing);
-  }
-  memcpy(staging + offset, buffer, length);
-
-  char tmp_path[512 + 16];
-  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", target);
-  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-  if (fd < 0) {
-    free(staging);
-    return false;
-  }
-  ssize_t w = write(fd, staging, final_size);
-  free(staging);
-  if (w != (ssize_t)final_size) {
-    close(fd);
-    unlink(tmp_path);
-    return false;
-  }
-  if (fsync(fd) != 0) {
-    close(fd);
-    unlink(tmp_path);
-    return false;
-  }
-  if (close(fd) != 0) {
-    unlink(tmp_path);
-    return false;
-  }
-  if (rename(tmp_path, target) != 0) {
-    unlink(tmp_path);
-    return false;
-  }
-  // Best-effort directory fsync so the rename is durable across power loss.
-  int dfd = open(s_cfg_dir, O_RDONLY | O_DIRECTORY);
-  if (dfd >= 0) {
-    fsync(dfd);
-    close(dfd);
+    return true;
   }
-  return true;
+  // Atomic write: on any failure the target (and its mapping) is left
+  // untouched.
+  return config_file_map_write(&s_cfg_maps[partition], offset, buffer,
+                               length);
 }
 
 void bm_config_reset(void) {}
@@ -254,7 +261,8 @@ static char   s_install_path[PATH_MAX] = {0};
 static char   s_staging_path[PATH_MAX] = {0};
 static char   s_backup_path[PATH_MAX]  = {0};
 static char   s_marker_path[PATH_MAX]  = {0};
-static int    s_dfu_fd                 = -1;
+static DfuStaging *s_dfu               = NULL;
+static DfuValidator s_dfu_check;
 static char **s_saved_argv             = NULL;
 static void (*s_pre_exec_cb)(void)     = NULL;
 // Sentinel used as the flash_area opaque handle (address passed to callers).
@@ -315,75 +323,40 @@ void platform_linux_dfu_restore_state(void) {
 // Staging-file validation helpers
 // ---------------------------------------------------------------------------
 
-// Check ELF magic and machine type (EM_AARCH64 = 0x00B7).
-static bool validate_staging_elf(void) {
-  // ELF header layout (little-endian):
-  //   bytes  0-3   e_ident magic  (\x7f E L F)
-  //   bytes 16-17  e_type
-  //   bytes 18-19  e_machine
-  uint8_t hdr[20];
-  FILE *f = fopen(s_staging_path, "rb");
-  if (!f) {
-    bm_log_error("dfu validate_elf: cannot open staging file: %s",
-                 strerror(errno));
-    return false;
-  }
-  size_t n = fread(hdr, 1, sizeof(hdr), f);
-  fclose(f);
-  if (n < sizeof(hdr)) {
-    bm_log_error("dfu validate_elf: staging file too small (%zu bytes)", n);
-    return false;
-  }
-  static const uint8_t k_elf_magic[4] = {0x7f, 'E', 'L', 'F'};
-  if (memcmp(hdr, k_elf_magic, 4) != 0) {
-    bm_log_error("dfu validate_elf: bad ELF magic");
-    return false;
-  }
-  // e_machine at bytes 18-19, little-endian.  EM_AARCH64 = 0x00B7.
-  uint16_t e_machine = (uint16_t)(hdr[18] | ((uint16_t)hdr[19] << 8));
-  if (e_machine != 0x00B7u) {
-    bm_log_error("dfu validate_elf: wrong architecture "
-                 "(e_machine=0x%04x, expected 0x00B7)",
-                 (unsigned)e_machine);
-    return false;
-  }
-  return true;
-}
+// ELF machine the staging binary must be built for (EM_AARCH64).
+#define DFU_ELF_MACHINE 0x00B7u
 
-// Search the staging binary for the app-identity marker string baked into
-// .rodata at compile time by main.cpp: "BM_SBC_IMAGE:<app_name>".
-static bool validate_staging_marker(void) {
-  char expected[64];
-  snprintf(expected, sizeof(expected), "BM_SBC_IMAGE:%s",
+// Checks run on each chunk as it is written; see dfu_validate.h.
+static void dfu_check_start(void) {
+  char marker[64];
+  snprintf(marker, sizeof(marker), "BM_SBC_IMAGE:%s",
            bm_sbc_app_name_runtime);
-  size_t expected_len = strlen(expected);
+  dfu_validate_init(&s_dfu_check, marker, DFU_ELF_MACHINE);
+}
 
-  int fd = open(s_staging_path, O_RDONLY);
+// Run the checks over the finished staging file, for an image that did not
+// arrive in order (or before any chunk arrived in this process).
+static bool dfu_check_file(void) {
+  dfu_check_start();
+  int fd = open(s_staging_path, O_RDONLY | O_CLOEXEC);
   if (fd < 0) {
-    bm_log_error("dfu validate_marker: cannot open staging file: %s",
+    bm_log_error("dfu validate: cannot open staging file: %s",
                  strerror(errno));
     return false;
   }
-  struct stat st;
-  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
-    bm_log_error("dfu validate_marker: fstat failed");
-    close(fd);
-    return false;
-  }
-  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  close(fd);
-  if (map == MAP_FAILED) {
-    bm_log_error("dfu validate_marker: mmap failed: %s", strerror(errno));
-    return false;
+  static uint8_t buf[64 * 1024];
+  uint32_t off = 0;
+  ssize_t n;
+  while ((n = pread(fd, buf, sizeof(buf), (off_t)off)) > 0 &&
+         dfu_validate_update(&s_dfu_check, off, buf, (size_t)n)) {
+    off += (uint32_t)n;
   }
-  bool found =
-      (memmem(map, (size_t)st.st_size, expected, expected_len) != NULL);
-  munmap(map, (size_t)st.st_size);
-  if (!found) {
-    bm_log_error("dfu validate_marker: marker \"%s\" not found in staging binary",
-                 expected);
+  bool ok = n >= 0;
+  if (!ok) {
+    bm_log_error("dfu validate: read failed: %s", strerror(errno));
   }
-  return found;
+  close(fd);
+  return ok;
 }
 
 void platform_linux_set_pre_exec_cb(void (*cb)(void)) {
@@ -413,37 +386,51 @@ BmErr bm_dfu_client_flash_area_open(const void **flash_area) {
     bm_log_error("bm_dfu_client_flash_area_open: paths not initialised");
     return BmEPERM;
   }
-  if (s_dfu_fd >= 0) {
-    close(s_dfu_fd);
+  if (s_dfu) {
+    dfu_staging_close(s_dfu);
   }
-  s_dfu_fd = open(s_staging_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
-  if (s_dfu_fd < 0) {
+  s_dfu = dfu_staging_open(s_staging_path, NULL);
+  if (!s_dfu) {
     bm_log_error("bm_dfu_client_flash_area_open: open(%s) failed: %s",
                  s_staging_path, strerror(errno));
     return BmEIO;
   }
+  dfu_check_start();
   *flash_area = &s_flash_area_tag;
   return BmOK;
 }
 
 BmErr bm_dfu_client_flash_area_close(const void *flash_area) {
   (void)flash_area;
-  if (s_dfu_fd >= 0) {
-    close(s_dfu_fd);
-    s_dfu_fd = -1;
+  if (s_dfu) {
+    bool ok = dfu_staging_close(s_dfu);
+    s_dfu = NULL;
+    if (!ok) {
+      bm_log_error("bm_dfu_client_flash_area_close: write failed: %s",
+                   strerror(errno));
+      return BmEIO;
+    }
   }
   return BmOK;
 }
 
+// Writes are buffered, so a failed write may instead be reported by a later
+// write, by close or by set_pending.
 BmErr bm_dfu_client_flash_area_write(const void *flash_area, uint32_t off,
                                      const void *src, uint32_t len) {
   (void)flash_area;
-  if (s_dfu_fd < 0) {
+  if (!s_dfu) {
     return BmEIO;
   }
-  ssize_t w = pwrite(s_dfu_fd, src, (size_t)len, (off_t)off);
-  if (w != (ssize_t)len) {
-    bm_log_error("bm_dfu_client_flash_area_write: pwrite failed: %s",
+  // Refuse the rest of an image as soon as it is known to be bad.
+  if (!dfu_validate_update(&s_dfu_check, off, src, len)) {
+    char err[128];
+    dfu_validate_finish(&s_dfu_check, err, sizeof(err));
+    bm_log_error("bm_dfu_client_flash_area_write: rejecting image: %s", err);
+    return BmEINVAL;
+  }
+  if (!dfu_staging_write(s_dfu, off, src, len)) {
+    bm_log_error("bm_dfu_client_flash_area_write: write failed: %s",
                  strerror(errno));
     return BmEIO;
   }
@@ -453,25 +440,15 @@ BmErr bm_dfu_client_flash_area_write(const void *flash_area, uint32_t off,
 BmErr bm_dfu_client_flash_area_erase(const void *flash_area, uint32_t off,
                                      uint32_t len) {
   (void)flash_area;
-  if (s_dfu_fd < 0) {
+  if (!s_dfu) {
     return BmEIO;
   }
-  // Zero-fill the region (matches erase-to-zero semantics).
-  static const uint8_t k_zeros[256] = {0};
-  uint32_t remaining = len;
-  off_t cur = (off_t)off;
-  while (remaining > 0) {
-    uint32_t chunk =
-        remaining < (uint32_t)sizeof(k_zeros) ? remaining
-                                              : (uint32_t)sizeof(k_zeros);
-    ssize_t w = pwrite(s_dfu_fd, k_zeros, (size_t)chunk, cur);
-    if (w != (ssize_t)chunk) {
-      bm_log_error("bm_dfu_client_flash_area_erase: pwrite failed: %s",
-                    strerror(errno));
-      return BmEIO;
-    }
-    cur += (off_t)chunk;
-    remaining -= chunk;
+  dfu_validate_erase(&s_dfu_check, off, len);
+  // Zero the region (matches erase-to-zero semantics) without writing it.
+  if (!dfu_staging_erase(s_dfu, off, len)) {
+    bm_log_error("bm_dfu_client_flash_area_erase: failed: %s",
+                 strerror(errno));
+    return BmEIO;
   }
   return BmOK;
 }
@@ -491,18 +468,32 @@ BmErr bm_dfu_client_set_pending_and_reset(void) {
     return BmEPERM;
   }
 
-  // 1. Validate the staging binary before touching the running binary.
-  if (!validate_staging_elf() || !validate_staging_marker()) {
-    bm_log_error("dfu set_pending: staging binary failed validation — aborting");
-    return BmEINVAL;
+  // 1. Write out buffered chunks, fsync and close the staging file.
+  if (s_dfu) {
+    bool ok = dfu_staging_sync(s_dfu);
+    ok = dfu_staging_close(s_dfu) && ok;
+    s_dfu = NULL;
+    if (!ok) {
+      bm_log_error("dfu set_pending: staging write failed: %s",
+                   strerror(errno));
+      return BmEIO;
+    }
   }
 
-  // 2. Flush and close the staging fd.
-  if (s_dfu_fd >= 0) {
-    fsync(s_dfu_fd);
-    close(s_dfu_fd);
-    s_dfu_fd = -1;
+  // 2. Validate the staging binary before touching the running binary.
+  //    The checks already ran as the chunks were written, unless they
+  //    arrived out of order.
+  if (!s_dfu_check.in_order && !dfu_check_file()) {
+    return BmEIO;
+  }
+  char err[128];
+  if (!dfu_validate_finish(&s_dfu_check, err, sizeof(err))) {
+    bm_log_error("dfu set_pending: staging binary failed validation (%s) — "
+                 "aborting", err);
+    return BmEINVAL;
   }
+  bm_log_info("dfu set_pending: image valid (%" PRIu64 " bytes, crc32c=0x%08"
+              PRIx32 ")", s_dfu_check.len, dfu_validate_crc(&s_dfu_check));
 
   // 3. Write the DFU marker file (noinit-RAM substitute) before the swap so
   //    the new process image sees DFU_REBOOT_MAGIC after execv().
@@ -544,7 +535,9 @@ BmErr bm_dfu_client_set_pending_and_reset(void) {
   // 6. Replace this process image with the new binary (transparent to systemd).
   bm_log_info("dfu set_pending: binary swapped, restarting via execv");
   if (s_pre_exec_cb) { s_pre_exec_cb(); }
+  pcap_file_sink_close();
   bm_log_shutdown();
+  sync_cfg_journals();
   close_fds_above_stderr();
   execv(s_install_path, s_saved_argv);
 
@@ -584,7 +577,9 @@ BmErr bm_dfu_client_fail_update_and_reset(void) {
   unlink(s_marker_path);
   bm_log_info("dfu fail_update: restarting via execv");
   if (s_pre_exec_cb) { s_pre_exec_cb(); }
+  pcap_file_sink_close();
   bm_log_shutdown();
+  sync_cfg_journals();
   close_fds_above_stderr();
   execv(s_install_path, s_saved_argv);
 
@@ -5,10 +5,28 @@
 ///
 /// Provides config partition, RTC, and DFU stubs for the Linux backend.
 
+#include <stdint.h>
+
 /// Initialize Linux platform services.
 /// @return 0 on success, non-zero on failure
 int platform_linux_init(void);
 
+/// Storage scheme for the config partition files.
+typedef enum {
+  /// Rewrite the whole file per save (tmp + fsync + rename); the default.
+  PLATFORM_CFG_BACKEND_FILE,
+  /// Append changed bytes to config.<partition>.jnl and fold them into the
+  /// .bin file periodically.  See config_journal.h.
+  PLATFORM_CFG_BACKEND_JOURNAL,
+} PlatformCfgBackend;
+
+/// Select the config partition backend.  @p commit_window_ms only applies to
+/// the journal: 0 syncs every save, otherwise saves landing within one window
+/// share a single fdatasync.
+/// Must be called before platform_linux_set_cfg_dir().
+void platform_linux_set_cfg_backend(PlatformCfgBackend backend,
+                                    uint32_t commit_window_ms);
+
 /// Set the directory used for config partition files.
 /// Files are named config.user.bin, config.sys.bin, config.hw.bin within this
 /// directory.  The directory is created if it does not exist.
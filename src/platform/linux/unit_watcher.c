@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include "unit_watcher.h"
+#include "dbus_client.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYSTEMD_DEST "org.freedesktop.systemd1"
+#define SYSTEMD_PATH "/org/freedesktop/systemd1"
+#define MANAGER_IFACE "org.freedesktop.systemd1.Manager"
+#define UNIT_IFACE "org.freedesktop.systemd1.Unit"
+#define SERVICE_IFACE "org.freedesktop.systemd1.Service"
+#define PROPS_IFACE "org.freedesktop.DBus.Properties"
+#define CALL_TIMEOUT_MS 5000
+#define DEFAULT_SLICE_DIR "/sys/fs/cgroup/system.slice"
+
+struct UnitWatcher {
+  const UnitWatcherOps *ops;
+  void *ctx;
+};
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+UnitState unit_state_from_string(const char *s) {
+  static const struct {
+    const char *name;
+    UnitState state;
+  } states[] = {
+      {"inactive", UNIT_STATE_INACTIVE},
+      {"active", UNIT_STATE_ACTIVE},
+      {"activating", UNIT_STATE_ACTIVATING},
+      {"deactivating", UNIT_STATE_DEACTIVATING},
+      {"reloading", UNIT_STATE_RELOADING},
+      {"failed", UNIT_STATE_FAILED},
+  };
+  for (size_t i = 0; s && i < sizeof(states) / sizeof(states[0]); i++) {
+    if (strcmp(s, states[i].name) == 0) {
+      return states[i].state;
+    }
+  }
+  return UNIT_STATE_UNKNOWN;
+}
+
+bool unit_state_running(UnitState s) {
+  return s != UNIT_STATE_INACTIVE && s != UNIT_STATE_FAILED;
+}
+
+/**************** D-Bus backend ****************/
+
+typedef struct {
+  DbusClient bus;
+  char path[256];
+  bool changed; ///< A PropertiesChanged arrived during a call.
+} DbusUnit;
+
+static bool dbus_unit_is_change(const DbusUnit *u, const DbusMsg *m) {
+  return m->type == DBUS_MSG_SIGNAL && m->path && m->member &&
+         strcmp(m->path, u->path) == 0 &&
+         strcmp(m->member, "PropertiesChanged") == 0;
+}
+
+static void dbus_unit_on_signal(const DbusMsg *m, void *arg) {
+  DbusUnit *u = (DbusUnit *)arg;
+  u->changed = u->changed || dbus_unit_is_change(u, m);
+}
+
+static bool dbus_unit_get_prop(DbusUnit *u, const char *iface,
+                               const char *prop, char *type, const char **s,
+                               int32_t *num) {
+  const char *const args[] = {iface, prop};
+  DbusMsg reply;
+  size_t off = 0;
+  return dbus_client_call(&u->bus, SYSTEMD_DEST, u->path, PROPS_IFACE, "Get",
+                          args, 2, &reply, CALL_TIMEOUT_MS) &&
+         dbus_msg_read_variant(&reply, &off, type, s, num);
+}
+
+static bool dbus_unit_get(void *ctx, UnitStatus *out) {
+  DbusUnit *u = (DbusUnit *)ctx;
+  char type = 0;
+  const char *state = NULL;
+  int32_t num = 0;
+  memset(out, 0, sizeof(*out));
+  if (!dbus_unit_get_prop(u, UNIT_IFACE, "ActiveState", &type, &state,
+                          &num) ||
+      type != 's') {
+    return false;
+  }
+  out->state = unit_state_from_string(state);
+  // Not a service unit, or an older systemd: leave it unknown.
+  if (dbus_unit_get_prop(u, SERVICE_IFACE, "ExecMainStatus", &type, &state,
+                         &num) &&
+      type == 'i') {
+    out->exec_main_status_known = true;
+    out->exec_main_status = num;
+  }
+  return true;
+}
+
+static int dbus_unit_wait(void *ctx, uint32_t timeout_ms) {
+  DbusUnit *u = (DbusUnit *)ctx;
+  const uint64_t deadline = now_ms() + timeout_ms;
+  while (!u->changed) {
+    uint64_t now = now_ms();
+    if (now >= deadline) {
+      return 0;
+    }
+    DbusMsg m;
+    int rc = dbus_client_recv(&u->bus, &m, (uint32_t)(deadline - now));
+    if (rc <= 0) {
+      return rc;
+    }
+    u->changed = dbus_unit_is_change(u, &m);
+  }
+  u->changed = false;
+  return 1;
+}
+
+static void dbus_unit_close(void *ctx) {
+  DbusUnit *u = (DbusUnit *)ctx;
+  dbus_client_close(&u->bus);
+  free(u);
+}
+
+static const UnitWatcherOps k_dbus_ops = {
+    .name = "dbus",
+    .get = dbus_unit_get,
+    .wait = dbus_unit_wait,
+    .close = dbus_unit_close,
+};
+
+UnitWatcher *unit_watcher_open_dbus(const char *unit, const char *bus_socket) {
+  DbusUnit *u = (DbusUnit *)calloc(1, sizeof(*u));
+  if (!u) {
+    return NULL;
+  }
+  if (!dbus_client_open(&u->bus, bus_socket)) {
+    free(u);
+    return NULL;
+  }
+  u->bus.on_signal = dbus_unit_on_signal;
+  u->bus.signal_arg = u;
+
+  // LoadUnit, unlike GetUnit, also answers for units that are not loaded.
+  const char *const load_args[] = {unit};
+  DbusMsg reply;
+  size_t off = 0;
+  const char *path = NULL;
+  bool ok = dbus_client_call(&u->bus, SYSTEMD_DEST, SYSTEMD_PATH,
+                             MANAGER_IFACE, "LoadUnit", load_args, 1, &reply,
+                             CALL_TIMEOUT_MS) &&
+            dbus_msg_read_string(&reply, &off, &path) &&
+            (size_t)snprintf(u->path, sizeof(u->path), "%s", path) <
+                sizeof(u->path);
+
+  // systemd only emits unit signals while some client is subscribed.
+  char match[512];
+  snprintf(match, sizeof(match),
+           "type='signal',sender='" SYSTEMD_DEST "',path='%s',"
+           "interface='" PROPS_IFACE "',member='PropertiesChanged'",
+           u->path);
+  const char *const match_args[] = {match};
+  ok = ok &&
+       dbus_client_call(&u->bus, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                        "Subscribe", NULL, 0, &reply, CALL_TIMEOUT_MS) &&
+       dbus_client_call(&u->bus, "org.freedesktop.DBus",
+                        "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                        "AddMatch", match_args, 1, &reply, CALL_TIMEOUT_MS);
+  UnitWatcher *w = ok ? unit_watcher_open_ops(&k_dbus_ops, u) : NULL;
+  if (!w) {
+    dbus_unit_close(u);
+  }
+  return w;
+}
+
+/**************** cgroup backend ****************/
+
+typedef struct {
+  int ifd;
+  char events[PATH_MAX];
+} CgroupUnit;
+
+static bool cgroup_unit_get(void *ctx, UnitStatus *out) {
+  CgroupUnit *u = (CgroupUnit *)ctx;
+  memset(out, 0, sizeof(*out));
+  out->state = UNIT_STATE_INACTIVE;
+  // No cgroup: systemd removed it, so nothing of the unit is running.
+  FILE *f = fopen(u->events, "r");
+  if (!f) {
+    return errno == ENOENT;
+  }
+  char line[64];
+  int populated = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "populated %d", &populated) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  out->state = populated ? UNIT_STATE_ACTIVE : UNIT_STATE_INACTIVE;
+  return true;
+}
+
+static int cgroup_unit_wait(void *ctx, uint32_t timeout_ms) {
+  CgroupUnit *u = (CgroupUnit *)ctx;
+  // Re-arm on every wait: the file comes and goes with the unit.
+  inotify_add_watch(u->ifd, u->events, IN_MODIFY);
+  struct pollfd p = {.fd = u->ifd, .events = POLLIN};
+  int rc = poll(&p, 1, (int)timeout_ms);
+  if (rc <= 0) {
+    return rc < 0 && errno != EINTR ? -1 : 0;
+  }
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (read(u->ifd, buf, sizeof(buf)) > 0) {
+  }
+  return 1;
+}
+
+static void cgroup_unit_close(void *ctx) {
+  CgroupUnit *u = (CgroupUnit *)ctx;
+  close(u->ifd);
+  free(u);
+}
+
+static const UnitWatcherOps k_cgroup_ops = {
+    .name = "cgroup",
+    .get = cgroup_unit_get,
+    .wait = cgroup_unit_wait,
+    .close = cgroup_unit_close,
+};
+
+UnitWatcher *unit_watcher_open_cgroup(const char *unit,
+                                      const char *slice_dir) {
+  if (!slice_dir) {
+    slice_dir = DEFAULT_SLICE_DIR;
+  }
+  CgroupUnit *u = (CgroupUnit *)calloc(1, sizeof(*u));
+  if (!u) {
+    return NULL;
+  }
+  u->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if ((size_t)snprintf(u->events, sizeof(u->events), "%s/%s/cgroup.events",
+                       slice_dir, unit) >= sizeof(u->events) ||
+      u->ifd < 0 ||
+      // The slice reports the unit's cgroup appearing and going away.
+      inotify_add_watch(u->ifd, slice_dir,
+                        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_ONLYDIR) < 0) {
+    if (u->ifd >= 0) {
+      close(u->ifd);
+    }
+    free(u);
+    return NULL;
+  }
+  inotify_add_watch(u->ifd, u->events, IN_MODIFY);
+  UnitWatcher *w = unit_watcher_open_ops(&k_cgroup_ops, u);
+  if (!w) {
+    cgroup_unit_close(u);
+  }
+  return w;
+}
+
+/**************** Watcher ****************/
+
+UnitWatcher *unit_watcher_open(const char *unit) {
+  UnitWatcher *w = unit_watcher_open_dbus(unit, NULL);
+  return w ? w : unit_watcher_open_cgroup(unit, NULL);
+}
+
+UnitWatcher *unit_watcher_open_ops(const UnitWatcherOps *ops, void *ctx) {
+  UnitWatcher *w = (UnitWatcher *)calloc(1, sizeof(*w));
+  if (w) {
+    w->ops = ops;
+    w->ctx = ctx;
+  }
+  return w;
+}
+
+const char *unit_watcher_backend(const UnitWatcher *w) {
+  return w->ops->name;
+}
+
+bool unit_watcher_get(UnitWatcher *w, UnitStatus *out) {
+  return w->ops->get(w->ctx, out);
+}
+
+int unit_watcher_wait(UnitWatcher *w, uint32_t timeout_ms) {
+  return w->ops->wait(w->ctx, timeout_ms);
+}
+
+int unit_watcher_wait_stopped(UnitWatcher *w, UnitStatus *out,
+                              uint32_t timeout_ms) {
+  const uint64_t deadline = now_ms() + timeout_ms;
+  for (;;) {
+    if (!w->ops->get(w->ctx, out)) {
+      return -1;
+    }
+    if (!unit_state_running(out->state)) {
+      return 1;
+    }
+    uint64_t now = now_ms();
+    if (now >= deadline) {
+      return 0;
+    }
+    if (w->ops->wait(w->ctx, (uint32_t)(deadline - now)) < 0) {
+      return -1;
+    }
+  }
+}
+
+void unit_watcher_close(UnitWatcher *w) {
+  if (w) {
+    if (w->ops->close) {
+      w->ops->close(w->ctx);
+    }
+    free(w);
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/// @file unit_watcher.h
+/// @brief Event-driven systemd unit state, without polling systemctl.
+///
+/// A watcher reports a unit's ActiveState and ExecMainStatus and blocks
+/// until they may have changed.  Backends, tried in order by
+/// unit_watcher_open():
+///
+///   - dbus: subscribes to systemd's PropertiesChanged signals for the unit
+///     over the system bus socket and reads properties with
+///     org.freedesktop.DBus.Properties.Get.
+///   - cgroup: watches the unit's cgroup.events with inotify.  The unit
+///     counts as active while its cgroup is populated; ExecMainStatus is not
+///     available.
+///
+/// Tests, or callers with another source of truth, can supply their own
+/// UnitWatcherOps.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  UNIT_STATE_UNKNOWN,
+  UNIT_STATE_INACTIVE,
+  UNIT_STATE_ACTIVE,
+  UNIT_STATE_ACTIVATING,
+  UNIT_STATE_DEACTIVATING,
+  UNIT_STATE_RELOADING,
+  UNIT_STATE_FAILED,
+} UnitState;
+
+typedef struct {
+  UnitState state;
+  bool exec_main_status_known;
+  int32_t exec_main_status; ///< Main process exit code, when known.
+} UnitStatus;
+
+/// Parse a systemd ActiveState string.
+UnitState unit_state_from_string(const char *s);
+
+/// True unless @p s is inactive or failed.
+bool unit_state_running(UnitState s);
+
+typedef struct {
+  const char *name;
+  /// Read the unit's current status.
+  bool (*get)(void *ctx, UnitStatus *out);
+  /// Wait up to @p timeout_ms for a possible change.
+  /// @return 1 on a change, 0 on timeout, -1 on error.
+  int (*wait)(void *ctx, uint32_t timeout_ms);
+  void (*close)(void *ctx);
+} UnitWatcherOps;
+
+typedef struct UnitWatcher UnitWatcher;
+
+/// Watch @p unit (e.g. "hydrotwind.service") with the first backend that
+/// works.
+/// @return NULL if none does.
+UnitWatcher *unit_watcher_open(const char *unit);
+
+/// D-Bus backend on the bus at @p bus_socket (NULL for the system bus).
+UnitWatcher *unit_watcher_open_dbus(const char *unit, const char *bus_socket);
+
+/// cgroup backend under @p slice_dir (NULL for
+/// /sys/fs/cgroup/system.slice).
+UnitWatcher *unit_watcher_open_cgroup(const char *unit,
+                                      const char *slice_dir);
+
+/// Wrap caller-supplied @p ops; @p ops->close(ctx) runs on close.
+UnitWatcher *unit_watcher_open_ops(const UnitWatcherOps *ops, void *ctx);
+
+/// Name of the backend in use.
+const char *unit_watcher_backend(const UnitWatcher *w);
+
+bool unit_watcher_get(UnitWatcher *w, UnitStatus *out);
+
+/// @return 1 if the unit may have changed, 0 on timeout, -1 on error.
+int unit_watcher_wait(UnitWatcher *w, uint32_t timeout_ms);
+
+/// Block until the unit is inactive or failed, up to @p timeout_ms.
+/// @return 1 with its status in @p out, 0 on timeout, -1 on error.
+int unit_watcher_wait_stopped(UnitWatcher *w, UnitStatus *out,
+                              uint32_t timeout_ms);
+
+void unit_watcher_close(UnitWatcher *w);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,7 @@
+#define BM_LOG_MODULE "uart_l2"
 #include "uart_l2_transport.h"
 #include "bm_log.h"
+#include "bm_trace.h"
 #include "cobs.h"
 #include "frame_codec.h"
 
@@ -161,9 +163,13 @@ static void *rx_thread_func(void *arg) {
           size_t l2_len =
               frame_decode(l2_frame, sizeof(l2_frame), accum, accum_len);
           if (l2_len > 0) {
+            bm_trace("uart_l2: rx len=%zu %*ph", l2_len, (int)l2_len,
+                     (const void *)l2_frame);
             s_rx_cb(l2_frame, l2_len, s_rx_ctx);
           } else {
-            bm_log_error("uart_l2: decode error, count - %d", ++decode_error_count);
+            bm_log_ratelimited(BM_LOG_ERROR,
+                               "uart_l2: decode error, count - %zu",
+                               ++decode_error_count);
           }
           // else: CRC/length error — silently drop
         }
@@ -218,6 +224,9 @@ int uart_l2_send(const uint8_t *l2_frame, size_t l2_len) {
     return -1;
   }
 
+  bm_trace("uart_l2: tx len=%zu %*ph", l2_len, (int)l2_len,
+           (const void *)l2_frame);
+
   uint8_t wire[FRAME_CODEC_MAX_WIRE_SIZE];
   size_t wire_len = frame_encode(wire, sizeof(wire), l2_frame, l2_len);
   if (wire_len == 0) {
@@ -0,0 +1,317 @@
+// bench_config_store — config partition save and read cost, per backend.
+//
+// Saves replay the pattern save_config() produces: the whole partition image
+// is written on every save, but only a few bytes (the changed key's value and
+// the partition CRC) differ from the previous one.  Each backend gets the
+// same sequence of images and the table reports saves per second, the worst
+// single save, fsyncs per save and bytes written per save.
+//
+// Reads compare an uncached fopen/fread per call (the old bm_config_read),
+// the mapped file and the journal's in-memory image: "startup" is opening
+// the store plus one full-partition read, as config_init() does, and
+// "read" is one --read-size lookup at a random offset.
+//
+// Run it against the storage the config dir really lives on; on tmpfs every
+// fsync is free and the backends look alike.
+//
+// Usage: bench_config_store [--dir PATH] [--saves N] [--size BYTES]
+//                           [--changes N] [--windows MS,MS,...]
+//                           [--reads N] [--read-size BYTES]
+
+#define _GNU_SOURCE
+#include "config_file.h"
+#include "config_journal.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char k_usage[] =
+    "Usage: bench_config_store [options]\n"
+    "  --dir PATH       Directory for the partition files (default: .)\n"
+    "  --saves N        Saves per backend (default: 500)\n"
+    "  --size BYTES     Partition image size (default: 4096)\n"
+    "  --changes N      Bytes changed per save (default: 8)\n"
+    "  --windows LIST   Journal commit windows in ms (default: 0,10,50)\n"
+    "  --reads N        Lookups per reader (default: 100000)\n"
+    "  --read-size B    Bytes per lookup (default: 32)\n";
+
+#define STARTUP_ROUNDS 200
+
+#define MAX_WINDOWS 8
+
+typedef struct {
+  double elapsed_s;
+  double worst_s;
+  uint64_t fsyncs;
+  uint64_t bytes;
+} Result;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Mutate @p changes bytes of @p img, the way a config_set does: a value
+// somewhere in the body plus the CRC in the header.
+static void next_image(uint8_t *img, size_t size, int changes,
+                       unsigned *seed) {
+  for (int i = 0; i < changes; i++) {
+    size_t at = i < 4 ? (size_t)i : (size_t)rand_r(seed) % size;
+    img[at] = (uint8_t)rand_r(seed);
+  }
+}
+
+static void print_row(const char *backend, const char *window, long saves,
+                      const Result *r) {
+  printf("%-16s %7s %10.0f %10.2f %12.3f %12.0f\n", backend, window,
+         (double)saves / r->elapsed_s, r->worst_s * 1e3,
+         (double)r->fsyncs / (double)saves, (double)r->bytes / (double)saves);
+}
+
+static bool run_file(const char *path, size_t size, long saves, int changes,
+                     Result *r) {
+  uint8_t *img = (uint8_t *)calloc(1, size);
+  unsigned seed = 1;
+  unlink(path);
+  double start = now_s();
+  for (long i = 0; i < saves; i++) {
+    next_image(img, size, changes, &seed);
+    double t0 = now_s();
+    if (!config_file_write(path, 0, img, size)) {
+      perror("config_file_write");
+      free(img);
+      return false;
+    }
+    double dt = now_s() - t0;
+    r->worst_s = dt > r->worst_s ? dt : r->worst_s;
+  }
+  r->elapsed_s = now_s() - start;
+  // Tempfile fsync plus directory fsync.
+  r->fsyncs = (uint64_t)saves * 2;
+  r->bytes = (uint64_t)saves * size;
+  free(img);
+  unlink(path);
+  return true;
+}
+
+static bool run_journal(const char *base, const char *jnl, size_t size,
+                        long saves, int changes, uint32_t window_ms,
+                        Result *r) {
+  unlink(base);
+  unlink(jnl);
+  ConfigJournalCfg cfg = {window_ms, 0};
+  ConfigJournal *j = config_journal_open(base, jnl, &cfg);
+  if (!j) {
+    perror("config_journal_open");
+    return false;
+  }
+  uint8_t *img = (uint8_t *)calloc(1, size);
+  unsigned seed = 1;
+  bool ok = true;
+  double start = now_s();
+  for (long i = 0; i < saves && ok; i++) {
+    next_image(img, size, changes, &seed);
+    double t0 = now_s();
+    ok = config_journal_write(j, 0, img, size);
+    double dt = now_s() - t0;
+    r->worst_s = dt > r->worst_s ? dt : r->worst_s;
+  }
+  // Count the time until the last save is durable, so windows are compared
+  // on equal terms.
+  ok = ok && config_journal_sync(j);
+  r->elapsed_s = now_s() - start;
+  if (!ok) {
+    perror("config_journal_write");
+  }
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  config_journal_close(j);
+  r->fsyncs = st.fsyncs;
+  r->bytes = st.bytes_appended;
+  free(img);
+  unlink(base);
+  unlink(jnl);
+  return ok;
+}
+
+typedef enum { READER_FOPEN, READER_MMAP, READER_JOURNAL } Reader;
+
+static const char *k_reader_names[] = {"fopen/fread", "mmap", "journal"};
+
+// Open the store behind @p reader, or do nothing for the uncached reader.
+static bool reader_open(Reader reader, const char *base, const char *jnl,
+                        ConfigFileMap *m, ConfigJournal **j) {
+  if (reader == READER_MMAP) {
+    return config_file_map(m, base);
+  }
+  if (reader == READER_JOURNAL) {
+    *j = config_journal_open(base, jnl, NULL);
+    return *j != NULL;
+  }
+  return true;
+}
+
+static void reader_read(Reader reader, const char *base, ConfigFileMap *m,
+                        ConfigJournal *j, uint32_t off, uint8_t *buf,
+                        size_t len) {
+  if (reader == READER_MMAP) {
+    config_file_map_read(m, off, buf, len);
+  } else if (reader == READER_JOURNAL) {
+    config_journal_read(j, off, buf, len);
+  } else {
+    config_file_read(base, off, buf, len);
+  }
+}
+
+static void reader_close(Reader reader, ConfigFileMap *m, ConfigJournal *j) {
+  if (reader == READER_MMAP) {
+    config_file_unmap(m);
+  } else if (reader == READER_JOURNAL) {
+    config_journal_close(j);
+  }
+}
+
+static bool run_reads(const char *base, const char *jnl, size_t size,
+                      long reads, size_t read_size) {
+  uint8_t *img = (uint8_t *)malloc(size);
+  uint8_t *buf = (uint8_t *)malloc(size);
+  unsigned seed = 2;
+  for (size_t i = 0; i < size; i++) {
+    img[i] = (uint8_t)rand_r(&seed);
+  }
+  unlink(base);
+  unlink(jnl);
+  bool ok = config_file_write(base, 0, img, size);
+
+  printf("\n%-16s %12s %10s\n", "reader", "startup_us", "read_ns");
+  for (int r = READER_FOPEN; ok && r <= READER_JOURNAL; r++) {
+    ConfigFileMap m;
+    ConfigJournal *j = NULL;
+    double startup = 0;
+    for (int i = 0; i < STARTUP_ROUNDS && ok; i++) {
+      double t0 = now_s();
+      ok = reader_open((Reader)r, base, jnl, &m, &j);
+      if (ok) {
+        reader_read((Reader)r, base, &m, j, 0, buf, size);
+        startup += now_s() - t0;
+        reader_close((Reader)r, &m, j);
+      }
+    }
+    if (!ok || memcmp(buf, img, size) != 0) {
+      fprintf(stderr, "%s: open failed or image mismatch\n",
+              k_reader_names[r]);
+      ok = false;
+      break;
+    }
+
+    reader_open((Reader)r, base, jnl, &m, &j);
+    double t0 = now_s();
+    for (long i = 0; i < reads; i++) {
+      uint32_t off = (uint32_t)((size_t)rand_r(&seed) % (size - read_size));
+      reader_read((Reader)r, base, &m, j, off, buf, read_size);
+    }
+    double per_read = (now_s() - t0) / (double)reads;
+    reader_close((Reader)r, &m, j);
+    printf("%-16s %12.1f %10.0f\n", k_reader_names[r],
+           startup / STARTUP_ROUNDS * 1e6, per_read * 1e9);
+  }
+  free(img);
+  free(buf);
+  unlink(base);
+  unlink(jnl);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = ".";
+  long saves = 500;
+  size_t size = 4096;
+  int changes = 8;
+  uint32_t windows[MAX_WINDOWS] = {0, 10, 50};
+  int nwindows = 3;
+  long reads = 100000;
+  size_t read_size = 32;
+
+  static const struct option opts[] = {
+      {"dir", required_argument, NULL, 'd'},
+      {"saves", required_argument, NULL, 'n'},
+      {"size", required_argument, NULL, 's'},
+      {"changes", required_argument, NULL, 'c'},
+      {"windows", required_argument, NULL, 'w'},
+      {"reads", required_argument, NULL, 'r'},
+      {"read-size", required_argument, NULL, 'z'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'n':
+      saves = strtol(optarg, NULL, 0);
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 0);
+      break;
+    case 'c':
+      changes = (int)strtol(optarg, NULL, 0);
+      break;
+    case 'w': {
+      nwindows = 0;
+      char *save = NULL;
+      for (char *tok = strtok_r(optarg, ",", &save);
+           tok && nwindows < MAX_WINDOWS; tok = strtok_r(NULL, ",", &save)) {
+        windows[nwindows++] = (uint32_t)strtoul(tok, NULL, 0);
+      }
+      break;
+    }
+    case 'r':
+      reads = strtol(optarg, NULL, 0);
+      break;
+    case 'z':
+      read_size = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      fputs(k_usage, opt == 'h' ? stdout : stderr);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (saves <= 0 || size < 16 || size > CONFIG_JOURNAL_MAX_IMAGE ||
+      changes <= 0 || reads <= 0 || read_size == 0 || read_size >= size) {
+    fputs(k_usage, stderr);
+    return 2;
+  }
+
+  char base[4096], jnl[4096];
+  snprintf(base, sizeof(base), "%s/bench_config.%d.bin", dir, (int)getpid());
+  snprintf(jnl, sizeof(jnl), "%s/bench_config.%d.jnl", dir, (int)getpid());
+
+  printf("%ld saves of a %zu-byte partition, %d bytes changed per save\n\n",
+         saves, size, changes);
+  printf("%-16s %7s %10s %10s %12s %12s\n", "backend", "window", "saves/s",
+         "worst_ms", "fsyncs/save", "bytes/save");
+
+  Result r = {0};
+  if (!run_file(base, size, saves, changes, &r)) {
+    return 1;
+  }
+  print_row("file (rename)", "-", saves, &r);
+
+  for (int i = 0; i < nwindows; i++) {
+    memset(&r, 0, sizeof(r));
+    if (!run_journal(base, jnl, size, saves, changes, windows[i], &r)) {
+      return 1;
+    }
+    char window[16];
+    snprintf(window, sizeof(window), "%ums", windows[i]);
+    print_row("journal", window, saves, &r);
+  }
+  return run_reads(base, jnl, size, reads, read_size) ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+// bench_dfu_staging — cost of receiving a DFU image into the staging file.
+//
+// Replays what the DFU client does with the flash area: open it, erase the
+// image's length, write the image in --chunk sized pieces in order, then
+// flush and fsync before the swap.  Each method gets the same image and the
+// table reports the time for each phase and the syscalls it made:
+//
+//   pwrite            erase as a 256-byte zero pwrite() loop and one
+//                     pwrite() per chunk (the original flash-area code)
+//   staging           dfu_staging: fallocate() erase, write-behind buffer
+//   staging+fill      dfu_staging, but erasing by writing zeros
+//
+// Every run reads the file back and checks it against the image.  As with
+// bench_config_store, run it on the filesystem the binary is installed on.
+//
+// A second table compares the image checks: reading the finished file
+// back at set_pending (the original validate_staging_elf/_marker, an fread
+// of the header and a memmem over an mmap of the file) with dfu_validate
+// run on each chunk as it is written.  "in_writes" is the time the checks
+// add across the transfer, "set_pending" the time left on the path to the
+// swap.
+//
+// Usage: bench_dfu_staging [--dir PATH] [--size BYTES] [--chunk BYTES]
+//                          [--buffer BYTES] [--rounds N]
+
+#define _GNU_SOURCE
+#include "dfu_staging.h"
+#include "dfu_validate.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char k_usage[] =
+    "Usage: bench_dfu_staging [options]\n"
+    "  --dir PATH       Directory for the staging file (default: .)\n"
+    "  --size BYTES     Image size (default: 10485760)\n"
+    "  --chunk BYTES    Bytes per flash-area write (default: 512)\n"
+    "  --buffer BYTES   Write-behind buffer, 0 = default (default: 0)\n"
+    "  --rounds N       Runs per method, averaged (default: 3)\n";
+
+typedef enum { METHOD_PWRITE, METHOD_STAGING, METHOD_FILL } Method;
+
+static const char *k_method_names[] = {"pwrite", "staging", "staging+fill"};
+
+typedef struct {
+  double erase_s;
+  double write_s;
+  double sync_s;
+  uint64_t erase_calls;
+  uint64_t write_calls;
+} Result;
+
+#define MARKER "BM_SBC_IMAGE:bench"
+#define MACHINE 0x00B7u
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// The flash-area code before dfu_staging, kept here as the baseline.
+static bool run_pwrite(const char *path, const uint8_t *img, size_t size,
+                       size_t chunk, Result *r) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  static const uint8_t k_zeros[256] = {0};
+  double t0 = now_s();
+  for (size_t off = 0; off < size; off += sizeof(k_zeros)) {
+    size_t n = size - off < sizeof(k_zeros) ? size - off : sizeof(k_zeros);
+    if (pwrite(fd, k_zeros, n, (off_t)off) != (ssize_t)n) {
+      close(fd);
+      return false;
+    }
+    r->erase_calls++;
+  }
+  double t1 = now_s();
+  for (size_t off = 0; off < size; off += chunk) {
+    size_t n = size - off < chunk ? size - off : chunk;
+    if (pwrite(fd, img + off, n, (off_t)off) != (ssize_t)n) {
+      close(fd);
+      return false;
+    }
+    r->write_calls++;
+  }
+  double t2 = now_s();
+  bool ok = fsync(fd) == 0;
+  r->erase_s += t1 - t0;
+  r->write_s += t2 - t1;
+  r->sync_s += now_s() - t2;
+  return close(fd) == 0 && ok;
+}
+
+static bool run_staging(const char *path, const uint8_t *img, size_t size,
+                        size_t chunk, uint32_t buffer, bool fill,
+                        Result *r) {
+  DfuStagingCfg cfg = {buffer, fill};
+  DfuStaging *s = dfu_staging_open(path, &cfg);
+  if (!s) {
+    return false;
+  }
+  double t0 = now_s();
+  bool ok = dfu_staging_erase(s, 0, (uint32_t)size);
+  DfuStagingStats erased;
+  dfu_staging_get_stats(s, &erased);
+  double t1 = now_s();
+  for (size_t off = 0; off < size && ok; off += chunk) {
+    size_t n = size - off < chunk ? size - off : chunk;
+    ok = dfu_staging_write(s, (uint32_t)off, img + off, (uint32_t)n);
+  }
+  double t2 = now_s();
+  // The flush of the buffered tail is part of set_pending's sync.
+  ok = ok && dfu_staging_sync(s);
+  double t3 = now_s();
+  DfuStagingStats st;
+  dfu_staging_get_stats(s, &st);
+  ok = dfu_staging_close(s) && ok;
+  r->erase_s += t1 - t0;
+  r->write_s += t2 - t1;
+  r->sync_s += t3 - t2;
+  r->erase_calls += erased.erase_calls + erased.pwrites;
+  r->write_calls += st.pwrites - erased.pwrites;
+  return ok;
+}
+
+static bool check(const char *path, const uint8_t *img, size_t size) {
+  uint8_t *buf = (uint8_t *)malloc(size + 1);
+  int fd = open(path, O_RDONLY);
+  ssize_t n = fd >= 0 && buf ? pread(fd, buf, size + 1, 0) : -1;
+  bool ok = n == (ssize_t)size && memcmp(buf, img, size) == 0;
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(buf);
+  return ok;
+}
+
+// The set_pending checks before dfu_validate, kept as the baseline.
+static bool validate_file(const char *path) {
+  uint8_t hdr[20];
+  FILE *f = fopen(path, "rb");
+  if (!f || fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+    if (f) {
+      fclose(f);
+    }
+    return false;
+  }
+  fclose(f);
+  if (memcmp(hdr, "\x7f" "ELF", 4) != 0 ||
+      (hdr[18] | (hdr[19] << 8)) != MACHINE) {
+    return false;
+  }
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  bool found = memmem(map, (size_t)st.st_size, MARKER, strlen(MARKER));
+  munmap(map, (size_t)st.st_size);
+  return found;
+}
+
+static bool run_validate(const char *path, const uint8_t *img, size_t size,
+                         size_t chunk, long rounds) {
+  double file_s = 0, stream_s = 0, finish_s = 0;
+  bool ok = true;
+  for (long i = 0; i < rounds && ok; i++) {
+    double t0 = now_s();
+    ok = validate_file(path);
+    file_s += now_s() - t0;
+
+    DfuValidator v;
+    dfu_validate_init(&v, MARKER, MACHINE);
+    t0 = now_s();
+    for (size_t off = 0; off < size && ok; off += chunk) {
+      size_t n = size - off < chunk ? size - off : chunk;
+      ok = dfu_validate_update(&v, (uint32_t)off, img + off, n);
+    }
+    double t1 = now_s();
+    char err[128];
+    ok = ok && dfu_validate_finish(&v, err, sizeof(err));
+    finish_s += now_s() - t1;
+    stream_s += t1 - t0;
+  }
+  if (!ok) {
+    fprintf(stderr, "validation failed\n");
+    return false;
+  }
+  printf("\n%-14s %14s %14s\n", "validation", "in_writes_ms",
+         "set_pending_ms");
+  printf("%-14s %14.2f %14.2f\n", "file (mmap)", 0.0, file_s / rounds * 1e3);
+  printf("%-14s %14.2f %14.3f\n", "streamed", stream_s / rounds * 1e3,
+         finish_s / rounds * 1e3);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = ".";
+  size_t size = 10u * 1024u * 1024u;
+  size_t chunk = 512;
+  uint32_t buffer = 0;
+  long rounds = 3;
+
+  static const struct option opts[] = {
+      {"dir", required_argument, NULL, 'd'},
+      {"size", required_argument, NULL, 's'},
+      {"chunk", required_argument, NULL, 'c'},
+      {"buffer", required_argument, NULL, 'b'},
+      {"rounds", required_argument, NULL, 'r'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 0);
+      break;
+    case 'c':
+      chunk = strtoul(optarg, NULL, 0);
+      break;
+    case 'b':
+      buffer = (uint32_t)strtoul(optarg, NULL, 0);
+      break;
+    case 'r':
+      rounds = strtol(optarg, NULL, 0);
+      break;
+    default:
+      fputs(k_usage, opt == 'h' ? stdout : stderr);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (size == 0 || size > UINT32_MAX || chunk == 0 || rounds <= 0) {
+    fputs(k_usage, stderr);
+    return 2;
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/bench_dfu.%d.staging", dir, (int)getpid());
+  uint8_t *img = (uint8_t *)malloc(size);
+  if (!img) {
+    perror("malloc");
+    return 1;
+  }
+  unsigned seed = 1;
+  for (size_t i = 0; i < size; i++) {
+    img[i] = (uint8_t)rand_r(&seed);
+  }
+  // A header and marker for the validation runs, the marker near the end
+  // as the worst case for the search.
+  const size_t marker_len = strlen(MARKER);
+  if (size >= 20 + marker_len) {
+    memcpy(img, "\x7f" "ELF", 4);
+    img[18] = (uint8_t)MACHINE;
+    img[19] = (uint8_t)(MACHINE >> 8);
+    memcpy(img + size - marker_len, MARKER, marker_len);
+  }
+
+  printf("%zu-byte image in %zu-byte chunks, %ld rounds\n\n", size, chunk,
+         rounds);
+  printf("%-14s %10s %10s %10s %12s %12s\n", "method", "erase_ms",
+         "write_ms", "sync_ms", "erase_calls", "write_calls");
+  int rc = 0;
+  for (int m = METHOD_PWRITE; m <= METHOD_FILL && rc == 0; m++) {
+    Result r = {0};
+    for (long i = 0; i < rounds && rc == 0; i++) {
+      bool ok = m == METHOD_PWRITE
+                    ? run_pwrite(path, img, size, chunk, &r)
+                    : run_staging(path, img, size, chunk, buffer,
+                                  m == METHOD_FILL, &r);
+      if (!ok || !check(path, img, size)) {
+        fprintf(stderr, "%s: write failed or image mismatch\n",
+                k_method_names[m]);
+        rc = 1;
+      }
+    }
+    printf("%-14s %10.2f %10.2f %10.2f %12llu %12llu\n", k_method_names[m],
+           r.erase_s / rounds * 1e3, r.write_s / rounds * 1e3,
+           r.sync_s / rounds * 1e3,
+           (unsigned long long)(r.erase_calls / (uint64_t)rounds),
+           (unsigned long long)(r.write_calls / (uint64_t)rounds));
+  }
+  if (rc == 0 && size >= 20 + marker_len &&
+      !run_validate(path, img, size, chunk, rounds)) {
+    rc = 1;
+  }
+  unlink(path);
+  free(img);
+  return rc;
+}
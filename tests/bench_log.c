@@ -0,0 +1,162 @@
+// bench_log — time spent inside bm_log() by the calling thread, synchronous
+// versus asynchronous.
+//
+// Two rates per mode: "info" paces each thread to one line per millisecond,
+// as a busy INFO log does, and "trace" logs flat out, as TRACE logging of
+// every frame does.  Each thread times every call; the table reports the
+// median, 99th percentile and worst call across threads, throughput, and
+// lines dropped because a ring was full.
+//
+// Run it against the storage the log dir really lives on; on tmpfs the
+// synchronous writes look much cheaper than on an SD card.
+//
+// Usage: bench_log [--dir PATH] [--lines N] [--threads N] [--ring BYTES]
+
+#define _GNU_SOURCE
+#include "bm_log.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char k_usage[] =
+    "Usage: bench_log [options]\n"
+    "  --dir PATH       Log directory (default: .)\n"
+    "  --lines N        Lines per thread (default: 2000)\n"
+    "  --threads N      Logging threads (default: 4)\n"
+    "  --ring BYTES     Async per-thread ring (default: 65536)\n";
+
+typedef struct {
+  long lines;
+  bool paced;
+  uint64_t *ns; // One sample per line.
+} Worker;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = (Worker *)arg;
+  uint64_t next = now_ns();
+  for (long i = 0; i < w->lines; i++) {
+    if (w->paced) {
+      next += 1000000ull;
+      struct timespec until = {(time_t)(next / 1000000000ull),
+                               (long)(next % 1000000000ull)};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+    }
+    uint64_t t0 = now_ns();
+    bm_log_info("bench line %ld rx_frame len=%d crc=0x%08x port=%d", i,
+                64 + (int)(i % 900), (unsigned)(i * 2654435761u),
+                (int)(i % 4));
+    w->ns[i] = now_ns() - t0;
+  }
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run(const char *dir, bool async, bool paced, long lines,
+                int threads, size_t ring) {
+  bm_log_init("bench_log", (uint64_t)getpid(), dir, false);
+  if (async) {
+    BmLogAsyncCfg cfg = {.ring_bytes = ring};
+    if (bm_log_start_async(&cfg) != 0) {
+      fprintf(stderr, "bm_log_start_async failed\n");
+      exit(1);
+    }
+  }
+  const uint64_t dropped_before = bm_log_dropped();
+
+  Worker *w = calloc((size_t)threads, sizeof(*w));
+  pthread_t *t = calloc((size_t)threads, sizeof(*t));
+  uint64_t *all = calloc((size_t)(lines * threads), sizeof(*all));
+  uint64_t start = now_ns();
+  for (int i = 0; i < threads; i++) {
+    w[i] = (Worker){lines, paced, all + i * lines};
+    pthread_create(&t[i], NULL, worker_main, &w[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(t[i], NULL);
+  }
+  double elapsed_s = (double)(now_ns() - start) / 1e9;
+  const uint64_t dropped = bm_log_dropped() - dropped_before;
+  bm_log_shutdown();
+
+  size_t n = (size_t)(lines * threads);
+  qsort(all, n, sizeof(*all), cmp_u64);
+  printf("%-6s %-6s %7d %10llu %10llu %10llu %12.0f %8llu\n",
+         async ? "async" : "sync", paced ? "info" : "trace", threads,
+         (unsigned long long)all[n / 2], (unsigned long long)all[n * 99 / 100],
+         (unsigned long long)all[n - 1], (double)n / elapsed_s,
+         (unsigned long long)dropped);
+  free(all);
+  free(t);
+  free(w);
+}
+
+int main(int argc, char **argv) {
+  const char *dir = ".";
+  long lines = 2000;
+  int threads = 4;
+  size_t ring = BM_LOG_ASYNC_DEFAULT_RING;
+
+  static const struct option opts[] = {
+      {"dir", required_argument, NULL, 'd'},
+      {"lines", required_argument, NULL, 'n'},
+      {"threads", required_argument, NULL, 't'},
+      {"ring", required_argument, NULL, 'r'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'n':
+      lines = strtol(optarg, NULL, 10);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'r':
+      ring = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "%s", k_usage);
+      return 1;
+    }
+  }
+  if (lines <= 0 || threads <= 0) {
+    fprintf(stderr, "%s", k_usage);
+    return 1;
+  }
+
+  printf("%ld lines per thread, log dir %s\n\n", lines, dir);
+  printf("%-6s %-6s %7s %10s %10s %10s %12s %8s\n", "mode", "rate",
+         "threads", "p50_ns", "p99_ns", "max_ns", "lines/s", "dropped");
+  for (int paced = 1; paced >= 0; paced--) {
+    for (int async = 0; async <= 1; async++) {
+      run(dir, async, paced, lines, 1, ring);
+      run(dir, async, paced, lines, threads, ring);
+    }
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bench_log_%016llx.log", dir,
+           (unsigned long long)getpid());
+  unlink(path);
+  return 0;
+}
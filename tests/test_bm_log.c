@@ -0,0 +1,289 @@
+/// @file test_bm_log.c
+/// @brief Unit tests for bm_log's asynchronous mode.
+
+#define _GNU_SOURCE
+#include "bm_log.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define NODE 0x42
+#define THREADS 4
+#define LINES 500
+
+static char g_dir[64];
+static char g_path[160];
+
+static void start(size_t ring_bytes, uint32_t flush_ms) {
+  unlink(g_path);
+  bm_log_init("t", NODE, g_dir, false);
+  bm_log_set_level(BM_LOG_TRACE);
+  BmLogAsyncCfg cfg = {.ring_bytes = ring_bytes, .flush_ms = flush_ms};
+  ASSERT_EQ(bm_log_start_async(&cfg), 0, "start async");
+}
+
+// Lines in the log file containing @p needle; the first @p max are copied
+// to @p out.
+static size_t grep_log(const char *needle, char (*out)[128], size_t max) {
+  FILE *f = fopen(g_path, "r");
+  size_t n = 0;
+  char line[2048];
+  while (f && fgets(line, sizeof(line), f)) {
+    const char *hit = strstr(line, needle);
+    if (hit) {
+      if (n < max) {
+        snprintf(out[n], sizeof(out[n]), "%s", hit);
+      }
+      n++;
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+  return n;
+}
+
+static void *log_b(void *arg) {
+  (void)arg;
+  bm_log_info("order B");
+  return NULL;
+}
+
+static void test_merge_order(void) {
+  start(0, 1000);
+  bm_log_info("order A");
+  pthread_t t;
+  pthread_create(&t, NULL, log_b, NULL);
+  pthread_join(t, NULL);
+  bm_log_info("order C");
+  // A long flush interval: only bm_log_flush() gets these written.
+  bm_log_flush();
+  char lines[3][128];
+  ASSERT_EQ(grep_log("order ", lines, 3), 3, "three lines");
+  ASSERT_EQ(strncmp(lines[0], "order A", 7), 0, "A first");
+  ASSERT_EQ(strncmp(lines[1], "order B", 7), 0, "B from the exited thread");
+  ASSERT_EQ(strncmp(lines[2], "order C", 7), 0, "C last");
+  bm_log_shutdown();
+}
+
+static void *log_many(void *arg) {
+  int id = (int)(intptr_t)arg;
+  for (int i = 0; i < LINES; i++) {
+    bm_log_debug("burst t%d %04d %s", id, i,
+                  "padding padding padding padding padding padding");
+  }
+  return NULL;
+}
+
+static void test_threads_and_drops(void) {
+  start(4096, 5);
+  pthread_t t[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    pthread_create(&t[i], NULL, log_many, (void *)(intptr_t)i);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(t[i], NULL);
+  }
+  const uint64_t dropped = bm_log_dropped();
+  bm_log_shutdown();
+  size_t written = grep_log("burst t", NULL, 0);
+  ASSERT_EQ(written + dropped, THREADS * LINES, "every line written or "
+                                                "counted as dropped");
+  ASSERT_EQ(grep_log("bm_log: dropped", NULL, 0) > 0, dropped > 0,
+            "drops reported in the log");
+
+  // Each thread's lines stay in order.
+  FILE *f = fopen(g_path, "r");
+  int last[THREADS] = {-1, -1, -1, -1};
+  bool ordered = true;
+  char line[2048];
+  while (f && fgets(line, sizeof(line), f)) {
+    int id;
+    int i;
+    const char *hit = strstr(line, "burst t");
+    if (hit && sscanf(hit, "burst t%d %d", &id, &i) == 2) {
+      ordered = ordered && i > last[id];
+      last[id] = i;
+    }
+  }
+  fclose(f);
+  ASSERT_EQ(ordered, true, "per-thread order kept");
+}
+
+static void test_shutdown_drains(void) {
+  start(0, 60000);
+  for (int i = 0; i < 100; i++) {
+    bm_log_info("drain %d", i);
+  }
+  bm_log_shutdown();
+  ASSERT_EQ(grep_log("drain ", NULL, 0), 100, "shutdown wrote everything");
+
+  // After shutdown logging falls back to stderr and must not crash.
+  bm_log_info("after shutdown\n");
+}
+
+static int g_reloads = 0;
+
+static void on_reload(void) {
+  g_reloads++;
+}
+
+static void test_module_levels(void) {
+  unlink(g_path);
+  bm_log_init("t", NODE, g_dir, false);
+  bm_log_set_level(BM_LOG_INFO);
+
+  bm_log_debug("module off");
+  ASSERT_EQ(bm_log_set_module_level("test_bm_log", BM_LOG_DEBUG), 0,
+            "set by file name");
+  bm_log_debug("module on");
+  bm_log_trace("module trace");
+
+  // Registered on first use, with an override set beforehand.
+  ASSERT_EQ(bm_log_set_module_levels("vpd=trace,nope=default"), 0, "spec");
+  static BmLogModule vpd = {"vpd", BM_LOG_THRESHOLD_UNSET, NULL, {0}};
+  bm_log_module(&vpd, BM_LOG_TRACE, "vpd trace");
+  static BmLogModule other = {"src/net/other.cpp", BM_LOG_THRESHOLD_UNSET,
+                              NULL, {0}};
+  bm_log_module(&other, BM_LOG_DEBUG, "other debug");
+  ASSERT_EQ(strcmp(other.tag, "other"), 0, "tag from a path");
+
+  char buf[128];
+  bm_log_format_module_levels(buf, sizeof(buf));
+  ASSERT_EQ(strcmp(buf, "test_bm_log=debug,vpd=trace"), 0, "format");
+
+  ASSERT_EQ(bm_log_set_module_levels("vpd=info,bad"), -1, "malformed");
+  ASSERT_EQ(bm_log_set_module_levels("vpd=loud"), -1, "unknown level");
+  bm_log_module(&vpd, BM_LOG_TRACE, "vpd still trace");
+
+  // Back to the global level, which now also lets debug through.
+  ASSERT_EQ(bm_log_set_module_levels("vpd=default"), 0, "default");
+  bm_log_module(&vpd, BM_LOG_TRACE, "vpd dropped");
+  bm_log_clear_module_levels();
+  bm_log_debug("module cleared");
+  bm_log_set_level(BM_LOG_DEBUG);
+  bm_log_module(&vpd, BM_LOG_DEBUG, "vpd global debug");
+
+  bm_log_set_reload_cb(on_reload);
+  bm_log_poll_reload();
+  raise(SIGHUP);
+  bm_log_poll_reload();
+  bm_log_poll_reload();
+  ASSERT_EQ(g_reloads, 1, "one reload per SIGHUP");
+  bm_log_set_reload_cb(NULL);
+  bm_log_shutdown();
+
+  static const char *const expect[][2] = {
+      {"module off", "0"},      {"module on", "1"},
+      {"module trace", "0"},    {"vpd trace", "1"},
+      {"other debug", "0"},     {"vpd still trace", "1"},
+      {"vpd dropped", "0"},     {"module cleared", "0"},
+      {"vpd global debug", "1"},
+  };
+  for (size_t i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+    ASSERT_EQ(grep_log(expect[i][0], NULL, 0), (size_t)(expect[i][1][0] - '0'),
+              expect[i][0]);
+  }
+}
+
+static void log_burst(int n, uint64_t key) {
+  for (int i = 0; i < n; i++) {
+    bm_log_ratelimited_key(BM_LOG_WARN, key, "limited key=%llu i=%d",
+                           (unsigned long long)key, i);
+  }
+}
+
+static void test_ratelimit(void) {
+  unlink(g_path);
+  bm_log_init("t", NODE, g_dir, false);
+  bm_log_set_level(BM_LOG_INFO);
+  bm_log_set_ratelimit(3, 50);
+
+  log_burst(10, 1);
+  log_burst(2, 2);
+  ASSERT_EQ(grep_log("limited key=1 ", NULL, 0), 3, "burst let through");
+  ASSERT_EQ(grep_log("limited key=2 ", NULL, 0), 2, "keys counted apart");
+  ASSERT_EQ(grep_log("suppressed", NULL, 0), 0, "no summary mid-window");
+
+  // Below the level: not counted against the burst.
+  for (int i = 0; i < 5; i++) {
+    bm_log_ratelimited(BM_LOG_DEBUG, "limited debug");
+  }
+
+  usleep(60 * 1000);
+  bm_log_ratelimit_flush();
+  char hits[2][128];
+  ASSERT_EQ(grep_log("suppressed", hits, 2), 1, "one summary after flush");
+  ASSERT_EQ(strstr(hits[0], "suppressed 7 line(s)") != NULL, true,
+            "suppressed count");
+  ASSERT_EQ(strstr(hits[0], "key=1 like: limited key=%llu") != NULL, true,
+            "summary names the key and format");
+  bm_log_ratelimit_flush();
+  ASSERT_EQ(grep_log("suppressed", NULL, 0), 1, "summary logged once");
+
+  // A new window lets a full burst through again.
+  log_burst(4, 1);
+  ASSERT_EQ(grep_log("limited key=1 ", NULL, 0), 6, "new window");
+
+  bm_log_set_ratelimit(0, 0);
+  log_burst(20, 3);
+  ASSERT_EQ(grep_log("limited key=3 ", NULL, 0), 20, "disabled");
+  bm_log_set_ratelimit(BM_LOG_RATELIMIT_DEFAULT_BURST,
+                       BM_LOG_RATELIMIT_DEFAULT_WINDOW_MS);
+  bm_log_shutdown();
+}
+
+// Everything below is built as if this file set a compile-time cutoff.
+#undef BM_LOG_MODULE_MIN_LEVEL
+#define BM_LOG_MODULE_MIN_LEVEL BM_LOG_INFO
+
+static void test_compile_time_cutoff(void) {
+  unlink(g_path);
+  bm_log_init("t", NODE, g_dir, false);
+  bm_log_set_level(BM_LOG_TRACE);
+  bm_log_debug("compiled out");
+  bm_log_info("compiled in");
+  bm_log_shutdown();
+  ASSERT_EQ(grep_log("compiled out", NULL, 0), 0, "debug removed");
+  ASSERT_EQ(grep_log("compiled in", NULL, 0), 1, "info kept");
+}
+
+int main(void) {
+  printf("=== bm_log ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_bm_log.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/t_%016x.log", g_dir, NODE);
+
+  test_merge_order();
+  test_threads_and_drops();
+  test_shutdown_drains();
+  test_module_levels();
+  test_ratelimit();
+  test_compile_time_cutoff();
+
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
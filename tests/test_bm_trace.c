@@ -0,0 +1,228 @@
+/// @file test_bm_trace.c
+/// @brief Unit tests for the binary trace channel.
+
+#define _GNU_SOURCE
+#include "bm_trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define NODE 0x42
+
+static char g_dir[64];
+static char g_path[160];
+
+/// The trace file, read back the way the decoder reads it.
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  BmTraceFileHeader hdr;
+} TraceFile;
+
+static bool trace_open(TraceFile *t, const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return false;
+  }
+  t->len = (size_t)st.st_size;
+  t->buf = (uint8_t *)mmap(NULL, t->len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (t->buf == MAP_FAILED) {
+    return false;
+  }
+  memcpy(&t->hdr, t->buf, sizeof(t->hdr));
+  return true;
+}
+
+static void trace_close(TraceFile *t) {
+  munmap(t->buf, t->len);
+}
+
+/// Format string registered for @p addr, or NULL.
+static const char *trace_fmt(const TraceFile *t, uint64_t addr,
+                             uint32_t *len) {
+  size_t off = t->hdr.strtab_off;
+  const size_t end = t->hdr.strtab_off + t->hdr.strtab_used;
+  while (off + 16 <= end) {
+    uint64_t a;
+    memcpy(&a, t->buf + off, 8);
+    memcpy(len, t->buf + off + 8, 4);
+    if (a == addr) {
+      return (const char *)t->buf + off + 16;
+    }
+    off += (16 + *len + 7) & ~7u;
+  }
+  return NULL;
+}
+
+/// The event records between tail and head, in order; returns the count
+/// and points @p recs at each record.
+static size_t trace_records(const TraceFile *t, const uint8_t **recs,
+                            size_t max) {
+  size_t n = 0;
+  for (uint64_t pos = t->hdr.tail; pos < t->hdr.head;) {
+    const uint8_t *r = t->buf + t->hdr.ring_off + pos % t->hdr.ring_bytes;
+    uint32_t len;
+    uint16_t type;
+    memcpy(&len, r, 4);
+    memcpy(&type, r + 4, 2);
+    if (len < 8 || len % 8) {
+      break;
+    }
+    if (type == BM_TRACE_REC_EVENT && n < max) {
+      recs[n++] = r;
+    }
+    pos += len;
+  }
+  return n;
+}
+
+static uint64_t rec_u64(const uint8_t *r, size_t off) {
+  uint64_t v;
+  memcpy(&v, r + off, 8);
+  return v;
+}
+
+static void test_encoding(void) {
+  ASSERT_EQ(bm_trace_init("t", NODE, g_dir, 0), 0, "init");
+  ASSERT_EQ(bm_trace_enabled(), true, "enabled");
+
+  static const char k_fmt[] = "rx port=%u len=%zd rssi=%hhd %s %.*s %*ph";
+  const uint8_t frame[] = {0xde, 0xad, 0xbe, 0xef, 0x01};
+  const char unterminated[4] = {'a', 'b', 'c', 'd'};
+  static BmTraceSite site;
+  bm_trace_record(&site, k_fmt, 3u, (ssize_t)-5, (signed char)-7, "hi", 2,
+                  unterminated, (int)sizeof(frame), (const void *)frame);
+
+  TraceFile t;
+  ASSERT_EQ(trace_open(&t, g_path), true, "open file");
+  ASSERT_MEM_EQ(t.hdr.magic, BM_TRACE_MAGIC, 8, "magic");
+  ASSERT_EQ(t.hdr.node_id, NODE, "node id");
+  ASSERT_EQ(strcmp(t.hdr.app_name, "t"), 0, "app name");
+
+  const uint8_t *recs[4];
+  ASSERT_EQ(trace_records(&t, recs, 4), 1, "one record");
+  const uint8_t *r = recs[0];
+  ASSERT_EQ(rec_u64(r, 16), (uint64_t)(uintptr_t)k_fmt, "format address");
+  uint32_t fmt_len = 0;
+  const char *fmt = trace_fmt(&t, rec_u64(r, 16), &fmt_len);
+  ASSERT_EQ(fmt != NULL && fmt_len == strlen(k_fmt) &&
+                memcmp(fmt, k_fmt, fmt_len) == 0,
+            true, "format in the table");
+
+  size_t off = BM_TRACE_REC_HDR;
+  ASSERT_EQ(rec_u64(r, off), 3, "%u");
+  ASSERT_EQ((int64_t)rec_u64(r, off + 8), -5, "%zd");
+  ASSERT_EQ((int64_t)rec_u64(r, off + 16), -7, "%hhd");
+  off += 24;
+  uint16_t lens[2];
+  memcpy(lens, r + off, 4);
+  ASSERT_EQ(lens[0], 2, "%s length");
+  ASSERT_MEM_EQ(r + off + 4, "hi", 2, "%s bytes");
+  off += 8;
+  ASSERT_EQ(rec_u64(r, off), 2, "%.*s precision");
+  memcpy(lens, r + off + 8, 4);
+  ASSERT_EQ(lens[0], 2, "%.*s stops at the precision");
+  ASSERT_MEM_EQ(r + off + 12, "ab", 2, "%.*s bytes");
+  off += 16;
+  ASSERT_EQ(rec_u64(r, off), sizeof(frame), "%*ph length");
+  memcpy(lens, r + off + 8, 4);
+  ASSERT_EQ(lens[0], sizeof(frame), "%*ph copied");
+  ASSERT_MEM_EQ(r + off + 12, frame, sizeof(frame), "%*ph bytes");
+  uint32_t rec_len;
+  memcpy(&rec_len, r, 4);
+  ASSERT_EQ(rec_len, off + 24, "record length");
+
+  trace_close(&t);
+  bm_trace_shutdown();
+  ASSERT_EQ(bm_trace_enabled(), false, "disabled after shutdown");
+}
+
+static void test_wrap(void) {
+  ASSERT_EQ(bm_trace_init("t", NODE, g_dir, 4096), 0, "init small ring");
+  for (int i = 0; i < 1000; i++) {
+    bm_trace("wrap %d", i);
+  }
+
+  TraceFile t;
+  ASSERT_EQ(trace_open(&t, g_path), true, "open file");
+  ASSERT_EQ(t.hdr.head > t.hdr.ring_bytes, true, "ring wrapped");
+  ASSERT_EQ(t.hdr.head - t.hdr.tail <= t.hdr.ring_bytes, true,
+            "tail within one ring of head");
+  static const uint8_t *recs[1000];
+  size_t n = trace_records(&t, recs, 1000);
+  bool consecutive = n > 0;
+  for (size_t i = 0; i < n; i++) {
+    int64_t v = (int64_t)rec_u64(recs[i], BM_TRACE_REC_HDR);
+    consecutive = consecutive && v == (int64_t)(1000 - n + i);
+  }
+  ASSERT_EQ(consecutive, true, "newest records kept, in order");
+  ASSERT_EQ(n * 32 > 4096 - 64, true, "ring close to full");
+  trace_close(&t);
+  bm_trace_shutdown();
+}
+
+static void test_previous_run_kept(void) {
+  char prev[170];
+  snprintf(prev, sizeof(prev), "%s.1", g_path);
+  unlink(prev);
+  ASSERT_EQ(bm_trace_init("t", NODE, g_dir, 0), 0, "init again");
+  bm_trace_shutdown();
+  ASSERT_EQ(access(prev, F_OK), 0, "previous file renamed");
+
+  // Nothing is recorded while tracing is off.
+  bm_trace("off %d", 1);
+  unlink(prev);
+}
+
+int main(void) {
+  printf("=== bm_trace ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_bm_trace.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/t_%016x.trace", g_dir, NODE);
+
+  test_encoding();
+  test_wrap();
+  test_previous_run_kept();
+
+  char prev[170];
+  snprintf(prev, sizeof(prev), "%s.1", g_path);
+  unlink(prev);
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
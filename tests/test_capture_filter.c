@@ -0,0 +1,201 @@
+/// @file test_capture_filter.c
+/// @brief Unit tests for capture filter expressions.
+
+#include "capture_filter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define IN CAPTURE_FILTER_DIR_IN
+#define OUT CAPTURE_FILTER_DIR_OUT
+
+typedef struct {
+  uint8_t buf[256];
+  size_t len;
+} Frame;
+
+/// Ethernet + IPv6 with next header @p nh and @p payload_len zero bytes.
+static void ip6_frame(Frame *f, uint8_t nh, size_t payload_len) {
+  memset(f, 0, sizeof(*f));
+  f->buf[12] = 0x86;
+  f->buf[13] = 0xdd;
+  f->buf[14] = 0x60;
+  f->buf[20] = nh;
+  f->len = 14 + 40 + payload_len;
+}
+
+static void bcmp_frame(Frame *f, uint16_t type) {
+  ip6_frame(f, 0xbc, 16);
+  f->buf[54] = (uint8_t)type;
+  f->buf[55] = (uint8_t)(type >> 8);
+}
+
+/// A pubsub publish on the middleware port.
+static void pub_frame(Frame *f, const char *topic) {
+  const size_t topic_len = strlen(topic);
+  ip6_frame(f, 17, 8 + 6 + topic_len + 4);
+  f->buf[54] = 4321 >> 8;
+  f->buf[55] = 4321 & 0xff;
+  f->buf[56] = 4321 >> 8;
+  f->buf[57] = 4321 & 0xff;
+  f->buf[62 + 4] = (uint8_t)topic_len;
+  memcpy(f->buf + 62 + 6, topic, topic_len);
+}
+
+static bool match(const char *expr, uint8_t port, uint8_t dir,
+                  const Frame *f) {
+  CaptureFilter cf;
+  char err[128];
+  if (capture_filter_compile(&cf, expr, err, sizeof(err)) != 0) {
+    printf("  compile '%s': %s\n", expr, err);
+    return false;
+  }
+  return capture_filter_match(&cf, port, dir, f->buf, f->len);
+}
+
+static void test_primitives(void) {
+  Frame bcmp, pub, icmp, arp;
+  bcmp_frame(&bcmp, 0xa2);
+  pub_frame(&pub, "sensor/temp");
+  ip6_frame(&icmp, 58, 8);
+  memset(&arp, 0, sizeof(arp));
+  arp.buf[12] = 0x08;
+  arp.buf[13] = 0x06;
+  arp.len = 42;
+
+  ASSERT_EQ(match("", 0, 0, &arp), true, "empty filter keeps all");
+  ASSERT_EQ(match("port 3", 3, IN, &bcmp), true, "port match");
+  ASSERT_EQ(match("port 3", 4, IN, &bcmp), false, "port mismatch");
+  ASSERT_EQ(match("in", 3, IN, &bcmp), true, "in");
+  ASSERT_EQ(match("out", 3, IN, &bcmp), false, "out");
+  ASSERT_EQ(match("in", 0, 0, &bcmp), false, "no direction known");
+  ASSERT_EQ(match("ether proto 0x0806", 0, 0, &arp), true, "ethertype");
+  ASSERT_EQ(match("ip6", 0, 0, &arp), false, "not IPv6");
+  ASSERT_EQ(match("ip6", 0, 0, &bcmp), true, "IPv6");
+  ASSERT_EQ(match("ip6 proto 58", 0, 0, &icmp), true, "next header");
+  ASSERT_EQ(match("icmp6", 0, 0, &icmp), true, "icmp6");
+  ASSERT_EQ(match("udp", 0, 0, &pub), true, "udp");
+  ASSERT_EQ(match("udp", 0, 0, &bcmp), false, "bcmp is not udp");
+  ASSERT_EQ(match("udp port 4321", 0, 0, &pub), true, "udp port");
+  ASSERT_EQ(match("udp port 4322", 0, 0, &pub), false, "other udp port");
+  ASSERT_EQ(match("bcmp", 0, 0, &bcmp), true, "bcmp");
+  ASSERT_EQ(match("bcmp type 0xa2", 0, 0, &bcmp), true, "bcmp type");
+  ASSERT_EQ(match("bcmp type 162", 0, 0, &bcmp), true, "decimal type");
+  ASSERT_EQ(match("bcmp type 0xa0-0xa7", 0, 0, &bcmp), true, "type range");
+  ASSERT_EQ(match("bcmp type 0xa3-0xa7", 0, 0, &bcmp), false,
+            "outside range");
+  ASSERT_EQ(match("topic sensor/", 0, 0, &pub), true, "topic prefix");
+  ASSERT_EQ(match("topic \"sensor/temp\"", 0, 0, &pub), true, "whole topic");
+  ASSERT_EQ(match("topic sensor/temperature", 0, 0, &pub), false,
+            "prefix longer than topic");
+  ASSERT_EQ(match("topic spotter", 0, 0, &pub), false, "other topic");
+  ASSERT_EQ(match("topic sensor", 0, 0, &bcmp), false, "topic needs udp");
+
+  // Truncated frames never read past their end.
+  Frame cut;
+  bcmp_frame(&cut, 0xa2);
+  cut.len = 55;
+  ASSERT_EQ(match("bcmp type 0xa2", 0, 0, &cut), false, "truncated bcmp");
+  pub_frame(&cut, "sensor/temp");
+  cut.len = 62 + 6 + 3;
+  ASSERT_EQ(match("topic sensor", 0, 0, &cut), false, "truncated topic");
+}
+
+static void test_logic(void) {
+  Frame bcmp;
+  bcmp_frame(&bcmp, 0xa2);
+  ASSERT_EQ(match("port 1 or port 2", 2, IN, &bcmp), true, "or");
+  ASSERT_EQ(match("port 1 || port 3", 2, IN, &bcmp), false, "|| neither");
+  ASSERT_EQ(match("port 2 and in", 2, IN, &bcmp), true, "and");
+  ASSERT_EQ(match("port 2 && out", 2, IN, &bcmp), false, "&& one false");
+  ASSERT_EQ(match("not port 2", 2, IN, &bcmp), false, "not");
+  ASSERT_EQ(match("!port 3", 2, IN, &bcmp), true, "!");
+  ASSERT_EQ(match("not not port 2", 2, IN, &bcmp), true, "double not");
+  // and binds tighter than or.
+  ASSERT_EQ(match("port 1 and in or bcmp", 2, OUT, &bcmp), true,
+            "precedence");
+  ASSERT_EQ(match("port 1 and (in or bcmp)", 2, OUT, &bcmp), false,
+            "parentheses");
+  ASSERT_EQ(match("not (port 1 or port 3) and bcmp type 0xa0-0xa7", 2, IN,
+                  &bcmp),
+            true, "de Morgan");
+  ASSERT_EQ(match("(udp or bcmp) and not (in and port 2)", 2, IN, &bcmp),
+            false, "nested");
+}
+
+static void test_program(void) {
+  CaptureFilter cf;
+  ASSERT_EQ(capture_filter_compile(&cf, "port 1 and in or bcmp", NULL, 0), 0,
+            "compile");
+  ASSERT_EQ(cf.num_insns, 3, "one test per primitive");
+  bool forward = true;
+  for (uint8_t i = 0; i < cf.num_insns; i++) {
+    const CaptureFilterInsn *insn = &cf.insns[i];
+    forward = forward && (insn->jt > i) && (insn->jf > i);
+  }
+  ASSERT_EQ(forward, true, "jumps only go forward");
+  ASSERT_EQ(cf.uses_port_dir, true, "port and direction tests reported");
+  capture_filter_compile(&cf, "not out", NULL, 0);
+  ASSERT_EQ(cf.uses_port_dir, true, "direction alone reported");
+  capture_filter_compile(&cf, "bcmp or udp port 2", NULL, 0);
+  ASSERT_EQ(cf.uses_port_dir, false, "udp port is not a BM port");
+
+  // Too many tests for the program.
+  char expr[2048] = "port 1";
+  for (int i = 0; i < CAPTURE_FILTER_MAX_INSNS; i++) {
+    strcat(expr, " or port 1");
+  }
+  char err[128];
+  ASSERT_EQ(capture_filter_compile(&cf, expr, err, sizeof(err)), -1,
+            "program too long");
+  ASSERT_EQ(cf.num_insns, 0, "failed filter left empty");
+}
+
+static void test_errors(void) {
+  static const char *const k_bad[] = {
+      "port",          "port 16",         "ether 0x86dd",
+      "bcmp type",     "bcmp type 5-2",   "bcmp type -1",
+      "topic",         "topic \"open",    "topic \"\"",
+      "(port 1",       "port 1)",         "port 1 and",
+      "or port 1",     "frobnicate",      "port 1 port 2",
+      "udp port 70000", "port 1 & port 2",
+  };
+  for (size_t i = 0; i < sizeof(k_bad) / sizeof(k_bad[0]); i++) {
+    CaptureFilter cf;
+    char err[128] = "";
+    const int rc = capture_filter_compile(&cf, k_bad[i], err, sizeof(err));
+    if (rc != -1 || err[0] == '\0') {
+      printf("  accepted: '%s'\n", k_bad[i]);
+    }
+    ASSERT_EQ(rc == -1 && err[0] != '\0', true, "syntax error reported");
+  }
+  CaptureFilter cf;
+  char err[128];
+  capture_filter_compile(&cf, "port 1 and frob", err, sizeof(err));
+  ASSERT_EQ(strstr(err, "frob") != NULL && strstr(err, "offset 11") != NULL,
+            true, "error names the word and where");
+}
+
+int main(void) {
+  printf("=== capture_filter ===\n");
+  test_primitives();
+  test_logic();
+  test_program();
+  test_errors();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/// @file test_completion.c
+/// @brief Unit tests for completions and the retrying request runner.
+
+#define _GNU_SOURCE
+#include "completion.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static CompletionWaiter g_waiter;
+
+typedef struct {
+  Completion *c;
+  uint32_t delay_ms;
+  int32_t status;
+} Signaller;
+
+static void *signal_later(void *arg) {
+  Signaller *s = (Signaller *)arg;
+  usleep(s->delay_ms * 1000);
+  completion_signal(s->c, s->status);
+  return NULL;
+}
+
+static void test_latch(void) {
+  Completion c;
+  completion_init(&c, &g_waiter);
+  ASSERT_EQ(completion_done(&c, NULL), false, "starts pending");
+  ASSERT_EQ(completion_signal(&c, 7), true, "first signal");
+  ASSERT_EQ(completion_signal(&c, 9), false, "second signal ignored");
+  int32_t status = 0;
+  ASSERT_EQ(completion_wait(&c, 0, &status), true, "signal before wait kept");
+  ASSERT_EQ(status, 7, "first status kept");
+  completion_reset(&c);
+  ASSERT_EQ(completion_done(&c, NULL), false, "reset clears");
+}
+
+static void test_wait_wakes_early(void) {
+  Completion c;
+  completion_init(&c, &g_waiter);
+  Signaller s = {&c, 20, 3};
+  pthread_t t;
+  pthread_create(&t, NULL, signal_later, &s);
+  uint64_t t0 = completion_now_ms();
+  int32_t status = 0;
+  ASSERT_EQ(completion_wait(&c, 5000, &status), true, "woken by signal");
+  ASSERT_EQ(completion_now_ms() - t0 < 1000, true, "well before timeout");
+  ASSERT_EQ(status, 3, "status passed through");
+  pthread_join(t, NULL);
+}
+
+static void test_wait_times_out(void) {
+  Completion c;
+  completion_init(&c, &g_waiter);
+  uint64_t t0 = completion_now_ms();
+  ASSERT_EQ(completion_wait(&c, 30, NULL), false, "times out");
+  ASSERT_EQ(completion_now_ms() - t0 >= 30, true, "waited the timeout");
+}
+
+// Fake service: answers attempt number @c answer_on (0: never), from
+// another thread, @c delay_ms after the send.
+typedef struct {
+  uint8_t answer_on;
+  uint32_t delay_ms;
+  uint8_t sends;
+  pthread_t thread;
+  Signaller sig;
+  bool started;
+} FakeService;
+
+static bool fake_send(CompletionRequest *req) {
+  FakeService *f = (FakeService *)req->ctx;
+  f->sends++;
+  if (f->sends == f->answer_on) {
+    f->sig.c = &req->done;
+    f->sig.delay_ms = f->delay_ms;
+    f->sig.status = 0;
+    pthread_create(&f->thread, NULL, signal_later, &f->sig);
+    f->started = true;
+  }
+  return true;
+}
+
+static void fake_join(FakeService *f) {
+  if (f->started) {
+    pthread_join(f->thread, NULL);
+  }
+}
+
+static int g_settled_ok;
+static int g_settled_failed;
+
+static void count_settled(CompletionRequest *req, bool ok, void *arg) {
+  (void)req;
+  (void)arg;
+  if (ok) {
+    g_settled_ok++;
+  } else {
+    g_settled_failed++;
+  }
+}
+
+static void test_retry_until_reply(void) {
+  FakeService f = {.answer_on = 3, .delay_ms = 5};
+  CompletionRequest req;
+  CompletionRetry retry = {5, 100};
+  completion_request_init(&req, &g_waiter, "fake", retry, fake_send, &f);
+  CompletionRequest *reqs[] = {&req};
+  g_settled_ok = g_settled_failed = 0;
+  size_t n = completion_request_run(reqs, 1, &g_waiter,
+                                    completion_now_ms() + 5000, count_settled,
+                                    NULL);
+  fake_join(&f);
+  ASSERT_EQ(n, 1, "request completed");
+  ASSERT_EQ(f.sends, 3, "resent until answered");
+  ASSERT_EQ(req.attempts, 3, "attempts counted");
+  ASSERT_EQ(g_settled_ok, 1, "settled callback ran once");
+}
+
+static void test_gives_up(void) {
+  FakeService f = {.answer_on = 0};
+  CompletionRequest req;
+  CompletionRetry retry = {3, 10};
+  completion_request_init(&req, &g_waiter, "silent", retry, fake_send, &f);
+  CompletionRequest *reqs[] = {&req};
+  g_settled_ok = g_settled_failed = 0;
+  uint64_t t0 = completion_now_ms();
+  size_t n = completion_request_run(reqs, 1, &g_waiter, t0 + 5000,
+                                    count_settled, NULL);
+  ASSERT_EQ(n, 0, "nothing completed");
+  ASSERT_EQ(f.sends, 3, "max attempts sent");
+  ASSERT_EQ(g_settled_failed, 1, "reported as given up");
+  ASSERT_EQ(req.settled_ms - t0 >= 30, true, "last attempt got its wait");
+}
+
+static void test_concurrent_with_deadline(void) {
+  // fast answers its first send, slow its second, silent never: all three
+  // run at once and the deadline cuts silent short of its attempts.
+  FakeService fast = {.answer_on = 1, .delay_ms = 5};
+  FakeService slow = {.answer_on = 2, .delay_ms = 5};
+  FakeService silent = {.answer_on = 0};
+  CompletionRequest a, b, c;
+  completion_request_init(&a, &g_waiter, "fast", (CompletionRetry){3, 500},
+                          fake_send, &fast);
+  completion_request_init(&b, &g_waiter, "slow", (CompletionRetry){3, 80},
+                          fake_send, &slow);
+  completion_request_init(&c, &g_waiter, "silent", (CompletionRetry){50, 40},
+                          fake_send, &silent);
+  CompletionRequest *reqs[] = {&a, &b, &c};
+  uint64_t t0 = completion_now_ms();
+  size_t n = completion_request_run(reqs, 3, &g_waiter, t0 + 200, NULL, NULL);
+  fake_join(&fast);
+  fake_join(&slow);
+  ASSERT_EQ(n, 2, "two completed");
+  ASSERT_EQ(a.settled_ms - t0 < 100, true, "fast not held by the others");
+  ASSERT_EQ(b.attempts, 2, "slow resent once");
+  ASSERT_EQ(c.settled, true, "silent settled");
+  ASSERT_EQ(c.settled_ms - t0 >= 200, true, "silent ran to the deadline");
+  ASSERT_EQ(silent.sends < 50, true, "deadline cut attempts short");
+}
+
+int main(void) {
+  printf("=== completion ===\n");
+  completion_waiter_init(&g_waiter);
+
+  test_latch();
+  test_wait_wakes_early();
+  test_wait_times_out();
+  test_retry_until_reply();
+  test_gives_up();
+  test_concurrent_with_deadline();
+
+  completion_waiter_destroy(&g_waiter);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+/// @file test_config_batch.c
+/// @brief Unit tests for all-or-nothing config batches.
+
+#include "config_batch.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// A partition with room for MAX_KEYS keys and ROOM value bytes in all,
+// which is what runs out part-way through a batch.
+#define MAX_KEYS 8
+#define MAX_VALUE 16
+#define ROOM 40
+
+typedef struct {
+  struct {
+    char key[16];
+    uint8_t val[MAX_VALUE];
+    size_t len;
+  } kv[MAX_KEYS];
+  size_t n;
+  size_t saves;
+  bool save_fails;
+  bool set_fails; ///< Every set fails, restores included.
+} Fake;
+
+static Fake g_fake;
+
+static int find(const Fake *f, const char *key, size_t key_len) {
+  for (size_t i = 0; i < f->n; i++) {
+    if (strlen(f->kv[i].key) == key_len &&
+        memcmp(f->kv[i].key, key, key_len) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static size_t used(const Fake *f) {
+  size_t total = 0;
+  for (size_t i = 0; i < f->n; i++) {
+    total += f->kv[i].len;
+  }
+  return total;
+}
+
+static bool fake_get(void *ctx, const char *key, size_t key_len, uint8_t *buf,
+                     size_t *len) {
+  const Fake *f = (const Fake *)ctx;
+  int i = find(f, key, key_len);
+  if (i < 0 || *len < f->kv[i].len) {
+    return false;
+  }
+  memcpy(buf, f->kv[i].val, f->kv[i].len);
+  *len = f->kv[i].len;
+  return true;
+}
+
+static bool fake_set(void *ctx, const char *key, size_t key_len,
+                     const uint8_t *buf, size_t len) {
+  Fake *f = (Fake *)ctx;
+  int i = find(f, key, key_len);
+  size_t old = i < 0 ? 0 : f->kv[i].len;
+  if (f->set_fails || len > MAX_VALUE || used(f) - old + len > ROOM ||
+      (i < 0 && f->n == MAX_KEYS)) {
+    return false;
+  }
+  if (i < 0) {
+    i = (int)f->n++;
+    memcpy(f->kv[i].key, key, key_len);
+    f->kv[i].key[key_len] = '\0';
+  }
+  memcpy(f->kv[i].val, buf, len);
+  f->kv[i].len = len;
+  return true;
+}
+
+static bool fake_remove(void *ctx, const char *key, size_t key_len) {
+  Fake *f = (Fake *)ctx;
+  int i = find(f, key, key_len);
+  if (i < 0) {
+    return false;
+  }
+  f->kv[i] = f->kv[--f->n];
+  return true;
+}
+
+static bool fake_save(void *ctx) {
+  Fake *f = (Fake *)ctx;
+  f->saves++;
+  return !f->save_fails;
+}
+
+static const ConfigBatchStore k_store = {
+    fake_get, fake_set, fake_remove, fake_save, &g_fake, MAX_VALUE,
+};
+
+typedef struct {
+  const char *key;
+  uint8_t fill;
+  size_t len;
+  bool breaks_store; ///< Fail, and fail every set after it.
+} Entry;
+
+static Entry g_entries[CONFIG_BATCH_MAX_ENTRIES + 1];
+static ConfigBatchKey g_keys[CONFIG_BATCH_MAX_ENTRIES + 1];
+
+static bool apply_entry(size_t n, void *arg) {
+  (void)arg;
+  if (g_entries[n].breaks_store) {
+    g_fake.set_fails = true;
+    return false;
+  }
+  uint8_t val[MAX_VALUE + 1];
+  memset(val, g_entries[n].fill, sizeof(val));
+  return fake_set(&g_fake, g_entries[n].key, strlen(g_entries[n].key), val,
+                  g_entries[n].len);
+}
+
+static int run(size_t count, size_t *failed) {
+  for (size_t n = 0; n < count; n++) {
+    g_keys[n].key = g_entries[n].key;
+    g_keys[n].key_len = strlen(g_entries[n].key);
+  }
+  return config_batch_apply(&k_store, g_keys, count, apply_entry, NULL,
+                            failed);
+}
+
+// Two keys already stored: "a" (8 bytes of 0x11) and "b" (8 of 0x22).
+static void reset(void) {
+  memset(&g_fake, 0, sizeof(g_fake));
+  uint8_t v[8];
+  memset(v, 0x11, sizeof(v));
+  fake_set(&g_fake, "a", 1, v, sizeof(v));
+  memset(v, 0x22, sizeof(v));
+  fake_set(&g_fake, "b", 1, v, sizeof(v));
+}
+
+static void test_applied(void) {
+  reset();
+  g_entries[0] = (Entry){"a", 0x33, 4, false};
+  g_entries[1] = (Entry){"c", 0x44, 10, false};
+  size_t failed = 99;
+  ASSERT_EQ(run(2, &failed), 0, "batch applied");
+  ASSERT_EQ(g_fake.saves, 1, "saved once");
+  ASSERT_EQ(failed, 99, "no failed entry");
+  ASSERT_EQ(g_fake.n, 3, "key added");
+  uint8_t buf[MAX_VALUE], want[MAX_VALUE];
+  size_t len = sizeof(buf);
+  fake_get(&g_fake, "a", 1, buf, &len);
+  memset(want, 0x33, sizeof(want));
+  ASSERT_EQ(len, 4, "a resized");
+  ASSERT_MEM_EQ(buf, want, 4, "a updated");
+}
+
+static void test_last_entry_fails(void) {
+  reset();
+  Fake before = g_fake;
+  // a grows, b shrinks, c and d are new; d no longer fits.
+  g_entries[0] = (Entry){"a", 0x33, 12, false};
+  g_entries[1] = (Entry){"b", 0x44, 2, false};
+  g_entries[2] = (Entry){"c", 0x55, 16, false};
+  g_entries[3] = (Entry){"d", 0x66, 16, false};
+  size_t failed = 99;
+  ASSERT_EQ(run(4, &failed), -ENOMEM, "batch refused");
+  ASSERT_EQ(failed, 3, "last entry named");
+  ASSERT_EQ(g_fake.saves, 0, "not saved");
+  ASSERT_EQ(g_fake.n, before.n, "added keys removed");
+  bool same = true;
+  for (size_t i = 0; i < before.n; i++) {
+    uint8_t buf[MAX_VALUE];
+    size_t len = sizeof(buf);
+    const char *k = before.kv[i].key;
+    same = same && fake_get(&g_fake, k, strlen(k), buf, &len) &&
+           len == before.kv[i].len &&
+           memcmp(buf, before.kv[i].val, len) == 0;
+  }
+  ASSERT_EQ(same, true, "changed keys restored");
+}
+
+static void test_first_entry_fails(void) {
+  reset();
+  g_entries[0] = (Entry){"a", 0x33, MAX_VALUE + 1, false};
+  g_entries[1] = (Entry){"c", 0x44, 2, false};
+  size_t failed = 99;
+  ASSERT_EQ(run(2, &failed), -ENOMEM, "refused");
+  ASSERT_EQ(failed, 0, "first entry named");
+  ASSERT_EQ(g_fake.n, 2, "later entry never applied");
+  ASSERT_EQ(g_fake.saves, 0, "not saved");
+}
+
+static void test_restore_fails(void) {
+  reset();
+  g_entries[0] = (Entry){"a", 0x33, 4, false};
+  g_entries[1] = (Entry){"c", 0x44, 2, true};
+  size_t failed = 99;
+  ASSERT_EQ(run(2, &failed), -EFAULT, "failed rollback reported");
+  ASSERT_EQ(failed, 1, "failing entry named");
+  ASSERT_EQ(g_fake.saves, 0, "not saved");
+}
+
+static void test_save_fails(void) {
+  reset();
+  g_fake.save_fails = true;
+  g_entries[0] = (Entry){"a", 0x33, 4, false};
+  size_t failed = 99;
+  ASSERT_EQ(run(1, &failed), -EIO, "save failure reported");
+  ASSERT_EQ(g_fake.saves, 1, "save attempted");
+}
+
+static void test_limits(void) {
+  reset();
+  size_t failed = 0;
+  ASSERT_EQ(run(0, &failed), -EINVAL, "empty batch");
+  for (size_t n = 0; n <= CONFIG_BATCH_MAX_ENTRIES; n++) {
+    g_entries[n] = (Entry){"a", 0x33, 1, false};
+  }
+  ASSERT_EQ(run(CONFIG_BATCH_MAX_ENTRIES + 1, &failed), -EINVAL,
+            "too many entries");
+  ASSERT_EQ(g_fake.saves, 0, "nothing saved");
+}
+
+int main(void) {
+  printf("=== config_batch ===\n");
+  test_applied();
+  test_last_entry_fails();
+  test_first_entry_fails();
+  test_restore_fails();
+  test_save_fails();
+  test_limits();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/// @file test_config_file.c
+/// @brief Unit tests for the whole-file config partition store and its
+/// mapped read cache.
+
+#define _GNU_SOURCE
+#include "config_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static char g_dir[64];
+static char g_path[128];
+
+static void test_missing_file(void) {
+  unlink(g_path);
+  uint8_t buf[16], zeros[16] = {0};
+  memset(buf, 0xaa, sizeof(buf));
+  ASSERT_EQ(config_file_read(g_path, 0, buf, sizeof(buf)), true,
+            "missing file read");
+  ASSERT_MEM_EQ(buf, zeros, sizeof(buf), "missing file reads zeros");
+
+  ConfigFileMap m;
+  ASSERT_EQ(config_file_map(&m, g_path), true, "map missing file");
+  memset(buf, 0xaa, sizeof(buf));
+  config_file_map_read(&m, 0, buf, sizeof(buf));
+  ASSERT_MEM_EQ(buf, zeros, sizeof(buf), "missing file maps as zeros");
+  config_file_unmap(&m);
+}
+
+static void test_write_keeps_tail(void) {
+  unlink(g_path);
+  uint8_t img[64], out[64];
+  for (size_t i = 0; i < sizeof(img); i++) {
+    img[i] = (uint8_t)i;
+  }
+  ASSERT_EQ(config_file_write(g_path, 0, img, sizeof(img)), true, "write");
+  uint8_t patch[4] = {0xde, 0xad, 0xbe, 0xef};
+  ASSERT_EQ(config_file_write(g_path, 8, patch, sizeof(patch)), true,
+            "partial write");
+  memcpy(img + 8, patch, sizeof(patch));
+  struct stat st;
+  stat(g_path, &st);
+  ASSERT_EQ(st.st_size, sizeof(img), "size kept");
+  config_file_read(g_path, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "tail kept");
+}
+
+static void test_map_tracks_writes(void) {
+  unlink(g_path);
+  uint8_t img[4096], out[4096];
+  for (size_t i = 0; i < sizeof(img); i++) {
+    img[i] = (uint8_t)(i * 3);
+  }
+  ConfigFileMap m;
+  config_file_map(&m, g_path);
+  ASSERT_EQ(config_file_map_write(&m, 0, img, sizeof(img)), true,
+            "mapped write creates file");
+  config_file_map_read(&m, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "mapping refreshed after write");
+
+  img[100] ^= 0xff;
+  config_file_map_write(&m, 100, img + 100, 1);
+  config_file_map_read(&m, 96, out, 8);
+  ASSERT_MEM_EQ(out, img + 96, 8, "one-byte write visible");
+  config_file_read(g_path, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "file matches mapping");
+
+  config_file_map_read(&m, sizeof(img) - 2, out, 4);
+  ASSERT_MEM_EQ(out, img + sizeof(img) - 2, 2, "read straddling end");
+  ASSERT_EQ(out[2] | out[3], 0, "past end reads zeros");
+  config_file_unmap(&m);
+
+  // A fresh mapping sees what the previous one wrote.
+  config_file_map(&m, g_path);
+  config_file_map_read(&m, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "remap after reopen");
+  config_file_unmap(&m);
+}
+
+int main(void) {
+  printf("=== config_file ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_config_file.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/config.sys.bin", g_dir);
+
+  test_missing_file();
+  test_write_keeps_tail();
+  test_map_tracks_writes();
+
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+/// @file test_config_journal.c
+/// @brief Unit tests for the journaled config partition store.
+
+#define _GNU_SOURCE
+#include "config_file.h"
+#include "config_journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define IMAGE_SIZE 4096
+
+static char g_dir[64];
+static char g_base[128];
+static char g_jnl[128];
+
+static void fresh_paths(void) {
+  unlink(g_base);
+  unlink(g_jnl);
+}
+
+static size_t file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static ConfigJournal *open_store(uint32_t window_ms, uint32_t compact) {
+  ConfigJournalCfg cfg = {window_ms, compact};
+  return config_journal_open(g_base, g_jnl, &cfg);
+}
+
+static void fill(uint8_t *buf, uint8_t seed) {
+  for (size_t i = 0; i < IMAGE_SIZE; i++) {
+    buf[i] = (uint8_t)(seed + i * 7);
+  }
+}
+
+static void test_roundtrip(void) {
+  fresh_paths();
+  uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  ConfigJournal *j = open_store(0, 0);
+  ASSERT_EQ(j != NULL, true, "open fresh store");
+  config_journal_read(j, 0, out, sizeof(out));
+  uint8_t zeros[IMAGE_SIZE] = {0};
+  ASSERT_MEM_EQ(out, zeros, sizeof(out), "fresh store reads zeros");
+
+  fill(img, 1);
+  ASSERT_EQ(config_journal_write(j, 0, img, sizeof(img)), true, "write");
+  config_journal_close(j);
+
+  j = open_store(0, 0);
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.replayed, 1, "record replayed on reopen");
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "image survives reopen");
+  config_journal_read(j, IMAGE_SIZE - 4, out, 8);
+  ASSERT_MEM_EQ(out, img + IMAGE_SIZE - 4, 4, "read straddling end");
+  ASSERT_MEM_EQ(out + 4, zeros, 4, "past end reads zeros");
+  config_journal_close(j);
+}
+
+static void test_only_changes_journaled(void) {
+  fresh_paths();
+  uint8_t img[IMAGE_SIZE];
+  fill(img, 2);
+  ConfigJournal *j = open_store(0, 0);
+  config_journal_write(j, 0, img, sizeof(img));
+  ConfigJournalStats before, after;
+  config_journal_get_stats(j, &before);
+
+  ASSERT_EQ(config_journal_write(j, 0, img, sizeof(img)), true,
+            "unchanged write");
+  config_journal_get_stats(j, &after);
+  ASSERT_EQ(after.records, before.records, "unchanged write appends nothing");
+  ASSERT_EQ(after.fsyncs, before.fsyncs, "unchanged write needs no fsync");
+
+  // Two bytes far apart: two segments of one byte each.
+  img[10] ^= 0xff;
+  img[3000] ^= 0xff;
+  size_t jsize = file_size(g_jnl);
+  config_journal_write(j, 0, img, sizeof(img));
+  ASSERT_EQ(file_size(g_jnl) - jsize, 16 + 2 * (8 + 1),
+            "record holds only changed bytes");
+  config_journal_close(j);
+
+  uint8_t out[IMAGE_SIZE];
+  j = open_store(0, 0);
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "sparse changes replayed");
+  config_journal_close(j);
+}
+
+static void test_torn_tail(void) {
+  fresh_paths();
+  uint8_t a[IMAGE_SIZE], b[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(a, 3);
+  memcpy(b, a, sizeof(b));
+  memset(b + 100, 0x5a, 200);
+  ConfigJournal *j = open_store(0, 0);
+  config_journal_write(j, 0, a, sizeof(a));
+  size_t good = file_size(g_jnl);
+  config_journal_write(j, 0, b, sizeof(b));
+  config_journal_close(j);
+
+  // Crash mid-append: the second record lost its last bytes.
+  ASSERT_EQ(truncate(g_jnl, (off_t)(file_size(g_jnl) - 5)), 0, "tear");
+  j = open_store(0, 0);
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.replayed, 1, "intact record replayed");
+  ASSERT_EQ(st.torn_bytes > 0, true, "torn tail counted");
+  ASSERT_EQ(file_size(g_jnl), good, "torn tail truncated");
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, a, sizeof(out), "torn save not applied");
+
+  // Appends after recovery land on a clean boundary.
+  config_journal_write(j, 0, b, sizeof(b));
+  config_journal_close(j);
+  j = open_store(0, 0);
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.torn_bytes, 0, "no tear after recovery");
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, b, sizeof(out), "save after recovery kept");
+  config_journal_close(j);
+}
+
+static void test_corrupt_record(void) {
+  fresh_paths();
+  uint8_t a[IMAGE_SIZE], b[IMAGE_SIZE], c[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(a, 4);
+  memcpy(b, a, sizeof(b));
+  b[5] ^= 1;
+  memcpy(c, b, sizeof(c));
+  c[6] ^= 1;
+  ConfigJournal *j = open_store(0, 0);
+  config_journal_write(j, 0, a, sizeof(a));
+  size_t good = file_size(g_jnl);
+  config_journal_write(j, 0, b, sizeof(b));
+  config_journal_write(j, 0, c, sizeof(c));
+  config_journal_close(j);
+
+  // Flip a payload byte of the second record: it and everything after it
+  // are dropped, since later records may depend on it.
+  FILE *f = fopen(g_jnl, "r+b");
+  fseek(f, (long)good + 20, SEEK_SET);
+  int ch = fgetc(f);
+  fseek(f, (long)good + 20, SEEK_SET);
+  fputc(ch ^ 0xff, f);
+  fclose(f);
+
+  j = open_store(0, 0);
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.replayed, 1, "replay stops at bad CRC");
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, a, sizeof(out), "image as of last good record");
+  config_journal_close(j);
+}
+
+static void test_compaction(void) {
+  fresh_paths();
+  uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(img, 5);
+  ConfigJournal *j = open_store(0, 256);
+  config_journal_write(j, 0, img, sizeof(img));
+  for (int i = 0; i < 40; i++) {
+    img[i * 13] ^= 0x33;
+    config_journal_write(j, 0, img, sizeof(img));
+  }
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.compactions > 1, true, "journal compacted");
+  ASSERT_EQ(file_size(g_jnl) < 256, true, "journal stays bounded");
+  ASSERT_EQ(file_size(g_base), IMAGE_SIZE, "base holds the image");
+  config_journal_close(j);
+
+  j = open_store(0, 256);
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "base + journal replay");
+  config_journal_close(j);
+
+  // Crash after the base was replaced but before the journal was cut:
+  // replaying records already in the base must be harmless.
+  j = open_store(0, 0);
+  img[1] ^= 0x44;
+  config_journal_write(j, 0, img, sizeof(img));
+  config_journal_close(j);
+  config_file_replace(g_base, img, sizeof(img));
+  j = open_store(0, 0);
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "interrupted compaction recovers");
+  config_journal_close(j);
+}
+
+static void test_group_commit(void) {
+  fresh_paths();
+  uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(img, 6);
+  ConfigJournal *j = open_store(50, 0);
+  int ok = 0;
+  for (int i = 0; i < 100; i++) {
+    img[i] ^= 0x11;
+    ok += config_journal_write(j, 0, img, sizeof(img));
+  }
+  ASSERT_EQ(ok, 100, "windowed writes");
+  ConfigJournalStats st;
+  config_journal_get_stats(j, &st);
+  ASSERT_EQ(st.records, 100, "every save journaled");
+  ASSERT_EQ(st.fsyncs < 10, true, "saves share fsyncs");
+  ASSERT_EQ(config_journal_sync(j), true, "explicit sync");
+  config_journal_close(j);
+
+  j = open_store(0, 0);
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "windowed saves persisted");
+  config_journal_close(j);
+}
+
+static void test_file_backend_interop(void) {
+  fresh_paths();
+  uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(img, 7);
+  ASSERT_EQ(config_file_write(g_base, 0, img, sizeof(img)), true,
+            "file backend write");
+  ConfigJournal *j = open_store(0, 0);
+  config_journal_read(j, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "journal reads file backend image");
+  img[9] = 0xee;
+  config_journal_write(j, 0, img, sizeof(img));
+  ASSERT_EQ(config_journal_compact(j), true, "compact on demand");
+  config_journal_close(j);
+
+  config_file_read(g_base, 0, out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, sizeof(out), "file backend reads compacted image");
+}
+
+int main(void) {
+  printf("=== config_journal ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_config_journal.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_base, sizeof(g_base), "%s/config.sys.bin", g_dir);
+  snprintf(g_jnl, sizeof(g_jnl), "%s/config.sys.jnl", g_dir);
+
+  test_roundtrip();
+  test_only_changes_journaled();
+  test_torn_tail();
+  test_corrupt_record();
+  test_compaction();
+  test_group_commit();
+  test_file_backend_interop();
+
+  fresh_paths();
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/// @file test_dfu_staging.c
+/// @brief Unit tests for the DFU staging file.
+
+#define _GNU_SOURCE
+#include "dfu_staging.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define IMAGE_SIZE 10000
+#define BUFFER 1024
+#define CHUNK 100
+
+static char g_dir[64];
+static char g_path[128];
+
+static size_t file_size(void) {
+  struct stat st;
+  return stat(g_path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static size_t read_file(uint8_t *buf, size_t len) {
+  int fd = open(g_path, O_RDONLY);
+  ssize_t n = fd >= 0 ? pread(fd, buf, len, 0) : -1;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return n > 0 ? (size_t)n : 0;
+}
+
+static void fill(uint8_t *buf, size_t len, uint8_t seed) {
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (uint8_t)(seed + i * 7 + (i >> 8));
+  }
+}
+
+static DfuStaging *open_staging(bool erase_fill) {
+  DfuStagingCfg cfg = {BUFFER, erase_fill};
+  return dfu_staging_open(g_path, &cfg);
+}
+
+static void test_write_behind(void) {
+  static uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(img, sizeof(img), 1);
+  DfuStaging *s = open_staging(false);
+  ASSERT_EQ(s != NULL, true, "open");
+
+  ASSERT_EQ(dfu_staging_write(s, 0, img, CHUNK), true, "first chunk");
+  ASSERT_EQ(file_size(), 0, "chunk held in the buffer");
+  for (uint32_t off = CHUNK; off < IMAGE_SIZE; off += CHUNK) {
+    dfu_staging_write(s, off, img + off, CHUNK);
+  }
+  DfuStagingStats st;
+  dfu_staging_get_stats(s, &st);
+  ASSERT_EQ(st.writes, IMAGE_SIZE / CHUNK, "writes counted");
+  ASSERT_EQ(st.pwrites, IMAGE_SIZE / BUFFER, "one pwrite per full buffer");
+  ASSERT_EQ(file_size(), IMAGE_SIZE / BUFFER * BUFFER,
+            "tail still buffered");
+  ASSERT_EQ(dfu_staging_flush(s), true, "flush");
+  ASSERT_EQ(file_size(), IMAGE_SIZE, "tail written by flush");
+  ASSERT_EQ(dfu_staging_close(s), true, "close");
+  ASSERT_EQ(read_file(out, sizeof(out)), IMAGE_SIZE, "read back");
+  ASSERT_MEM_EQ(out, img, IMAGE_SIZE, "image intact");
+}
+
+static void test_out_of_order(void) {
+  static uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE];
+  fill(img, sizeof(img), 2);
+  DfuStaging *s = open_staging(false);
+  // Starting mid-buffer: the first flush ends on a buffer boundary.
+  dfu_staging_write(s, 1000, img + 1000, 100);
+  DfuStagingStats st;
+  dfu_staging_get_stats(s, &st);
+  ASSERT_EQ(st.pwrites, 1, "flushed at the buffer boundary");
+  ASSERT_EQ(file_size(), BUFFER, "boundary reached");
+
+  // A write that does not follow on flushes what is buffered.
+  dfu_staging_write(s, 0, img, 1000);
+  dfu_staging_get_stats(s, &st);
+  ASSERT_EQ(st.pwrites, 2, "gap flushes");
+  // Rewriting a range already written: the last write wins.
+  uint8_t junk[50];
+  memset(junk, 0xaa, sizeof(junk));
+  dfu_staging_write(s, 500, junk, sizeof(junk));
+  dfu_staging_write(s, 500, img + 500, 50);
+  dfu_staging_write(s, 1100, img + 1100, IMAGE_SIZE - 1100);
+  ASSERT_EQ(dfu_staging_close(s), true, "close");
+  read_file(out, sizeof(out));
+  ASSERT_MEM_EQ(out, img, IMAGE_SIZE, "image intact after rewrites");
+}
+
+static void test_erase(bool erase_fill, const char *name) {
+  static uint8_t img[IMAGE_SIZE], out[IMAGE_SIZE], zeros[IMAGE_SIZE];
+  fill(img, sizeof(img), 3);
+  printf("  erase: %s\n", name);
+  DfuStaging *s = open_staging(erase_fill);
+
+  // Erasing past the end extends the file.
+  ASSERT_EQ(dfu_staging_erase(s, 0, IMAGE_SIZE), true, "erase empty file");
+  ASSERT_EQ(file_size(), IMAGE_SIZE, "erase extends");
+  read_file(out, sizeof(out));
+  ASSERT_MEM_EQ(out, zeros, IMAGE_SIZE, "erased reads zeros");
+
+  dfu_staging_write(s, 0, img, IMAGE_SIZE);
+  dfu_staging_flush(s);
+  ASSERT_EQ(dfu_staging_erase(s, 4096, 4096), true, "erase middle");
+  // Buffered bytes inside an erased range are zeroed too.
+  dfu_staging_write(s, 100, img, 50);
+  ASSERT_EQ(dfu_staging_erase(s, 100, 50), true, "erase buffered range");
+  ASSERT_EQ(dfu_staging_erase(s, IMAGE_SIZE - 10, 20), true,
+            "erase straddling end");
+  ASSERT_EQ(dfu_staging_erase(s, 0, 0), true, "empty erase");
+  DfuStagingStats st;
+  dfu_staging_get_stats(s, &st);
+  ASSERT_EQ(st.erases, 5, "erases counted");
+  if (erase_fill) {
+    ASSERT_EQ(st.zero_filled, IMAGE_SIZE + 4096 + 50 + 20, "all zero-filled");
+    ASSERT_EQ(st.erase_calls, 0, "no fallocate");
+  }
+  ASSERT_EQ(dfu_staging_close(s), true, "close");
+
+  ASSERT_EQ(file_size(), IMAGE_SIZE + 10, "size after erases");
+  read_file(out, sizeof(out));
+  memcpy(zeros, img, sizeof(zeros));
+  memset(zeros + 4096, 0, 4096);
+  memset(zeros + 100, 0, 50);
+  memset(zeros + IMAGE_SIZE - 10, 0, 10);
+  ASSERT_MEM_EQ(out, zeros, IMAGE_SIZE, "erased ranges zero, rest intact");
+  memset(zeros, 0, sizeof(zeros));
+}
+
+static void test_sticky_error(void) {
+  // Every write to /dev/full fails with ENOSPC.
+  DfuStagingCfg cfg = {BUFFER, false};
+  DfuStaging *s = dfu_staging_open("/dev/full", &cfg);
+  if (!s) {
+    printf("  skipped: /dev/full not available\n");
+    return;
+  }
+  uint8_t chunk[CHUNK] = {1};
+  ASSERT_EQ(dfu_staging_write(s, 0, chunk, sizeof(chunk)), true,
+            "buffered write succeeds");
+  ASSERT_EQ(dfu_staging_flush(s), false, "deferred error reported");
+  ASSERT_EQ(dfu_staging_write(s, CHUNK, chunk, sizeof(chunk)), false,
+            "error is sticky");
+  ASSERT_EQ(dfu_staging_close(s), false, "close reports it");
+}
+
+int main(void) {
+  printf("=== dfu_staging ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_dfu_staging.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/bm_sbc.staging", g_dir);
+
+  test_write_behind();
+  test_out_of_order();
+  test_erase(false, "fallocate");
+  test_erase(true, "zero-fill");
+  test_sticky_error();
+
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/// @file test_dfu_validate.c
+/// @brief Unit tests for the streaming DFU image checks.
+
+#include "crc32c.h"
+#include "dfu_validate.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define MARKER "BM_SBC_IMAGE:gateway"
+#define MACHINE 0x00B7u
+#define IMAGE_SIZE 4096
+
+static uint8_t g_img[IMAGE_SIZE];
+
+/// An ELF image for @p machine with the marker at @p marker_at (or none).
+static void make_image(uint16_t machine, long marker_at) {
+  for (size_t i = 0; i < IMAGE_SIZE; i++) {
+    g_img[i] = (uint8_t)(i * 13 + 5);
+  }
+  memcpy(g_img, "\x7f" "ELF", 4);
+  g_img[18] = (uint8_t)machine;
+  g_img[19] = (uint8_t)(machine >> 8);
+  if (marker_at >= 0) {
+    memcpy(g_img + marker_at, MARKER, strlen(MARKER));
+  }
+}
+
+/// Feed the image in @p chunk sized writes; true if every write was taken
+/// and the image passes.
+static bool feed(DfuValidator *v, size_t chunk) {
+  dfu_validate_init(v, MARKER, MACHINE);
+  for (size_t off = 0; off < IMAGE_SIZE; off += chunk) {
+    size_t n = IMAGE_SIZE - off < chunk ? IMAGE_SIZE - off : chunk;
+    if (!dfu_validate_update(v, (uint32_t)off, g_img + off, n)) {
+      return false;
+    }
+  }
+  char err[128];
+  return dfu_validate_finish(v, err, sizeof(err));
+}
+
+static void test_valid_image(void) {
+  DfuValidator v;
+  make_image(MACHINE, 2000);
+  ASSERT_EQ(feed(&v, 512), true, "valid image");
+  ASSERT_EQ(v.len, IMAGE_SIZE, "all bytes checked");
+  ASSERT_EQ(dfu_validate_crc(&v), crc32c(g_img, IMAGE_SIZE),
+            "running CRC matches one-shot CRC");
+  ASSERT_EQ(feed(&v, 1), true, "one byte per write");
+  ASSERT_EQ(dfu_validate_crc(&v), crc32c(g_img, IMAGE_SIZE),
+            "CRC independent of chunking");
+}
+
+static void test_split_marker(void) {
+  // The marker straddles a chunk boundary at every possible split.
+  const size_t m = strlen(MARKER);
+  bool all = true;
+  for (size_t chunk = 1; chunk <= m + 2; chunk++) {
+    for (size_t split = 1; split < m; split++) {
+      make_image(MACHINE, (long)(chunk * 40 - split));
+      DfuValidator v;
+      if (!feed(&v, chunk)) {
+        printf("  missed marker: chunk %zu split %zu\n", chunk, split);
+        all = false;
+      }
+    }
+  }
+  ASSERT_EQ(all, true, "marker found across chunk boundaries");
+
+  // A near miss split across chunks is not a match.
+  make_image(MACHINE, -1);
+  memcpy(g_img + 1020, MARKER, m - 1);
+  DfuValidator v;
+  ASSERT_EQ(feed(&v, 1024), false, "partial marker not found");
+  char err[128];
+  dfu_validate_finish(&v, err, sizeof(err));
+  ASSERT_EQ(strstr(err, "not found") != NULL, true, "missing marker named");
+}
+
+static void test_early_reject(void) {
+  DfuValidator v;
+  make_image(MACHINE, 2000);
+  g_img[1] = 'X';
+  dfu_validate_init(&v, MARKER, MACHINE);
+  ASSERT_EQ(dfu_validate_update(&v, 0, g_img, 4), false,
+            "bad magic rejected on the first chunk");
+  ASSERT_EQ(dfu_validate_update(&v, 4, g_img + 4, 512), false,
+            "stays rejected");
+
+  make_image(0x003e, 2000); // x86-64
+  dfu_validate_init(&v, MARKER, MACHINE);
+  ASSERT_EQ(dfu_validate_update(&v, 0, g_img, 10), true,
+            "machine not known yet");
+  ASSERT_EQ(dfu_validate_update(&v, 10, g_img + 10, 10), false,
+            "wrong machine rejected once the header is in");
+  char err[128];
+  ASSERT_EQ(dfu_validate_finish(&v, err, sizeof(err)), false, "not valid");
+  ASSERT_EQ(strstr(err, "0x003e") != NULL, true, "machine reported");
+
+  make_image(MACHINE, 2000);
+  dfu_validate_init(&v, MARKER, MACHINE);
+  dfu_validate_update(&v, 0, g_img, 12);
+  ASSERT_EQ(dfu_validate_finish(&v, err, sizeof(err)), false,
+            "truncated image");
+}
+
+static void test_out_of_order(void) {
+  make_image(MACHINE, 2000);
+  DfuValidator v;
+  // Erasing ahead of the data, as the DFU client does first, is in order.
+  dfu_validate_init(&v, MARKER, MACHINE);
+  dfu_validate_erase(&v, 0, IMAGE_SIZE);
+  dfu_validate_update(&v, 0, g_img, 1024);
+  ASSERT_EQ(v.in_order, true, "erase ahead keeps order");
+  dfu_validate_erase(&v, 512, 512);
+  ASSERT_EQ(v.in_order, false, "erase over checked bytes");
+
+  dfu_validate_init(&v, MARKER, MACHINE);
+  dfu_validate_update(&v, 0, g_img, 1024);
+  dfu_validate_update(&v, 512, g_img + 512, 1024);
+  ASSERT_EQ(v.in_order, false, "rewrite");
+
+  dfu_validate_init(&v, MARKER, MACHINE);
+  dfu_validate_update(&v, 1024, g_img + 1024, 1024);
+  ASSERT_EQ(v.in_order, false, "gap");
+  char err[128];
+  ASSERT_EQ(dfu_validate_finish(&v, err, sizeof(err)), false,
+            "no verdict without the bytes in order");
+}
+
+int main(void) {
+  printf("=== dfu_validate ===\n");
+  test_valid_image();
+  test_split_marker();
+  test_early_reject();
+  test_out_of_order();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
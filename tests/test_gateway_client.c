@@ -0,0 +1,424 @@
+/// @file test_gateway_client.c
+/// @brief Unit tests for the native gateway IPC client library.
+
+#define _GNU_SOURCE
+#include "bm_sbc_gateway_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, len, msg)                                          \
+  do {                                                                         \
+    if (memcmp((a), (b), (len)) != 0) {                                        \
+      printf("  FAIL: %s (memory mismatch)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// ---- Encoder ----------------------------------------------------------------
+
+static void test_encode_replay_caught_up(void) {
+  static const uint8_t expected[] = {
+      0xa2, 0x61, 'v', 0x01, 0x64, 't', 'y', 'p', 'e', 0x70, 'r', 'e',
+      'p',  'l',  'a', 'y',  '_',  'c', 'a', 'u', 'g', 'h',  't', '_',
+      'u',  'p'};
+  uint8_t buf[64];
+  size_t n = gateway_client_encode_replay_caught_up(buf, sizeof(buf), 0);
+  ASSERT_EQ(n, sizeof(expected), "replay_caught_up length");
+  ASSERT_MEM_EQ(buf, expected, sizeof(expected), "replay_caught_up bytes");
+
+  // req_id adds a third pair: "req_id": 300 (0x19 0x01 0x2c).
+  static const uint8_t req_tail[] = {0x66, 'r', 'e',  'q', '_',
+                                     'i',  'd', 0x19, 0x01, 0x2c};
+  n = gateway_client_encode_replay_caught_up(buf, sizeof(buf), 300);
+  ASSERT_EQ(buf[0], 0xa3, "req_id bumps map length");
+  ASSERT_EQ(n, sizeof(expected) + sizeof(req_tail), "req_id length");
+  ASSERT_MEM_EQ(buf + sizeof(expected), req_tail, sizeof(req_tail),
+                "req_id bytes");
+}
+
+static void test_encode_config_values(void) {
+  uint8_t buf[64];
+  size_t n = gateway_client_encode_config_set_int(buf, sizeof(buf), 0, "k", -7);
+  ASSERT_EQ(n > 0, 1, "config_set int encodes");
+  ASSERT_EQ(buf[n - 1], 0x26, "negative int is major 1");
+
+  n = gateway_client_encode_config_set_uint(buf, sizeof(buf), 0, "k", 115200);
+  static const uint8_t u32[] = {0x1a, 0x00, 0x01, 0xc2, 0x00};
+  ASSERT_MEM_EQ(buf + n - sizeof(u32), u32, sizeof(u32), "uint32 value");
+
+  n = gateway_client_encode_config_set_float(buf, sizeof(buf), 0, "k", 2.5f);
+  static const uint8_t f32[] = {0xfa, 0x40, 0x20, 0x00, 0x00};
+  ASSERT_MEM_EQ(buf + n - sizeof(f32), f32, sizeof(f32), "float32 value");
+
+  n = gateway_client_encode_config_set_str(buf, sizeof(buf), 0, "k", "ab");
+  static const uint8_t str[] = {0x62, 'a', 'b'};
+  ASSERT_MEM_EQ(buf + n - sizeof(str), str, sizeof(str), "text value");
+}
+
+static void test_encode_config_batch(void) {
+  GatewayClientConfigEntry entries[2] = {
+      {.key = "a", .type = GATEWAY_CLIENT_CONFIG_UINT, .value.u = 300},
+      {.key = "b", .type = GATEWAY_CLIENT_CONFIG_STR, .value.str = "xy"},
+  };
+  // ... "entries": {"a": 300, "b": "xy"}
+  static const uint8_t tail[] = {0x67, 'e', 'n',  't',  'r',  'i', 'e',
+                                 's',  0xa2, 0x61, 'a',  0x19, 0x01, 0x2c,
+                                 0x61, 'b',  0x62, 'x',  'y'};
+  uint8_t buf[64];
+  size_t n = gateway_client_encode_config_set_batch(buf, sizeof(buf), 0,
+                                                    entries, 2);
+  ASSERT_EQ(n > sizeof(tail), 1, "config_set_batch encodes");
+  ASSERT_EQ(buf[0], 0xa3, "config_set_batch has one field");
+  ASSERT_MEM_EQ(buf + n - sizeof(tail), tail, sizeof(tail),
+                "config_set_batch entries map");
+  ASSERT_EQ(gateway_client_encode_config_set_batch(buf, 20, 0, entries, 2), 0,
+            "config_set_batch overflow rejected");
+}
+
+static void test_encode_overflow(void) {
+  uint8_t data[300];
+  memset(data, 0x5a, sizeof(data));
+  uint8_t buf[GATEWAY_CLIENT_MAX_DGRAM];
+  size_t full = gateway_client_encode_sensor_data(buf, sizeof(buf), 0, "t",
+                                                  data, sizeof(data));
+  ASSERT_EQ(full > sizeof(data), 1, "sensor_data encodes");
+  for (size_t cap = 0; cap < full; cap += 37) {
+    ASSERT_EQ(gateway_client_encode_sensor_data(buf, cap, 0, "t", data,
+                                                sizeof(data)),
+              0, "short buffer rejected");
+  }
+  ASSERT_EQ(gateway_client_encode_sensor_data(buf, full, 0, "t", data,
+                                              sizeof(data)),
+            full, "exact-fit buffer accepted");
+}
+
+static void test_decode_ack(void) {
+  // {"v":1,"type":"ack","req_id":7,"status":22,"credits":9}
+  static const uint8_t ack[] = {
+      0xa5, 0x61, 'v', 0x01, 0x64, 't', 'y', 'p', 'e', 0x63, 'a', 'c', 'k',
+      0x66, 'r',  'e', 'q',  '_',  'i', 'd', 0x07, 0x66, 's', 't', 'a', 't',
+      'u',  's',  0x16, 0x67, 'c', 'r', 'e', 'd', 'i', 't', 's', 0x09};
+  GatewayClientAck out;
+  ASSERT_EQ(gateway_client_decode_ack(ack, sizeof(ack), &out), 0,
+            "decode ack");
+  ASSERT_EQ(out.req_id, 7, "ack req_id");
+  ASSERT_EQ(out.status, 22, "ack status");
+  ASSERT_EQ(out.credits, 9, "ack credits");
+
+  for (size_t len = 0; len < sizeof(ack); len++) {
+    if (gateway_client_decode_ack(ack, len, &out) == 0) {
+      printf("  FAIL: truncated ack (%zu bytes) accepted\n", len);
+      g_fail++;
+      return;
+    }
+  }
+  g_pass++;
+
+  uint8_t push[64];
+  size_t n = gateway_client_encode_replay_caught_up(push, sizeof(push), 7);
+  ASSERT_EQ(gateway_client_decode_ack(push, n, &out), -1,
+            "non-ack message rejected");
+}
+
+static void test_stats(void) {
+  // {"v":1,"type":"stats","reset":true}
+  static const uint8_t req[] = {0xa3, 0x61, 'v', 0x01, 0x64, 't', 'y',
+                                'p',  'e',  0x65, 's', 't',  'a', 't',
+                                's',  0x65, 'r',  'e', 's',  'e', 't',
+                                0xf5};
+  uint8_t buf[64];
+  size_t n = gateway_client_encode_stats(buf, sizeof(buf), 0, true);
+  ASSERT_EQ(n, sizeof(req), "stats request length");
+  ASSERT_MEM_EQ(buf, req, sizeof(req), "stats request bytes");
+
+  // {"type":"stats","published":300,"dispatch_ns_hist":[0,5,1],
+  //  "rx_datagrams":2}
+  static const uint8_t reply[] = {
+      0xa4, 0x64, 't',  'y',  'p',  'e',  0x65, 's', 't', 'a', 't', 's',
+      0x69, 'p',  'u',  'b',  'l',  'i',  's',  'h', 'e', 'd', 0x19, 0x01,
+      0x2c, 0x70, 'd',  'i',  's',  'p',  'a',  't', 'c', 'h', '_', 'n',
+      's',  '_',  'h',  'i',  's',  't',  0x83, 0x00, 0x05, 0x01, 0x6c, 'r',
+      'x',  '_',  'd',  'a',  't',  'a',  'g',  'r', 'a', 'm', 's', 0x02};
+  GatewayClientStats st;
+  ASSERT_EQ(gateway_client_decode_stats(reply, sizeof(reply), &st), 0,
+            "decode stats");
+  ASSERT_EQ(st.published, 300, "stats published");
+  ASSERT_EQ(st.rx_datagrams, 2, "stats rx_datagrams");
+  ASSERT_EQ(st.rx_batches, 0, "absent counter is zero");
+  ASSERT_EQ(st.dispatch_ns_hist[1], 5, "stats histogram bucket");
+  ASSERT_EQ(st.dispatch_ns_hist[3], 0, "short histogram zero-filled");
+
+  for (size_t len = 0; len < sizeof(reply); len++) {
+    if (gateway_client_decode_stats(reply, len, &st) == 0) {
+      printf("  FAIL: truncated stats (%zu bytes) accepted\n", len);
+      g_fail++;
+      return;
+    }
+  }
+  g_pass++;
+  n = gateway_client_encode_replay_caught_up(buf, sizeof(buf), 0);
+  ASSERT_EQ(gateway_client_decode_stats(buf, n, &st), -1,
+            "non-stats message rejected");
+}
+
+// ---- Socket round trip ------------------------------------------------------
+
+static char g_dir[] = "/tmp/test_gateway_client_XXXXXX";
+static char g_path[108];
+
+static int bind_server(void) {
+  snprintf(g_path, sizeof(g_path), "%s/gw.sock", g_dir);
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, g_path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void test_batch_and_ack(void) {
+  int srv = bind_server();
+  ASSERT_EQ(srv >= 0, 1, "bind fake gateway");
+  if (srv < 0) {
+    return;
+  }
+  GatewayClient c;
+  ASSERT_EQ(gateway_client_open(&c, g_path), 0, "client open");
+
+  uint8_t bufs[3][64];
+  GatewayClientMsg msgs[3];
+  for (int i = 0; i < 3; i++) {
+    uint8_t d = (uint8_t)i;
+    msgs[i].buf = bufs[i];
+    msgs[i].len = gateway_client_encode_sensor_data(
+        bufs[i], sizeof(bufs[i]), gateway_client_next_req_id(&c), "t", &d, 1);
+  }
+  ASSERT_EQ(gateway_client_send_batch(&c, msgs, 3), 3, "batch sent");
+
+  struct sockaddr_un from;
+  socklen_t from_len = 0;
+  uint8_t rx[128];
+  for (int i = 0; i < 3; i++) {
+    from_len = sizeof(from);
+    ssize_t n = recvfrom(srv, rx, sizeof(rx), 0, (struct sockaddr *)&from,
+                         &from_len);
+    ASSERT_EQ((size_t)n, msgs[i].len, "batch datagram length");
+    ASSERT_MEM_EQ(rx, msgs[i].buf, msgs[i].len, "batch datagram bytes");
+  }
+  ASSERT_EQ(from_len > sizeof(sa_family_t), 1, "client is autobound");
+
+  // A push first, then the ack: recv_ack must skip the push.
+  uint8_t push[64];
+  size_t push_len = gateway_client_encode_replay_caught_up(push, sizeof(push),
+                                                           0);
+  sendto(srv, push, push_len, 0, (struct sockaddr *)&from, from_len);
+  static const uint8_t ack[] = {
+      0xa4, 0x64, 't', 'y', 'p', 'e', 0x63, 'a', 'c', 'k', 0x66, 'r',
+      'e',  'q',  '_', 'i', 'd', 0x03, 0x66, 's', 't', 'a', 't', 'u',
+      's',  0x00, 0x67, 'c', 'r', 'e', 'd', 'i', 't', 's', 0x0a};
+  sendto(srv, ack, sizeof(ack), 0, (struct sockaddr *)&from, from_len);
+
+  GatewayClientAck got;
+  ASSERT_EQ(gateway_client_recv_ack(&c, &got, 1000), 0, "recv ack");
+  ASSERT_EQ(got.req_id, 3, "recv ack req_id");
+  ASSERT_EQ(got.status, 0, "recv ack status");
+  ASSERT_EQ(c.credits, 10, "credits tracked");
+  ASSERT_EQ(gateway_client_recv_ack(&c, &got, 10), -1, "recv ack timeout");
+
+  gateway_client_close(&c);
+  close(srv);
+  unlink(g_path);
+}
+
+// Fake gateway side of shm_register: take the datagram and its
+// descriptors, then ack req_id 1 with @p status.
+typedef struct {
+  int srv;
+  uint8_t status;
+  bool got_fds;
+  int fds[2];
+} ShmGateway;
+
+static void *shm_gateway(void *arg) {
+  ShmGateway *g = (ShmGateway *)arg;
+  uint8_t rx[128];
+  union {
+    struct cmsghdr align;
+    uint8_t bytes[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  struct iovec iov = {rx, sizeof(rx)};
+  struct sockaddr_un from;
+  struct msghdr msg = {0};
+  msg.msg_name = &from;
+  msg.msg_namelen = sizeof(from);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.bytes;
+  msg.msg_controllen = sizeof(control.bytes);
+  if (recvmsg(g->srv, &msg, 0) <= 0) {
+    return NULL;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  g->got_fds = cmsg != NULL && cmsg->cmsg_type == SCM_RIGHTS;
+  if (g->got_fds) {
+    memcpy(g->fds, CMSG_DATA(cmsg), sizeof(g->fds));
+  }
+  // {"type":"ack","req_id":1,"status":<status>,"credits":10}
+  const uint8_t ack[] = {
+      0xa4, 0x64, 't', 'y', 'p', 'e', 0x63, 'a', 'c', 'k', 0x66, 'r',
+      'e',  'q',  '_', 'i', 'd', 0x01, 0x66, 's', 't', 'a', 't', 'u',
+      's',  g->status, 0x67, 'c', 'r', 'e', 'd', 'i', 't', 's', 0x0a};
+  sendto(g->srv, ack, sizeof(ack), 0, (struct sockaddr *)&from,
+         msg.msg_namelen);
+  return NULL;
+}
+
+static void test_shm_refused(void) {
+  ShmGateway g = {.srv = bind_server(), .status = EPERM};
+  GatewayClient c;
+  gateway_client_open(&c, g_path);
+  pthread_t th;
+  pthread_create(&th, NULL, shm_gateway, &g);
+  GatewayClientShm shm;
+  errno = 0;
+  ASSERT_EQ(gateway_client_shm_open(&c, &shm, "test", SHM_RING_MIN_CAPACITY,
+                                    1000),
+            -1, "refused shm open fails");
+  ASSERT_EQ(errno, EPERM, "ack status returned");
+  ASSERT_EQ(shm.map == NULL && shm.doorbell_fd < 0, 1, "ring released");
+  pthread_join(th, NULL);
+  if (g.got_fds) {
+    close(g.fds[0]);
+    close(g.fds[1]);
+  }
+
+  // No gateway answer at all.
+  errno = 0;
+  ASSERT_EQ(gateway_client_shm_open(&c, &shm, "test", SHM_RING_MIN_CAPACITY,
+                                    50),
+            -1, "unanswered shm open fails");
+  ASSERT_EQ(errno, ETIMEDOUT, "timeout reported");
+  gateway_client_close(&c);
+  close(g.srv);
+  unlink(g_path);
+}
+
+static void test_shm_producer(void) {
+  ShmGateway g = {.srv = bind_server()};
+  int srv = g.srv;
+  if (srv < 0) {
+    printf("  FAIL: bind fake gateway\n");
+    g_fail++;
+    return;
+  }
+  GatewayClient c;
+  gateway_client_open(&c, g_path);
+  pthread_t th;
+  pthread_create(&th, NULL, shm_gateway, &g);
+  GatewayClientShm shm;
+  ASSERT_EQ(gateway_client_shm_open(&c, &shm, "test", SHM_RING_MIN_CAPACITY,
+                                    1000),
+            0, "shm open");
+  pthread_join(th, NULL);
+
+  // The registration carried its two descriptors.
+  uint8_t rx[128];
+  ASSERT_EQ(g.got_fds, true, "shm_register carries fds");
+  if (!g.got_fds) {
+    gateway_client_shm_close(NULL, &shm);
+    gateway_client_close(&c);
+    close(srv);
+    return;
+  }
+  int fds[2];
+  memcpy(fds, g.fds, sizeof(fds));
+  ASSERT_EQ(fcntl(fds[0], F_GET_SEALS) & F_SEAL_SHRINK, F_SEAL_SHRINK,
+            "memfd sealed against shrinking");
+
+  struct stat st;
+  fstat(fds[0], &st);
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fds[0], 0);
+  ShmRing cons;
+  ASSERT_EQ(shm_ring_attach(&cons, map, (size_t)st.st_size), 0,
+            "gateway side attaches");
+
+  const uint8_t data[] = {1, 2, 3};
+  ASSERT_EQ(gateway_client_shm_sensor_data(&shm, "temp", data, sizeof(data)),
+            0, "shm record queued");
+  gateway_client_shm_kick(&shm);
+  uint64_t doorbell = 0;
+  ASSERT_EQ(read(fds[1], &doorbell, sizeof(doorbell)), sizeof(doorbell),
+            "doorbell rang");
+
+  size_t len = 0;
+  const uint8_t *rec = shm_ring_peek(&cons, &len, NULL);
+  static const uint8_t expected[] = {4, 0, 't', 'e', 'm', 'p', 1, 2, 3};
+  ASSERT_EQ(len, sizeof(expected), "shm record length");
+  if (rec) {
+    ASSERT_MEM_EQ(rec, expected, sizeof(expected), "shm record bytes");
+  }
+
+  gateway_client_shm_close(&c, &shm);
+  ASSERT_EQ(recv(srv, rx, sizeof(rx), 0) > 0, 1, "shm_unregister sent");
+
+  munmap(map, (size_t)st.st_size);
+  close(fds[0]);
+  close(fds[1]);
+  gateway_client_close(&c);
+  close(srv);
+  unlink(g_path);
+}
+
+// ---- Main -----------------------------------------------------------------
+
+int main(void) {
+  printf("=== gateway_client ===\n");
+  test_encode_replay_caught_up();
+  test_encode_config_values();
+  test_encode_config_batch();
+  test_encode_overflow();
+  test_decode_ack();
+  test_stats();
+
+  if (!mkdtemp(g_dir)) {
+    printf("  FAIL: mkdtemp\n");
+    return 1;
+  }
+  test_batch_and_ack();
+  test_shm_producer();
+  test_shm_refused();
+  rmdir(g_dir);
+
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+/// @file test_ipc_peer.c
+/// @brief Unit tests for resolving a subscriber's reply path from the
+///        datagram's sender.
+
+#define _GNU_SOURCE
+#include "ipc_peer.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static char g_dir[64];
+static char g_gw_path[100];
+static char g_own_path[100];
+static char g_other_path[100];
+static int g_gw = -1;
+
+static int bound_socket(const char *path) {
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// Send one datagram from @p fd to the fake gateway and receive it there,
+/// returning the sender address the kernel reports.
+static socklen_t send_and_recv(int fd, struct sockaddr_un *from) {
+  struct sockaddr_un gw = {.sun_family = AF_UNIX};
+  snprintf(gw.sun_path, sizeof(gw.sun_path), "%s", g_gw_path);
+  uint8_t b = 1;
+  if (sendto(fd, &b, 1, 0, (struct sockaddr *)&gw, sizeof(gw)) != 1) {
+    return 0;
+  }
+  socklen_t len = sizeof(*from);
+  memset(from, 0, sizeof(*from));
+  if (recvfrom(g_gw, &b, 1, 0, (struct sockaddr *)from, &len) != 1) {
+    return 0;
+  }
+  return len;
+}
+
+static void test_own_path(void) {
+  int fd = bound_socket(g_own_path);
+  struct sockaddr_un from;
+  socklen_t len = send_and_recv(fd, &from);
+  char out[sizeof(from.sun_path)];
+  ASSERT_EQ(ipc_peer_is_bound(len), true, "bound sender");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, NULL, out, sizeof(out)), 0,
+            "no reply_path: sender's path used");
+  ASSERT_EQ(strcmp(out, g_own_path), 0, "sender's path");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, g_own_path, out, sizeof(out)), 0,
+            "reply_path naming the sender's own socket");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, g_own_path, out, 8), -EINVAL,
+            "path longer than the buffer");
+  close(fd);
+}
+
+static void test_path_not_owned(void) {
+  // Another client's socket exists at g_other_path; this one tries to
+  // subscribe (or unsubscribe) it.
+  int other = bound_socket(g_other_path);
+  int fd = bound_socket(g_own_path);
+  struct sockaddr_un from;
+  socklen_t len = send_and_recv(fd, &from);
+  char out[sizeof(from.sun_path)];
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, g_other_path, out, sizeof(out)),
+            -EPERM, "another client's socket refused");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, "/dev/log", out, sizeof(out)),
+            -EPERM, "a system socket refused");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, g_gw_path, out, sizeof(out)),
+            -EPERM, "the gateway's own socket refused");
+  close(fd);
+  close(other);
+}
+
+static void test_unbound_and_abstract(void) {
+  char out[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  struct sockaddr_un from;
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  socklen_t len = send_and_recv(fd, &from);
+  ASSERT_EQ(ipc_peer_is_bound(len), false, "unbound sender");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, g_other_path, out, sizeof(out)),
+            -EINVAL, "unbound sender refused");
+  close(fd);
+
+  // Autobind, as the C and Python clients do for acks.
+  fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  struct sockaddr_un self = {.sun_family = AF_UNIX};
+  bind(fd, (struct sockaddr *)&self, sizeof(sa_family_t));
+  len = send_and_recv(fd, &from);
+  ASSERT_EQ(ipc_peer_is_bound(len), true, "autobound sender");
+  ASSERT_EQ(ipc_peer_reply_path(&from, len, NULL, out, sizeof(out)), -EINVAL,
+            "abstract sender refused");
+  close(fd);
+}
+
+int main(void) {
+  printf("=== ipc_peer ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_ipc_peer.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_gw_path, sizeof(g_gw_path), "%s/gw.sock", g_dir);
+  snprintf(g_own_path, sizeof(g_own_path), "%s/own.sock", g_dir);
+  snprintf(g_other_path, sizeof(g_other_path), "%s/other.sock", g_dir);
+  g_gw = bound_socket(g_gw_path);
+  if (g_gw < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  test_own_path();
+  unlink(g_own_path);
+  test_path_not_owned();
+  test_unbound_and_abstract();
+
+  close(g_gw);
+  unlink(g_gw_path);
+  unlink(g_own_path);
+  unlink(g_other_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/// @file test_ipc_ratelimit.c
+/// @brief Unit tests for the IPC per-client token buckets.
+
+#include "ipc_ratelimit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define MS(x) ((uint64_t)(x) * 1000000ull)
+
+static IpcRateLimit g_rl;
+
+static int admit_n(IpcClient *c, IpcPriority prio, int n, uint64_t now) {
+  int ok = 0;
+  for (int i = 0; i < n; i++) {
+    ok += ipc_ratelimit_admit(&g_rl, c, prio, now);
+  }
+  return ok;
+}
+
+static void test_burst_and_refill(void) {
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  IpcClient *c = ipc_ratelimit_client(&g_rl, 42, 1000, MS(1));
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 15, MS(1)), 10, "burst admitted");
+  ASSERT_EQ(c->accepted, 10, "accepted counted");
+  ASSERT_EQ(c->dropped, 5, "dropped counted");
+  ASSERT_EQ(c->limited, true, "client marked limited");
+  ASSERT_EQ(c->burst_drops, 5, "drops in this episode");
+
+  // 100 msg/s: 50 ms refills five messages.
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 10, MS(51)), 5, "refill after 50 ms");
+  // Refill is capped at the burst however long the client was idle.
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 20, MS(100000)), 10, "refill capped");
+}
+
+static void test_fine_grained_refill(void) {
+  // Calls 1 us apart each earn 0.1 milli-message at 100 msg/s; the bucket
+  // must still fill rather than lose every fraction.
+  ipc_ratelimit_init(&g_rl, 100, 1);
+  IpcClient *c = ipc_ratelimit_client(&g_rl, 1, 1, 0);
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 1, 0), 1, "first message");
+  int ok = 0;
+  for (uint64_t t = 1000; t <= MS(20); t += 1000) {
+    ok += ipc_ratelimit_admit(&g_rl, c, IPC_PRIO_NORMAL, t);
+  }
+  ASSERT_EQ(ok, 2, "sub-token refills accumulate");
+}
+
+static void test_priorities(void) {
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  IpcClient *c = ipc_ratelimit_client(&g_rl, 7, 0, 0);
+  // Bulk stops at half the bucket, leaving the rest for normal traffic.
+  ASSERT_EQ(admit_n(c, IPC_PRIO_BULK, 10, 0), 5, "bulk keeps reserve");
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 10, 0), 5, "normal uses reserve");
+  // Control messages have their own bucket, so an empty data bucket does
+  // not hold them back.
+  ASSERT_EQ(admit_n(c, IPC_PRIO_CRITICAL, 5, 0), 5,
+            "critical admitted with the bucket empty");
+  ASSERT_EQ(c->limited, true, "critical does not clear limited");
+  ASSERT_EQ(c->tokens_milli, 0, "critical not charged to the data bucket");
+
+  ipc_ratelimit_init(&g_rl, 0, 1);
+  c = ipc_ratelimit_client(&g_rl, 7, 0, 0);
+  ASSERT_EQ(admit_n(c, IPC_PRIO_BULK, 1000, 0), 1000, "rate 0 disables");
+}
+
+static void test_critical_flood(void) {
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  ipc_ratelimit_set_critical(&g_rl, 20, 5);
+  IpcClient *c = ipc_ratelimit_client(&g_rl, 7, 0, 0);
+  ASSERT_EQ(admit_n(c, IPC_PRIO_CRITICAL, 1000, 0), 5,
+            "critical flood throttled at its burst");
+  ASSERT_EQ(c->dropped, 995, "flood drops counted");
+  ASSERT_EQ(c->limited, true, "client flagged");
+  ASSERT_EQ(admit_n(c, IPC_PRIO_CRITICAL, 10, MS(100)), 2,
+            "critical refills at its own rate");
+  // A control flood leaves the data bucket alone.
+  ASSERT_EQ(admit_n(c, IPC_PRIO_NORMAL, 20, MS(100)), 10,
+            "data bucket untouched");
+
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  ASSERT_EQ(g_rl.critical_burst, IPC_RATELIMIT_CRITICAL_BURST,
+            "default control burst");
+  c = ipc_ratelimit_client(&g_rl, 7, 0, 0);
+  ASSERT_EQ(admit_n(c, IPC_PRIO_CRITICAL, 1000, 0),
+            IPC_RATELIMIT_CRITICAL_BURST, "default control bucket bounded");
+
+  ipc_ratelimit_set_critical(&g_rl, 0, 1);
+  c = ipc_ratelimit_client(&g_rl, 8, 0, 0);
+  ASSERT_EQ(admit_n(c, IPC_PRIO_CRITICAL, 1000, 0), 1000,
+            "control rate 0 disables");
+}
+
+static void test_clients_isolated(void) {
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  IpcClient *spam = ipc_ratelimit_client(&g_rl, 100, 1000, 0);
+  admit_n(spam, IPC_PRIO_NORMAL, 1000, 0);
+  IpcClient *good = ipc_ratelimit_client(&g_rl, 200, 1000, 0);
+  ASSERT_EQ(good != spam, 1, "distinct pids get distinct entries");
+  ASSERT_EQ(admit_n(good, IPC_PRIO_NORMAL, 10, 0), 10,
+            "other client keeps its budget");
+  ASSERT_EQ(ipc_ratelimit_client(&g_rl, 100, 0, 0) != spam, 1,
+            "uid is part of the key");
+  ASSERT_EQ(ipc_ratelimit_client(&g_rl, 100, 1000, 0) == spam, 1,
+            "lookup finds existing entry");
+}
+
+static void test_eviction(void) {
+  ipc_ratelimit_init(&g_rl, 100, 10);
+  for (uint32_t i = 0; i < IPC_RATELIMIT_MAX_CLIENTS; i++) {
+    ipc_ratelimit_client(&g_rl, i + 1, 0, MS(i + 1));
+  }
+  // Touch pid 1 so pid 2 becomes the least recently seen.
+  IpcClient *first = ipc_ratelimit_client(&g_rl, 1, 0, MS(100));
+  IpcClient *fresh = ipc_ratelimit_client(&g_rl, 999, 0, MS(101));
+  ASSERT_EQ(fresh->pid, 999, "new client claims a slot");
+  ASSERT_EQ(fresh->tokens_milli, 10 * IPC_RATELIMIT_MILLI,
+            "new client starts full");
+  ASSERT_EQ(first->pid, 1, "recently seen client kept");
+  int found = 0;
+  for (size_t i = 0; i < IPC_RATELIMIT_MAX_CLIENTS; i++) {
+    found += g_rl.clients[i].pid == 2;
+  }
+  ASSERT_EQ(found, 0, "least recently seen client evicted");
+}
+
+int main(void) {
+  printf("=== ipc_ratelimit ===\n");
+  test_burst_and_refill();
+  test_fine_grained_refill();
+  test_priorities();
+  test_critical_flood();
+  test_clients_isolated();
+  test_eviction();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
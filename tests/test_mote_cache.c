@@ -0,0 +1,137 @@
+/// @file test_mote_cache.c
+/// @brief Unit tests for the gateway's on-disk mote cache.
+
+#define _GNU_SOURCE
+#include "mote_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define NODE 0x1122334455667788ull
+
+static char g_dir[64];
+static char g_path[128];
+
+// A CBOR map {"a": 1}: the cache treats it as opaque bytes.
+static const uint8_t k_cbor[] = {0xa1, 0x61, 0x61, 0x01};
+
+static void store_sample(void) {
+  MoteCache c = {0};
+  c.node_id = NODE;
+  c.git_sha = 0xdeadbeef;
+  c.sys_config_crc = 0x12345678;
+  strcpy(c.app_name, "borealis2");
+  mote_cache_set_cbor(&c, k_cbor, sizeof(k_cbor));
+  ASSERT_EQ(mote_cache_store(g_path, &c), true, "store");
+  mote_cache_free(&c);
+}
+
+static void test_missing(void) {
+  unlink(g_path);
+  MoteCache c;
+  ASSERT_EQ(mote_cache_load(g_path, NODE, &c), false, "missing file");
+  ASSERT_EQ(c.cbor == NULL, true, "left empty");
+}
+
+static void test_roundtrip(void) {
+  store_sample();
+  MoteCache c;
+  ASSERT_EQ(mote_cache_load(g_path, NODE, &c), true, "load");
+  ASSERT_EQ(c.git_sha, 0xdeadbeef, "git sha");
+  ASSERT_EQ(c.sys_config_crc, 0x12345678, "config crc");
+  ASSERT_EQ(strcmp(c.app_name, "borealis2"), 0, "app name");
+  ASSERT_EQ(c.cbor_len, sizeof(k_cbor), "map length");
+  ASSERT_MEM_EQ(c.cbor, k_cbor, sizeof(k_cbor), "map bytes");
+  mote_cache_free(&c);
+}
+
+static void test_other_node(void) {
+  store_sample();
+  MoteCache c;
+  ASSERT_EQ(mote_cache_load(g_path, NODE + 1, &c), false,
+            "another mote's cache ignored");
+}
+
+static void test_corrupt(void) {
+  store_sample();
+  FILE *f = fopen(g_path, "r+b");
+  fseek(f, 30, SEEK_SET);
+  int ch = fgetc(f);
+  fseek(f, 30, SEEK_SET);
+  fputc(ch ^ 0x01, f);
+  fclose(f);
+  MoteCache c;
+  ASSERT_EQ(mote_cache_load(g_path, NODE, &c), false, "bit flip rejected");
+
+  store_sample();
+  f = fopen(g_path, "rb");
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  ASSERT_EQ(truncate(g_path, size - 1), 0, "truncate");
+  ASSERT_EQ(mote_cache_load(g_path, NODE, &c), false, "short file rejected");
+}
+
+static void test_matches(void) {
+  store_sample();
+  MoteCache c;
+  mote_cache_load(g_path, NODE, &c);
+  ASSERT_EQ(mote_cache_matches(&c, 0xdeadbeef, 0x12345678, "borealis2"), true,
+            "same mote matches");
+  ASSERT_EQ(mote_cache_matches(&c, 0xdeadbeee, 0x12345678, "borealis2"),
+            false, "new firmware");
+  ASSERT_EQ(mote_cache_matches(&c, 0xdeadbeef, 0x12345679, "borealis2"),
+            false, "configs changed");
+  ASSERT_EQ(mote_cache_matches(&c, 0xdeadbeef, 0x12345678, "other"), false,
+            "other app");
+  mote_cache_free(&c);
+  ASSERT_EQ(mote_cache_matches(&c, 0xdeadbeef, 0x12345678, "borealis2"),
+            false, "no map, no match");
+}
+
+int main(void) {
+  printf("=== mote_cache ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_mote_cache.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/mote_cache.bin", g_dir);
+
+  test_missing();
+  test_roundtrip();
+  test_other_node();
+  test_corrupt();
+  test_matches();
+
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
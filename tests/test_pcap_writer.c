@@ -0,0 +1,516 @@
+/// @file test_pcap_writer.c
+/// @brief Unit tests for the buffered pcap writer.
+
+#define _GNU_SOURCE
+#include "pcap_live.h"
+#include "pcap_writer.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define THREADS 3
+#define FRAMES 400
+#define PAYLOAD 100
+
+static char g_dir[64];
+static char g_path[160];
+
+static const uint32_t k_global[6] = {0xa1b2c3d4u, 0x00040002u, 0, 0,
+                                     65535,       147};
+
+/// Emit one record the way bm_core's pcap module does: header, then frame.
+static void emit(const uint8_t *frame, uint32_t len) {
+  uint32_t hdr[4] = {1700000000u, 0, len, len};
+  pcap_writer_write((const uint8_t *)hdr, sizeof(hdr), NULL);
+  pcap_writer_write(frame, len, NULL);
+}
+
+static void *producer(void *arg) {
+  const uint8_t id = (uint8_t)(uintptr_t)arg;
+  uint8_t frame[PAYLOAD];
+  for (uint32_t i = 0; i < FRAMES; i++) {
+    memset(frame, id, sizeof(frame));
+    memcpy(frame + 1, &i, sizeof(i));
+    emit(frame, sizeof(frame));
+    if (i % 64 == 0) {
+      usleep(1000); // Let the writer keep up.
+    }
+  }
+  return NULL;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    *len = 0;
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *len = (size_t)ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = (uint8_t *)malloc(*len + 1);
+  *len = fread(buf, 1, *len, f);
+  fclose(f);
+  return buf;
+}
+
+/// Count the records in a pcap file; -1 if it does not parse.
+static long count_records(const uint8_t *buf, size_t len) {
+  if (len < 24 || memcmp(buf, k_global, 24) != 0) {
+    return -1;
+  }
+  long n = 0;
+  size_t off = 24;
+  while (off + 16 <= len) {
+    uint32_t incl;
+    memcpy(&incl, buf + off + 8, 4);
+    off += 16 + incl;
+    n++;
+  }
+  return off == len ? n : -1;
+}
+
+static void test_threads(void) {
+  ASSERT_EQ(pcap_writer_open(g_path, NULL), 0, "open");
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+
+  pthread_t t[THREADS];
+  for (uintptr_t i = 0; i < THREADS; i++) {
+    pthread_create(&t[i], NULL, producer, (void *)(i + 1));
+  }
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(t[i], NULL);
+  }
+  PcapWriterStats st;
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.captured + st.dropped, THREADS * FRAMES, "all accounted");
+  ASSERT_EQ(st.written, st.captured, "everything queued written");
+
+  size_t len;
+  uint8_t *buf = read_file(g_path, &len);
+  ASSERT_EQ(count_records(buf, len), (long)st.written, "file parses");
+  ASSERT_EQ(len, st.bytes, "byte count");
+
+  // Each thread's records are whole and in order.
+  int64_t last[THREADS + 1] = {-1, -1, -1, -1};
+  bool whole = true;
+  bool ordered = true;
+  for (size_t off = 24; off + 16 <= len; off += 16 + PAYLOAD) {
+    const uint8_t *f = buf + off + 16;
+    uint32_t seq;
+    memcpy(&seq, f + 1, 4);
+    whole = whole && f[0] >= 1 && f[0] <= THREADS && f[PAYLOAD - 1] == f[0];
+    if (f[0] >= 1 && f[0] <= THREADS) {
+      ordered = ordered && (int64_t)seq > last[f[0]];
+      last[f[0]] = seq;
+    }
+  }
+  ASSERT_EQ(whole, true, "records not interleaved");
+  ASSERT_EQ(ordered, true, "per-thread order kept");
+  free(buf);
+}
+
+static void test_rotation(void) {
+  // 24-byte header plus at most 8 records of 116 bytes per file.
+  PcapWriterCfg cfg = {.file_bytes = 1000, .file_count = 3};
+  ASSERT_EQ(pcap_writer_open(g_path, &cfg), 0, "open rotating");
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+  uint8_t frame[PAYLOAD] = {0};
+  for (uint32_t i = 0; i < 60; i++) {
+    memcpy(frame, &i, sizeof(i));
+    emit(frame, sizeof(frame));
+    usleep(100);
+  }
+  PcapWriterStats st;
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.dropped, 0, "no drops");
+  ASSERT_EQ(st.files, 8, "files opened");
+
+  long total = 0;
+  for (uint32_t i = 0; i < 3; i++) {
+    char name[200];
+    pcap_writer_file_name(name, sizeof(name), g_path, &cfg, i);
+    size_t len;
+    uint8_t *buf = read_file(name, &len);
+    long n = count_records(buf, len);
+    ASSERT_EQ(n >= 0 && len <= 1000, true, "rotated file parses, in limit");
+    total += n;
+    free(buf);
+    unlink(name);
+  }
+  // Files 0..7 were opened; 5, 6 and 7 reused names 2, 0 and 1.
+  ASSERT_EQ(total, 60 - 5 * 8, "last three files kept");
+  char name[200];
+  pcap_writer_file_name(name, sizeof(name), g_path, &cfg, 3);
+  ASSERT_EQ(access(name, F_OK) != 0, true, "no fourth file");
+}
+
+static void test_truncation_and_drops(void) {
+  PcapWriterCfg cfg = {.slots = 4, .flush_ms = 10000};
+  ASSERT_EQ(pcap_writer_open(g_path, &cfg), 0, "open small ring");
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+
+  static uint8_t big[3000];
+  emit(big, sizeof(big));
+  uint8_t frame[PAYLOAD] = {0};
+  for (int i = 0; i < 2000; i++) {
+    emit(frame, sizeof(frame));
+  }
+  PcapWriterStats st;
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.truncated, 1, "oversized frame truncated");
+  ASSERT_EQ(st.captured + st.dropped, 2001, "all accounted");
+  ASSERT_EQ(st.dropped > 0, true, "small ring drops");
+
+  size_t len;
+  uint8_t *buf = read_file(g_path, &len);
+  ASSERT_EQ(count_records(buf, len), (long)st.written, "file parses");
+  uint32_t incl, orig;
+  memcpy(&incl, buf + 24 + 8, 4);
+  memcpy(&orig, buf + 24 + 12, 4);
+  ASSERT_EQ(incl, PCAP_WRITER_MAX_RECORD - 16, "incl_len cut");
+  ASSERT_EQ(orig, sizeof(big), "orig_len kept");
+  free(buf);
+}
+
+static uint32_t rd32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+/// Find option @p code in a block's options at [p, end); NULL if absent.
+static const uint8_t *find_opt(const uint8_t *p, const uint8_t *end,
+                               uint16_t code, uint16_t *len) {
+  while (p + 4 <= end) {
+    uint16_t c, l;
+    memcpy(&c, p, 2);
+    memcpy(&l, p + 2, 2);
+    if (c == 0) {
+      break;
+    }
+    if (c == code) {
+      *len = l;
+      return p + 4;
+    }
+    p += 4 + ((l + 3u) & ~3u);
+  }
+  return NULL;
+}
+
+static void test_pcapng(void) {
+  PcapWriterCfg cfg = {.pcapng = true, .num_ports = 3,
+                       .comment = "t node=0x42"};
+  cfg.ports[0] = (PcapWriterPort){"vpd1", "peer 0x0000000000000002"};
+  cfg.ports[1] = (PcapWriterPort){"vpd2", NULL};
+  cfg.ports[2] = (PcapWriterPort){"uart", "/dev/ttyUSB0"};
+  ASSERT_EQ(pcap_writer_open(g_path, &cfg), 0, "open pcapng");
+
+  // The classic stream is ignored in this mode.
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+  const uint8_t frame[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  pcap_writer_frame(1, PCAP_WRITER_OUT, frame, sizeof(frame));
+  pcap_writer_frame(3, PCAP_WRITER_IN, frame, 14);
+  pcap_writer_frame(4, PCAP_WRITER_IN, frame, 14); // No such port.
+  static uint8_t big[3000];
+  pcap_writer_frame(2, PCAP_WRITER_IN, big, sizeof(big));
+  PcapWriterStats st;
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.written, 3, "three frames");
+  ASSERT_EQ(st.truncated, 1, "oversized frame truncated");
+
+  size_t len;
+  uint8_t *buf = read_file(g_path, &len);
+  ASSERT_EQ(len, st.bytes, "byte count");
+  // Walk the blocks; each must repeat its length at the end.
+  size_t off = 0;
+  int shb = 0, idb = 0, epb = 0;
+  bool lengths_ok = true;
+  bool tsresol_ns = true;
+  uint64_t last_ts = 0;
+  bool ts_ok = true;
+  const uint8_t *epbs[3] = {NULL, NULL, NULL};
+  while (off + 12 <= len) {
+    const uint32_t type = rd32(buf + off);
+    const uint32_t total = rd32(buf + off + 4);
+    if (total < 12 || total % 4 || off + total > len ||
+        rd32(buf + off + total - 4) != total) {
+      lengths_ok = false;
+      break;
+    }
+    const uint8_t *b = buf + off;
+    uint16_t olen = 0;
+    if (type == 0x0a0d0d0au) {
+      shb++;
+      ASSERT_EQ(rd32(b + 8), 0x1a2b3c4du, "byte order magic");
+      const uint8_t *c = find_opt(b + 24, b + total - 4, 1, &olen);
+      ASSERT_EQ(c && olen == 11 && memcmp(c, "t node=0x42", 11) == 0, true,
+                "section comment");
+    } else if (type == 1) {
+      const uint8_t *r = find_opt(b + 16, b + total - 4, 9, &olen);
+      tsresol_ns = tsresol_ns && r && olen == 1 && *r == 9;
+      const uint8_t *n = find_opt(b + 16, b + total - 4, 2, &olen);
+      if (idb == 2) {
+        ASSERT_EQ(n && olen == 4 && memcmp(n, "uart", 4) == 0, true,
+                  "interface 2 is the uart");
+      }
+      if (idb == 1) {
+        ASSERT_EQ(find_opt(b + 16, b + total - 4, 3, &olen) == NULL, true,
+                  "no description when NULL");
+      }
+      idb++;
+    } else if (type == 6) {
+      const uint64_t ts = ((uint64_t)rd32(b + 12) << 32) | rd32(b + 16);
+      ts_ok = ts_ok && ts >= last_ts && ts > 1600000000ull * 1000000000ull;
+      last_ts = ts;
+      if (epb < 3) {
+        epbs[epb] = b;
+      }
+      epb++;
+    }
+    off += total;
+  }
+  ASSERT_EQ(lengths_ok && off == len, true, "blocks well formed");
+  ASSERT_EQ(shb, 1, "one section header");
+  ASSERT_EQ(idb, 3, "one interface per port");
+  ASSERT_EQ(tsresol_ns, true, "nanosecond resolution");
+  ASSERT_EQ(epb, 3, "three packet blocks");
+  ASSERT_EQ(ts_ok, true, "ns timestamps, in order");
+
+  if (epb == 3) {
+    uint16_t olen;
+    const uint8_t *e = epbs[0];
+    ASSERT_EQ(rd32(e + 8), 0, "port 1 is interface 0");
+    ASSERT_EQ(rd32(e + 20), sizeof(frame), "captured length");
+    ASSERT_EQ(memcmp(e + 28, frame, sizeof(frame)), 0, "frame bytes");
+    const uint8_t *f = find_opt(e + 28 + 16, e + rd32(e + 4) - 4, 2, &olen);
+    ASSERT_EQ(f && rd32(f) == 2, true, "outbound flag");
+    e = epbs[1];
+    ASSERT_EQ(rd32(e + 8), 2, "port 3 is interface 2");
+    f = find_opt(e + 28 + 16, e + rd32(e + 4) - 4, 2, &olen);
+    ASSERT_EQ(f && rd32(f) == 1, true, "inbound flag");
+    e = epbs[2];
+    ASSERT_EQ(rd32(e + 24), sizeof(big), "original length kept");
+    ASSERT_EQ(rd32(e + 20) < sizeof(big), true, "captured length cut");
+  }
+  free(buf);
+}
+
+static void test_filter(void) {
+  CaptureFilter filter;
+  ASSERT_EQ(capture_filter_compile(&filter, "port 2 and in", NULL, 0), 0,
+            "compile filter");
+  PcapWriterCfg cfg = {.pcapng = true, .num_ports = 3, .filter = &filter};
+  ASSERT_EQ(pcap_writer_open(g_path, &cfg), 0, "open filtered pcapng");
+  const uint8_t frame[14] = {0};
+  pcap_writer_frame(1, PCAP_WRITER_IN, frame, sizeof(frame));
+  pcap_writer_frame(2, PCAP_WRITER_OUT, frame, sizeof(frame));
+  pcap_writer_frame(2, PCAP_WRITER_IN, frame, sizeof(frame));
+  pcap_writer_close();
+  PcapWriterStats st;
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.written, 1, "one frame kept");
+  ASSERT_EQ(st.filtered, 2, "two frames filtered");
+
+  // The classic stream: frames are matched without a port or direction.
+  ASSERT_EQ(capture_filter_compile(&filter, "ether proto 0x86dd", NULL, 0),
+            0, "compile ethertype filter");
+  cfg = (PcapWriterCfg){.filter = &filter};
+  ASSERT_EQ(pcap_writer_open(g_path, &cfg), 0, "open filtered pcap");
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+  uint8_t eth[PAYLOAD] = {0};
+  emit(eth, sizeof(eth));
+  eth[12] = 0x86;
+  eth[13] = 0xdd;
+  emit(eth, sizeof(eth));
+  emit(eth, 10); // Too short to have an ethertype.
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.written, 1, "IPv6 frame kept");
+  ASSERT_EQ(st.filtered, 2, "others filtered");
+  size_t len;
+  uint8_t *buf = read_file(g_path, &len);
+  ASSERT_EQ(count_records(buf, len), 1, "one record in the file");
+  free(buf);
+}
+
+/// Wait for the writer to have taken over @p n live clients.
+static bool wait_clients(uint32_t n) {
+  for (int i = 0; i < 500; i++) {
+    PcapWriterStats st;
+    pcap_writer_stats(&st);
+    if (st.live_clients >= n) {
+      return true;
+    }
+    usleep(2000);
+  }
+  return false;
+}
+
+/// Wait for @p n records to have been streamed, then read what arrived.
+static size_t read_streamed(int fd, uint64_t n, uint8_t *buf, size_t cap) {
+  for (int i = 0; i < 500; i++) {
+    PcapWriterStats st;
+    pcap_writer_stats(&st);
+    if (st.streamed >= n) {
+      break;
+    }
+    usleep(2000);
+  }
+  size_t len = 0;
+  ssize_t r;
+  while (len < cap &&
+         (r = recv(fd, buf + len, cap - len, MSG_DONTWAIT)) > 0) {
+    len += (size_t)r;
+  }
+  return len;
+}
+
+static void test_live(void) {
+  PcapWriterCfg cfg = {.pcapng = true, .num_ports = 2, .flush_ms = 5};
+  ASSERT_EQ(pcap_writer_open(NULL, &cfg), 0, "open without a file");
+  const uint8_t frame[20] = {0};
+  pcap_writer_frame(1, PCAP_WRITER_IN, frame, sizeof(frame));
+  PcapWriterStats st;
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.captured, 0, "nothing captured without a client");
+
+  int sv[2], other[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0, "socketpair");
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, other), 0, "socketpair");
+  ASSERT_EQ(pcap_writer_attach(sv[0]), 0, "attach");
+  ASSERT_EQ(pcap_writer_attach(other[0]), -1, "second client refused");
+  close(other[0]);
+  close(other[1]);
+  ASSERT_EQ(wait_clients(1), true, "client taken over");
+  pcap_writer_frame(1, PCAP_WRITER_IN, frame, sizeof(frame));
+  pcap_writer_frame(2, PCAP_WRITER_OUT, frame, sizeof(frame));
+
+  static uint8_t buf[4096];
+  size_t len = read_streamed(sv[1], 2, buf, sizeof(buf));
+  int blocks[7] = {0};
+  size_t off = 0;
+  while (off + 12 <= len) {
+    const uint32_t type = rd32(buf + off);
+    const uint32_t total = rd32(buf + off + 4);
+    if (total < 12 || off + total > len) {
+      break;
+    }
+    blocks[type == 0x0a0d0d0au ? 0 : type < 7 ? type : 0]++;
+    off += total;
+  }
+  ASSERT_EQ(off == len && len > 0, true, "stream is whole blocks");
+  ASSERT_EQ(blocks[0], 1, "section header first");
+  ASSERT_EQ(blocks[1], 2, "interfaces");
+  ASSERT_EQ(blocks[6], 2, "frames since attaching");
+
+  // Hanging up frees the slot for the next client, here through the
+  // listening socket.
+  close(sv[1]);
+  char sock[100];
+  snprintf(sock, sizeof(sock), "%s/live.sock", g_dir);
+  ASSERT_EQ(pcap_live_open(sock), 0, "listen");
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  memcpy(addr.sun_path, sock, strlen(sock) + 1);
+  // Until the writer notices the hang-up, new clients are refused.
+  int c = -1;
+  bool attached = false;
+  for (int i = 0; i < 20 && !attached; i++) {
+    if (c >= 0) {
+      close(c);
+    }
+    c = socket(AF_UNIX, SOCK_STREAM, 0);
+    attached = connect(c, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+               wait_clients(2);
+  }
+  ASSERT_EQ(attached, true, "next client taken over");
+  uint32_t magic = 0;
+  ASSERT_EQ(recv(c, &magic, sizeof(magic), MSG_WAITALL), 4, "preamble");
+  ASSERT_EQ(magic, 0x0a0d0d0au, "new client starts with a section");
+  pcap_live_close();
+  ASSERT_EQ(access(sock, F_OK), -1, "socket removed");
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.streamed, 2, "streamed count");
+  ASSERT_EQ(st.files, 0, "no file opened");
+  close(c);
+
+  // Classic stream: records seen with nobody attached are skipped without
+  // losing track of where the next one starts.
+  ASSERT_EQ(pcap_writer_open(NULL, NULL), 0, "open classic without file");
+  pcap_writer_write((const uint8_t *)k_global, sizeof(k_global), NULL);
+  uint8_t payload[PAYLOAD] = {7};
+  emit(payload, sizeof(payload));
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0, "socketpair");
+  ASSERT_EQ(pcap_writer_attach(sv[0]), 0, "attach classic");
+  ASSERT_EQ(wait_clients(1), true, "classic client taken over");
+  emit(payload, sizeof(payload));
+  len = read_streamed(sv[1], 1, buf, sizeof(buf));
+  ASSERT_EQ(count_records(buf, len), 1, "global header and one record");
+  pcap_writer_close();
+  pcap_writer_stats(&st);
+  ASSERT_EQ(st.captured, 1, "skipped record not captured");
+  close(sv[1]);
+}
+
+static void test_file_names(void) {
+  char name[64];
+  PcapWriterCfg cfg = {.file_bytes = 1};
+  pcap_writer_file_name(name, sizeof(name), "c.pcap", &cfg, 0);
+  ASSERT_EQ(strcmp(name, "c.pcap"), 0, "-C first file");
+  pcap_writer_file_name(name, sizeof(name), "c.pcap", &cfg, 12);
+  ASSERT_EQ(strcmp(name, "c.pcap12"), 0, "-C later file");
+  cfg.file_count = 10;
+  pcap_writer_file_name(name, sizeof(name), "c.pcap", &cfg, 0);
+  ASSERT_EQ(strcmp(name, "c.pcap0"), 0, "-W 10");
+  cfg.file_count = 11;
+  pcap_writer_file_name(name, sizeof(name), "c.pcap", &cfg, 3);
+  ASSERT_EQ(strcmp(name, "c.pcap03"), 0, "-W 11 pads");
+}
+
+int main(void) {
+  printf("=== pcap_writer ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_pcap_writer.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s/c.pcap", g_dir);
+
+  test_threads();
+  test_rotation();
+  test_truncation_and_drops();
+  test_pcapng();
+  test_filter();
+  test_live();
+  test_file_names();
+
+  unlink(g_path);
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/// @file test_process_runner.c
+/// @brief Unit tests for the non-blocking process runner.
+
+#define _GNU_SOURCE
+#include "process_runner.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  int calls;
+  int spawn_errno;
+  int status;
+  bool ok;
+  bool timed_out;
+  bool truncated;
+  char output[256];
+  size_t output_len;
+  uint64_t run_us;
+} Seen;
+
+static void record(const ProcessResult *r, void *arg) {
+  Seen *s = (Seen *)arg;
+  s->calls++;
+  s->spawn_errno = r->spawn_errno;
+  s->status = r->status;
+  s->ok = process_result_ok(r);
+  s->timed_out = r->timed_out;
+  s->truncated = r->output_truncated;
+  s->output_len = r->output_len;
+  snprintf(s->output, sizeof(s->output), "%s", r->output);
+  s->run_us = r->run_us;
+}
+
+static void drain(ProcessRunner *r) {
+  for (int i = 0; i < 1000 && process_runner_pending(r); i++) {
+    process_runner_poll(r, 50);
+  }
+}
+
+static void test_exit_and_output(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen ok = {0};
+  Seen bad = {0};
+  const char *const argv[] = {"echo", "hello", NULL};
+  ASSERT_EQ(process_runner_spawn(r, NULL, argv, 0, record, &ok), true,
+            "spawn");
+  process_runner_shell(r, "fail", "echo oops >&2; exit 3", 0, record, &bad);
+  drain(r);
+  ASSERT_EQ(ok.calls, 1, "callback once");
+  ASSERT_EQ(ok.ok, true, "exit 0 is ok");
+  ASSERT_EQ(strcmp(ok.output, "hello\n"), 0, "stdout captured");
+  ASSERT_EQ(bad.ok, false, "exit 3 is not ok");
+  ASSERT_EQ(WEXITSTATUS(bad.status), 3, "exit status");
+  ASSERT_EQ(strcmp(bad.output, "oops\n"), 0, "stderr captured");
+  process_runner_destroy(r);
+}
+
+static void test_spawn_error(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen s = {0};
+  const char *const argv[] = {"/nonexistent/command", NULL};
+  process_runner_spawn(r, "missing", argv, 0, record, &s);
+  drain(r);
+  ASSERT_EQ(s.calls, 1, "callback for failed spawn");
+  ASSERT_EQ(s.spawn_errno, ENOENT, "spawn errno");
+  ASSERT_EQ(s.ok, false, "not ok");
+  process_runner_destroy(r);
+}
+
+static void test_timeout(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen s = {0};
+  const char *const argv[] = {"sleep", "10", NULL};
+  process_runner_spawn(r, "sleep", argv, 100, record, &s);
+  drain(r);
+  ASSERT_EQ(s.calls, 1, "callback after kill");
+  ASSERT_EQ(s.timed_out, true, "timed out");
+  ASSERT_EQ(WIFSIGNALED(s.status) && WTERMSIG(s.status) == SIGKILL, true,
+            "killed");
+  ASSERT_EQ(s.run_us < 5000000, true, "did not wait for sleep");
+  process_runner_destroy(r);
+}
+
+static void test_truncation(void) {
+  ProcessRunnerCfg cfg = {.capture_max = 8};
+  ProcessRunner *r = process_runner_create(&cfg);
+  Seen s = {0};
+  process_runner_shell(r, "long", "echo 0123456789abcdef", 0, record, &s);
+  drain(r);
+  ASSERT_EQ(s.output_len, 8, "kept capture_max bytes");
+  ASSERT_EQ(strcmp(s.output, "01234567"), 0, "kept the start");
+  ASSERT_EQ(s.truncated, true, "flagged truncated");
+  ASSERT_EQ(s.ok, true, "still ok");
+  process_runner_destroy(r);
+}
+
+static void test_concurrency_cap(void) {
+  ProcessRunnerCfg cfg = {.max_running = 2};
+  ProcessRunner *r = process_runner_create(&cfg);
+  Seen s[5] = {{0}};
+  for (int i = 0; i < 5; i++) {
+    process_runner_shell(r, "nap", "sleep 0.2", 0, record, &s[i]);
+  }
+  ASSERT_EQ(process_runner_pending(r), 5, "all pending");
+  process_runner_poll(r, 0);
+  // Two running, three queued: none done after a short wait.
+  process_runner_poll(r, 50);
+  int done = 0;
+  for (int i = 0; i < 5; i++) {
+    done += s[i].calls;
+  }
+  ASSERT_EQ(done, 0, "none done yet");
+  ASSERT_EQ(process_runner_pending(r), 5, "still pending");
+  drain(r);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(s[i].ok, true, "each ran");
+  }
+
+  ProcessStats st[PROCESS_RUNNER_MAX_STATS];
+  size_t n = process_runner_get_stats(r, st, PROCESS_RUNNER_MAX_STATS);
+  ASSERT_EQ(n, 1, "one name");
+  ASSERT_EQ(st[0].runs, 5, "five runs");
+  ASSERT_EQ(st[0].failures, 0, "no failures");
+  // The fifth waited for two rounds of two to finish.
+  ASSERT_EQ(st[0].total_queued_us >= 400000, true, "queueing counted");
+  ASSERT_EQ(st[0].max_run_us >= 200000, true, "run time counted");
+  process_runner_destroy(r);
+}
+
+static void test_stats(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  process_runner_shell(r, "a", "true", 0, NULL, NULL);
+  process_runner_shell(r, "a", "false", 0, NULL, NULL);
+  process_runner_shell(r, "b", "sleep 5", 50, NULL, NULL);
+  drain(r);
+  ProcessStats st[PROCESS_RUNNER_MAX_STATS];
+  size_t n = process_runner_get_stats(r, st, PROCESS_RUNNER_MAX_STATS);
+  ASSERT_EQ(n, 2, "two names");
+  ASSERT_EQ(st[0].runs, 2, "a runs");
+  ASSERT_EQ(st[0].failures, 1, "a failures");
+  ASSERT_EQ(st[1].timeouts, 1, "b timeouts");
+  ASSERT_EQ(st[1].failures, 1, "timeouts are failures");
+  process_runner_destroy(r);
+}
+
+static void chain_next(const ProcessResult *res, void *arg) {
+  (void)res;
+  void **ctx = (void **)arg;
+  process_runner_shell((ProcessRunner *)ctx[0], "second", "exit 0", 0, record,
+                       ctx[1]);
+}
+
+static void test_submit_from_callback(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen s = {0};
+  void *ctx[2] = {r, &s};
+  process_runner_shell(r, "first", "exit 0", 0, chain_next, ctx);
+  drain(r);
+  ASSERT_EQ(s.calls, 1, "chained command ran");
+  ASSERT_EQ(process_runner_pending(r), 0, "nothing left");
+  process_runner_destroy(r);
+}
+
+static void test_no_capture(void) {
+  // A command that leaves a background writer behind.  With capture the
+  // writer would get SIGPIPE once the runner closed the pipe; without it
+  // the writer outlives the command and finishes.
+  char marker[] = "/tmp/test_process_runner.XXXXXX";
+  int fd = mkstemp(marker);
+  close(fd);
+  unlink(marker);
+  char cmd[160];
+  snprintf(cmd, sizeof(cmd), "(sleep 0.2; echo late; touch %s) & exit 0",
+           marker);
+
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen s = {0};
+  ASSERT_EQ(process_runner_shell_flags(r, "bg", cmd, 0,
+                                       PROCESS_RUNNER_NO_CAPTURE, record, &s),
+            true, "queued");
+  // The child inherits stdout; keep its line out of the test output.
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  dup2(devnull, STDOUT_FILENO);
+  close(devnull);
+  drain(r);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  ASSERT_EQ(s.calls, 1, "callback once");
+  ASSERT_EQ(s.ok, true, "exit 0 is ok");
+  ASSERT_EQ(s.output_len, 0, "nothing captured");
+
+  struct stat st;
+  bool finished = false;
+  for (int i = 0; i < 100 && !finished; i++) {
+    finished = stat(marker, &st) == 0;
+    usleep(20000);
+  }
+  ASSERT_EQ(finished, true, "background writer not killed by SIGPIPE");
+  unlink(marker);
+  process_runner_destroy(r);
+}
+
+static void test_destroy_kills(void) {
+  ProcessRunner *r = process_runner_create(NULL);
+  Seen s = {0};
+  process_runner_shell(r, "long", "sleep 10", 0, record, &s);
+  process_runner_poll(r, 0);
+  process_runner_destroy(r);
+  ASSERT_EQ(s.calls, 0, "no callback on destroy");
+}
+
+int main(void) {
+  printf("=== process_runner ===\n");
+  test_exit_and_output();
+  test_spawn_error();
+  test_timeout();
+  test_truncation();
+  test_concurrency_cap();
+  test_stats();
+  test_submit_from_callback();
+  test_no_capture();
+  test_destroy_kills();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+/// @file test_replay_capture.c
+/// @brief Unit tests for bm_sbc_replay's pcap / pcapng loader.
+
+#include "replay_capture.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, n, msg)                                            \
+  do {                                                                         \
+    if (memcmp((a), (b), (n)) != 0) {                                          \
+      printf("  FAIL: %s (contents differ)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// Fixtures are built in g_buf, in either byte order.
+static uint8_t g_buf[8192];
+static size_t g_len;
+static bool g_swap;
+
+static uint8_t g_frame_a[60];
+static uint8_t g_frame_b[100];
+
+static void put32(uint32_t v) {
+  if (g_swap) {
+    v = __builtin_bswap32(v);
+  }
+  memcpy(g_buf + g_len, &v, 4);
+  g_len += 4;
+}
+
+static void put16(uint16_t v) {
+  if (g_swap) {
+    v = __builtin_bswap16(v);
+  }
+  memcpy(g_buf + g_len, &v, 2);
+  g_len += 2;
+}
+
+static void put_bytes(const void *p, size_t n) {
+  memcpy(g_buf + g_len, p, n);
+  g_len += n;
+  while (g_len % 4) {
+    g_buf[g_len++] = 0;
+  }
+}
+
+static void fill_frames(void) {
+  for (size_t i = 0; i < sizeof(g_frame_a); i++) {
+    g_frame_a[i] = (uint8_t)(i * 3 + 1);
+  }
+  for (size_t i = 0; i < sizeof(g_frame_b); i++) {
+    g_frame_b[i] = (uint8_t)(i * 5 + 2);
+  }
+}
+
+static void pcap_header(uint32_t magic) {
+  g_len = 0;
+  put32(magic);
+  put32(0x00040002u); // Version 2.4.
+  put32(0);
+  put32(0);
+  put32(65535);
+  put32(1); // LINKTYPE_ETHERNET.
+}
+
+static void pcap_record(uint32_t sec, uint32_t frac, const uint8_t *frame,
+                        uint32_t incl, uint32_t orig) {
+  put32(sec);
+  put32(frac);
+  put32(incl);
+  put32(orig);
+  memcpy(g_buf + g_len, frame, incl);
+  g_len += incl;
+}
+
+static void check_frame(const ReplayFrameList *l, size_t i, uint8_t port,
+                        uint64_t ts_ns, const uint8_t *data, uint32_t len,
+                        const char *msg) {
+  if (i >= l->count) {
+    printf("  FAIL: %s (frame %zu missing)\n", msg, i);
+    g_fail++;
+    return;
+  }
+  const ReplayFrame *f = &l->frames[i];
+  ASSERT_EQ(f->port, port, msg);
+  ASSERT_EQ(f->ts_ns, ts_ns, msg);
+  ASSERT_EQ(f->len, len, msg);
+  ASSERT_MEM_EQ(f->data, data, len < f->len ? len : f->len, msg);
+}
+
+static void test_pcap(bool swap, uint32_t magic, const char *name) {
+  printf("  pcap: %s\n", name);
+  const bool ns = magic == 0xa1b23c4du;
+  g_swap = swap;
+  pcap_header(magic);
+  pcap_record(10, 5, g_frame_a, sizeof(g_frame_a), sizeof(g_frame_a));
+  pcap_record(11, 7, g_frame_b, 20, sizeof(g_frame_b)); // Truncated.
+  pcap_record(12, 9, g_frame_b, 10, 10);                // Runt.
+  pcap_record(13, 1, g_frame_b, sizeof(g_frame_b), sizeof(g_frame_b));
+  const size_t whole = g_len;
+  pcap_record(14, 0, g_frame_a, sizeof(g_frame_a), sizeof(g_frame_a));
+
+  ReplayFrameList l = {0};
+  // The last record is cut short, as if still being written.
+  ASSERT_EQ(replay_capture_load(&l, g_buf, g_len - 1, 4, REPLAY_DIR_IN), 0,
+            "load");
+  ASSERT_EQ(l.count, 2, "frames kept");
+  ASSERT_EQ(l.skipped, 2, "truncated and runt skipped");
+  check_frame(&l, 0, 4, 10000000000ull + (ns ? 5 : 5000), g_frame_a,
+              sizeof(g_frame_a), "first frame");
+  check_frame(&l, 1, 4, 13000000000ull + (ns ? 1 : 1000), g_frame_b,
+              sizeof(g_frame_b), "second frame");
+  ASSERT_EQ(l.frames[0].data, g_buf + 24 + 16, "frame points into buffer");
+  replay_capture_free(&l);
+
+  ASSERT_EQ(replay_capture_load(&l, g_buf, whole, 0, REPLAY_DIR_IN), 0,
+            "load with port 0");
+  ASSERT_EQ(l.count, 0, "bad port skips every frame");
+  replay_capture_free(&l);
+}
+
+static void ng_block(uint32_t type, const uint8_t *body, size_t body_len) {
+  const uint32_t total = (uint32_t)(12 + ((body_len + 3) & ~(size_t)3));
+  put32(type);
+  put32(total);
+  memcpy(g_buf + g_len, body, body_len);
+  g_len += body_len;
+  while (g_len % 4) {
+    g_buf[g_len++] = 0;
+  }
+  put32(total);
+}
+
+static void ng_shb(void) {
+  put32(0x0a0d0d0au);
+  put32(28);
+  put32(0x1a2b3c4du);
+  put16(1);
+  put16(0);
+  put32(0xffffffffu); // Section length unknown.
+  put32(0xffffffffu);
+  put32(28);
+}
+
+// An IDB, with if_tsresol when @p tsresol is non-zero.
+static void ng_idb(uint8_t tsresol) {
+  const size_t start = g_len;
+  put32(0x00000001u);
+  put32(0); // Patched below.
+  put16(1); // LINKTYPE_ETHERNET.
+  put16(0);
+  put32(65535);
+  if (tsresol) {
+    put16(9);
+    put16(1);
+    put_bytes(&tsresol, 1);
+    put16(0); // opt_endofopt.
+    put16(0);
+  }
+  const uint32_t total = (uint32_t)(g_len - start + 4);
+  put32(total);
+  uint32_t v = g_swap ? __builtin_bswap32(total) : total;
+  memcpy(g_buf + start + 4, &v, 4);
+}
+
+// An EPB; @p flags 0 records no direction.
+static void ng_epb(uint32_t iface, uint64_t ts, const uint8_t *frame,
+                   uint32_t cap, uint32_t orig, uint32_t flags) {
+  const size_t start = g_len;
+  put32(0x00000006u);
+  put32(0);
+  put32(iface);
+  put32((uint32_t)(ts >> 32));
+  put32((uint32_t)ts);
+  put32(cap);
+  put32(orig);
+  put_bytes(frame, cap);
+  if (flags) {
+    put16(2);
+    put16(4);
+    put32(flags);
+    put16(0);
+    put16(0);
+  }
+  const uint32_t total = (uint32_t)(g_len - start + 4);
+  put32(total);
+  uint32_t v = g_swap ? __builtin_bswap32(total) : total;
+  memcpy(g_buf + start + 4, &v, 4);
+}
+
+static void test_pcapng(bool swap, const char *name) {
+  printf("  pcapng: %s\n", name);
+  g_swap = swap;
+  g_len = 0;
+  ng_shb();
+  ng_idb(0); // Port 1, microseconds.
+  ng_idb(9); // Port 2, nanoseconds.
+  const uint8_t comment[8] = "comment";
+  ng_block(0x00000005u, comment, sizeof(comment)); // Skipped block type.
+  ng_epb(0, 1500, g_frame_a, sizeof(g_frame_a), sizeof(g_frame_a), 1);
+  ng_epb(1, 2000000123ull, g_frame_b, sizeof(g_frame_b),
+         sizeof(g_frame_b), 2);
+  ng_epb(1, 2000000456ull, g_frame_a, sizeof(g_frame_a),
+         sizeof(g_frame_a), 0);
+  ng_epb(2, 3000, g_frame_a, sizeof(g_frame_a), sizeof(g_frame_a), 1);
+  ng_epb(0, 4000, g_frame_b, 40, sizeof(g_frame_b), 1); // Truncated.
+
+  ReplayFrameList l = {0};
+  ASSERT_EQ(replay_capture_load(&l, g_buf, g_len, 9, REPLAY_DIR_IN), 0,
+            "load inbound");
+  ASSERT_EQ(l.count, 2, "inbound and undirected kept");
+  ASSERT_EQ(l.skipped, 3, "outbound, unknown iface, truncated skipped");
+  check_frame(&l, 0, 1, 1500000, g_frame_a, sizeof(g_frame_a),
+              "us timestamp on port 1");
+  check_frame(&l, 1, 2, 2000000456ull, g_frame_a, sizeof(g_frame_a),
+              "ns timestamp on port 2");
+  replay_capture_free(&l);
+
+  ASSERT_EQ(replay_capture_load(&l, g_buf, g_len, 9, REPLAY_DIR_ALL), 0,
+            "load all");
+  ASSERT_EQ(l.count, 3, "both directions kept");
+  check_frame(&l, 1, 2, 2000000123ull, g_frame_b, sizeof(g_frame_b),
+              "outbound frame");
+  replay_capture_free(&l);
+}
+
+static void test_not_a_capture(void) {
+  ReplayFrameList l = {0};
+  memset(g_buf, 'x', 64);
+  ASSERT_EQ(replay_capture_load(&l, g_buf, 64, 1, REPLAY_DIR_IN), -EINVAL,
+            "unknown magic");
+  ASSERT_EQ(replay_capture_load(&l, g_buf, 4, 1, REPLAY_DIR_IN), -EINVAL,
+            "too short for a header");
+  ASSERT_EQ(l.count, 0, "nothing loaded");
+}
+
+int main(void) {
+  printf("=== replay_capture ===\n");
+  fill_frames();
+  test_pcap(false, 0xa1b2c3d4u, "microseconds");
+  test_pcap(false, 0xa1b23c4du, "nanoseconds");
+  test_pcap(true, 0xa1b2c3d4u, "swapped");
+  test_pcapng(false, "native");
+  test_pcapng(true, "swapped");
+  test_not_a_capture();
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
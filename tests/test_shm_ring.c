@@ -0,0 +1,199 @@
+/// @file test_shm_ring.c
+/// @brief Unit tests for the shared-memory SPSC ring.
+
+#include "shm_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_MEM_EQ(a, b, len, msg)                                          \
+  do {                                                                         \
+    if (memcmp((a), (b), (len)) != 0) {                                        \
+      printf("  FAIL: %s (memory mismatch)\n", msg);                           \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define REGION_BYTES SHM_RING_REGION_BYTES(SHM_RING_MIN_CAPACITY)
+
+// 8-byte aligned backing store shared by the producer and consumer views.
+static uint64_t g_region[REGION_BYTES / sizeof(uint64_t)];
+
+static void setup(ShmRing *prod, ShmRing *cons) {
+  memset(g_region, 0, sizeof(g_region));
+  shm_ring_init(prod, g_region, sizeof(g_region));
+  shm_ring_attach(cons, g_region, sizeof(g_region));
+}
+
+static void test_init_attach(void) {
+  ShmRing prod, cons;
+  ASSERT_EQ(shm_ring_init(&prod, g_region, sizeof(g_region)), 0, "init");
+  ASSERT_EQ(prod.capacity, SHM_RING_MIN_CAPACITY, "init capacity");
+  ASSERT_EQ(shm_ring_attach(&cons, g_region, sizeof(g_region)), 0, "attach");
+  ASSERT_EQ(cons.capacity, SHM_RING_MIN_CAPACITY, "attach capacity");
+  ASSERT_EQ(shm_ring_init(&prod, g_region, 64), -1, "init too small");
+  ASSERT_EQ(shm_ring_attach(&cons, g_region, 64), -1, "attach too small");
+}
+
+static void test_attach_rejects_garbage(void) {
+  ShmRing cons;
+  memset(g_region, 0xA5, sizeof(g_region));
+  ASSERT_EQ(shm_ring_attach(&cons, g_region, sizeof(g_region)), -1,
+            "attach rejects bad magic");
+
+  ShmRing prod;
+  shm_ring_init(&prod, g_region, sizeof(g_region));
+  prod.hdr->capacity = 12345;
+  ASSERT_EQ(shm_ring_attach(&cons, g_region, sizeof(g_region)), -1,
+            "attach rejects non-pow2 capacity");
+}
+
+static void test_push_peek_pop(void) {
+  ShmRing prod, cons;
+  setup(&prod, &cons);
+
+  size_t len = 99;
+  ASSERT_EQ(shm_ring_peek(&cons, &len, NULL) == NULL, 1, "peek empty");
+
+  const char a[] = "hello";
+  const char b[] = "ring";
+  ASSERT_EQ(shm_ring_push(&prod, a, sizeof(a)), 0, "push a");
+  ASSERT_EQ(shm_ring_push(&prod, b, sizeof(b)), 0, "push b");
+  ASSERT_EQ(shm_ring_push(&prod, NULL, 0), 0, "push empty record");
+
+  const uint8_t *rec = shm_ring_peek(&cons, &len, NULL);
+  ASSERT_EQ(len, sizeof(a), "peek a length");
+  ASSERT_MEM_EQ(rec, a, sizeof(a), "peek a data");
+  // Peek again without pop returns the same record.
+  rec = shm_ring_peek(&cons, &len, NULL);
+  ASSERT_MEM_EQ(rec, a, sizeof(a), "re-peek a data");
+  shm_ring_pop(&cons);
+
+  rec = shm_ring_peek(&cons, &len, NULL);
+  ASSERT_EQ(len, sizeof(b), "peek b length");
+  ASSERT_MEM_EQ(rec, b, sizeof(b), "peek b data");
+  shm_ring_pop(&cons);
+
+  rec = shm_ring_peek(&cons, &len, NULL);
+  ASSERT_EQ(rec != NULL, 1, "peek empty record present");
+  ASSERT_EQ(len, 0, "peek empty record length");
+  shm_ring_pop(&cons);
+
+  ASSERT_EQ(shm_ring_used(&cons), 0, "ring drained");
+}
+
+static void test_full_and_oversized(void) {
+  ShmRing prod, cons;
+  setup(&prod, &cons);
+
+  size_t max = shm_ring_max_record(&prod);
+  uint8_t *big = (uint8_t *)malloc(max + 1);
+  memset(big, 0x5A, max + 1);
+  ASSERT_EQ(shm_ring_push(&prod, big, max + 1), -1, "push oversized");
+  ASSERT_EQ(shm_ring_push(&prod, big, max), 0, "push max record");
+
+  // Fill the rest with small records until the producer sees a full ring.
+  int pushed = 0;
+  while (shm_ring_push(&prod, big, 100) == 0) {
+    pushed++;
+  }
+  ASSERT_EQ(pushed > 0, 1, "small records fit after max record");
+  ASSERT_EQ(shm_ring_used(&prod) <= prod.capacity, 1, "used within capacity");
+
+  size_t len = 0;
+  ASSERT_EQ(shm_ring_peek(&cons, &len, NULL) != NULL, 1, "peek max record");
+  ASSERT_EQ(len, max, "peek max record length");
+  shm_ring_pop(&cons);
+  ASSERT_EQ(shm_ring_push(&prod, big, 100), 0, "push after pop");
+  free(big);
+}
+
+static void test_wraparound(void) {
+  ShmRing prod, cons;
+  setup(&prod, &cons);
+
+  // Odd-sized records force wrap markers at varying offsets.
+  uint8_t rec_in[301];
+  uint32_t seq_out = 0;
+  for (uint32_t seq = 0; seq < 2000; seq++) {
+    memset(rec_in, (int)(seq & 0xFF), sizeof(rec_in));
+    size_t len_in = 1 + (seq * 37u) % sizeof(rec_in);
+    while (shm_ring_push(&prod, rec_in, len_in) != 0) {
+      size_t len = 0;
+      const uint8_t *rec = shm_ring_peek(&cons, &len, NULL);
+      if (!rec) {
+        break;
+      }
+      if (rec[0] != (uint8_t)(seq_out & 0xFF) ||
+          len != 1 + (seq_out * 37u) % sizeof(rec_in)) {
+        printf("  FAIL: wraparound record %u mismatch\n", seq_out);
+        g_fail++;
+        return;
+      }
+      shm_ring_pop(&cons);
+      seq_out++;
+    }
+  }
+  size_t len = 0;
+  while (shm_ring_peek(&cons, &len, NULL)) {
+    shm_ring_pop(&cons);
+    seq_out++;
+  }
+  ASSERT_EQ(seq_out, 2000, "wraparound delivered every record in order");
+}
+
+static void test_corrupt_length(void) {
+  ShmRing prod, cons;
+  setup(&prod, &cons);
+  const char a[] = "x";
+  shm_ring_push(&prod, a, sizeof(a));
+
+  // Producer scribbles an impossible length over the committed record.
+  uint32_t bogus = prod.capacity;
+  memcpy(prod.data, &bogus, sizeof(bogus));
+
+  size_t len = 0;
+  bool corrupt = false;
+  ASSERT_EQ(shm_ring_peek(&cons, &len, &corrupt) == NULL, 1,
+            "peek rejects bad length");
+  ASSERT_EQ(corrupt, true, "corrupt flagged");
+
+  // A head that runs ahead of the data area is also rejected.
+  setup(&prod, &cons);
+  prod.hdr->head = (uint64_t)prod.capacity * 2;
+  ASSERT_EQ(shm_ring_peek(&cons, &len, &corrupt) == NULL, 1,
+            "peek rejects runaway head");
+  ASSERT_EQ(corrupt, true, "runaway head flagged");
+}
+
+// ---- Main -----------------------------------------------------------------
+
+int main(void) {
+  printf("=== shm_ring ===\n");
+  test_init_attach();
+  test_attach_rejects_garbage();
+  test_push_peek_pop();
+  test_full_and_oversized();
+  test_wraparound();
+  test_corrupt_length();
+
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,369 @@
+/// @file test_unit_watcher.c
+/// @brief Unit tests for the systemd unit watcher and its D-Bus client.
+
+#define _GNU_SOURCE
+#include "dbus_client.h"
+#include "unit_watcher.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define ASSERT_EQ(a, b, msg)                                                   \
+  do {                                                                         \
+    if ((a) != (b)) {                                                          \
+      printf("  FAIL: %s (got %zu, expected %zu)\n", msg,                      \
+             (size_t)(a), (size_t)(b));                                        \
+      g_fail++;                                                                \
+    } else {                                                                   \
+      g_pass++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static char g_dir[64];
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+/**************** Fake backend ****************/
+
+typedef struct {
+  UnitStatus script[4];
+  int n;
+  int pos;
+  int waits;
+  int closed;
+  bool fail_get;
+} Fake;
+
+static bool fake_get(void *ctx, UnitStatus *out) {
+  Fake *f = (Fake *)ctx;
+  *out = f->script[f->pos];
+  return !f->fail_get;
+}
+
+static int fake_wait(void *ctx, uint32_t timeout_ms) {
+  Fake *f = (Fake *)ctx;
+  f->waits++;
+  if (f->pos + 1 < f->n) {
+    f->pos++;
+    return 1;
+  }
+  usleep((timeout_ms < 20 ? timeout_ms : 20) * 1000);
+  return 0;
+}
+
+static void fake_close(void *ctx) { ((Fake *)ctx)->closed++; }
+
+static const UnitWatcherOps k_fake_ops = {
+    .name = "fake",
+    .get = fake_get,
+    .wait = fake_wait,
+    .close = fake_close,
+};
+
+static void test_states(void) {
+  ASSERT_EQ(unit_state_from_string("active"), UNIT_STATE_ACTIVE, "active");
+  ASSERT_EQ(unit_state_from_string("deactivating"), UNIT_STATE_DEACTIVATING,
+            "deactivating");
+  ASSERT_EQ(unit_state_from_string("failed"), UNIT_STATE_FAILED, "failed");
+  ASSERT_EQ(unit_state_from_string("bogus"), UNIT_STATE_UNKNOWN, "unknown");
+  ASSERT_EQ(unit_state_running(UNIT_STATE_ACTIVATING), true,
+            "activating runs");
+  ASSERT_EQ(unit_state_running(UNIT_STATE_UNKNOWN), true, "unknown runs");
+  ASSERT_EQ(unit_state_running(UNIT_STATE_FAILED), false, "failed stopped");
+}
+
+static void test_fake_stops(void) {
+  Fake f = {.n = 3};
+  f.script[0].state = UNIT_STATE_ACTIVE;
+  f.script[1].state = UNIT_STATE_DEACTIVATING;
+  f.script[2] = (UnitStatus){UNIT_STATE_INACTIVE, true, 0};
+  UnitWatcher *w = unit_watcher_open_ops(&k_fake_ops, &f);
+  ASSERT_EQ(strcmp(unit_watcher_backend(w), "fake"), 0, "backend name");
+  UnitStatus st;
+  ASSERT_EQ(unit_watcher_wait_stopped(w, &st, 1000), 1, "stopped");
+  ASSERT_EQ(st.state, UNIT_STATE_INACTIVE, "inactive");
+  ASSERT_EQ(st.exec_main_status_known, true, "status known");
+  ASSERT_EQ(f.waits, 2, "one wait per change");
+  unit_watcher_close(w);
+  ASSERT_EQ(f.closed, 1, "backend closed");
+}
+
+static void test_fake_timeout_and_error(void) {
+  Fake f = {.n = 1};
+  f.script[0].state = UNIT_STATE_ACTIVE;
+  UnitWatcher *w = unit_watcher_open_ops(&k_fake_ops, &f);
+  UnitStatus st;
+  uint64_t start = now_ms();
+  ASSERT_EQ(unit_watcher_wait_stopped(w, &st, 60), 0, "timed out");
+  ASSERT_EQ(now_ms() - start >= 60, true, "waited the timeout");
+  f.fail_get = true;
+  ASSERT_EQ(unit_watcher_wait_stopped(w, &st, 60), -1, "get error");
+  unit_watcher_close(w);
+}
+
+/**************** cgroup backend ****************/
+
+static char g_events[160];
+
+static void write_events(int populated) {
+  FILE *f = fopen(g_events, "w");
+  fprintf(f, "populated %d\nfrozen 0\n", populated);
+  fclose(f);
+}
+
+static void *depopulate_later(void *arg) {
+  (void)arg;
+  usleep(100000);
+  write_events(0);
+  return NULL;
+}
+
+static void test_cgroup(void) {
+  char slice[96];
+  char unit_dir[128];
+  snprintf(slice, sizeof(slice), "%s/system.slice", g_dir);
+  snprintf(unit_dir, sizeof(unit_dir), "%s/x.service", slice);
+  snprintf(g_events, sizeof(g_events), "%s/cgroup.events", unit_dir);
+  mkdir(slice, 0755);
+  mkdir(unit_dir, 0755);
+  write_events(1);
+
+  UnitWatcher *w = unit_watcher_open_cgroup("x.service", slice);
+  ASSERT_EQ(w != NULL, true, "open");
+  ASSERT_EQ(strcmp(unit_watcher_backend(w), "cgroup"), 0, "backend name");
+  UnitStatus st;
+  ASSERT_EQ(unit_watcher_get(w, &st), true, "get");
+  ASSERT_EQ(st.state, UNIT_STATE_ACTIVE, "populated is active");
+
+  pthread_t t;
+  pthread_create(&t, NULL, depopulate_later, NULL);
+  uint64_t start = now_ms();
+  ASSERT_EQ(unit_watcher_wait_stopped(w, &st, 5000), 1, "stopped");
+  ASSERT_EQ(now_ms() - start < 2000, true, "woken by inotify");
+  ASSERT_EQ(st.state, UNIT_STATE_INACTIVE, "inactive");
+  ASSERT_EQ(st.exec_main_status_known, false, "no exit status");
+  pthread_join(t, NULL);
+
+  unlink(g_events);
+  rmdir(unit_dir);
+  ASSERT_EQ(unit_watcher_get(w, &st), true, "get without cgroup");
+  ASSERT_EQ(st.state, UNIT_STATE_INACTIVE, "no cgroup is inactive");
+  unit_watcher_close(w);
+  rmdir(slice);
+
+  ASSERT_EQ(unit_watcher_open_cgroup("x.service", slice) == NULL, true,
+            "missing slice");
+}
+
+/**************** D-Bus ****************/
+
+static void test_msg_roundtrip(void) {
+  uint8_t body[64];
+  size_t body_len = dbus_msg_put_string(body, sizeof(body), 0, "hello");
+  DbusMsg m = {
+      .type = DBUS_MSG_SIGNAL,
+      .serial = 7,
+      .path = "/a/b",
+      .interface = "x.y",
+      .member = "Z",
+      .signature = "s",
+      .body = body,
+      .body_len = body_len,
+  };
+  uint8_t buf[256];
+  size_t len = dbus_msg_encode(&m, buf, sizeof(buf));
+  ASSERT_EQ(len > 0, true, "encoded");
+  ASSERT_EQ(dbus_msg_size(buf, 15), 0, "short header");
+  ASSERT_EQ(dbus_msg_size(buf, len), len, "size");
+  ASSERT_EQ(dbus_msg_encode(&m, buf, 20), 0, "too small");
+  len = dbus_msg_encode(&m, buf, sizeof(buf));
+
+  DbusMsg d;
+  ASSERT_EQ(dbus_msg_decode(buf, len, &d), true, "decoded");
+  ASSERT_EQ(d.type, DBUS_MSG_SIGNAL, "type");
+  ASSERT_EQ(d.serial, 7, "serial");
+  ASSERT_EQ(strcmp(d.path, "/a/b"), 0, "path");
+  ASSERT_EQ(strcmp(d.member, "Z"), 0, "member");
+  ASSERT_EQ(strcmp(d.signature, "s"), 0, "signature");
+  size_t off = 0;
+  const char *s = NULL;
+  ASSERT_EQ(dbus_msg_read_string(&d, &off, &s), true, "body string");
+  ASSERT_EQ(strcmp(s, "hello"), 0, "body value");
+  ASSERT_EQ(dbus_msg_read_string(&d, &off, &s), false, "end of body");
+  ASSERT_EQ(dbus_msg_decode(buf, len - 1, &d), false, "truncated");
+}
+
+// A bus daemon and systemd in one: answers the calls the D-Bus backend
+// makes, then stops the unit and signals it.
+static char g_bus_path[128];
+static int g_listen_fd = -1;
+static uint32_t g_srv_serial;
+
+static void srv_send(int fd, const DbusMsg *m) {
+  uint8_t out[1024];
+  size_t n = dbus_msg_encode(m, out, sizeof(out));
+  (void)!write(fd, out, n);
+}
+
+static void srv_reply(int fd, const DbusMsg *req, const char *sig,
+                      const uint8_t *body, size_t len) {
+  DbusMsg m = {
+      .type = DBUS_MSG_METHOD_RETURN,
+      .serial = ++g_srv_serial,
+      .reply_serial = req->serial,
+      .signature = sig,
+      .body = body,
+      .body_len = len,
+  };
+  srv_send(fd, &m);
+}
+
+static void srv_variant(int fd, const DbusMsg *req, char type,
+                        const char *str, int32_t num) {
+  uint8_t body[64] = {1, (uint8_t)type, 0};
+  size_t len;
+  if (type == 's') {
+    len = dbus_msg_put_string(body, sizeof(body), 3, str);
+  } else {
+    memcpy(body + 4, &num, 4);
+    len = 8;
+  }
+  srv_reply(fd, req, "v", body, len);
+}
+
+#define UNIT_PATH "/org/freedesktop/systemd1/unit/x_2eservice"
+
+static void *bus_server(void *arg) {
+  (void)arg;
+  int fd = accept(g_listen_fd, NULL, NULL);
+  char line[128];
+  size_t n = 0;
+  // "\0AUTH EXTERNAL <uid>\r\n", then "BEGIN\r\n" after our OK.
+  while (n < sizeof(line) && read(fd, line + n, 1) == 1) {
+    if (++n > 2 && line[n - 1] == '\n') {
+      break;
+    }
+  }
+  const char *ok = "OK 0123456789abcdef0123456789abcdef\r\n";
+  (void)!write(fd, ok, strlen(ok));
+  for (n = 0; n < 7 && read(fd, line + n, 1) == 1; n++) {
+  }
+
+  const char *state = "active";
+  uint8_t buf[8192];
+  size_t len = 0;
+  for (;;) {
+    ssize_t got = read(fd, buf + len, sizeof(buf) - len);
+    if (got <= 0) {
+      break;
+    }
+    len += (size_t)got;
+    size_t size;
+    while ((size = dbus_msg_size(buf, len)) && size <= len) {
+      DbusMsg req;
+      dbus_msg_decode(buf, size, &req);
+      uint8_t body[256];
+      size_t off = 0;
+      const char *arg1 = NULL;
+      const char *arg2 = NULL;
+      dbus_msg_read_string(&req, &off, &arg1);
+      dbus_msg_read_string(&req, &off, &arg2);
+      if (strcmp(req.member, "Hello") == 0) {
+        srv_reply(fd, &req, "s", body,
+                  dbus_msg_put_string(body, sizeof(body), 0, ":1.1"));
+      } else if (strcmp(req.member, "LoadUnit") == 0) {
+        srv_reply(fd, &req, "o", body,
+                  dbus_msg_put_string(body, sizeof(body), 0, UNIT_PATH));
+      } else if (strcmp(req.member, "Get") == 0 &&
+                 strcmp(arg2, "ActiveState") == 0) {
+        srv_variant(fd, &req, 's', state, 0);
+      } else if (strcmp(req.member, "Get") == 0) {
+        srv_variant(fd, &req, 'i', NULL, 0);
+      } else {
+        srv_reply(fd, &req, NULL, NULL, 0);
+      }
+      if (strcmp(req.member, "AddMatch") == 0) {
+        usleep(100000);
+        state = "inactive";
+        DbusMsg sig = {
+            .type = DBUS_MSG_SIGNAL,
+            .serial = ++g_srv_serial,
+            .path = UNIT_PATH,
+            .interface = "org.freedesktop.DBus.Properties",
+            .member = "PropertiesChanged",
+            .signature = "s",
+            .body = body,
+            .body_len = dbus_msg_put_string(body, sizeof(body), 0,
+                                            "org.freedesktop.systemd1.Unit"),
+        };
+        srv_send(fd, &sig);
+      }
+      memmove(buf, buf + size, len - size);
+      len -= size;
+    }
+  }
+  close(fd);
+  return NULL;
+}
+
+static void test_dbus_backend(void) {
+  snprintf(g_bus_path, sizeof(g_bus_path), "%s/bus", g_dir);
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strcpy(addr.sun_path, g_bus_path);
+  g_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  bind(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+  listen(g_listen_fd, 1);
+  pthread_t t;
+  pthread_create(&t, NULL, bus_server, NULL);
+
+  UnitWatcher *w = unit_watcher_open_dbus("x.service", g_bus_path);
+  ASSERT_EQ(w != NULL, true, "open");
+  if (w) {
+    ASSERT_EQ(strcmp(unit_watcher_backend(w), "dbus"), 0, "backend name");
+    UnitStatus st;
+    uint64_t start = now_ms();
+    ASSERT_EQ(unit_watcher_wait_stopped(w, &st, 5000), 1, "stopped");
+    ASSERT_EQ(now_ms() - start < 2000, true, "woken by the signal");
+    ASSERT_EQ(st.state, UNIT_STATE_INACTIVE, "inactive");
+    ASSERT_EQ(st.exec_main_status_known, true, "exit status known");
+    ASSERT_EQ(st.exec_main_status, 0, "exit status");
+    unit_watcher_close(w);
+  }
+  pthread_join(t, NULL);
+  close(g_listen_fd);
+  unlink(g_bus_path);
+}
+
+int main(void) {
+  printf("=== unit_watcher ===\n");
+  snprintf(g_dir, sizeof(g_dir), "/tmp/test_unit_watcher.XXXXXX");
+  if (!mkdtemp(g_dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  test_states();
+  test_fake_stops();
+  test_fake_timeout_and_error();
+  test_cgroup();
+  test_msg_roundtrip();
+  test_dbus_backend();
+
+  rmdir(g_dir);
+  printf("\n%d passed, %d failed\n", g_pass, g_fail);
+  return g_fail > 0 ? 1 : 0;
+}